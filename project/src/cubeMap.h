@@ -7,16 +7,28 @@
 #include <glm/glm.hpp>
 
 #include <map>
+#include <vector>
+#include <memory>
+#include <chrono>
 
 #include "shader.h"
 #include "meshes/object.h"
+#include "meshes/resource_manager.h"
+#include "meshes/texture_cache.h"
+#include "meshes/texture_uploader.h"
+#include "utils/virtual_file_system.h"
+#include "utils/memory_report.h"
+#include "utils/mip_generator.h"
+#include "utils/thread_pool.h"
 
 class CubeMap
 {
 public:
-    Shader cubeMapShader;
-    Object cubeMapObject;
-    GLuint cubeMapTexture;
+    // shared by the cube maps, see ResourceManager
+    std::shared_ptr<Shader> cubeMapShader;
+    std::shared_ptr<Object> cubeMapObject;
+    GLuint cubeMapTexture = 0;
+    size_t textureBytes = 0;    // size of the loaded faces on the GPU
 
 
     CubeMap()
@@ -24,35 +36,46 @@ public:
         const char sourceVCubeMap[] = PATH_TO_PROJECT_SHADERS "/vertex_cubeMap.cpp";
 	    const char sourceFCubeMap[] = PATH_TO_PROJECT_SHADERS "/fragment_cubeMap.cpp";
 
-        this->cubeMapShader = Shader(sourceVCubeMap, sourceFCubeMap);
+        this->cubeMapShader = getResourceManager().loadShader(sourceVCubeMap, sourceFCubeMap);
 
         char pathCube[] = PATH_TO_OBJECTS "/cube.obj";
-        this->cubeMapObject = Object(pathCube);
-        this->cubeMapObject.makeObject(this->cubeMapShader);
+        this->cubeMapObject = getResourceManager().loadObject(pathCube, *this->cubeMapShader);
     }
 
 
     CubeMap(const char* sourceVCubeMap, const char* sourceFCubeMap, const char* pathCube)
     {
-        this->cubeMapShader = Shader(sourceVCubeMap, sourceFCubeMap);
-        this->cubeMapObject = Object(pathCube);
-        this->cubeMapObject.makeObject(this->cubeMapShader);
+        this->cubeMapShader = getResourceManager().loadShader(sourceVCubeMap, sourceFCubeMap);
+        this->cubeMapObject = getResourceManager().loadObject(pathCube, *this->cubeMapShader);
     }
 
 
+    // A face decoded with its mip chain, before its upload
+    struct CubeMapFace
+    {
+        std::string Path;
+        GLenum Target = 0;
+        int Width = 0;
+        int Height = 0;
+        std::vector<unsigned char> Pixels;  // RGB, empty if the face can not be loaded
+        std::vector<MipLevel> Levels;
+        double GenerateMs = 0.0;
+        double Drift = 0.0;
+    };
+    std::string path;
+    std::vector<CubeMapFace> faces;     // decoded by decodeFaces, released once uploaded
+
+
     void loadTexture(std::string pathToCubeMap)
     {
-        glGenTextures(1, &cubeMapTexture);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
+        this->decodeFaces(pathToCubeMap);
+        this->uploadFaces();
+    }
 
-        // texture parameters
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    // First part of loadTexture, without any GL call so that it can run on a loading thread
+    void decodeFaces(std::string pathToCubeMap)
+    {
         //stbi_set_flip_vertically_on_load(true);
 
         //std::string pathToCubeMap = PATH_TO_TEXTURE "/cubemaps/night/";//"/cubemaps/yokohama3/";//"/cubemaps/sky2/";//"/cubemaps/yokohama3/";
@@ -67,22 +90,95 @@ public:
             {pathToCubeMap + "nz.jpg",GL_TEXTURE_CUBE_MAP_NEGATIVE_Z},
             
         };
-        //load the six faces
+        this->path = pathToCubeMap;
+        this->faces.clear();
         for (std::pair<std::string, GLenum> pair : facesToLoad) {
-            this->loadCubemapFace(pair.first.c_str(), pair.second);
+            CubeMapFace face;
+            face.Path = pair.first;
+            face.Target = pair.second;
+            this->faces.push_back(face);
+        }
+
+        //load the six faces, decoded and filtered in parallel
+        getThreadPool().parallelFor((unsigned int)this->faces.size(), [&](unsigned int i) {
+            this->loadCubemapFace(this->faces[i]);
+        });
+    }
+
+
+    // Second part of loadTexture, on the GL thread: upload the decoded faces and release them
+    void uploadFaces()
+    {
+        glGenTextures(1, &cubeMapTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
+
+        // texture parameters
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // the faces are filtered separately, the seamless sampling blends their edges in the small levels
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        // immutable storage for the faces and their mip chains, of the size of the first face
+        int faceSize = 0;
+        for (const CubeMapFace& face : faces) {
+            if (!face.Pixels.empty() && faceSize == 0) {
+                faceSize = face.Width;
+                glTexStorage2D(GL_TEXTURE_CUBE_MAP, getNumMipLevels(face.Width, face.Height), GL_RGB8, face.Width, face.Height);
+            }
         }
+        for (const CubeMapFace& face : faces) {
+            this->uploadCubemapFace(face, faceSize);
+        }
+
+        const TextureMipSettings& mips = getTextureMipSettings();
+        if (mips.Filter == MipFilter::Driver && faceSize > 0) {
+            double start = glfwGetTime();
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            glFinish();
+            double generateMs = (glfwGetTime() - start) * 1000.0;
+            for (CubeMapFace& face : faces) {
+                this->readBackCubemapFace(face, faceSize);
+                face.GenerateMs = generateMs / faces.size();
+            }
+        }
+        for (const CubeMapFace& face : faces) {
+            if (!face.Levels.empty()) {
+                getTextureMipStatistics().AddTexture(face.GenerateMs, face.Drift);
+            }
+        }
+        getMemoryReport().setAsset("cubemap " + this->path, 0, this->textureBytes);
+        this->faces.clear();
     }
 
 
-    void loadCubemapFace(const char * path, const GLenum& targetFace)
+    bool isLoaded() const { return this->cubeMapTexture != 0; }
+
+
+    void loadCubemapFace(CubeMapFace& face)
     {
-        int imWidth, imHeight, imNrChannels;
-        unsigned char* data = stbi_load(path, &imWidth, &imHeight, &imNrChannels, 0);
+        int imNrChannels;
+        FileData file;
+        unsigned char* data = NULL;
+        // the faces are flipped like the textures loaded before them, also on the loading threads that use their own flag
+        stbi_set_flip_vertically_on_load_thread(1);
+        if (getVirtualFileSystem().readFile(face.Path, file)) {
+            data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &face.Width, &face.Height, &imNrChannels, 3);
+        }
         if (data)
         {
-
-            glTexImage2D(targetFace, 0, GL_RGB, imWidth, imHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            //glGenerateMipmap(targetFace);
+            face.Pixels.assign(data, data + (size_t)face.Width * face.Height * 3);
+
+            const TextureMipSettings& mips = getTextureMipSettings();
+            if (mips.Filter != MipFilter::Driver) {
+                auto start = std::chrono::steady_clock::now();
+                generateMipChain(data, face.Width, face.Height, 3, mips.Filter, mips.GammaCorrect, face.Levels);
+                face.GenerateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                face.Drift = getBrightnessDrift(data, face.Width, face.Height, 3, mips.GammaCorrect, face.Levels);
+            }
         }
         else {
             std::cout << "Failed to Load texture" << std::endl;
@@ -93,15 +189,61 @@ public:
     }
 
 
-    void render(glm::mat4 view, glm::mat4 perspective)
+    void uploadCubemapFace(const CubeMapFace& face, int faceSize)
+    {
+        if (face.Pixels.empty() || face.Width != faceSize) {
+            return;
+        }
+
+        // through the ring of the texture uploader, in the cube map bound to the first unit
+        TextureUploader& uploader = getTextureUploader();
+        uploader.upload(face.Target, 0, face.Width, face.Height, GL_RGB, GL_RGB8, face.Pixels.data(), face.Pixels.size());
+        for (size_t i = 0 ; i < face.Levels.size() ; i++) {
+            const MipLevel& level = face.Levels[i];
+            uploader.upload(face.Target, (GLint)i + 1, level.Width, level.Height, GL_RGB, GL_RGB8, level.Pixels.data(), level.Pixels.size());
+        }
+
+        // the drivers store the RGB images as RGBA, with the mipmaps a third of the base level
+        this->textureBytes += (size_t)face.Width * face.Height * 4 * 4 / 3;
+    }
+
+
+    // Read the levels generated by the driver, to measure them like the levels of the CPU
+    void readBackCubemapFace(CubeMapFace& face, int faceSize)
     {
-        this->cubeMapShader.use();
-        this->cubeMapShader.setMatrix4("V", view);
-        this->cubeMapShader.setMatrix4("P", perspective);
-        this->cubeMapShader.setInteger("cubemapTexture", 0);
+        if (face.Pixels.empty() || face.Width != faceSize) {
+            return;
+        }
+
+        int width = face.Width, height = face.Height;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            face.Levels.emplace_back();
+            face.Levels.back().Width = width;
+            face.Levels.back().Height = height;
+            face.Levels.back().Pixels.resize((size_t)width * height * 3);
+            glGetTexImage(face.Target, (GLint)face.Levels.size(), GL_RGB, GL_UNSIGNED_BYTE, face.Levels.back().Pixels.data());
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        face.Drift = getBrightnessDrift(face.Pixels.data(), face.Width, face.Height, 3, getTextureMipSettings().GammaCorrect, face.Levels);
+    }
+
+
+    // the view and the projection are read from the FrameUniforms block (see frame_uniforms.h)
+    void render()
+    {
+        // until the faces are loaded, the clear color stands for the sky
+        if (!this->isLoaded()) {
+            glDepthFunc(GL_LESS);
+            return;
+        }
+        this->cubeMapShader->use();
+        this->cubeMapShader->setInteger("cubemapTexture", 0);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubeMapTexture);
-        this->cubeMapObject.draw();
+        this->cubeMapObject->draw();
         glDepthFunc(GL_LESS);
     }
 
@@ -0,0 +1,114 @@
+// Per-frame uniforms: the camera and the lights are written once per frame in a std140 uniform buffer,
+// bound at a fixed binding point where every program reads its FrameUniforms block.
+
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <chrono>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "light.h"
+
+
+// binding point of the FrameUniforms block, see the "binding" of the block in the shaders
+#define FRAME_UNIFORM_BINDING 0
+
+
+// Layout of the FrameUniforms block (std140), all the members are aligned on 16 bytes
+struct FrameUniformData
+{
+    glm::mat4 View = glm::mat4(1.0f);
+    glm::mat4 Projection = glm::mat4(1.0f);
+    glm::mat4 ViewProjection = glm::mat4(1.0f);
+    glm::vec4 CameraPos = glm::vec4(0.0f);      // in world space
+    glm::ivec4 NumLights = glm::ivec4(0);       // x: point lights, y: spot lights
+    PointLightData PointLights[NUM_POINT_LIGHTS];
+    SpotLightData SpotLights[NUM_SPOT_LIGHTS];
+};
+
+static_assert(sizeof(FrameUniformData) == 3 * 64 + 2 * 16 + NUM_POINT_LIGHTS * 48 + NUM_SPOT_LIGHTS * 64,
+              "FrameUniformData must match the std140 layout of the FrameUniforms block");
+
+
+struct FrameUniformStatistics
+{
+    unsigned int Frames = 0;
+    unsigned int Uploads = 0;           // frames where the block changed and was written
+    size_t BytesUploaded = 0;
+    double SetupMs = 0.0;               // CPU time to fill the block and upload it
+
+    void Reset() { *this = FrameUniformStatistics(); }
+};
+
+
+class FrameUniforms
+{
+public:
+    FrameUniforms() {}
+
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+    ~FrameUniforms()
+    {
+        if (m_Buffer != 0) {
+            glDeleteBuffers(1, &m_Buffer);
+        }
+    }
+
+    void init()
+    {
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_Buffer);
+    }
+
+    /**
+     * @brief Fill the block of the frame, and write it in the buffer only when it differs from the one of the previous frame
+     *
+     */
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos, const Lighting& lighting)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        FrameUniformData data;
+        data.View = view;
+        data.Projection = projection;
+        data.ViewProjection = projection * view;
+        data.CameraPos = glm::vec4(cameraPos, 1.0f);
+        glm::ivec2 numLights = lighting.getLightData(data.PointLights, data.SpotLights);
+        data.NumLights = glm::ivec4(numLights, 0, 0);
+
+        m_Statistics.Frames++;
+        if (!m_Uploaded || std::memcmp(&data, &m_Data, sizeof(data)) != 0) {
+            m_Data = data;
+            m_Uploaded = true;
+            glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(m_Data), &m_Data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            m_Statistics.Uploads++;
+            m_Statistics.BytesUploaded += sizeof(m_Data);
+        }
+
+        m_Statistics.SetupMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const FrameUniformData& getData() const { return m_Data; }
+
+    FrameUniformStatistics& getStatistics() { return m_Statistics; }
+
+private:
+    GLuint m_Buffer = 0;
+    FrameUniformData m_Data;        // the content of the buffer
+    bool m_Uploaded = false;
+    FrameUniformStatistics m_Statistics;
+};
+
+
+#endif
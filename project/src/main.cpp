@@ -18,17 +18,30 @@
 #include "stb_image.h"
 
 #include <map>
+#include <cmath>
+#include <algorithm>
 
 #include "camera.h"
 #include "shader.h"
 #include "cubeMap.h"
 #include "utils/utils.h"
+#include "utils/gpu_timer.h"
+#include "utils/virtual_file_system.h"
+#include "utils/memory_report.h"
+#include "utils/asset_loader.h"
 
 #include "meshes/object.h"
 #include "meshes/static_object.h"
 #include "meshes/animated_object.h"
+#include "meshes/gltf_object.h"
+#include "meshes/static_batch.h"
+#include "meshes/world_streamer.h"
+#include "meshes/resource_manager.h"
+#include "meshes/draw_uniforms.h"
 
 #include "light.h"
+#include "frame_uniforms.h"
+#include "shader_variants.h"
 
 
 #define HALF_PI 1.57079632679489661923132169163975144f
@@ -84,16 +97,9 @@ void APIENTRY glDebugOutput(GLenum source,
 #endif
 
 
-void setMaterial(const Material& material, Shader shader)
+void setMaterial(const Material& material)
 {
-	shader.setVector3f("gMaterial.AmbientColor", material.AmbientColor.r, material.AmbientColor.g, material.AmbientColor.b);
-	shader.setVector3f("gMaterial.DiffuseColor", material.DiffuseColor.r, material.DiffuseColor.g, material.DiffuseColor.b);
-	shader.setVector3f("gMaterial.SpecularColor", material.SpecularColor.r, material.SpecularColor.g, material.SpecularColor.b);
-}
-
-void setCameraLocalPos(glm::vec3 CameraLocalPos3f, Shader shader)
-{
-	shader.setVector3f("gCameraLocalPos", CameraLocalPos3f);
+	getDrawUniforms().setMaterial(material.AmbientColor, material.DiffuseColor, material.SpecularColor);
 }
 
 
@@ -104,7 +110,7 @@ void init_OpenGL()
 		throw std::runtime_error("Failed to initialise GLFW \n");
 	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 }
 
@@ -113,6 +119,90 @@ int main(int argc, char* argv[])
 {
 	std::cout << "Welcome in my OpenGL project!" << std::endl;
 
+	// "--forest N" renders a grid of N trees, to measure the savings of the levels of detail
+	// "--glb file" loads a binary glTF file with the native loader, next to the tree
+	// "--static-batch" bakes the ground and the trees into world space batches, drawn with one call per material
+	// "--archive file" reads the assets from an archive written by asset_cooker instead of the loose files
+	// "--stream-world N" scatters N trees and some guards on a large ground, streamed by chunks around the camera
+	unsigned int numTrees = 1;
+	unsigned int numStreamedTrees = 0;
+	std::string pathGlb;
+	std::string pathArchive;
+	// "--vertex-pulling" renders the character with vertices fetched from storage buffers instead of vertex attributes
+	// "--compress-textures" uploads the textures block compressed, cooked by texture_cooker or cached at the first run
+	// "--mip-filter driver|box|kaiser" filters the mip chains of the textures with glGenerateMipmap or on the CPU
+	// "--texture-budget MiB" streams the large levels of the textures of the objects within a GPU memory budget
+	// "--material-binding bind|arrays|bindless" binds the textures of each mesh, or reads the materials of the character
+	// and of the trees from one buffer, with their textures in texture arrays or through bindless handles
+	// "--asset-copies N" loads the tree N more times, with its textures shared, to measure the reuse of the resources
+	// "--upload-budget MiB" uploads at most this much of the queued textures per frame, through the ring of pixel buffers
+	// "--async-loading" imports and decodes the character, the ground, the tree and the cube map on the thread pool,
+	// and renders the first frames while their uploads are spread over the frames
+	// "--no-uniform-cache" looks the uniforms up by name and sends all their values, to compare with the table of the shaders
+	// "--no-shader-cache" compiles all the programs from their sources, without the cache of the program binaries
+	bool useStaticBatch = false;
+	bool useVertexPulling = false;
+	bool useTextureCompression = false;
+	bool useAsyncLoading = false;
+	bool useUniformCache = true;
+	bool useShaderCache = true;
+	MipFilter mipFilter = MipFilter::Kaiser;
+	unsigned int textureBudget = 0;
+	MaterialBinding materialBinding = MaterialBinding::Bind;
+	unsigned int uploadBudget = 4;
+	unsigned int assetCopies = 0;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--static-batch") {
+			useStaticBatch = true;
+		}
+		if (std::string(argv[i]) == "--vertex-pulling") {
+			useVertexPulling = true;
+		}
+		if (std::string(argv[i]) == "--compress-textures") {
+			useTextureCompression = true;
+		}
+		if (std::string(argv[i]) == "--async-loading") {
+			useAsyncLoading = true;
+		}
+		if (std::string(argv[i]) == "--no-uniform-cache") {
+			useUniformCache = false;
+		}
+		if (std::string(argv[i]) == "--no-shader-cache") {
+			useShaderCache = false;
+		}
+	}
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--forest") {
+			numTrees = std::max(1, atoi(argv[i + 1]));
+		}
+		if (std::string(argv[i]) == "--glb") {
+			pathGlb = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--archive") {
+			pathArchive = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--stream-world") {
+			numStreamedTrees = std::max(1, atoi(argv[i + 1]));
+		}
+		if (std::string(argv[i]) == "--texture-budget") {
+			textureBudget = std::max(1, atoi(argv[i + 1]));
+		}
+		if (std::string(argv[i]) == "--asset-copies") {
+			assetCopies = std::max(1, atoi(argv[i + 1]));
+		}
+		if (std::string(argv[i]) == "--upload-budget") {
+			uploadBudget = std::max(1, atoi(argv[i + 1]));
+		}
+		if (std::string(argv[i]) == "--material-binding") {
+			std::string binding = argv[i + 1];
+			materialBinding = binding == "bindless" ? MaterialBinding::Bindless : (binding == "arrays" ? MaterialBinding::Arrays : MaterialBinding::Bind);
+		}
+		if (std::string(argv[i]) == "--mip-filter") {
+			std::string filter = argv[i + 1];
+			mipFilter = filter == "driver" ? MipFilter::Driver : (filter == "box" ? MipFilter::Box : MipFilter::Kaiser);
+		}
+	}
+
 	//Boilerplate
 	init_OpenGL();
 
@@ -160,47 +250,128 @@ int main(int argc, char* argv[])
 	// For screen resolution
 	int framebuffer_width, framebuffer_height;
 
+	// the texture arrays hold all the levels of the textures, they can't be streamed
+	getMaterialTable().setMode(materialBinding);
+	if (getMaterialTable().getMode() == MaterialBinding::Arrays && textureBudget > 0) {
+		std::cout << "The textures in texture arrays can't be streamed, --texture-budget is ignored" << std::endl;
+		textureBudget = 0;
+	}
+
 	/******************
 	* Include Shaders *
 	*******************/
+	// the binaries of the programs linked at the first run are reloaded at the next ones
+	getShaderCacheSettings().Enabled = useShaderCache;
+	getShaderCacheSettings().CacheDirectory = VirtualFileSystem::normalizePath(PATH_TO_OBJECTS "/../shader_cache");
+
+	// the lit objects share one fragment shader, compiled in variants for their features when they are first drawn
 	const char sourceV_character[] = PATH_TO_PROJECT_SHADERS "/vertex_skinning.cpp";
-	const char sourceF_character[] = PATH_TO_PROJECT_SHADERS "/fragment_skinning.cpp";
+	const char sourceV_character_pulling[] = PATH_TO_PROJECT_SHADERS "/vertex_skinning_pulling.cpp";
+	const char sourceV_tree[] = PATH_TO_PROJECT_SHADERS "/vertex_tree.cpp";
+	const char sourceF_phong[] = PATH_TO_PROJECT_SHADERS "/fragment_phong.cpp";
 
-	Shader shader_character(sourceV_character, sourceF_character);
+	// the objects in the material table are drawn with the variants of the shaders that read it
+	std::string materialDefines = getMaterialTable().getShaderDefines();
+	ShaderVariants shaderVariants([](Shader& shader) {
+		shader.use();
+		shader.setInteger("gSampler", COLOR_TEXTURE_UNIT_INDEX);
+		shader.setInteger("gSamplerSpecularExponent", SPECULAR_EXPONENT_UNIT_INDEX);
+		getMaterialTable().initShader(shader);
+	});
 
 	const char sourceV_ground[] = PATH_TO_PROJECT_SHADERS "/vertex_ground.cpp";
 	const char sourceF_ground[] = PATH_TO_PROJECT_SHADERS "/fragment_ground.cpp";
 
-	Shader shader_ground(sourceV_ground, sourceF_ground);
-	
-	const char sourceV_tree[] = PATH_TO_PROJECT_SHADERS "/vertex_tree.cpp";
-	const char sourceF_tree[] = PATH_TO_PROJECT_SHADERS "/fragment_tree.cpp";
-
-	Shader shader_tree(sourceV_tree, sourceF_tree);
+	// the program is shared through the resource manager, the handle keeps it alive until the end
+	std::shared_ptr<Shader> groundProgram = getResourceManager().loadShader(sourceV_ground, sourceF_ground);
+	Shader& shader_ground = *groundProgram;
 	
 
 	/******************
 	* Include Objects *
 	*******************/
 
+	// the archive is packed from the root of the repository, where the objects and textures directories are
+	if (!pathArchive.empty() && !getVirtualFileSystem().mountArchive(pathArchive.c_str(), VirtualFileSystem::normalizePath(PATH_TO_OBJECTS "/.."))) {
+		exit(1);
+	}
+	getTextureCompressionSettings().Enabled = useTextureCompression;
+	getTextureCompressionSettings().CacheDirectory = VirtualFileSystem::normalizePath(PATH_TO_OBJECTS "/../texture_cache");
+	getTextureMipSettings().Filter = mipFilter;
+	getTextureStreamingSettings().Enabled = textureBudget > 0;
+	getTextureStreamingSettings().Budget = (size_t)textureBudget * 1024 * 1024;
+	getTextureUploadSettings().FrameBudget = (size_t)uploadBudget * 1024 * 1024;
+	double assetsStart = glfwGetTime();
+
 	char path_character[] = PATH_TO_OBJECTS "/ogldev_guard/boblampclean.md5mesh";//"/man/model.dae"; //"/simple/model.dae";//"/ogldev_ex/boblampclean.md5mesh";//"/mc_walking/mc_walking.dae";
 	AnimatedObject character = AnimatedObject();
-	character.LoadMesh(path_character);
 
 	char path_ground[] = PATH_TO_OBJECTS "/plane.obj";
-	Object ground = Object(path_ground);
-	ground.makeObject(shader_ground, false);
+	std::shared_ptr<Object> ground;
+	std::unique_ptr<Object> groundImport;
 
 	char path_tree[] = PATH_TO_OBJECTS "/sapin.dae";
 	StaticObject tree = StaticObject();
-	tree.LoadMesh(path_tree);
 
 	/**********
 	* CubeMap *
 	***********/
 	CubeMap cubeMap = CubeMap();
 	std::string pathToCubeMap = PATH_TO_TEXTURE "/cubemaps/night/";
-	cubeMap.loadTexture(pathToCubeMap);
+
+	// the loading threads read, import, optimize the meshes and decode the images, the render thread only creates the GL objects:
+	// at most loadBudgetMs of them per frame (and at least one asset), the scene is rendered without the assets that are not finished yet
+	AssetLoader assetLoader;
+	double loadBudgetMs = 4.0;
+	if (useAsyncLoading) {
+		assetLoader.add(path_character, [&]() { return character.ImportMesh(path_character, true); }, [&]() { character.FinishLoad(); });
+		assetLoader.add(path_ground, [&]() { groundImport.reset(new Object(path_ground)); return true; },
+		                [&]() { ground = getResourceManager().loadObject(std::move(groundImport), shader_ground, false); });
+		assetLoader.add(path_tree, [&]() { return tree.ImportMesh(path_tree, true); }, [&]() { tree.FinishLoad(); });
+		assetLoader.add("cubemap " + pathToCubeMap, [&]() { cubeMap.decodeFaces(pathToCubeMap); return true; }, [&]() { cubeMap.uploadFaces(); });
+	}
+	else {
+		character.LoadMesh(path_character);
+		ground = getResourceManager().loadObject(path_ground, shader_ground, false);
+		tree.LoadMesh(path_tree);
+	}
+
+	// the copies keep their own geometry and share the textures of the tree, they stay loaded with it
+	std::vector<std::unique_ptr<StaticObject>> treeCopies;
+	if (assetCopies > 0) {
+		ResourceStatistics before = getResourceManager().getStatistics();
+		size_t residentBefore = getCurrentResidentMemory();
+		double copiesStart = glfwGetTime();
+		for (unsigned int i = 0; i < assetCopies; i++) {
+			treeCopies.emplace_back(new StaticObject());
+			treeCopies.back()->LoadMesh(path_tree);
+		}
+		const ResourceStatistics& after = getResourceManager().getStatistics();
+		int textureIndex = (int)ResourceType::Texture;
+		std::cout << "Asset copies: " << assetCopies << " trees loaded in " << (glfwGetTime() - copiesStart) * 1000.0 << " ms, "
+		          << after.Loaded[textureIndex] - before.Loaded[textureIndex] << " textures loaded, " << after.Reused[textureIndex] - before.Reused[textureIndex]
+		          << " shared (" << toMiB(after.ReusedTextureBytes - before.ReusedTextureBytes) << " MiB not uploaded again), resident memory "
+		          << toMiB(residentBefore) << " -> " << toMiB(getCurrentResidentMemory()) << " MiB" << std::endl;
+	}
+
+	GltfObject asset = GltfObject();
+	if (!pathGlb.empty()) {
+		asset.LoadMesh(pathGlb.c_str());
+	}
+
+	if (!useAsyncLoading) {
+		cubeMap.loadTexture(pathToCubeMap);
+	}
+
+	FileSystemStatistics fileStatistics = getVirtualFileSystem().getStatistics();
+	std::cout << (useAsyncLoading ? "Synchronous assets loaded in " : "Assets loaded in ") << (glfwGetTime() - assetsStart) * 1000.0 << " ms from " << (pathArchive.empty() ? "the loose files" : pathArchive)
+	          << ": " << fileStatistics.LooseReads << " files opened, " << fileStatistics.ArchiveReads << " archive entries, "
+	          << fileStatistics.BytesRead << " bytes read, " << fileStatistics.BytesDecompressed << " bytes decompressed" << std::endl;
+	const ResourceStatistics& resourceStatistics = getResourceManager().getStatistics();
+	std::cout << "Resources: " << resourceStatistics.Loaded[(int)ResourceType::Texture] << " textures, " << resourceStatistics.Loaded[(int)ResourceType::Shader]
+	          << " shaders, " << resourceStatistics.Loaded[(int)ResourceType::Mesh] << " meshes loaded in " << resourceStatistics.LoadMs << " ms, "
+	          << resourceStatistics.GetReused() << " requests served by a loaded resource (" << toMiB(resourceStatistics.ReusedTextureBytes)
+	          << " MiB of textures not loaded again)" << std::endl;
 
 	/*****************
 	* Transformation *
@@ -209,8 +380,11 @@ int main(int argc, char* argv[])
 	glm::mat4 perspective = camera.GetProjectionMatrix();
 
 	// init model ground
+	// the streamed world is a square of trees centered on the origin, the ground covers it
+	unsigned int worldSide = (unsigned int)std::ceil(std::sqrt((float)numStreamedTrees));
+	float groundHalfSize = std::max(20.0f, worldSide * 4.0f + 8.0f);
 	glm::mat4 modelGround = glm::mat4(1.0);
-	modelGround = glm::scale(modelGround, glm::vec3(20, 1, 20));
+	modelGround = glm::scale(modelGround, glm::vec3(groundHalfSize, 1, groundHalfSize));
 	modelGround = glm::translate(modelGround, glm::vec3(0,-4.5,0));
 
 	// init model tree
@@ -219,14 +393,67 @@ int main(int argc, char* argv[])
 	modelTree = glm::translate(modelTree, glm::vec3(1.5,-0.18,-1.5));
 	modelTree = glm::rotate(modelTree, -HALF_PI, glm::vec3(1,0,0));
 
-	// Init texture
-	shader_character.use();
-	shader_character.setInteger("gSampler", COLOR_TEXTURE_UNIT_INDEX);
-	shader_character.setInteger("gSamplerSpecularExponent", SPECULAR_EXPONENT_UNIT_INDEX);
+	// init model of the glTF asset, standing on the ground
+	glm::mat4 modelAsset = glm::translate(glm::mat4(1.0), glm::vec3(-6, -4.5, -6));
 
-	shader_tree.use();
-	shader_tree.setInteger("gSampler", COLOR_TEXTURE_UNIT_INDEX);
-	shader_tree.setInteger("gSamplerSpecularExponent", SPECULAR_EXPONENT_UNIT_INDEX);
+	// the other trees of the forest are placed on a grid behind the first one
+	std::vector<glm::mat4> modelTrees = { modelTree };
+	std::vector<unsigned int> lodTrees(numTrees, 0);
+	unsigned int forestSide = (unsigned int)std::ceil(std::sqrt((float)numTrees));
+	for (unsigned int i = 1; i < numTrees; i++) {
+		glm::vec3 offset = glm::vec3(((float)(i % forestSide) - forestSide / 2.0f) * 8.0f, 0.0f, -(float)(i / forestSide) * 8.0f - 8.0f);
+		modelTrees.push_back(glm::translate(glm::mat4(1.0), offset) * modelTree);
+	}
+
+	// the batches replace the ground and the trees, they are drawn with a model matrix of identity
+	StaticBatcher groundBatch = StaticBatcher();
+	StaticBatcher forestBatch = StaticBatcher();
+	if (useStaticBatch) {
+		groundBatch.addObject(path_ground, modelGround);
+		groundBatch.build("ground");
+		for (const glm::mat4& model : modelTrees) {
+			forestBatch.addObject(path_tree, model);
+		}
+		forestBatch.build("forest");
+	}
+
+	// the textures of the materials are placed once all the objects are loaded, at the end of the asynchronous loading when it is used
+	auto finishLoading = [&]() {
+		getMaterialTable().build();
+		if (getMaterialTable().isEnabled()) {
+			const MaterialTableStatistics& tableStatistics = getMaterialTable().getStatistics();
+			std::cout << "Material table (" << (getMaterialTable().getMode() == MaterialBinding::Bindless ? "bindless" : "arrays") << "): "
+			          << tableStatistics.Materials << " materials, " << tableStatistics.Textures << " textures";
+			if (getMaterialTable().getMode() == MaterialBinding::Arrays) {
+				std::cout << " in " << tableStatistics.Arrays << " texture arrays of " << toMiB(tableStatistics.ArrayBytes) << " MiB, "
+				          << tableStatistics.UnplacedTextures << " left out";
+			}
+			std::cout << std::endl;
+		}
+
+		// the source data of the assets was released after the upload, only what the animation and the queries need is kept
+		if (useTextureCompression) {
+			TextureCompressionStatistics textureStatistics = getTextureCompressionStatistics();
+			std::cout << "Compressed textures: " << textureStatistics.CookedTextures << " cooked, " << textureStatistics.CachedTextures << " cached, "
+			          << textureStatistics.EncodedTextures << " encoded in " << textureStatistics.EncodeMs << " ms, " << textureStatistics.RawTextures
+			          << " uncompressed; " << toMiB(textureStatistics.CompressedBytes) << " MiB instead of " << toMiB(textureStatistics.RawBytes) << " MiB" << std::endl;
+		}
+		TextureMipStatistics mipStatistics = getTextureMipStatistics();
+		if (mipStatistics.Textures > 0) {
+			const char* filterNames[] = { "driver", "box", "kaiser" };
+			std::cout << "Mip chains (" << filterNames[(int)mipFilter] << "): " << mipStatistics.Textures << " textures in " << mipStatistics.GenerateMs
+			          << " ms, brightness drift " << mipStatistics.DriftSum / mipStatistics.Textures << "% on average, " << mipStatistics.MaxDrift << "% at most" << std::endl;
+		}
+		const TextureUploadStatistics& uploadStatistics = getTextureUploader().getStatistics();
+		std::cout << "Texture uploads: " << toMiB(uploadStatistics.BytesUploaded) << " MiB in " << uploadStatistics.SubUploads << " sub-uploads from the ring at "
+		          << uploadStatistics.GetBandwidth() << " MiB/s, waited " << uploadStatistics.WaitMs << " ms for " << uploadStatistics.SlotWaits << " slots" << std::endl;
+		getMemoryReport().print();
+		std::cout << "Resident memory after loading: " << toMiB(getCurrentResidentMemory()) << " MiB (peak "
+		          << toMiB(getPeakResidentMemory()) << " MiB)" << std::endl;
+	};
+	if (!useAsyncLoading) {
+		finishLoading();
+	}
 
 	// Init worldTransform
 	WorldTrans& worldTransform = character.getWorldTransform();
@@ -235,81 +462,310 @@ int main(int argc, char* argv[])
     worldTransform.SetScale(0.1f);
 	glm::mat4 World = worldTransform.GetMatrix();
 
+	// the chunks of the world are loaded in the background while the frames are rendered, a guard stands next to one tree out of 32
+	WorldStreamer world("streamed world");
+	std::vector<const WorldObject*> streamedGuards;
+	for (unsigned int i = 0; i < numStreamedTrees; i++) {
+		glm::vec3 offset = glm::vec3(((float)(i % worldSide) - worldSide / 2.0f) * 8.0f, 0.0f, ((float)(i / worldSide) - worldSide / 2.0f) * 8.0f);
+		world.addObject(path_tree, glm::translate(glm::mat4(1.0), offset) * modelTree);
+		if (i % 32 == 0) {
+			world.addObject(path_character, glm::translate(glm::mat4(1.0), offset + glm::vec3(4.0f, 0.0f, 4.0f)) * World, true);
+		}
+	}
+	if (numStreamedTrees > 0) {
+		std::cout << "Streamed world of " << numStreamedTrees << " trees in " << world.getNumChunks() << " chunks" << std::endl;
+	}
+
 	// Init Lighting
 	Lighting lighting = Lighting();
 	lighting.init();
 
-	shader_character.use();
-	lighting.render(shader_character, worldTransform, camera.Position, camera.Front);
+	// the camera and the lights in world space, read by all the programs from their FrameUniforms block
+	FrameUniforms frameUniforms;
+	frameUniforms.init();
+	// the model matrices, the materials and the bone palettes, written per draw in a ring of three frames
+	getDrawUniforms().init();
 
-	shader_tree.use();
-	lighting.render(shader_tree, worldTransform, camera.Position, camera.Front);
 
+	// the lit variants are compiled for the lights of the scene
+	ShaderFeatures litFeatures;
+	litFeatures.NumPointLights = lighting.getNumLights().x;
+	litFeatures.NumSpotLights = lighting.getNumLights().y;
 
 	glfwSwapInterval(1);
 	//Rendering
 	auto lastFrameTime = glfwGetTime();
 	auto starting_t = lastFrameTime;
+	bool firstFrame = true;
+	// the lit variants are only compiled by the frames that first draw their objects
+	unsigned int reportedPrograms = 0;
+	getUniformSettings().Cache = useUniformCache;
+	getUniformStatistics().Reset();
 	while (!glfwWindowShouldClose(window)) {
 		processInput(window);
 		
 		glfwPollEvents();
 		
 		double now = glfwGetTime();
+		getUniformStatistics().Frames++;
+		getDrawUniforms().beginFrame();
 
 		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		view = camera.GetViewMatrix();
+
+		// the assets prepared by the loading threads are uploaded within the loading budget
+		if (!assetLoader.isDone()) {
+			assetLoader.update(loadBudgetMs);
+			if (assetLoader.isDone()) {
+				const AssetLoadStatistics& loadStatistics = assetLoader.getStatistics();
+				std::cout << std::endl << "Asynchronous loading: " << loadStatistics.Finished << " assets in " << loadStatistics.TotalMs << " ms ("
+				          << loadStatistics.PrepareMs << " ms on the loading threads, " << loadStatistics.FinishMs << " ms on the render thread, at most "
+				          << loadStatistics.MaxFrameMs << " ms in a frame for a budget of " << loadStatistics.BudgetMs << " ms, "
+				          << loadStatistics.FramesOverBudget << " frames over), " << loadStatistics.Failed << " failed" << std::endl;
+				getImagePrefetcher().clear();
+				finishLoading();
+			}
+		}
+		// the material table is only built once all the assets are loaded
+		bool tableReady = assetLoader.isDone() || !getMaterialTable().isEnabled();
+		bool drawCharacter = character.isLoaded() && tableReady;
+		bool drawTree = tree.isLoaded() && tableReady;
+
+		// never waits for the loading of the chunks
+		if (numStreamedTrees > 0) {
+			world.update(camera.Position);
+		}
+		// nor for the loading of the texture levels requested by the previous frame
+		if (textureBudget > 0) {
+			getTextureStreamer().update();
+		}
+		// the textures queued by the streamers are uploaded over the frames, within the upload budget
+		getTextureUploader().update();
+		// the materials and their textures are bound once for all the meshes of the frame
+		getMaterialTable().update();
+		getMaterialTable().bind();
+
 		// For screen resolution
 		glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
 		double ratio = framebuffer_width/ framebuffer_height;
 		perspective = camera.GetProjectionMatrix(45.0, ratio);
 
-		// Use the shader Class to send the uniform
-		shader_character.use();
-		lighting.render(shader_character, worldTransform, camera.Position, camera.Front);
-
-		setMaterial(character.getMaterial(), shader_character);
-		glm::vec3 CameraLocalPos3f = worldTransform.WorldPosToLocalPos(camera.Position);
-		setCameraLocalPos(CameraLocalPos3f, shader_character);
+		// written once for all the programs, and only when the camera or the lights moved
+		lighting.update(camera.Position, camera.Front);
+		frameUniforms.update(view, perspective, camera.Position, lighting);
 
 		float AnimationTimeSec = (float)(now - starting_t);
 		
 		std::vector<glm::mat4> transforms;
 		character.getBoneTransforms(AnimationTimeSec, transforms);
-		shader_character.setMatrix4Array("gBones", transforms, transforms.size());
-		shader_character.setMatrix4("M", World);
-		shader_character.setMatrix4("V", view);
-		shader_character.setMatrix4("P", perspective);
+		getDrawUniforms().setBones(transforms);
+		getDrawUniforms().setModel(World);
 
 		glDepthFunc(GL_LEQUAL);
-		character.render();
-
-		shader_ground.use();
-		shader_ground.setMatrix4("M", modelGround);
-		shader_ground.setMatrix4("V", view);
-		shader_ground.setMatrix4("P", perspective);
 
-		ground.draw();
+		// the character reads as many bones per vertex as its mesh needs, with the vertex pulling or the vertex attributes
+		world.getResidentAnimatedObjects(streamedGuards);
+		if (drawCharacter) {
+			ShaderFeatures characterFeatures = litFeatures;
+			characterFeatures.NumBoneInfluences = character.getMaxBoneInfluences();
+			characterFeatures.SpecularMap = character.hasSpecularMap();
+			ShaderVariant& characterVariant = useVertexPulling
+				? shaderVariants.get("character, vertex pulling", sourceV_character_pulling, sourceF_phong, characterFeatures, materialDefines)
+				: shaderVariants.get("character", sourceV_character, sourceF_phong, characterFeatures, materialDefines);
+			Shader& shader_animated = *characterVariant.Program;
+			shader_animated.use();
+			setMaterial(character.getMaterial());
+			characterVariant.Timer.begin();
+
+			// the bounds of the bones follow the animation, so the character is only culled when the whole pose is outside
+			BoundingBox characterBounds = character.getSkinnedBoundingBox(transforms).Transform(World);
+			if (Frustum(perspective * view).IsBoxVisible(characterBounds.Min, characterBounds.Max)) {
+				character.requestTextureDetail(projectedScreenSize(characterBounds, view, perspective) * framebuffer_height);
+				if (useVertexPulling) {
+					character.renderPulled(shader_animated);
+				}
+				else {
+					character.render();
+				}
+			}
+
+			// the guards of the world share the pose of the character
+			for (const WorldObject* guard : streamedGuards) {
+				BoundingBox guardBounds = character.getSkinnedBoundingBox(transforms).Transform(guard->Model);
+				if (Frustum(perspective * view).IsBoxVisible(guardBounds.Min, guardBounds.Max)) {
+					character.requestTextureDetail(projectedScreenSize(guardBounds, view, perspective) * framebuffer_height);
+					getDrawUniforms().setModel(guard->Model);
+					if (useVertexPulling) {
+						character.renderPulled(shader_animated);
+					}
+					else {
+						character.render();
+					}
+				}
+			}
+			characterVariant.Timer.end();
+		}
 
-		shader_tree.use();
-		lighting.render(shader_tree, worldTransform, camera.Position, camera.Front);
-		setMaterial(tree.getMaterial(), shader_tree);
-		setCameraLocalPos(CameraLocalPos3f, shader_tree);
-		shader_tree.setMatrix4("M", modelTree);
-		shader_tree.setMatrix4("V", view);
-		shader_tree.setMatrix4("P", perspective);
+		shader_ground.use();
 
-		tree.render();
+		if (useStaticBatch) {
+			shader_ground.setMatrix4("M", glm::mat4(1.0));
+			groundBatch.resetRenderStatistics();
+			groundBatch.render(view, perspective);
+		}
+		else if (ground) {
+			shader_ground.setMatrix4("M", modelGround);
+			ground->draw();
+		}
+
+		// the trees are drawn in a flat green
+		ShaderFeatures treeFeatures = litFeatures;
+		treeFeatures.Textured = false;
+
+		tree.resetRenderStatistics();
+		forestBatch.resetRenderStatistics();
+		if (useStaticBatch) {
+			treeFeatures.SpecularMap = forestBatch.hasSpecularMap();
+			ShaderVariant& forestVariant = shaderVariants.get("forest", sourceV_tree, sourceF_phong, treeFeatures);
+			forestVariant.Program->use();
+			forestVariant.Timer.begin();
+			getDrawUniforms().setModel(glm::mat4(1.0));
+			forestBatch.render(view, perspective);
+			forestVariant.Timer.end();
+		}
+		else if (drawTree) {
+			// the tree reads its materials from the material table when it is used
+			treeFeatures.SpecularMap = tree.hasSpecularMap();
+			ShaderVariant& treeVariant = shaderVariants.get("tree", sourceV_tree, sourceF_phong, treeFeatures, materialDefines);
+			treeVariant.Program->use();
+			setMaterial(tree.getMaterial());
+			treeVariant.Timer.begin();
+			for (unsigned int i = 0; i < modelTrees.size(); i++) {
+				unsigned int lod = tree.selectLod(modelTrees[i], view, perspective, lodTrees[i]);
+				tree.requestTextureDetail(tree.projectedScreenSize(modelTrees[i], view, perspective) * framebuffer_height);
+				getDrawUniforms().setModel(modelTrees[i]);
+				tree.render(modelTrees[i], view, perspective, lod);
+			}
+			treeVariant.Timer.end();
+		}
+
+		if (numStreamedTrees > 0) {
+			// the materials of the chunks are only known once they are loaded, each variant draws the materials with its textures
+			// (the ones whose textures are still uploading are drawn in the flat color until then)
+			getDrawUniforms().setModel(glm::mat4(1.0));
+			for (int textures = 0; textures < 4; textures++) {
+				ShaderFeatures worldFeatures = litFeatures;
+				worldFeatures.Textured = (textures & 1) != 0;
+				worldFeatures.SpecularMap = (textures & 2) != 0;
+				if (!world.hasMaterials(worldFeatures.Textured, worldFeatures.SpecularMap)) {
+					continue;
+				}
+				ShaderVariant& worldVariant = shaderVariants.get("streamed world", sourceV_tree, sourceF_phong, worldFeatures);
+				worldVariant.Program->use();
+				worldVariant.Timer.begin();
+				world.render(view, perspective, worldFeatures.Textured, worldFeatures.SpecularMap);
+				worldVariant.Timer.end();
+			}
+		}
+
+		if (asset.isLoaded()) {
+			// the glTF materials only have a diffuse texture, and 4 bones per vertex
+			ShaderFeatures assetFeatures = litFeatures;
+			assetFeatures.SpecularMap = false;
+			assetFeatures.NumBoneInfluences = asset.isSkinned() ? 4 : 0;
+			ShaderVariant& assetVariant = shaderVariants.get("glTF asset", asset.isSkinned() ? sourceV_character : sourceV_tree, sourceF_phong, assetFeatures);
+			assetVariant.Program->use();
+			setMaterial(asset.getMaterial());
+			if (asset.isSkinned()) {
+				std::vector<glm::mat4> assetTransforms;
+				asset.getBoneTransforms(AnimationTimeSec, assetTransforms);
+				getDrawUniforms().setBones(assetTransforms);
+			}
+			asset.requestTextureDetail(projectedScreenSize(asset.getBoundingBox().Transform(modelAsset), view, perspective) * framebuffer_height);
+			assetVariant.Timer.begin();
+			asset.render(modelAsset);
+			assetVariant.Timer.end();
+		}
 
 		// CubeMap rendering
-		cubeMap.render(view, perspective);
-
-		fps(now);
+		cubeMap.render();
+
+		if (fps(now)) {
+			if (useStaticBatch) {
+				const StaticBatchStatistics& forestStatistics = forestBatch.getRenderStatistics();
+				std::cout << " | forest: " << forestStatistics.TrianglesRendered << " triangles, " << forestStatistics.BatchesRendered
+				          << " batches in " << forestStatistics.DrawCalls << " draw calls, culled " << forestStatistics.BatchesCulled << " batches";
+			}
+			else {
+				const RenderStatistics& treeStatistics = tree.getRenderStatistics();
+				std::cout << " | trees: " << treeStatistics.TrianglesRendered << " / " << treeStatistics.TrianglesFullDetail << " triangles"
+				          << ", culled " << treeStatistics.TrianglesFrustumCulled << " (frustum) " << treeStatistics.TrianglesBackFaceCulled << " (back face)";
+			}
+			// GPU time of the draws of each variant, the character with the vertex pulling or the vertex attributes among them
+			std::cout << " | variants:";
+			for (const auto& variant : shaderVariants.getVariants()) {
+				std::cout << " " << variant.second->Name << " " << variant.second->Timer.getAverageMs() << " ms GPU;";
+				variant.second->Timer.reset();
+			}
+			const UniformStatistics& uniformStatistics = getUniformStatistics();
+			if (uniformStatistics.Frames > 0) {
+				std::cout << " | uniforms per frame: " << uniformStatistics.Uploads / uniformStatistics.Frames << " calls, "
+				          << uniformStatistics.Lookups / uniformStatistics.Frames << " lookups, " << uniformStatistics.Skipped / uniformStatistics.Frames
+				          << " unchanged skipped";
+			}
+			getUniformStatistics().Reset();
+			FrameUniformStatistics& frameStatistics = frameUniforms.getStatistics();
+			if (frameStatistics.Frames > 0) {
+				std::cout << " | frame uniforms: " << frameStatistics.Uploads << " / " << frameStatistics.Frames << " frames written ("
+				          << frameStatistics.BytesUploaded / frameStatistics.Frames << " bytes per frame), "
+				          << frameStatistics.SetupMs * 1000.0 / frameStatistics.Frames << " us per frame";
+			}
+			frameStatistics.Reset();
+			DynamicRingStatistics& ringStatistics = getDrawUniforms().getStatistics();
+			if (ringStatistics.Frames > 0) {
+				std::cout << " | draw uniforms per frame: " << ringStatistics.Allocations / ringStatistics.Frames << " ranges, "
+				          << ringStatistics.BytesWritten / ringStatistics.Frames / 1024 << " KiB, " << ringStatistics.SegmentWaits << " waits ("
+				          << ringStatistics.WaitMs << " ms), " << ringStatistics.Overflows << " overflows";
+			}
+			ringStatistics.Reset();
+			if (numStreamedTrees > 0) {
+				const StreamingStatistics& worldStatistics = world.getStatistics();
+				std::cout << " | world: " << worldStatistics.ResidentChunks << " resident, " << worldStatistics.LoadingChunks << " loading, "
+				          << worldStatistics.QueuedChunks << " queued chunks, " << worldStatistics.Stalls << " stalls (max "
+				          << worldStatistics.MaxUpdateMs << " ms)";
+			}
+			if (textureBudget > 0) {
+				const TextureStreamingStatistics& textureStatistics = getTextureStreamer().getStatistics();
+				std::cout << " | textures: " << textureStatistics.ResidentLevels << " / " << textureStatistics.TotalLevels << " levels, "
+				          << toMiB(textureStatistics.ResidentBytes) << " / " << toMiB(textureStatistics.Budget) << " MiB, "
+				          << textureStatistics.PendingRequests << " pending, " << textureStatistics.LevelsEvicted << " evicted";
+			}
+			if (numStreamedTrees > 0 || textureBudget > 0) {
+				const TextureUploadStatistics& uploadStatistics = getTextureUploader().getStatistics();
+				std::cout << " | uploads: " << uploadStatistics.QueuedUploads << " queued (" << toMiB(uploadStatistics.QueuedBytes) << " MiB), "
+				          << uploadStatistics.GetAverageFrameMs() << " ms per frame (max " << uploadStatistics.MaxFrameMs << " ms), "
+				          << uploadStatistics.GetBandwidth() << " MiB/s";
+			}
+			std::cout.flush();
+		}
 		lastFrameTime = now;
 		
 		glfwSwapBuffers(window);
+		if (firstFrame) {
+			std::cout << "First frame after " << glfwGetTime() * 1000.0 << " ms (" << (useAsyncLoading ? "asynchronous" : "serial") << " loading)" << std::endl;
+			firstFrame = false;
+		}
+		// the startup time of the shaders with a cold or a warm cache, again after each frame that created programs:
+		// the first one with the serial loading, the ones that draw the assets and the chunks for the first time otherwise
+		const ShaderCacheStatistics& shaderStatistics = getShaderCacheStatistics();
+		if (shaderStatistics.Programs != reportedPrograms) {
+			std::cout << std::endl << "Shaders: " << shaderStatistics.Programs << " programs in " << shaderStatistics.CachedMs + shaderStatistics.CompiledMs << " ms, "
+			          << shaderStatistics.CachedPrograms << " from the cache (" << shaderStatistics.CachedMs << " ms), " << shaderStatistics.CompiledPrograms
+			          << " compiled (" << shaderStatistics.CompiledMs << " ms), " << shaderStatistics.RejectedPrograms << " rejected by the driver" << std::endl;
+			reportedPrograms = shaderStatistics.Programs;
+		}
 	}
 
 	//clean up ressource
@@ -7,6 +7,9 @@
 #include <map>
 #include <vector>
 #include <unordered_map>
+#include <chrono>
+#include <memory>
+#include <algorithm>
 
 // Assimp library to load the mesh file
 #include <assimp/Importer.hpp>      // C++ importer interface
@@ -24,8 +27,19 @@
 
 #include "utils.h"
 #include "material.h"
+#include "material_table.h"
 #include "texture.h"
+#include "resource_manager.h"
 #include "world_transform.h"
+#include "mesh_optimizer.h"
+#include "virtual_io_system.h"
+#include "vertex_pulling.h"
+#include "bounds.h"
+#include "skeleton.h"
+#include "draw_uniforms.h"
+#include "../utils/thread_pool.h"
+#include "../utils/memory_usage.h"
+#include "../utils/memory_report.h"
 
 using namespace Assimp;
 
@@ -95,19 +109,30 @@ private:
         unsigned int BaseVertex;
         unsigned int BaseIndex;
         unsigned int MaterialIndex;
+        BoundingBox Bounds;     // in model space, in the bind pose
+        unsigned int MaxBoneInfluences = 0;     // largest number of bones of a vertex
     };
 
-    Assimp::Importer importer;  // the assimp importer
-    const aiScene* scene;   // the assimp scene
+    const aiScene* scene = NULL;   // the assimp scene, only set during the loading
+    std::unique_ptr<Assimp::Importer> m_Importer;   // owns the scene between ImportMesh and FinishLoad
+    std::string m_Path;
+    double m_ImportMs = 0.0;
+    size_t m_PeakMemoryBefore = 0;      // peak resident memory when the loading started
     std::vector<BasicMeshEntry> m_Meshes;
     std::vector<Material> m_Materials;
+    unsigned int m_FirstMaterial = 0;   // index of the first material in the material table, when it is used
 
-    // Temporary space for vertex stuff before we load them into the GPU
-    std::vector<glm::vec3> m_Positions;
-    std::vector<glm::vec3> m_Normals;
-    std::vector<glm::vec2> m_TexCoords;
-    std::vector<unsigned int> m_Indices;
-    std::vector<VertexBoneData> m_Bones;
+    std::vector<std::string> m_DiffusePaths;    // texture files of each material, loaded by FinishLoad
+    std::vector<std::string> m_SpecularPaths;
+
+    // Indices of a mesh and its vertex fetch order, built by ImportMesh and kept until FinishLoad writes the mesh
+    // into the mapped buffers
+    struct MeshLoadResult {
+        std::vector<unsigned int> Indices;
+        std::vector<unsigned int> Order;        // vertex of the scene at each place of the vertex buffer
+        std::vector<int> BoneIds;               // id of each bone of the mesh
+    };
+    std::vector<MeshLoadResult> m_LoadResults;
 
     std::map<std::string,uint> m_BoneNameToIndexMap;
 
@@ -115,19 +140,27 @@ private:
     {
         uint id;
         glm::mat4 OffsetMatrix;
-        glm::mat4 FinalTransformation;
 
         BoneInfo(const glm::mat4& Offset, uint boneId)
         {
             id = boneId;
             OffsetMatrix = Offset;
-            FinalTransformation = glm::mat4(0.0f);
         }
     };
 
     std::vector<BoneInfo> m_BoneInfo;
     glm::mat4 m_GlobalInverseTransform;
 
+    BoundingBox m_BoundingBox;              // in model space, in the bind pose
+    std::vector<BoundingBox> m_BoneBounds;  // bind pose positions of the vertices influenced by each bone
+
+    // The animation is converted from the scene, so the scene is released after the loading
+    Skeleton m_Skeleton;                    // one joint per node of the scene
+    std::vector<AnimationClip> m_Clips;
+    std::vector<int> m_BoneJoints;          // joint of each bone, -1 if no node has the name of the bone
+    std::vector<JointPose> m_Pose;
+    std::vector<glm::mat4> m_JointMatrices;
+
 public:
     AnimatedObject() {};
 
@@ -154,6 +187,39 @@ public:
 
     WorldTrans& getWorldTransform() { return m_worldTransform; }
 
+    const BoundingBox& getBoundingBox() const { return m_BoundingBox; }
+
+    /**
+     * @brief Request the levels of the streamed textures needed by an instance of the object
+     *
+     * @param screenPixels the projected size of the instance, in pixels
+     */
+    void requestTextureDetail(float screenPixels)
+    {
+        for (Material& material : m_Materials) {
+            material.RequestTextureDetail(screenPixels);
+        }
+    }
+
+    unsigned int getNumMeshes() const { return (unsigned int)m_Meshes.size(); }
+
+    const BoundingBox& getMeshBoundingBox(unsigned int meshIndex) const { return m_Meshes[meshIndex].Bounds; }
+
+    /**
+     * @brief Conservative bounding box of the skinned object in model space: a skinned vertex is a weighted average
+     * of its position transformed by its bones, so it is inside the union of the transformed boxes of the bones
+     * 
+     * @param Transforms the bone transforms of the pose, as returned by getBoneTransforms
+     */
+    BoundingBox getSkinnedBoundingBox(const std::vector<glm::mat4>& Transforms) const
+    {
+        BoundingBox box;
+        for (unsigned int i = 0 ; i < m_BoneBounds.size() && i < Transforms.size() ; i++) {
+            box.Add(m_BoneBounds[i].Transform(Transforms[i]));
+        }
+        return box;
+    }
+
     /**
      * @brief Load meshes from the file in path
      * 
@@ -161,6 +227,71 @@ public:
      */
     void LoadMesh(const char* path)
     {
+        if (ImportMesh(path)) {
+            FinishLoad();
+        }
+    }
+
+    /**
+     * @brief First part of LoadMesh, without any GL call so that it can run on a loading thread: import the file,
+     * optimize the meshes and convert the skeleton and the animations. The vertices stay in the scene until
+     * FinishLoad, which must then be called on the GL thread, writes them into the mapped buffers.
+     *
+     * @param prefetchImages true to also decode the images of the materials here (see ImagePrefetcher)
+     * @return false if the file can't be imported
+     */
+    bool ImportMesh(const char* path, bool prefetchImages = false)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_Path = path;
+        m_PeakMemoryBefore = getPeakResidentMemory();
+
+        // Import the file content with the assimp library, through the virtual file system.
+        // The importer owns the scene, it is released with the importer once the data is on the GPU
+        m_Importer.reset(new Assimp::Importer());
+        m_Importer->SetIOHandler(new VirtualIOSystem());
+        scene = m_Importer->ReadFile(path, 
+								aiProcess_Triangulate  				|
+                                aiProcess_GenNormals                |
+								aiProcess_JoinIdenticalVertices		|
+								aiProcess_ValidateDataStructure);
+
+        if (!scene) {
+            std::cout << "Error parsing " << path << ": " << m_Importer->GetErrorString() << std::endl;
+            m_Importer.reset();
+            return false;
+        }
+
+        std::string directory = getDirFromPath(path);
+        for (unsigned int i = 0 ; prefetchImages && i < scene->mNumMaterials ; i++) {
+            for (aiTextureType type : { aiTextureType_DIFFUSE, aiTextureType_SHININESS }) {
+                std::string texturePath = getAssimpTexturePath(directory, scene->mMaterials[i], type);
+                if (!texturePath.empty()) {
+                    getImagePrefetcher().prefetch(texturePath, type == aiTextureType_DIFFUSE);
+                }
+            }
+        }
+
+        m_GlobalInverseTransform = assimpToGlmMatrix4x4(scene->mRootNode->mTransformation);
+        m_GlobalInverseTransform = glm::inverse(m_GlobalInverseTransform);
+        initFromScene(path);
+
+        // The bones are found by their joint from now on
+        m_BoneNameToIndexMap.clear();
+
+        m_ImportMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    /**
+     * @brief Second part of LoadMesh, on the GL thread: allocate and map the buffers, write the meshes processed
+     * by ImportMesh straight into the mapping, describe the buffers in the VAO and load the textures
+     *
+     */
+    void FinishLoad()
+    {
+        auto start = std::chrono::steady_clock::now();
+
          // Release the previously loaded mesh (if it exists)
         Clear();
 
@@ -171,25 +302,90 @@ public:
         // Create the buffers for the vertices attributes
         glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
 
-        // Import the file content with the assimp library
-        scene = importer.ReadFile(path, 
-								aiProcess_Triangulate  				|
-                                aiProcess_GenNormals                |
-								aiProcess_JoinIdenticalVertices		|
-								aiProcess_ValidateDataStructure);
+        loadTextures();
+        m_FirstMaterial = getMaterialTable().addMaterials(m_Materials);
 
-        if (scene) {
-            m_GlobalInverseTransform = assimpToGlmMatrix4x4(scene->mRootNode->mTransformation);
-            m_GlobalInverseTransform = glm::inverse(m_GlobalInverseTransform);
-            initFromScene(path);
+        populateBuffers();
+
+        std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Loaded " << m_Path << ": " << m_ImportMs << " ms to import and process, " << loadTime.count()
+                  << " ms on the GL thread" << std::endl;
+        std::cout << "Peak resident memory while loading " << m_Path << ": " << toMiB(m_PeakMemoryBefore) << " MiB -> "
+                  << toMiB(getPeakResidentMemory()) << " MiB" << std::endl;
+
+        reportMemory(m_Path);
+        std::vector<MeshLoadResult>().swap(m_LoadResults);
+        scene = NULL;
+        m_Importer.reset();
+    }
+
+    bool isLoaded() const { return m_VAO != 0 && !m_Importer; }
+
+    /**
+     * @brief Largest number of bones of a vertex, the skinning shader variant reads only as many
+     *
+     */
+    unsigned int getMaxBoneInfluences() const
+    {
+        unsigned int influences = 0;
+        for (const BasicMeshEntry& entry : m_Meshes) {
+            influences = std::max(influences, entry.MaxBoneInfluences);
         }
-        else {
-            std::cout << "Error parsing " << path << ": " << importer.GetErrorString() << std::endl;
+        return influences;
+    }
+
+    /**
+     * @brief true if a material of the object has a specular exponent texture, the shader variant samples it
+     *
+     */
+    bool hasSpecularMap() const
+    {
+        for (const Material& material : m_Materials) {
+            if (material.pSpecularExponent) {
+                return true;
+            }
         }
+        return false;
     }
 
+    /**
+     * @brief Report the memory kept by the object to the memory report
+     * 
+     * @param name the name of the object in the report
+     */
+    void reportMemory(const std::string& name) const
+    {
+        size_t NumVertices = 0;
+        size_t NumIndices = 0;
+        size_t textureBytes = 0;
+        for (const BasicMeshEntry& mesh : m_Meshes) {
+            NumVertices += mesh.NumVertices;
+            NumIndices += mesh.NumIndices;
+        }
+        for (const Material& material : m_Materials) {
+            textureBytes += material.GetTextureBytes();
+        }
+
+        size_t cpuBytes = vectorBytes(m_Meshes) + vectorBytes(m_Materials) + vectorBytes(m_BoneInfo) + vectorBytes(m_BoneBounds)
+                        + vectorBytes(m_BoneJoints) + m_Skeleton.GetMemoryBytes();
+        for (const AnimationClip& clip : m_Clips) {
+            cpuBytes += clip.GetMemoryBytes();
+        }
+        size_t gpuBytes = NumVertices * (2 * sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(VertexBoneData))
+                        + NumIndices * sizeof(unsigned int) + textureBytes;
+        getMemoryReport().setAsset(name, cpuBytes, gpuBytes);
+    }
+
+    /**
+     * @brief Optimize the meshes of the scene with the thread pool and place them in the buffers, from the counts
+     * of the scene. No GL call: the buffers are written by FinishLoad.
+     * 
+     * @param path the path of the loaded file, used in the reports
+     */
     void initFromScene(const char* path)
     {
+        auto start = std::chrono::steady_clock::now();
+
         m_Meshes.resize(scene->mNumMeshes);
         m_Materials.resize(scene->mNumMaterials);
 
@@ -198,12 +394,18 @@ public:
 
         countVerticesAndIndices(NumVertices, NumIndices);
 
-        reserveSpace(NumVertices, NumIndices);
+        m_LoadResults.clear();
+        m_LoadResults.resize(m_Meshes.size());
+        initAllMeshes(path);
+
+        std::chrono::duration<double, std::milli> meshTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Meshes of " << path << " processed in " << meshTime.count() << " ms with "
+                  << getThreadPool().getNumThreads() << " worker threads" << std::endl;
 
-        initAllMeshes();
         initMaterials(path);
 
-        populateBuffers();
+        initSkeleton();
+        initAnimations();
     }
     
     void countVerticesAndIndices(unsigned int& NumVertices, unsigned int& NumIndices)
@@ -222,79 +424,180 @@ public:
         }
     }
     
-    void reserveSpace(unsigned int NumVertices, unsigned int NumIndices)
-    {
-        m_Positions.reserve(NumVertices);
-        m_Normals.reserve(NumVertices);
-        m_TexCoords.reserve(NumVertices);
-        m_Indices.reserve(NumIndices);
-        m_Bones.resize(NumVertices);
-    }
-
-    
-    void initAllMeshes()
+    /**
+     * @brief Import and optimize the meshes in parallel and print the optimization statistics
+     * 
+     * @param path the path of the loaded file, used in the report
+     */
+    void initAllMeshes(const char* path)
     {
+        // The bone ids are shared by all the meshes, they are allocated before the parallel part
         for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
-            const aiMesh* mesh = scene->mMeshes[i];
-            initSingleMesh(i, mesh);
+            m_LoadResults[i].BoneIds = registerMeshBones(scene->mMeshes[i]);
         }
-    }
-
-    
-    void initSingleMesh(uint meshIndex, const aiMesh* mesh)
-    {
-        const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
-        // Populate the vertex attribute vectors
-        for (unsigned int i = 0 ; i < mesh->mNumVertices ; i++) {
+        std::vector<MeshOptimizationStatistics> meshStats(m_Meshes.size());
+        std::vector<std::vector<BoundingBox>> meshBoneBounds(m_Meshes.size());
 
-            const aiVector3D& pos = mesh->mVertices[i];
-            m_Positions.push_back(glm::vec3(pos.x, pos.y, pos.z));
+        getThreadPool().parallelFor((unsigned int)m_Meshes.size(), [&](unsigned int i) {
+            initSingleMesh(i, scene->mMeshes[i], m_LoadResults[i], meshBoneBounds[i], meshStats[i]);
+        });
 
-            if (mesh->mNormals) {
-                const aiVector3D& normal = mesh->mNormals[i];
-                m_Normals.push_back(glm::vec3(normal.x, normal.y, normal.z));
-            } else {
-                m_Normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+        m_BoundingBox = BoundingBox();
+        m_BoneBounds.assign(m_BoneInfo.size(), BoundingBox());
+        for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+            m_BoundingBox.Add(m_Meshes[i].Bounds);
+            for (unsigned int b = 0 ; b < meshBoneBounds[i].size() ; b++) {
+                m_BoneBounds[b].Add(meshBoneBounds[i][b]);
             }
+        }
 
-            const aiVector3D& texCoord = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : Zero3D;
-            m_TexCoords.push_back(glm::vec2(texCoord.x, texCoord.y));
+        MeshOptimizationStatistics stats;
+        for (const MeshOptimizationStatistics& s : meshStats) {
+            stats.CacheBefore.Add(s.CacheBefore);
+            stats.CacheAfter.Add(s.CacheAfter);
+            stats.OverdrawBefore.Add(s.OverdrawBefore);
+            stats.OverdrawAfter.Add(s.OverdrawAfter);
         }
+        stats.Print(path);
+    }
 
-        loadMeshBones(meshIndex, mesh);
+    
+    /**
+     * @brief Optimize a mesh with the original vertex numbering, reading the attributes in place from assimp,
+     * then renumber the vertices for the vertex fetch
+     * 
+     * @param meshIndex the index of the mesh
+     * @param mesh the assimp mesh
+     * @param result the ids of the bones of the mesh, its indices and its vertex fetch order are set
+     * @param boneBounds the bounds of the vertices of the mesh influenced by each bone
+     * @param stats the optimization statistics of the mesh
+     */
+    void initSingleMesh(uint meshIndex, const aiMesh* mesh, MeshLoadResult& result, std::vector<BoundingBox>& boneBounds,
+                        MeshOptimizationStatistics& stats)
+    {
+        BasicMeshEntry& entry = m_Meshes[meshIndex];
+
+        std::vector<glm::vec3> positionStorage;
+        const glm::vec3* positions = assimpAsGlmVec3Array(mesh->mVertices, mesh->mNumVertices, positionStorage);
+        entry.Bounds = computeBoundingBox(positions, entry.NumVertices);
 
         // Populate the index buffer
+        std::vector<unsigned int>& meshIndices = result.Indices;
+        meshIndices.resize(entry.NumIndices);
         for (unsigned int i = 0 ; i < mesh->mNumFaces ; i++) {
             const aiFace& Face = mesh->mFaces[i];
             //        printf("num indices %d\n", Face.mNumIndices);
             //        assert(Face.mNumIndices == 3);
-            m_Indices.push_back(Face.mIndices[0]);
-            m_Indices.push_back(Face.mIndices[1]);
-            m_Indices.push_back(Face.mIndices[2]);
+            meshIndices[3 * i] = Face.mIndices[0];
+            meshIndices[3 * i + 1] = Face.mIndices[1];
+            meshIndices[3 * i + 2] = Face.mIndices[2];
+        }
+
+        optimizeTriangleOrder(meshIndices.data(), entry.NumIndices, positions, entry.NumVertices, stats);
+        std::vector<unsigned int> remap = optimizeVertexFetch(meshIndices.data(), entry.NumIndices, entry.NumVertices);
+        result.Order = invertRemap(remap);
+
+        // The weights are accumulated per vertex, for the bounds of the bones and the number of influences
+        std::vector<VertexBoneData> bones(entry.NumVertices);
+        loadMeshBones(bones, mesh, result.BoneIds);
+        computeBoneBounds(boneBounds, bones, positions);
+        for (const VertexBoneData& vertexBones : bones) {
+            unsigned int influences = 0;
+            while (influences < MAX_NUM_BONES_PER_VERTEX && vertexBones.Weights[influences] > 0.0f) {
+                influences++;
+            }
+            entry.MaxBoneInfluences = std::max(entry.MaxBoneInfluences, influences);
+        }
+    }
+
+    /**
+     * @brief Write the vertices of a mesh in its vertex fetch order at its base vertex in the mapped buffers,
+     * and its indices at its base index
+     * 
+     * @param meshIndex the index of the mesh
+     */
+    void writeMesh(unsigned int meshIndex, glm::vec3* positions, glm::vec3* normals, glm::vec2* texCoords,
+                   VertexBoneData* vertexBones, unsigned int* indices)
+    {
+        const aiMesh* mesh = scene->mMeshes[meshIndex];
+        const BasicMeshEntry& entry = m_Meshes[meshIndex];
+        const MeshLoadResult& result = m_LoadResults[meshIndex];
+
+        std::copy(result.Indices.begin(), result.Indices.end(), indices + entry.BaseIndex);
+
+        gatherVertexBuffer(positions + entry.BaseVertex, mesh->mVertices, result.Order, assimpToGlmVec3);
+
+        if (mesh->mNormals) {
+            gatherVertexBuffer(normals + entry.BaseVertex, mesh->mNormals, result.Order, assimpToGlmVec3);
+        } else {
+            std::fill_n(normals + entry.BaseVertex, mesh->mNumVertices, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        if (mesh->HasTextureCoords(0)) {
+            gatherVertexBuffer(texCoords + entry.BaseVertex, mesh->mTextureCoords[0], result.Order,
+                               [](const aiVector3D& t) { return glm::vec2(t.x, t.y); });
+        } else {
+            std::fill_n(texCoords + entry.BaseVertex, mesh->mNumVertices, glm::vec2(0.0f));
+        }
+
+        // The weights are accumulated per vertex, so they are gathered before being written
+        std::vector<VertexBoneData> bones(entry.NumVertices);
+        loadMeshBones(bones, mesh, result.BoneIds);
+        gatherVertexBuffer(vertexBones + entry.BaseVertex, bones.data(), result.Order, [](const VertexBoneData& b) { return b; });
+    }
+
+    /**
+     * @brief Allocate the ids of the bones of a mesh that were not seen in the previous meshes
+     * 
+     * @return the id of each bone of the mesh
+     */
+    std::vector<int> registerMeshBones(const aiMesh* mesh)
+    {
+        std::vector<int> boneIds(mesh->mNumBones);
+
+        for (uint i = 0 ; i < mesh->mNumBones ; i++) {
+            const aiBone* bone = mesh->mBones[i];
+            boneIds[i] = getBoneId(bone);
+
+            if (boneIds[i] == (int)m_BoneInfo.size()) {
+                BoneInfo bi(assimpToGlmMatrix4x4(bone->mOffsetMatrix), boneIds[i]);
+                m_BoneInfo.push_back(bi);
+            }
         }
+
+        return boneIds;
     }
     
-    void loadMeshBones(uint meshIndex, const aiMesh* mesh)
+    void loadMeshBones(std::vector<VertexBoneData>& bones, const aiMesh* mesh, const std::vector<int>& boneIds)
     {
         for (uint i = 0 ; i < mesh->mNumBones ; i++) {
-            loadSingleBone(meshIndex, mesh->mBones[i]);
+            loadSingleBone(bones, mesh->mBones[i], boneIds[i]);
         }
     }
     
-    void loadSingleBone(uint meshIndex, const aiBone* bone)
+    /**
+     * @brief Add the vertices of a mesh to the bounds of the bones that influence them
+     * 
+     */
+    void computeBoneBounds(std::vector<BoundingBox>& boneBounds, const std::vector<VertexBoneData>& bones, const glm::vec3* positions)
     {
-        int BoneId = getBoneId(bone);
-
-        if (BoneId == m_BoneInfo.size()) {
-            BoneInfo bi(assimpToGlmMatrix4x4(bone->mOffsetMatrix), BoneId);
-            m_BoneInfo.push_back(bi);
+        boneBounds.assign(m_BoneInfo.size(), BoundingBox());
+        for (unsigned int v = 0 ; v < bones.size() ; v++) {
+            for (uint i = 0 ; i < MAX_NUM_BONES_PER_VERTEX ; i++) {
+                if (bones[v].Weights[i] > 0.0f) {
+                    boneBounds[(unsigned int)bones[v].BoneIDs[i]].Add(positions[v]);
+                }
+            }
         }
+    }
 
+    // Only writes the vertices of the mesh, so the meshes can be loaded concurrently
+    void loadSingleBone(std::vector<VertexBoneData>& bones, const aiBone* bone, int BoneId)
+    {
         for (uint i = 0 ; i < bone->mNumWeights ; i++) {
             const aiVertexWeight& vw = bone->mWeights[i];
-            uint GlobalVertexID = m_Meshes[meshIndex].BaseVertex + bone->mWeights[i].mVertexId;
-            m_Bones[GlobalVertexID].AddBoneData(BoneId, vw.mWeight);
+            bones[vw.mVertexId].AddBoneData(BoneId, vw.mWeight);
         }
     }
 
@@ -316,86 +619,52 @@ public:
         return BoneIndex;
     }
 
-    
+
+    /**
+     * @brief Read the colors and the texture files of the materials, the textures are loaded by FinishLoad
+     *
+     */
     void initMaterials(const char* path)
     {
         std::string directory = getDirFromPath(path);
 
+        m_DiffusePaths.resize(scene->mNumMaterials);
+        m_SpecularPaths.resize(scene->mNumMaterials);
+
         // Initialize the materials
         for (unsigned int i = 0 ; i < scene->mNumMaterials ; i++) {
             const aiMaterial* material = scene->mMaterials[i];
 
-            loadTextures(directory, material, i);
+            m_DiffusePaths[i] = getAssimpTexturePath(directory, material, aiTextureType_DIFFUSE);
+            m_SpecularPaths[i] = getAssimpTexturePath(directory, material, aiTextureType_SHININESS);
 
             loadColors(material, i);
         }
     }
 
     
-    void loadTextures(const std::string& directory, const aiMaterial* material, int index)
-    {
-        loadDiffuseTexture(directory, material, index);
-        loadSpecularTexture(directory, material, index);
-    }
-    
-    void loadDiffuseTexture(const std::string& directory, const aiMaterial* material, int index)
+    void loadTextures()
     {
-        m_Materials[index].pDiffuse = NULL;
-
-        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-            aiString Path;
-
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string p(Path.data);
-
-                if (p.substr(0, 2) == ".\\") {
-                    p = p.substr(2, p.size() - 2);
-                }
-
-                std::string FullPath = directory + "/" + p;
-
-                m_Materials[index].pDiffuse = new Texture(GL_TEXTURE_2D, FullPath.c_str());
-
-                if (!m_Materials[index].pDiffuse->Load()) {
-                    std::cout << "Error loading diffuse texture " << FullPath.c_str() << std::endl;
-                    exit(0);
-                }
-                else {
-                    //std::cout << "Loaded diffuse texture " << FullPath.c_str() << std::endl;
-                }
-            }
+        for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+            m_Materials[i].pDiffuse = loadMaterialTexture(m_DiffusePaths[i], "diffuse", true);
+            m_Materials[i].pSpecularExponent = loadMaterialTexture(m_SpecularPaths[i], "specular", false);
         }
     }
-    
-    void loadSpecularTexture(const std::string& directory, const aiMaterial* material, int index)
-    {
-        m_Materials[index].pSpecularExponent = NULL;
-
-        if (material->GetTextureCount(aiTextureType_SHININESS) > 0) {
-            aiString Path;
 
-            if (material->GetTexture(aiTextureType_SHININESS, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string p(Path.data);
-
-                if (p == "C:\\\\") {
-                    p = "";
-                } else if (p.substr(0, 2) == ".\\") {
-                    p = p.substr(2, p.size() - 2);
-                }
-
-                std::string FullPath = directory + "/" + p;
+    std::shared_ptr<Texture> loadMaterialTexture(const std::string& path, const char* type, bool color)
+    {
+        if (path.empty()) {
+            return std::shared_ptr<Texture>();
+        }
 
-                m_Materials[index].pSpecularExponent = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+        // shared with the other objects that load the same file
+        std::shared_ptr<Texture> texture = getResourceManager().loadTexture(path, true, color);
 
-                if (!m_Materials[index].pSpecularExponent->Load()) {
-                    std::cout << "Error loading specular texture " << FullPath.c_str() << std::endl;
-                    exit(0);
-                }
-                else {
-                    //std::cout << "Loaded specular texture " << FullPath.c_str() << std::endl;
-                }
-            }
+        if (!texture) {
+            std::cout << "Error loading " << type << " texture " << path << std::endl;
+            exit(0);
         }
+        return texture;
     }
     
     void loadColors(const aiMaterial* material, int index)
@@ -436,25 +705,52 @@ public:
     }
 
     
+    /**
+     * @brief Allocate and map the buffers, write the meshes into the mapping with the thread pool, then unmap
+     * the buffers and describe their layout in the VAO
+     * 
+     */
     void populateBuffers()
     {
+        unsigned int NumVertices = 0;
+        unsigned int NumIndices = 0;
+        for (const BasicMeshEntry& entry : m_Meshes) {
+            NumVertices += entry.NumVertices;
+            NumIndices += entry.NumIndices;
+        }
+
+        glm::vec3* positions = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB], sizeof(glm::vec3) * NumVertices);
+        glm::vec2* texCoords = (glm::vec2*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB], sizeof(glm::vec2) * NumVertices);
+        glm::vec3* normals = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB], sizeof(glm::vec3) * NumVertices);
+        VertexBoneData* bones = (VertexBoneData*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[BONE_VB], sizeof(VertexBoneData) * NumVertices);
+
+        // The VAO is bound, so it keeps this index buffer
+        unsigned int* indices = (unsigned int*)createMappedBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER],
+                                                                  sizeof(unsigned int) * NumIndices);
+
+        getThreadPool().parallelFor((unsigned int)m_Meshes.size(), [&](unsigned int i) {
+            writeMesh(i, positions, normals, texCoords, bones, indices);
+        });
+
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_Positions[0]) * m_Positions.size(), &m_Positions[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(POSITION_LOCATION);
         glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, false, 0, 0);
         
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_TexCoords[0]) * m_TexCoords.size(), &m_TexCoords[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(TEX_COORD_LOCATION);
         glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, false, 0, 0);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_Normals[0]) * m_Normals.size(), &m_Normals[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(NORMAL_LOCATION);
         glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, false, 0, 0);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[BONE_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_Bones[0]) * m_Bones.size(), &m_Bones[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
 
 
         glEnableVertexAttribArray(BONE_ID_LOCATION);
@@ -477,10 +773,10 @@ public:
         glEnableVertexAttribArray(8);
         glVertexAttribPointer(8, 2, GL_FLOAT, false, sizeof(VertexBoneData),
                             (void*)((MAX_NUM_BONES_PER_VERTEX) * sizeof(int32_t) + 8*sizeof(float)));
-        
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(m_Indices[0]) * m_Indices.size(), &m_Indices[0], GL_STATIC_DRAW);
 
+        if (getMaterialTable().isEnabled()) {
+            bindMaterialIndexAttribute();
+        }
 
         //desactive the buffer
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -494,236 +790,215 @@ public:
      */
     void render()
     {
+        // the model matrix and the material of the object, set by the caller
+        getDrawUniforms().bind();
         glBindVertexArray(m_VAO);
 
         for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
             unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
 
-            assert(MaterialIndex < m_Materials.size());
+            bindTextures(MaterialIndex);
 
-            if (m_Materials[MaterialIndex].pDiffuse) {
-                m_Materials[MaterialIndex].pDiffuse->Bind(COLOR_TEXTURE_UNIT);
-            }
-
-            if (m_Materials[MaterialIndex].pSpecularExponent) {
-                m_Materials[MaterialIndex].pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
-            }
-
-            glDrawElementsBaseVertex(GL_TRIANGLES,
-                                    m_Meshes[i].NumIndices,
-                                    GL_UNSIGNED_INT,
-                                    (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
-                                    m_Meshes[i].BaseVertex);
+            // the base instance is the index of the material in the material table
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                                                          m_Meshes[i].NumIndices,
+                                                          GL_UNSIGNED_INT,
+                                                          (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
+                                                          1,
+                                                          m_Meshes[i].BaseVertex,
+                                                          m_FirstMaterial + MaterialIndex);
         }
 
         // Make sure the VAO is not changed from the outside
         glBindVertexArray(0);
     }
 
-    
-    const Material& getMaterial()
+
+    /**
+     * @brief Render the object with the vertex pulling path: the buffers are bound as storage buffers
+     * and the shader fetches the vertices itself, the VAO of the object is not used
+     * 
+     * @param shader the shader in use, it must read the storage buffers (see vertex_skinning_pulling.cpp)
+     */
+    void renderPulled(Shader& shader)
     {
-        for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
-            if (m_Materials[i].AmbientColor != glm::vec3(0.0f, 0.0f, 0.0f)) {
-                return m_Materials[i];
-            }
-        }
+        // the model matrix and the material of the object, set by the caller
+        getDrawUniforms().bind();
+        glBindVertexArray(getEmptyVertexArray());
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLING_INDEX_BINDING, m_Buffers[INDEX_BUFFER]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLING_POSITION_BINDING, m_Buffers[POS_VB]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLING_TEX_COORD_BINDING, m_Buffers[TEXCOORD_VB]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLING_NORMAL_BINDING, m_Buffers[NORMAL_VB]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULLING_BONE_BINDING, m_Buffers[BONE_VB]);
+
+        UniformHandle baseVertexUniform = shader.getUniform("gBaseVertex");
+        UniformHandle materialIndexUniform = shader.getUniform("gMaterialIndex");
+        for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+            unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
 
-        return m_Materials[0];
-    }
+            bindTextures(MaterialIndex);
 
-    
-    uint findPosition(float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
-    {
-        for (uint i = 0 ; i < nodeAnim->mNumPositionKeys - 1 ; i++) {
-            float t = (float)nodeAnim->mPositionKeys[i + 1].mTime;
-            if (AnimationTimeTicks < t) {
-                return i;
+            // gl_VertexID walks the range of the index buffer of the mesh
+            shader.setInteger(baseVertexUniform, m_Meshes[i].BaseVertex);
+            if (getMaterialTable().isEnabled()) {
+                shader.setInteger(materialIndexUniform, m_FirstMaterial + MaterialIndex);
             }
+            glDrawArrays(GL_TRIANGLES, m_Meshes[i].BaseIndex, m_Meshes[i].NumIndices);
         }
-        return 0;
+
+        glBindVertexArray(0);
     }
 
-    
-    void calcInterpolatedPosition(glm::vec3& Out, float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
+
+    /**
+     * @brief Bind the textures of a material, unless the shaders find them in the material table
+     * 
+     */
+    void bindTextures(unsigned int MaterialIndex)
     {
-        // we need at least two values to interpolate...
-        if (nodeAnim->mNumPositionKeys == 1) {
-            Out = assimpToGlmVec3(nodeAnim->mPositionKeys[0].mValue);
+        assert(MaterialIndex < m_Materials.size());
+
+        if (getMaterialTable().isEnabled()) {
             return;
         }
 
-        uint PositionIndex = findPosition(AnimationTimeTicks, nodeAnim);
-        uint NextPositionIndex = PositionIndex + 1;
-        assert(NextPositionIndex < nodeAnim->mNumPositionKeys);
-        float t1 = (float)nodeAnim->mPositionKeys[PositionIndex].mTime;
-        float t2 = (float)nodeAnim->mPositionKeys[NextPositionIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
-        assert(Factor >= 0.0f && Factor <= 1.0f);
+        if (m_Materials[MaterialIndex].pDiffuse) {
+            m_Materials[MaterialIndex].pDiffuse->Bind(COLOR_TEXTURE_UNIT);
+        }
 
-        glm::vec3 Start = assimpToGlmVec3(nodeAnim->mPositionKeys[PositionIndex].mValue);
-        glm::vec3 End = assimpToGlmVec3(nodeAnim->mPositionKeys[NextPositionIndex].mValue);
-        Out = glm::mix(Start, End, Factor);
+        if (m_Materials[MaterialIndex].pSpecularExponent) {
+            m_Materials[MaterialIndex].pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
+        }
     }
 
     
-    uint findRotation(float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
+    const Material& getMaterial()
     {
-        assert(nodeAnim->mNumRotationKeys > 0);
-
-        for (uint i = 0 ; i < nodeAnim->mNumRotationKeys - 1 ; i++) {
-            float t = (float)nodeAnim->mRotationKeys[i + 1].mTime;
-            if (AnimationTimeTicks < t) {
-                return i;
+        for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+            if (m_Materials[i].AmbientColor != glm::vec3(0.0f, 0.0f, 0.0f)) {
+                return m_Materials[i];
             }
         }
-        return 0;
+
+        return m_Materials[0];
     }
 
     
-    void calcInterpolatedRotation(glm::quat& Out, float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
+    /**
+     * @brief Convert the node hierarchy of the scene into the skeleton and map every bone to its joint
+     * 
+     */
+    void initSkeleton()
     {
-        // we need at least two values to interpolate...
-        if (nodeAnim->mNumRotationKeys == 1) {
-            Out = assimpToGlmQuat(nodeAnim->mRotationKeys[0].mValue);
-            return;
+        m_Skeleton = Skeleton();
+        m_Skeleton.GlobalInverseTransform = m_GlobalInverseTransform;
+        addJoint(scene->mRootNode, -1);
+        m_Skeleton.Finalize();
+
+        m_BoneJoints.assign(m_BoneInfo.size(), -1);
+        for (const auto& bone : m_BoneNameToIndexMap) {
+            int joint = m_Skeleton.FindJoint(bone.first);
+            m_BoneJoints[bone.second] = joint;
+            if (joint >= 0) {
+                m_Skeleton.Joints[joint].InverseBindMatrix = m_BoneInfo[bone.second].OffsetMatrix;
+            }
         }
-
-        uint RotationIndex = findRotation(AnimationTimeTicks, nodeAnim);
-        uint NextRotationIndex = RotationIndex + 1;
-        assert(NextRotationIndex < nodeAnim->mNumRotationKeys);
-        float t1 = (float)nodeAnim->mRotationKeys[RotationIndex].mTime;
-        float t2 = (float)nodeAnim->mRotationKeys[NextRotationIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
-        assert(Factor >= 0.0f && Factor <= 1.0f);
-        glm::quat StartRotationQ = assimpToGlmQuat(nodeAnim->mRotationKeys[RotationIndex].mValue);
-	    glm::quat EndRotationQ = assimpToGlmQuat(nodeAnim->mRotationKeys[NextRotationIndex].mValue);
-        Out = glm::slerp(StartRotationQ, EndRotationQ, Factor);
     }
 
     
-    uint findScaling(float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
+    // The nodes of the scene are not sheared, their transform can be split into translation, rotation and scale
+    void addJoint(const aiNode* node, int parent)
     {
-        assert(nodeAnim->mNumScalingKeys > 0);
+        Joint joint;
+        joint.Name = node->mName.C_Str();
+        joint.Parent = parent;
+        joint.BindPose = JointPose::FromMatrix(assimpToGlmMatrix4x4(node->mTransformation));
 
-        
-        for (uint i = 0 ; i < nodeAnim->mNumScalingKeys - 1 ; i++) {
-            float t = (float)nodeAnim->mScalingKeys[i + 1].mTime;
-            if (AnimationTimeTicks < t) {
-                return i;
-            }
+        int index = (int)m_Skeleton.Joints.size();
+        m_Skeleton.Joints.push_back(joint);
+
+        for (uint i = 0 ; i < node->mNumChildren ; i++) {
+            addJoint(node->mChildren[i], index);
         }
-        return 0;
     }
 
     
-    void calcInterpolatedScaling(glm::vec3& Out, float AnimationTimeTicks, const aiNodeAnim* nodeAnim)
+    /**
+     * @brief Convert the animations of the scene into clips, with the times in seconds
+     * 
+     */
+    void initAnimations()
     {
-        // we need at least two values to interpolate...
-        if (nodeAnim->mNumScalingKeys == 1) {
-            Out = assimpToGlmVec3(nodeAnim->mScalingKeys[0].mValue);
-            return;
-        }
+        m_Clips.clear();
+        m_Clips.resize(scene->mNumAnimations);
+
+        for (uint a = 0 ; a < scene->mNumAnimations ; a++) {
+            const aiAnimation* animation = scene->mAnimations[a];
+            float TicksPerSecond = (float)(animation->mTicksPerSecond != 0 ? animation->mTicksPerSecond : 25.0f);
+
+            AnimationClip& clip = m_Clips[a];
+            clip.Name = animation->mName.C_Str();
+            clip.Duration = (float)animation->mDuration / TicksPerSecond;
+
+            for (uint i = 0 ; i < animation->mNumChannels ; i++) {
+                const aiNodeAnim* nodeAnim = animation->mChannels[i];
+                int joint = m_Skeleton.FindJoint(nodeAnim->mNodeName.C_Str());
+                if (joint < 0) {
+                    continue;
+                }
 
-        uint ScalingIndex = findScaling(AnimationTimeTicks, nodeAnim);
-        uint NextScalingIndex = ScalingIndex + 1;
-        assert(NextScalingIndex < nodeAnim->mNumScalingKeys);
-        float t1 = (float)nodeAnim->mScalingKeys[ScalingIndex].mTime;
-        float t2 = (float)nodeAnim->mScalingKeys[NextScalingIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - (float)t1) / DeltaTime;
-        if (Factor < 0.0f || Factor > 1.0f){
-            std::cout << "Factor " << Factor << " t1 " << t1 << " t2 " << t2 << " deltaTime " << DeltaTime << " animationTicks " << AnimationTimeTicks << std::endl;
+                addChannel(clip, joint, AnimationPath::Translation, nodeAnim->mPositionKeys, nodeAnim->mNumPositionKeys, TicksPerSecond,
+                           [](const aiVector3D& v) { return glm::vec4(v.x, v.y, v.z, 0.0f); });
+                addChannel(clip, joint, AnimationPath::Rotation, nodeAnim->mRotationKeys, nodeAnim->mNumRotationKeys, TicksPerSecond,
+                           [](const aiQuaternion& q) { return glm::vec4(q.x, q.y, q.z, q.w); });
+                addChannel(clip, joint, AnimationPath::Scale, nodeAnim->mScalingKeys, nodeAnim->mNumScalingKeys, TicksPerSecond,
+                           [](const aiVector3D& v) { return glm::vec4(v.x, v.y, v.z, 0.0f); });
+            }
         }
-        assert(Factor >= 0.0f && Factor <= 1.0f);
-        glm::vec3 Start = assimpToGlmVec3(nodeAnim->mScalingKeys[ScalingIndex].mValue);
-        glm::vec3 End = assimpToGlmVec3(nodeAnim->mScalingKeys[NextScalingIndex].mValue);
-        Out = glm::mix(Start, End, Factor);
     }
 
     
-    void readNodeHierarchy(float AnimationTimeTicks, const aiNode* node, const glm::mat4& parentTransform)
+    template<typename Key, typename Convert>
+    static void addChannel(AnimationClip& clip, int joint, AnimationPath path, const Key* keys, uint numKeys, float TicksPerSecond, Convert convert)
     {
-        std::string NodeName(node->mName.data);
-
-        const aiAnimation* animation = scene->mAnimations[0];
-
-        glm::mat4 NodeTransformation = assimpToGlmMatrix4x4(node->mTransformation);
-
-        const aiNodeAnim* nodeAnim = findNodeAnim(animation, NodeName);
-
-        
-        if (nodeAnim) {
-            // Interpolate scaling and generate scaling transformation matrix
-            glm::vec3 Scaling;
-            calcInterpolatedScaling(Scaling, AnimationTimeTicks, nodeAnim);
-
-            glm::mat4 ScalingM = glm::mat4(1.0f);
-            ScalingM = glm::scale(ScalingM, Scaling);
-
-            // Interpolate rotation and generate rotation transformation matrix
-            glm::quat RotationQ;
-            calcInterpolatedRotation(RotationQ, AnimationTimeTicks, nodeAnim);
-            glm::mat4 RotationM = glm::toMat4(RotationQ);
-            
-            // Interpolate translation and generate translation transformation matrix
-            glm::vec3 Translation;
-            calcInterpolatedPosition(Translation, AnimationTimeTicks, nodeAnim);
-            glm::mat4 TranslationM = glm::mat4(1.0f);
-            TranslationM = glm::translate(TranslationM, Translation);
-
-            // Combine the above transformations
-            NodeTransformation = TranslationM * RotationM * ScalingM;
-        }
-        
-
-        glm::mat4 GlobalTransformation = parentTransform * NodeTransformation;
-
-        if (m_BoneNameToIndexMap.find(NodeName) != m_BoneNameToIndexMap.end()) {
-            uint BoneIndex = m_BoneNameToIndexMap[NodeName];
-            m_BoneInfo[BoneIndex].FinalTransformation = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].OffsetMatrix;
+        if (numKeys == 0) {
+            return;
         }
 
-        for (uint i = 0 ; i < node->mNumChildren ; i++) {
-            readNodeHierarchy(AnimationTimeTicks, node->mChildren[i], GlobalTransformation);
+        AnimationChannel channel;
+        channel.Joint = (unsigned int)joint;
+        channel.Path = path;
+        channel.Interpolation = AnimationInterpolation::Linear;
+        channel.Times.resize(numKeys);
+        channel.Values.resize(numKeys);
+        for (uint k = 0 ; k < numKeys ; k++) {
+            channel.Times[k] = (float)keys[k].mTime / TicksPerSecond;
+            channel.Values[k] = convert(keys[k].mValue);
         }
+        clip.Channels.push_back(std::move(channel));
     }
 
     
-    void getBoneTransforms(float TimeInSeconds, std::vector<glm::mat4>& Transforms)
-    {
-        glm::mat4 Identity = glm::mat4(1.0f);
-        //std::cout << scene->mNumAnimations << std::endl;
-
-        float TicksPerSecond = (float)(scene->mAnimations[0]->mTicksPerSecond != 0 ? scene->mAnimations[0]->mTicksPerSecond : 25.0f);
-        float TimeInTicks = TimeInSeconds * TicksPerSecond;
-        float AnimationTimeTicks = fmod(TimeInTicks, (float)scene->mAnimations[0]->mDuration);
+    const std::vector<AnimationClip>& getClips() const { return m_Clips; }
 
-        //std::cout << "duration " << (float)scene->mAnimations[0]->mDuration << " ticksPerSecond " << scene->mAnimations[0]->mTicksPerSecond << std::endl;
-        //std::cout << "timeInSeconds " << TimeInSeconds << " ticksPerSecond " << TicksPerSecond << " timeInTicks " << TimeInTicks << " AnimationTimeTicks " << AnimationTimeTicks << std::endl;
-
-        readNodeHierarchy(AnimationTimeTicks, scene->mRootNode, Identity);
-        Transforms.resize(m_BoneInfo.size());
-
-        for (uint i = 0 ; i < m_BoneInfo.size() ; i++) {
-            Transforms[i] = m_BoneInfo[i].FinalTransformation;
-        }
-    }
     
-
-    const aiNodeAnim* findNodeAnim(const aiAnimation* animation, const std::string& nodeName)
+    /**
+     * @brief Skinning matrix of every bone for the first animation, looped, at the given time
+     * 
+     */
+    void getBoneTransforms(float TimeInSeconds, std::vector<glm::mat4>& Transforms)
     {
-        for (uint i = 0 ; i < animation->mNumChannels ; i++) {
-            const aiNodeAnim* nodeAnim = animation->mChannels[i];
-
-            if (std::string(nodeAnim->mNodeName.data) == nodeName) {
-                return nodeAnim;
-            }
+        m_Skeleton.GetBindPose(m_Pose);
+        if (!m_Clips.empty()) {
+            m_Clips[0].SamplePose(TimeInSeconds, m_Pose);
         }
+        m_Skeleton.ComputeSkinningMatrices(m_Pose, m_JointMatrices);
 
-        return NULL;
+        Transforms.resize(m_BoneJoints.size());
+        for (uint i = 0 ; i < m_BoneJoints.size() ; i++) {
+            Transforms[i] = m_BoneJoints[i] >= 0 ? m_JointMatrices[m_BoneJoints[i]] : glm::mat4(0.0f);
+        }
     }
 
 };
@@ -0,0 +1,142 @@
+// Bounding volumes of the meshes, used by the culling and the selection of the levels of detail.
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+
+struct BoundingSphere
+{
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+};
+
+
+/**
+ * @brief Axis aligned bounding box, empty until a point is added
+ *
+ */
+struct BoundingBox
+{
+    glm::vec3 Min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 Max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool IsEmpty() const { return Min.x > Max.x; }
+
+    glm::vec3 GetCenter() const { return (Min + Max) * 0.5f; }
+
+    glm::vec3 GetExtent() const { return (Max - Min) * 0.5f; }
+
+    void Add(const glm::vec3& p)
+    {
+        Min = glm::min(Min, p);
+        Max = glm::max(Max, p);
+    }
+
+    void Add(const BoundingBox& box)
+    {
+        if (!box.IsEmpty()) {
+            Min = glm::min(Min, box.Min);
+            Max = glm::max(Max, box.Max);
+        }
+    }
+
+    /**
+     * @brief Box around this box transformed by an affine matrix (Arvo), larger than the transformed box itself
+     */
+    BoundingBox Transform(const glm::mat4& m) const
+    {
+        if (IsEmpty()) {
+            return *this;
+        }
+
+        glm::vec3 center = glm::vec3(m * glm::vec4(GetCenter(), 1.0f));
+        glm::vec3 extent = GetExtent();
+        glm::vec3 newExtent = glm::abs(glm::vec3(m[0])) * extent.x
+                            + glm::abs(glm::vec3(m[1])) * extent.y
+                            + glm::abs(glm::vec3(m[2])) * extent.z;
+
+        BoundingBox result;
+        result.Min = center - newExtent;
+        result.Max = center + newExtent;
+        return result;
+    }
+
+    /**
+     * @brief Sphere around the box, centered on the box
+     */
+    BoundingSphere GetSphere() const
+    {
+        BoundingSphere sphere;
+        if (!IsEmpty()) {
+            sphere.Center = GetCenter();
+            sphere.Radius = glm::length(GetExtent());
+        }
+        return sphere;
+    }
+};
+
+
+/**
+ * @brief Bounding box of an array of points
+ */
+inline BoundingBox computeBoundingBox(const glm::vec3* positions, unsigned int count)
+{
+    BoundingBox box;
+    for (unsigned int i = 0 ; i < count ; i++) {
+        box.Add(positions[i]);
+    }
+    return box;
+}
+
+
+/**
+ * @brief Sphere centered on the bounding box of the points, with the distance to the farthest point as radius.
+ * It is tighter than the sphere around the box.
+ */
+inline BoundingSphere computeBoundingSphere(const glm::vec3* positions, unsigned int count, const BoundingBox& box)
+{
+    BoundingSphere sphere;
+    sphere.Center = box.GetCenter();
+    for (unsigned int i = 0 ; i < count ; i++) {
+        sphere.Radius = std::max(sphere.Radius, glm::length(positions[i] - sphere.Center));
+    }
+    return sphere;
+}
+
+
+/**
+ * @brief Projected diameter of a sphere, as a fraction of the viewport height
+ *
+ * @param viewCenter the center of the sphere in view space
+ */
+inline float projectedScreenSize(const glm::vec3& viewCenter, float radius, const glm::mat4& projection)
+{
+    // Inside the sphere, it covers the whole screen
+    float distance = glm::length(viewCenter);
+    if (distance <= radius) {
+        return 1.0f;
+    }
+
+    return radius * std::fabs(projection[1][1]) / distance;
+}
+
+
+/**
+ * @brief Projected diameter of the sphere around a box in world space, as a fraction of the viewport height
+ */
+inline float projectedScreenSize(const BoundingBox& box, const glm::mat4& view, const glm::mat4& projection)
+{
+    if (box.IsEmpty()) {
+        return 0.0f;
+    }
+    return projectedScreenSize(glm::vec3(view * glm::vec4(box.GetCenter(), 1.0f)), glm::length(box.GetExtent()), projection);
+}
+
+
+#endif
@@ -0,0 +1,261 @@
+// Per-draw data: the model matrix, the colors of the material and the bone palette are written in a persistently
+// mapped buffer, cut in three segments so that the CPU writes one frame while the GPU still reads the two previous ones.
+// Each draw gets its own range of the segment, bound with glBindBufferRange to the blocks of the shaders,
+// so the data is written once by the CPU with no copy by the driver and no implicit synchronization.
+
+#ifndef DRAW_UNIFORMS_H
+#define DRAW_UNIFORMS_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+
+// binding points of the DrawUniforms and BonePalette blocks, see the "binding" of the blocks in the shaders
+#define DRAW_UNIFORM_BINDING 1
+#define BONE_PALETTE_BINDING 2
+
+// size of the gBones array of the skinning shaders
+#define MAX_PALETTE_BONES 100
+
+
+struct DynamicRingStatistics
+{
+    unsigned int Frames = 0;
+    unsigned long Allocations = 0;
+    size_t BytesWritten = 0;
+    unsigned int SegmentWaits = 0;      // a segment was still read by the GPU when the CPU came back to it
+    double WaitMs = 0.0;
+    unsigned int Overflows = 0;         // frames that needed more than one segment
+
+    void Reset() { *this = DynamicRingStatistics(); }
+};
+
+
+/**
+ * @brief Ring of three segments in one persistently and coherently mapped buffer, with a fence per segment.
+ * The buffer stays mapped as long as the context.
+ *
+ */
+class DynamicRing
+{
+public:
+    struct Allocation {
+        void* Pointer = NULL;
+        GLintptr Offset = 0;
+        GLsizeiptr Size = 0;
+    };
+
+    DynamicRing() {}
+
+    DynamicRing(const DynamicRing&) = delete;
+    DynamicRing& operator=(const DynamicRing&) = delete;
+
+    /**
+     * @brief Create and map the buffer
+     *
+     * @param segmentSize bytes written per frame, a frame that needs more moves to the next segment
+     */
+    void init(GLsizeiptr segmentSize)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_Alignment = std::max(alignment, 16);
+        m_SegmentSize = (segmentSize + m_Alignment - 1) / m_Alignment * m_Alignment;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &m_Buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+        glBufferStorage(GL_UNIFORM_BUFFER, m_SegmentSize * NUM_SEGMENTS, NULL, flags);
+        m_Mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, m_SegmentSize * NUM_SEGMENTS, flags);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        m_Segment = 0;
+        m_Offset = 0;
+        m_SegmentsInFrame = 1;
+    }
+
+    /**
+     * @brief Start the data of a new frame in the next segment
+     *
+     */
+    void beginFrame()
+    {
+        nextSegment();
+        m_SegmentsInFrame = 1;
+        m_Statistics.Frames++;
+    }
+
+    /**
+     * @brief Reserve a range of the current segment, aligned for glBindBufferRange
+     *
+     */
+    Allocation allocate(GLsizeiptr size)
+    {
+        Allocation allocation;
+        if (m_Mapped == NULL || size > m_SegmentSize) {
+            return allocation;
+        }
+        if (m_Offset + size > m_SegmentSize) {
+            nextSegment();
+            if (++m_SegmentsInFrame == 2) {
+                m_Statistics.Overflows++;
+            }
+        }
+
+        allocation.Offset = m_Segment * m_SegmentSize + m_Offset;
+        allocation.Pointer = m_Mapped + allocation.Offset;
+        allocation.Size = size;
+        m_Offset += (size + m_Alignment - 1) / m_Alignment * m_Alignment;
+
+        m_Statistics.Allocations++;
+        m_Statistics.BytesWritten += size;
+        return allocation;
+    }
+
+    GLuint getBuffer() const { return m_Buffer; }
+
+    DynamicRingStatistics& getStatistics() { return m_Statistics; }
+
+private:
+    static const unsigned int NUM_SEGMENTS = 3;
+
+    GLuint m_Buffer = 0;
+    unsigned char* m_Mapped = NULL;
+    GLsizeiptr m_SegmentSize = 0;
+    GLint m_Alignment = 256;
+    GLsync m_Fences[NUM_SEGMENTS] = { 0, 0, 0 };
+    unsigned int m_Segment = 0;
+    GLsizeiptr m_Offset = 0;
+    unsigned int m_SegmentsInFrame = 1;
+    DynamicRingStatistics m_Statistics;
+
+    // The draws issued so far read the current segment, it is written again once its fence is signaled
+    void nextSegment()
+    {
+        if (m_Mapped == NULL) {
+            return;
+        }
+        if (m_Fences[m_Segment]) {
+            glDeleteSync(m_Fences[m_Segment]);
+        }
+        m_Fences[m_Segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_Segment = (m_Segment + 1) % NUM_SEGMENTS;
+        m_Offset = 0;
+
+        GLsync& fence = m_Fences[m_Segment];
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                auto start = std::chrono::steady_clock::now();
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+                m_Statistics.SegmentWaits++;
+                m_Statistics.WaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+};
+
+
+// Layout of the DrawUniforms block (std140)
+struct DrawUniformData
+{
+    glm::mat4 Model = glm::mat4(1.0f);
+    glm::vec4 AmbientColor = glm::vec4(0.0f);
+    glm::vec4 DiffuseColor = glm::vec4(0.0f);
+    glm::vec4 SpecularColor = glm::vec4(0.0f);
+};
+
+
+/**
+ * @brief The data of the draws of the skinning and static programs: the model matrix and the material are set
+ * by the renderers and written in the ring by bind, just before the draws that use them
+ *
+ */
+class DrawUniforms
+{
+public:
+    // 1 MiB per frame, a frame of the streamed world with a few thousands of draws fits in it
+    void init(GLsizeiptr segmentSize = 1 << 20) { m_Ring.init(segmentSize); }
+
+    void beginFrame()
+    {
+        m_Ring.beginFrame();
+        m_Dirty = true;
+    }
+
+    void setModel(const glm::mat4& model)
+    {
+        m_Dirty = m_Dirty || model != m_Data.Model;
+        m_Data.Model = model;
+    }
+
+    void setMaterial(const glm::vec3& ambientColor, const glm::vec3& diffuseColor, const glm::vec3& specularColor)
+    {
+        glm::vec4 ambient(ambientColor, 1.0f), diffuse(diffuseColor, 1.0f), specular(specularColor, 1.0f);
+        m_Dirty = m_Dirty || ambient != m_Data.AmbientColor || diffuse != m_Data.DiffuseColor || specular != m_Data.SpecularColor;
+        m_Data.AmbientColor = ambient;
+        m_Data.DiffuseColor = diffuse;
+        m_Data.SpecularColor = specular;
+    }
+
+    /**
+     * @brief Write the bone palette and bind it, the following skinned draws use it until the next one
+     *
+     */
+    void setBones(const std::vector<glm::mat4>& transforms)
+    {
+        DynamicRing::Allocation allocation = m_Ring.allocate(sizeof(glm::mat4) * MAX_PALETTE_BONES);
+        if (allocation.Pointer == NULL) {
+            return;
+        }
+        size_t numBones = std::min(transforms.size(), (size_t)MAX_PALETTE_BONES);
+        std::memcpy(allocation.Pointer, transforms.data(), sizeof(glm::mat4) * numBones);
+        std::memset((glm::mat4*)allocation.Pointer + numBones, 0, sizeof(glm::mat4) * (MAX_PALETTE_BONES - numBones));
+        glBindBufferRange(GL_UNIFORM_BUFFER, BONE_PALETTE_BINDING, m_Ring.getBuffer(), allocation.Offset, allocation.Size);
+    }
+
+    /**
+     * @brief Write the model matrix and the material in a new range of the ring if they changed since the last draw,
+     * called by the renderers before their draws
+     *
+     */
+    void bind()
+    {
+        if (!m_Dirty) {
+            return;
+        }
+        DynamicRing::Allocation allocation = m_Ring.allocate(sizeof(DrawUniformData));
+        if (allocation.Pointer == NULL) {
+            return;
+        }
+        std::memcpy(allocation.Pointer, &m_Data, sizeof(DrawUniformData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_UNIFORM_BINDING, m_Ring.getBuffer(), allocation.Offset, allocation.Size);
+        m_Dirty = false;
+    }
+
+    DynamicRingStatistics& getStatistics() { return m_Ring.getStatistics(); }
+
+private:
+    DynamicRing m_Ring;
+    DrawUniformData m_Data;
+    bool m_Dirty = true;
+};
+
+
+inline DrawUniforms& getDrawUniforms()
+{
+    static DrawUniforms drawUniforms;
+    return drawUniforms;
+}
+
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+
+/**
+ * @brief View frustum as 6 planes pointing inside, extracted from a view-projection matrix (Gribb, Hartmann)
+ *
+ */
+class Frustum
+{
+public:
+    glm::vec4 Planes[6];
+
+    Frustum() {}
+
+    Frustum(const glm::mat4& viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection);
+
+        Planes[0] = m[3] + m[0];  // left
+        Planes[1] = m[3] - m[0];  // right
+        Planes[2] = m[3] + m[1];  // bottom
+        Planes[3] = m[3] - m[1];  // top
+        Planes[4] = m[3] + m[2];  // near
+        Planes[5] = m[3] - m[2];  // far
+
+        for (int i = 0 ; i < 6 ; i++) {
+            Planes[i] /= glm::length(glm::vec3(Planes[i]));
+        }
+    }
+
+    bool IsSphereVisible(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0 ; i < 6 ; i++) {
+            if (glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether an axis aligned box is inside or intersects the frustum, tested with its corner the farthest along each plane
+     */
+    bool IsBoxVisible(const glm::vec3& min, const glm::vec3& max) const
+    {
+        for (int i = 0 ; i < 6 ; i++) {
+            glm::vec3 normal = glm::vec3(Planes[i]);
+            glm::vec3 corner = glm::vec3(normal.x >= 0.0f ? max.x : min.x,
+                                         normal.y >= 0.0f ? max.y : min.y,
+                                         normal.z >= 0.0f ? max.z : min.z);
+            if (glm::dot(normal, corner) + Planes[i].w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+#endif
@@ -0,0 +1,1137 @@
+// Native loader of the binary glTF 2.0 files (.glb), that bypasses assimp.
+// The file is memory-mapped and, since the accessors of glTF describe their data exactly like glVertexAttribPointer,
+// the vertex and index data is uploaded once from the mapping and used in place. Only the sparse accessors and the texture
+// coordinates are converted: the images are flipped like the other textures of the engine, so the coordinates are flipped too.
+// Specification: https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html
+
+#ifndef GLTF_OBJECT_H
+#define GLTF_OBJECT_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <rapidjson/document.h>
+
+#include "../shader.h"
+#include "../utils/virtual_file_system.h"
+#include "../utils/memory_report.h"
+
+#include "utils.h"
+#include "bounds.h"
+#include "material.h"
+#include "texture.h"
+#include "resource_manager.h"
+#include "skeleton.h"
+#include "draw_uniforms.h"
+
+#define GLB_MAGIC 0x46546C67        // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A   // "JSON"
+#define GLB_CHUNK_BIN 0x004E4942    // "BIN"
+
+#define GLTF_POSITION_LOCATION      0
+#define GLTF_TEX_COORD_LOCATION     1
+#define GLTF_NORMAL_LOCATION        2
+#define GLTF_JOINTS_LOCATION        3   // first bone ids of the skinning shader
+#define GLTF_WEIGHTS_LOCATION       6   // first bone weights of the skinning shader
+
+
+class GltfObject
+{
+private:
+    struct Accessor {
+        size_t Offset = 0;          // in the binary chunk
+        size_t Stride = 0;
+        GLenum ComponentType = GL_FLOAT;
+        unsigned int NumComponents = 1;
+        unsigned int Count = 0;
+        bool Normalized = false;
+        bool Direct = false;        // the data can be used in place, without conversion
+    };
+
+    struct Primitive {
+        GLuint VAO = 0;
+        GLenum Mode = GL_TRIANGLES;
+        unsigned int Count = 0;
+        bool Indexed = false;
+        GLenum IndexType = GL_UNSIGNED_INT;
+        size_t IndexOffset = 0;     // in the index buffer
+        int MaterialIndex = -1;
+    };
+
+    struct MeshRange {
+        unsigned int FirstPrimitive = 0;
+        unsigned int NumPrimitives = 0;
+        BoundingBox Bounds;         // from the min and max of the positions of its primitives
+    };
+
+    // A mesh placed in the scene by a node
+    struct MeshInstance {
+        unsigned int Mesh = 0;
+        glm::mat4 Transform = glm::mat4(1.0f);
+        bool Skinned = false;      // the joints place the vertices, the transform of the node is ignored
+    };
+
+    FileData m_File;
+    rapidjson::Document m_Json;
+    const unsigned char* m_Bin = NULL;
+    size_t m_BinSize = 0;
+
+    GLuint m_Buffer = 0;                        // the part of the binary chunk used by the vertices and indices
+    size_t m_BufferBase = 0;                    // offset of this part in the binary chunk
+    std::vector<GLuint> m_ConvertedBuffers;     // the accessors that could not be used in place
+    size_t m_BufferBytes = 0;                   // size of all the buffers, for the memory report
+
+    std::vector<Primitive> m_Primitives;
+    std::vector<MeshRange> m_Meshes;
+    std::vector<MeshInstance> m_Instances;
+    std::vector<Material> m_Materials;
+    BoundingBox m_BoundingBox;                  // of the instances, in the bind pose for a skinned object
+
+    Skeleton m_Skeleton;
+    std::vector<AnimationClip> m_Clips;
+    std::vector<JointPose> m_Pose;
+
+    bool m_Loaded = false;
+
+
+    // The getters return the default value when the object is not an object, or when its member is missing or of another type
+
+    static size_t getSize(const rapidjson::Value& object, const char* name, size_t defaultValue)
+    {
+        if (!object.IsObject()) {
+            return defaultValue;
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsUint64() ? (size_t)it->value.GetUint64() : defaultValue;
+    }
+
+    static int getInt(const rapidjson::Value& object, const char* name, int defaultValue)
+    {
+        if (!object.IsObject()) {
+            return defaultValue;
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsInt() ? it->value.GetInt() : defaultValue;
+    }
+
+    static float getFloat(const rapidjson::Value& object, const char* name, float defaultValue)
+    {
+        if (!object.IsObject()) {
+            return defaultValue;
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsNumber() ? it->value.GetFloat() : defaultValue;
+    }
+
+    static std::string getString(const rapidjson::Value& object, const char* name)
+    {
+        if (!object.IsObject()) {
+            return std::string();
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsString() ? std::string(it->value.GetString()) : std::string();
+    }
+
+    static void getFloats(const rapidjson::Value& object, const char* name, float* values, unsigned int count)
+    {
+        const rapidjson::Value* array = getArray(object, name);
+        for (unsigned int i = 0 ; array && i < count && i < array->Size() ; i++) {
+            if ((*array)[i].IsNumber()) {
+                values[i] = (*array)[i].GetFloat();
+            }
+        }
+    }
+
+    static const rapidjson::Value* getArray(const rapidjson::Value& object, const char* name)
+    {
+        if (!object.IsObject()) {
+            return NULL;
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsArray() ? &it->value : NULL;
+    }
+
+    static const rapidjson::Value* getObject(const rapidjson::Value& object, const char* name)
+    {
+        if (!object.IsObject()) {
+            return NULL;
+        }
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        return it != object.MemberEnd() && it->value.IsObject() ? &it->value : NULL;
+    }
+
+    // The member is missing when it is optional, or it is an index below count
+    static bool isIndex(const rapidjson::Value& object, const char* name, size_t count, bool required)
+    {
+        rapidjson::Value::ConstMemberIterator it = object.FindMember(name);
+        if (it == object.MemberEnd()) {
+            return !required;
+        }
+        return it->value.IsUint() && it->value.GetUint() < count;
+    }
+
+    // The member is an array of indices below count
+    static bool isIndexArray(const rapidjson::Value& object, const char* name, size_t count)
+    {
+        const rapidjson::Value* array = getArray(object, name);
+        if (!array) {
+            return false;
+        }
+        for (const rapidjson::Value& index : array->GetArray()) {
+            if (!index.IsUint() || index.GetUint() >= count) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Number of elements of an array of the top level, 0 when it is missing
+    size_t getCount(const char* name) const
+    {
+        const rapidjson::Value* array = getArray(m_Json, name);
+        return array ? array->Size() : 0;
+    }
+
+    static unsigned int componentSize(GLenum componentType)
+    {
+        switch (componentType) {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        default: return 4;
+        }
+    }
+
+    static unsigned int numComponents(const std::string& type)
+    {
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4" || type == "MAT2") return 4;
+        if (type == "MAT3") return 9;
+        if (type == "MAT4") return 16;
+        return 1;
+    }
+
+
+public:
+    GltfObject() {}
+
+    ~GltfObject()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        for (Primitive& primitive : m_Primitives) {
+            glDeleteVertexArrays(1, &primitive.VAO);
+        }
+        if (m_Buffer != 0) {
+            glDeleteBuffers(1, &m_Buffer);
+            m_Buffer = 0;
+        }
+        if (!m_ConvertedBuffers.empty()) {
+            glDeleteBuffers((GLsizei)m_ConvertedBuffers.size(), m_ConvertedBuffers.data());
+        }
+
+        m_ConvertedBuffers.clear();
+        m_BufferBytes = 0;
+        m_Primitives.clear();
+        m_Meshes.clear();
+        m_Instances.clear();
+        m_Materials.clear();
+        m_BoundingBox = BoundingBox();
+        m_Skeleton = Skeleton();
+        m_Clips.clear();
+        m_Loaded = false;
+    }
+
+    bool isLoaded() const { return m_Loaded; }
+
+    bool isSkinned() const { return !m_Skeleton.Joints.empty(); }
+
+    const Skeleton& getSkeleton() const { return m_Skeleton; }
+
+    const std::vector<AnimationClip>& getClips() const { return m_Clips; }
+
+    const BoundingBox& getBoundingBox() const { return m_BoundingBox; }
+
+    /**
+     * @brief Request the levels of the streamed textures needed by the object
+     *
+     * @param screenPixels the projected size of the object, in pixels
+     */
+    void requestTextureDetail(float screenPixels)
+    {
+        for (Material& material : m_Materials) {
+            material.RequestTextureDetail(screenPixels);
+        }
+    }
+
+    /**
+     * @brief Load the binary glTF file in path
+     *
+     * @param path the path of the .glb file to load
+     * @return false if the file can not be loaded
+     */
+    bool LoadMesh(const char* path)
+    {
+        Clear();
+
+        auto start = std::chrono::steady_clock::now();
+
+        if (!getVirtualFileSystem().readFile(path, m_File)) {
+            std::cout << "Error opening " << path << std::endl;
+            return false;
+        }
+
+        if (!readChunks(path) || !checkJson(path)) {
+            m_Json.SetNull();
+            m_File.Close();
+            m_Bin = NULL;
+            return false;
+        }
+
+        std::string directory = getDirFromPath(path);
+
+        initMaterials(directory);
+        initMeshes();
+        initNodes();
+        initSkin();
+        initAnimations();
+
+        // Everything was copied to the GPU or converted
+        m_Json.SetNull();
+        m_File.Close();
+        m_Bin = NULL;
+        m_Loaded = true;
+
+        std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Loaded " << path << " in " << loadTime.count() << " ms (glTF: " << m_Primitives.size() << " primitives, "
+                  << m_Skeleton.Joints.size() << " joints, " << m_Clips.size() << " animations)" << std::endl;
+
+        reportMemory(path);
+        return true;
+    }
+
+    /**
+     * @brief Report the memory kept by the object to the memory report
+     *
+     * @param name the name of the object in the report
+     */
+    void reportMemory(const std::string& name) const
+    {
+        size_t cpuBytes = vectorBytes(m_Primitives) + vectorBytes(m_Meshes) + vectorBytes(m_Instances) + vectorBytes(m_Materials)
+                        + vectorBytes(m_ConvertedBuffers) + vectorBytes(m_Pose) + m_Skeleton.GetMemoryBytes();
+        for (const AnimationClip& clip : m_Clips) {
+            cpuBytes += clip.GetMemoryBytes();
+        }
+
+        size_t gpuBytes = m_BufferBytes;
+        for (const Material& material : m_Materials) {
+            gpuBytes += material.GetTextureBytes();
+        }
+        getMemoryReport().setAsset(name, cpuBytes, gpuBytes);
+    }
+
+
+    /**
+     * @brief Check the header of the file and find its JSON and binary chunks
+     *
+     */
+    bool readChunks(const char* path)
+    {
+        const unsigned char* data = m_File.GetData();
+        size_t size = m_File.GetSize();
+
+        uint32_t header[3];
+        if (size < sizeof(header)) {
+            std::cout << "Error parsing " << path << ": not a binary glTF file" << std::endl;
+            return false;
+        }
+        memcpy(header, data, sizeof(header));
+        if (header[0] != GLB_MAGIC || header[1] != 2) {
+            std::cout << "Error parsing " << path << ": not a binary glTF 2.0 file" << std::endl;
+            return false;
+        }
+
+        const char* json = NULL;
+        size_t jsonSize = 0;
+        size_t offset = sizeof(header);
+        while (offset + 8 <= size) {
+            uint32_t chunk[2];
+            memcpy(chunk, data + offset, sizeof(chunk));
+            offset += sizeof(chunk);
+            if (offset + chunk[0] > size) {
+                break;
+            }
+
+            if (chunk[1] == GLB_CHUNK_JSON && json == NULL) {
+                json = (const char*)data + offset;
+                jsonSize = chunk[0];
+            } else if (chunk[1] == GLB_CHUNK_BIN && m_Bin == NULL) {
+                m_Bin = data + offset;
+                m_BinSize = chunk[0];
+            }
+            offset += chunk[0];
+        }
+
+        if (json == NULL || m_Json.Parse(json, jsonSize).HasParseError() || !m_Json.IsObject()) {
+            std::cout << "Error parsing " << path << ": invalid JSON chunk" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+
+    /**
+     * @brief Check the types of the members that the loading indexes directly and the indices between the objects
+     * of the file, so that an invalid file fails to load rather than reading out of the JSON or of the arrays
+     *
+     */
+    bool checkJson(const char* path) const
+    {
+        const char* error = findJsonError();
+        if (error) {
+            std::cout << "Error parsing " << path << ": " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // The first problem of the JSON chunk, NULL when there is none
+    const char* findJsonError() const
+    {
+        static const char* arrays[] = { "accessors", "bufferViews", "images", "textures", "materials", "meshes", "nodes", "skins", "animations" };
+        for (const char* name : arrays) {
+            rapidjson::Value::ConstMemberIterator it = m_Json.FindMember(name);
+            if (it == m_Json.MemberEnd()) {
+                continue;
+            }
+            if (!it->value.IsArray()) {
+                return "a top-level member is not an array";
+            }
+            for (const rapidjson::Value& element : it->value.GetArray()) {
+                if (!element.IsObject()) {
+                    return "an element of a top-level array is not an object";
+                }
+            }
+        }
+
+        size_t numAccessors = getCount("accessors");
+        size_t numViews = getCount("bufferViews");
+        size_t numNodes = getCount("nodes");
+
+        for (unsigned int i = 0 ; i < numAccessors ; i++) {
+            if (!isIndex(m_Json["accessors"][i], "bufferView", numViews, false)) {
+                return "invalid buffer view of an accessor";
+            }
+        }
+        for (unsigned int i = 0 ; i < getCount("images") ; i++) {
+            if (!isIndex(m_Json["images"][i], "bufferView", numViews, false)) {
+                return "invalid buffer view of an image";
+            }
+        }
+
+        for (unsigned int i = 0 ; i < getCount("meshes") ; i++) {
+            const rapidjson::Value* primitives = getArray(m_Json["meshes"][i], "primitives");
+            if (!primitives) {
+                return "a mesh has no primitives";
+            }
+            for (const rapidjson::Value& primitive : primitives->GetArray()) {
+                const rapidjson::Value* attributes = getObject(primitive, "attributes");
+                if (!attributes) {
+                    return "a primitive has no attributes";
+                }
+                for (const auto& attribute : attributes->GetObject()) {
+                    if (!attribute.value.IsUint() || attribute.value.GetUint() >= numAccessors) {
+                        return "invalid accessor of a vertex attribute";
+                    }
+                }
+                if (!isIndex(primitive, "indices", numAccessors, false)) {
+                    return "invalid accessor of the indices of a primitive";
+                }
+            }
+        }
+
+        for (unsigned int i = 0 ; i < numNodes ; i++) {
+            if (m_Json["nodes"][i].HasMember("children") && !isIndexArray(m_Json["nodes"][i], "children", numNodes)) {
+                return "invalid children of a node";
+            }
+        }
+
+        for (unsigned int i = 0 ; i < getCount("skins") ; i++) {
+            const rapidjson::Value& skin = m_Json["skins"][i];
+            if (!isIndexArray(skin, "joints", numNodes) || !isIndex(skin, "inverseBindMatrices", numAccessors, false)) {
+                return "invalid joints of a skin";
+            }
+        }
+
+        for (unsigned int i = 0 ; i < getCount("animations") ; i++) {
+            const rapidjson::Value& animation = m_Json["animations"][i];
+            const rapidjson::Value* samplers = getArray(animation, "samplers");
+            const rapidjson::Value* channels = getArray(animation, "channels");
+            if (!samplers || !channels) {
+                return "an animation has no samplers or no channels";
+            }
+            for (const rapidjson::Value& sampler : samplers->GetArray()) {
+                if (!sampler.IsObject() || !isIndex(sampler, "input", numAccessors, true) || !isIndex(sampler, "output", numAccessors, true)) {
+                    return "invalid accessors of an animation sampler";
+                }
+            }
+            for (const rapidjson::Value& channel : channels->GetArray()) {
+                if (!channel.IsObject() || !isIndex(channel, "sampler", samplers->Size(), true) || !getObject(channel, "target")) {
+                    return "invalid sampler or target of an animation channel";
+                }
+            }
+        }
+        return NULL;
+    }
+
+
+    /**
+     * @brief Offset in the binary chunk of the bytes read at byteOffset in a buffer view
+     *
+     * @return false when the bytes are not all in the view, or the view is not in the binary chunk
+     */
+    bool getViewRange(int view, size_t byteOffset, size_t bytes, size_t& offset) const
+    {
+        const rapidjson::Value* views = getArray(m_Json, "bufferViews");
+        if (!views || view < 0 || view >= (int)views->Size() || m_Bin == NULL) {
+            return false;
+        }
+        size_t viewOffset = getSize((*views)[view], "byteOffset", 0);
+        size_t viewLength = getSize((*views)[view], "byteLength", 0);
+        offset = viewOffset + byteOffset;
+        return viewOffset <= m_BinSize && viewLength <= m_BinSize - viewOffset && byteOffset <= viewLength && bytes <= viewLength - byteOffset;
+    }
+
+
+    Accessor getAccessor(unsigned int index) const
+    {
+        Accessor accessor;
+        const rapidjson::Value* accessors = getArray(m_Json, "accessors");
+        if (!accessors || index >= accessors->Size()) {
+            return accessor;
+        }
+        const rapidjson::Value& a = (*accessors)[index];
+
+        accessor.ComponentType = (GLenum)getInt(a, "componentType", GL_FLOAT);
+        accessor.NumComponents = numComponents(getString(a, "type"));
+        accessor.Count = (unsigned int)getSize(a, "count", 0);
+        accessor.Normalized = a.HasMember("normalized") && a["normalized"].IsBool() && a["normalized"].GetBool();
+        accessor.Stride = componentSize(accessor.ComponentType) * accessor.NumComponents;
+
+        int view = getInt(a, "bufferView", -1);
+        const rapidjson::Value* views = getArray(m_Json, "bufferViews");
+        if (view < 0 || !views || view >= (int)views->Size()) {
+            return accessor;
+        }
+        const rapidjson::Value& v = (*views)[view];
+
+        accessor.Offset = getSize(v, "byteOffset", 0) + getSize(a, "byteOffset", 0);
+        accessor.Stride = getSize(v, "byteStride", accessor.Stride);
+
+        // Only the buffer stored in the binary chunk is supported
+        size_t end = accessor.Count > 0 ? accessor.Offset + accessor.Stride * (accessor.Count - 1) +
+                                          componentSize(accessor.ComponentType) * accessor.NumComponents : accessor.Offset;
+        accessor.Direct = getSize(v, "buffer", 0) == 0 && m_Bin != NULL && end <= m_BinSize && !a.HasMember("sparse");
+        return accessor;
+    }
+
+
+    static float readComponent(const unsigned char* data, GLenum componentType, bool normalized)
+    {
+        switch (componentType) {
+        case GL_BYTE:           { int8_t v; memcpy(&v, data, 1); return normalized ? std::max(v / 127.0f, -1.0f) : v; }
+        case GL_UNSIGNED_BYTE:  { uint8_t v; memcpy(&v, data, 1); return normalized ? v / 255.0f : v; }
+        case GL_SHORT:          { int16_t v; memcpy(&v, data, 2); return normalized ? std::max(v / 32767.0f, -1.0f) : v; }
+        case GL_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, data, 2); return normalized ? v / 65535.0f : v; }
+        case GL_UNSIGNED_INT:   { uint32_t v; memcpy(&v, data, 4); return (float)v; }
+        default:                { float v; memcpy(&v, data, 4); return v; }
+        }
+    }
+
+
+    /**
+     * @brief Read an accessor as floats, applying the normalization and the sparse substitutions
+     *
+     */
+    std::vector<float> readAccessor(unsigned int index) const
+    {
+        if (index >= getCount("accessors")) {
+            return std::vector<float>();
+        }
+        Accessor accessor = getAccessor(index);
+        std::vector<float> values((size_t)accessor.Count * accessor.NumComponents, 0.0f);
+        unsigned int size = componentSize(accessor.ComponentType);
+
+        const rapidjson::Value& a = m_Json["accessors"][index];
+        bool inBin = a.HasMember("bufferView") && m_Bin != NULL;
+
+        for (unsigned int i = 0 ; inBin && i < accessor.Count ; i++) {
+            const unsigned char* element = m_Bin + accessor.Offset + accessor.Stride * i;
+            if (element + size * accessor.NumComponents > m_Bin + m_BinSize) {
+                break;
+            }
+            for (unsigned int c = 0 ; c < accessor.NumComponents ; c++) {
+                values[(size_t)i * accessor.NumComponents + c] = readComponent(element + size * c, accessor.ComponentType, accessor.Normalized);
+            }
+        }
+
+        const rapidjson::Value* sparse = getObject(a, "sparse");
+        const rapidjson::Value* sparseIndices = sparse ? getObject(*sparse, "indices") : NULL;
+        const rapidjson::Value* sparseValues = sparse ? getObject(*sparse, "values") : NULL;
+        if (sparseIndices && sparseValues) {
+            unsigned int count = (unsigned int)getSize(*sparse, "count", 0);
+            GLenum indexType = (GLenum)getInt(*sparseIndices, "componentType", GL_UNSIGNED_INT);
+
+            // The indices and the values are checked against their buffer views like the dense data against the binary chunk
+            size_t indexOffset, valueOffset;
+            if (!getViewRange(getInt(*sparseIndices, "bufferView", -1), getSize(*sparseIndices, "byteOffset", 0),
+                              (size_t)componentSize(indexType) * count, indexOffset) ||
+                !getViewRange(getInt(*sparseValues, "bufferView", -1), getSize(*sparseValues, "byteOffset", 0),
+                              (size_t)size * accessor.NumComponents * count, valueOffset)) {
+                std::cout << "The sparse values of the glTF accessor " << index << " are out of their buffer views" << std::endl;
+                return values;
+            }
+
+            for (unsigned int i = 0 ; i < count ; i++) {
+                unsigned int target = (unsigned int)readComponent(m_Bin + indexOffset + componentSize(indexType) * i, indexType, false);
+                if (target >= accessor.Count) {
+                    continue;
+                }
+                for (unsigned int c = 0 ; c < accessor.NumComponents ; c++) {
+                    values[(size_t)target * accessor.NumComponents + c] =
+                        readComponent(m_Bin + valueOffset + size * (i * accessor.NumComponents + c), accessor.ComponentType, accessor.Normalized);
+                }
+            }
+        }
+
+        return values;
+    }
+
+
+    void initMaterials(const std::string& directory)
+    {
+        const rapidjson::Value* materials = getArray(m_Json, "materials");
+        m_Materials.resize(materials ? materials->Size() : 0);
+        std::map<int, std::shared_ptr<Texture>> textures;     // the materials that use the same texture share it
+
+        for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+            const rapidjson::Value& material = (*materials)[i];
+            Material& m = m_Materials[i];
+
+            float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            float metallic = 1.0f;
+            float roughness = 1.0f;
+            int texture = -1;
+
+            rapidjson::Value::ConstMemberIterator pbr = material.FindMember("pbrMetallicRoughness");
+            if (pbr != material.MemberEnd()) {
+                getFloats(pbr->value, "baseColorFactor", baseColor, 4);
+                metallic = getFloat(pbr->value, "metallicFactor", metallic);
+                roughness = getFloat(pbr->value, "roughnessFactor", roughness);
+                const rapidjson::Value* baseColorTexture = getObject(pbr->value, "baseColorTexture");
+                if (baseColorTexture) texture = getInt(*baseColorTexture, "index", -1);
+            }
+
+            m.AmbientColor = glm::vec3(1.0f, 1.0f, 1.0f);
+            m.DiffuseColor = glm::vec3(baseColor[0], baseColor[1], baseColor[2]);
+            m.PBRmaterial.Color = m.DiffuseColor;
+            m.PBRmaterial.Roughness = roughness;
+            m.PBRmaterial.IsMetal = metallic > 0.5f;
+
+            if (texture >= 0) {
+                if (textures.find(texture) == textures.end()) {
+                    textures[texture] = loadTexture(directory, texture);
+                }
+                m.pDiffuse = textures[texture];
+            }
+        }
+    }
+
+
+    /**
+     * @brief Load the image of a glTF texture, stored in the binary chunk or in a separate file. The separate files
+     * go through the resource manager, so that they are shared with the other objects and streamed like their textures.
+     *
+     */
+    std::shared_ptr<Texture> loadTexture(const std::string& directory, int textureIndex)
+    {
+        const rapidjson::Value* textures = getArray(m_Json, "textures");
+        const rapidjson::Value* images = getArray(m_Json, "images");
+        if (!textures || !images || textureIndex >= (int)textures->Size()) {
+            return std::shared_ptr<Texture>();
+        }
+        int source = getInt((*textures)[textureIndex], "source", -1);
+        if (source < 0 || source >= (int)images->Size()) {
+            return std::shared_ptr<Texture>();
+        }
+        const rapidjson::Value& image = (*images)[source];
+
+        int view = getInt(image, "bufferView", -1);
+        if (view >= 0 && m_Bin != NULL) {
+            const rapidjson::Value& v = m_Json["bufferViews"][view];
+            size_t offset = getSize(v, "byteOffset", 0);
+            size_t length = getSize(v, "byteLength", 0);
+            if (offset + length > m_BinSize) {
+                return std::shared_ptr<Texture>();
+            }
+            // Flipped like the textures loaded from the files (see initMeshes)
+            stbi_set_flip_vertically_on_load(1);
+            std::shared_ptr<Texture> pTexture(new Texture(GL_TEXTURE_2D));
+            pTexture->Load((unsigned int)length, (void*)(m_Bin + offset));
+            return pTexture;
+        }
+
+        std::string uri = getString(image, "uri");
+        std::shared_ptr<Texture> pTexture;
+        // Texture::Load exits on a missing file, a missing image only leaves the material untextured
+        if (!uri.empty() && uri.compare(0, 5, "data:") != 0 && getVirtualFileSystem().exists(directory + "/" + uri)) {
+            pTexture = getResourceManager().loadTexture(directory + "/" + uri, true);
+        }
+        if (!pTexture) {
+            std::cout << "Error loading glTF image " << uri << std::endl;
+        }
+        return pTexture;
+    }
+
+
+    /**
+     * @brief Upload the part of the binary chunk used by the meshes in a single buffer, and describe
+     * the attributes of every primitive in its own VAO, pointing directly into this buffer
+     *
+     */
+    void initMeshes()
+    {
+        const rapidjson::Value* meshes = getArray(m_Json, "meshes");
+        if (!meshes) {
+            return;
+        }
+
+        // The v coordinate of glTF starts at the top of the image, it is converted for the flipped textures
+        static const struct { const char* Name; GLuint Location; bool FlipV; } attributes[] = {
+            { "POSITION",   GLTF_POSITION_LOCATION,  false },
+            { "TEXCOORD_0", GLTF_TEX_COORD_LOCATION, true },
+            { "NORMAL",     GLTF_NORMAL_LOCATION,    false },
+            { "JOINTS_0",   GLTF_JOINTS_LOCATION,    false },
+            { "WEIGHTS_0",  GLTF_WEIGHTS_LOCATION,   false },
+        };
+
+        // Range of the binary chunk used in place by the primitives: the images are not uploaded
+        size_t begin = m_BinSize;
+        size_t end = 0;
+        auto extendRange = [&](int accessorIndex) {
+            Accessor accessor = getAccessor(accessorIndex);
+            if (accessor.Direct && accessor.Count > 0) {
+                begin = std::min(begin, accessor.Offset);
+                end = std::max(end, accessor.Offset + accessor.Stride * (accessor.Count - 1) + componentSize(accessor.ComponentType) * accessor.NumComponents);
+            }
+        };
+        for (const rapidjson::Value& mesh : meshes->GetArray()) {
+            for (const rapidjson::Value& primitive : mesh["primitives"].GetArray()) {
+                for (const auto& attribute : attributes) {
+                    if (!attribute.FlipV && primitive["attributes"].HasMember(attribute.Name)) {
+                        extendRange(primitive["attributes"][attribute.Name].GetInt());
+                    }
+                }
+                if (primitive.HasMember("indices")) {
+                    extendRange(primitive["indices"].GetInt());
+                }
+            }
+        }
+
+        if (begin < end) {
+            m_BufferBase = begin;
+            glGenBuffers(1, &m_Buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+            glBufferStorage(GL_ARRAY_BUFFER, end - begin, m_Bin + begin, 0);
+            m_BufferBytes += end - begin;
+        }
+
+        for (const rapidjson::Value& mesh : meshes->GetArray()) {
+            MeshRange range;
+            range.FirstPrimitive = (unsigned int)m_Primitives.size();
+
+            for (const rapidjson::Value& p : mesh["primitives"].GetArray()) {
+                Primitive primitive;
+                primitive.Mode = (GLenum)getInt(p, "mode", GL_TRIANGLES);
+                primitive.MaterialIndex = getInt(p, "material", -1);
+
+                glGenVertexArrays(1, &primitive.VAO);
+                glBindVertexArray(primitive.VAO);
+
+                for (const auto& attribute : attributes) {
+                    if (!p["attributes"].HasMember(attribute.Name)) {
+                        continue;
+                    }
+                    int accessorIndex = p["attributes"][attribute.Name].GetInt();
+                    Accessor accessor = getAccessor(accessorIndex);
+
+                    if (accessor.Direct && !attribute.FlipV) {
+                        glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+                        glVertexAttribPointer(attribute.Location, accessor.NumComponents, accessor.ComponentType, accessor.Normalized,
+                                              (GLsizei)accessor.Stride, (void*)(accessor.Offset - m_BufferBase));
+                    } else {
+                        std::vector<float> values = readAccessor(accessorIndex);
+                        for (size_t v = 1 ; attribute.FlipV && v < values.size() ; v += accessor.NumComponents) {
+                            values[v] = 1.0f - values[v];
+                        }
+                        glBindBuffer(GL_ARRAY_BUFFER, createConvertedBuffer(GL_ARRAY_BUFFER, values.data(), sizeof(float) * values.size()));
+                        glVertexAttribPointer(attribute.Location, accessor.NumComponents, GL_FLOAT, false, 0, 0);
+                    }
+                    glEnableVertexAttribArray(attribute.Location);
+
+                    if (attribute.Location == GLTF_POSITION_LOCATION) {
+                        primitive.Count = accessor.Count;
+                        range.Bounds.Add(getAccessorBounds(accessorIndex));
+                    }
+                }
+
+                if (p.HasMember("indices")) {
+                    int accessorIndex = p["indices"].GetInt();
+                    Accessor accessor = getAccessor(accessorIndex);
+                    primitive.Indexed = true;
+                    primitive.Count = accessor.Count;
+
+                    if (accessor.Direct && accessor.Stride == componentSize(accessor.ComponentType)) {
+                        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffer);
+                        primitive.IndexType = accessor.ComponentType;
+                        primitive.IndexOffset = accessor.Offset - m_BufferBase;
+                    } else {
+                        std::vector<float> values = readAccessor(accessorIndex);
+                        std::vector<GLuint> indices(values.begin(), values.end());
+                        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, createConvertedBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.data(), sizeof(GLuint) * indices.size()));
+                        primitive.IndexType = GL_UNSIGNED_INT;
+                        primitive.IndexOffset = 0;
+                    }
+                }
+
+                glBindVertexArray(0);
+                m_Primitives.push_back(primitive);
+            }
+
+            range.NumPrimitives = (unsigned int)m_Primitives.size() - range.FirstPrimitive;
+            m_Meshes.push_back(range);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+
+    // The min and max of a position accessor are required by glTF, the box is empty without them
+    BoundingBox getAccessorBounds(int accessorIndex) const
+    {
+        BoundingBox box;
+        const rapidjson::Value& a = m_Json["accessors"][accessorIndex];
+        if (getArray(a, "min") && getArray(a, "max")) {
+            getFloats(a, "min", glm::value_ptr(box.Min), 3);
+            getFloats(a, "max", glm::value_ptr(box.Max), 3);
+        }
+        return box;
+    }
+
+
+    GLuint createConvertedBuffer(GLenum target, const void* data, size_t size)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferStorage(target, std::max(size, (size_t)4), data, 0);
+        m_ConvertedBuffers.push_back(buffer);
+        m_BufferBytes += std::max(size, (size_t)4);
+        return buffer;
+    }
+
+
+    static JointPose getNodePose(const rapidjson::Value& node)
+    {
+        JointPose pose;
+
+        if (node.HasMember("matrix")) {
+            glm::mat4 matrix(1.0f);
+            getFloats(node, "matrix", glm::value_ptr(matrix), 16);
+
+            // The matrices of the nodes are not sheared, they can be split into translation, rotation and scale
+            return JointPose::FromMatrix(matrix);
+        }
+
+        float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        getFloats(node, "translation", glm::value_ptr(pose.Translation), 3);
+        getFloats(node, "rotation", rotation, 4);
+        getFloats(node, "scale", glm::value_ptr(pose.Scale), 3);
+        pose.Rotation = glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]);
+        return pose;
+    }
+
+
+    /**
+     * @brief Global transform of every node of the default scene, and parent of every node
+     *
+     */
+    void computeNodeTransforms(std::vector<glm::mat4>& globalTransforms, std::vector<int>& parents) const
+    {
+        const rapidjson::Value* nodes = getArray(m_Json, "nodes");
+        unsigned int numNodes = nodes ? nodes->Size() : 0;
+        globalTransforms.assign(numNodes, glm::mat4(1.0f));
+        parents.assign(numNodes, -1);
+
+        for (unsigned int n = 0 ; n < numNodes ; n++) {
+            const rapidjson::Value* children = getArray((*nodes)[n], "children");
+            for (unsigned int c = 0 ; children && c < children->Size() ; c++) {
+                unsigned int child = (*children)[c].GetUint();
+                if (child < numNodes) {
+                    parents[child] = (int)n;
+                }
+            }
+        }
+
+        // Walk up to the root for every node, the hierarchies of the glTF files are shallow
+        for (unsigned int n = 0 ; n < numNodes ; n++) {
+            glm::mat4 transform = getNodePose((*nodes)[n]).GetMatrix();
+            unsigned int depth = 0;
+            for (int p = parents[n] ; p >= 0 && depth < numNodes ; p = parents[p], depth++) {
+                transform = getNodePose((*nodes)[p]).GetMatrix() * transform;
+            }
+            globalTransforms[n] = transform;
+        }
+    }
+
+
+    void initNodes()
+    {
+        const rapidjson::Value* nodes = getArray(m_Json, "nodes");
+        if (!nodes) {
+            return;
+        }
+
+        std::vector<glm::mat4> globalTransforms;
+        std::vector<int> parents;
+        computeNodeTransforms(globalTransforms, parents);
+
+        for (unsigned int n = 0 ; n < nodes->Size() ; n++) {
+            int mesh = getInt((*nodes)[n], "mesh", -1);
+            if (mesh < 0 || mesh >= (int)m_Meshes.size()) {
+                continue;
+            }
+
+            MeshInstance instance;
+            instance.Mesh = (unsigned int)mesh;
+            instance.Transform = globalTransforms[n];
+            instance.Skinned = (*nodes)[n].HasMember("skin");
+            m_Instances.push_back(instance);
+            m_BoundingBox.Add(instance.Skinned ? m_Meshes[mesh].Bounds : m_Meshes[mesh].Bounds.Transform(instance.Transform));
+        }
+    }
+
+
+    /**
+     * @brief Convert the first skin of the file into the skeleton of the object
+     *
+     */
+    void initSkin()
+    {
+        const rapidjson::Value* skins = getArray(m_Json, "skins");
+        const rapidjson::Value* nodes = getArray(m_Json, "nodes");
+        if (!skins || skins->Size() == 0 || !nodes) {
+            return;
+        }
+        if (skins->Size() > 1) {
+            std::cout << "Only the first of the " << skins->Size() << " skins is used" << std::endl;
+        }
+        const rapidjson::Value& skin = (*skins)[0];
+        const rapidjson::Value* joints = getArray(skin, "joints");
+        if (!joints) {
+            return;
+        }
+
+        std::vector<glm::mat4> globalTransforms;
+        std::vector<int> parents;
+        computeNodeTransforms(globalTransforms, parents);
+
+        // The joints are indices of nodes, checked by checkJson
+        std::vector<int> nodeToJoint(nodes->Size(), -1);
+        for (unsigned int j = 0 ; j < joints->Size() ; j++) {
+            nodeToJoint[(*joints)[j].GetUint()] = (int)j;
+        }
+
+        std::vector<float> inverseBindMatrices;
+        if (skin.HasMember("inverseBindMatrices")) {
+            inverseBindMatrices = readAccessor(skin["inverseBindMatrices"].GetUint());
+        }
+
+        m_Skeleton.Joints.resize(joints->Size());
+        for (unsigned int j = 0 ; j < joints->Size() ; j++) {
+            unsigned int node = (*joints)[j].GetUint();
+            Joint& joint = m_Skeleton.Joints[j];
+
+            joint.Name = getString((*nodes)[node], "name");
+            joint.BindPose = getNodePose((*nodes)[node]);
+            joint.Parent = parents[node] >= 0 ? nodeToJoint[parents[node]] : -1;
+            if (joint.Parent < 0 && parents[node] >= 0) {
+                joint.RootTransform = globalTransforms[parents[node]];
+            }
+            if (inverseBindMatrices.size() >= (j + 1) * 16) {
+                joint.InverseBindMatrix = glm::make_mat4(&inverseBindMatrices[j * 16]);
+            }
+        }
+
+        m_Skeleton.Finalize();
+        m_Skeleton.GetBindPose(m_Pose);
+
+        if (m_Skeleton.Joints.size() > 100) {
+            std::cout << "The skeleton has " << m_Skeleton.Joints.size() << " joints, the skinning shader supports 100" << std::endl;
+        }
+    }
+
+
+    /**
+     * @brief Convert the animations of the joints into clips, the animations of the other nodes are ignored
+     *
+     */
+    void initAnimations()
+    {
+        const rapidjson::Value* animations = getArray(m_Json, "animations");
+        const rapidjson::Value* skins = getArray(m_Json, "skins");
+        if (!animations || !skins || skins->Size() == 0 || m_Skeleton.Joints.empty()) {
+            return;
+        }
+
+        // The joints are indices of nodes, the samplers of the channels indices of samplers, checked by checkJson
+        const rapidjson::Value& joints = (*skins)[0]["joints"];
+        std::vector<int> nodeToJoint(getCount("nodes"), -1);
+        for (unsigned int j = 0 ; j < joints.Size() ; j++) {
+            nodeToJoint[joints[j].GetUint()] = (int)j;
+        }
+
+        for (const rapidjson::Value& animation : animations->GetArray()) {
+            AnimationClip clip;
+            clip.Name = getString(animation, "name");
+
+            const rapidjson::Value& samplers = animation["samplers"];
+
+            for (const rapidjson::Value& c : animation["channels"].GetArray()) {
+                const rapidjson::Value& target = c["target"];
+                int node = getInt(target, "node", -1);
+                std::string path = getString(target, "path");
+                if (node < 0 || node >= (int)nodeToJoint.size() || nodeToJoint[node] < 0 || path == "weights") {
+                    continue;
+                }
+
+                AnimationChannel channel;
+                channel.Joint = (unsigned int)nodeToJoint[node];
+                channel.Path = path == "rotation" ? AnimationPath::Rotation : path == "scale" ? AnimationPath::Scale : AnimationPath::Translation;
+
+                const rapidjson::Value& sampler = samplers[getInt(c, "sampler", 0)];
+                std::string interpolation = getString(sampler, "interpolation");
+                channel.Interpolation = interpolation == "STEP" ? AnimationInterpolation::Step :
+                                        interpolation == "CUBICSPLINE" ? AnimationInterpolation::CubicSpline : AnimationInterpolation::Linear;
+
+                channel.Times = readAccessor(getInt(sampler, "input", 0));
+
+                unsigned int outputIndex = getInt(sampler, "output", 0);
+                unsigned int size = getAccessor(outputIndex).NumComponents;
+                std::vector<float> values = readAccessor(outputIndex);
+                channel.Values.resize(values.size() / size);
+                for (unsigned int k = 0 ; k < channel.Values.size() ; k++) {
+                    for (unsigned int i = 0 ; i < size && i < 4 ; i++) {
+                        channel.Values[k][i] = values[k * size + i];
+                    }
+                }
+
+                unsigned int keysPerTime = channel.Interpolation == AnimationInterpolation::CubicSpline ? 3 : 1;
+                if (channel.Times.empty() || channel.Values.size() < channel.Times.size() * keysPerTime) {
+                    continue;
+                }
+
+                clip.Duration = std::max(clip.Duration, channel.Times.back());
+                clip.Channels.push_back(std::move(channel));
+            }
+
+            m_Clips.push_back(std::move(clip));
+        }
+    }
+
+
+    /**
+     * @brief Compute the skinning matrices of the first animation at the given time, or of the bind pose without animation
+     *
+     * @param TimeInSeconds the time since the start of the animation
+     * @param Transforms the skinning matrix of every joint
+     */
+    void getBoneTransforms(float TimeInSeconds, std::vector<glm::mat4>& Transforms)
+    {
+        m_Skeleton.GetBindPose(m_Pose);
+        if (!m_Clips.empty()) {
+            m_Clips[0].SamplePose(TimeInSeconds, m_Pose);
+        }
+        m_Skeleton.ComputeSkinningMatrices(m_Pose, Transforms);
+    }
+
+
+    /**
+     * @brief Render the object in the screen, the model matrix of every mesh goes through the per-draw uniforms
+     *
+     * @param model the model matrix of the object, the bones of a skinned object must be set in the per-draw uniforms
+     */
+    void render(const glm::mat4& model)
+    {
+        if (isSkinned()) {
+            // The skinning shader reads 10 bones per vertex, glTF gives the 4 first ones
+            glVertexAttrib4f(GLTF_JOINTS_LOCATION + 1, 0.0f, 0.0f, 0.0f, 0.0f);
+            glVertexAttrib4f(GLTF_JOINTS_LOCATION + 2, 0.0f, 0.0f, 0.0f, 0.0f);
+            glVertexAttrib4f(GLTF_WEIGHTS_LOCATION + 1, 0.0f, 0.0f, 0.0f, 0.0f);
+            glVertexAttrib4f(GLTF_WEIGHTS_LOCATION + 2, 0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        for (const MeshInstance& instance : m_Instances) {
+            getDrawUniforms().setModel(instance.Skinned ? model : model * instance.Transform);
+            getDrawUniforms().bind();
+
+            const MeshRange& mesh = m_Meshes[instance.Mesh];
+            for (unsigned int i = mesh.FirstPrimitive ; i < mesh.FirstPrimitive + mesh.NumPrimitives ; i++) {
+                const Primitive& primitive = m_Primitives[i];
+
+                if (primitive.MaterialIndex >= 0 && primitive.MaterialIndex < (int)m_Materials.size() && m_Materials[primitive.MaterialIndex].pDiffuse) {
+                    m_Materials[primitive.MaterialIndex].pDiffuse->Bind(COLOR_TEXTURE_UNIT);
+                }
+
+                glBindVertexArray(primitive.VAO);
+                if (primitive.Indexed) {
+                    glDrawElements(primitive.Mode, primitive.Count, primitive.IndexType, (void*)primitive.IndexOffset);
+                } else {
+                    glDrawArrays(primitive.Mode, 0, primitive.Count);
+                }
+            }
+        }
+
+        // Make sure the VAO is not changed from the outside
+        glBindVertexArray(0);
+    }
+
+
+    const Material& getMaterial()
+    {
+        static Material defaultMaterial;
+        defaultMaterial.AmbientColor = glm::vec3(1.0f);
+        defaultMaterial.DiffuseColor = glm::vec3(1.0f);
+
+        return m_Materials.empty() ? defaultMaterial : m_Materials[0];
+    }
+};
+
+
+#endif
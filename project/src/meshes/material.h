@@ -3,6 +3,8 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <memory>
+
 #include <glm/glm.hpp>
 
 #include "texture.h"
@@ -25,20 +27,25 @@ class Material {
 
     PBRMaterial PBRmaterial;
 
-    Texture* pDiffuse = NULL; // base color of the material
-    Texture* pSpecularExponent = NULL;
+    // shared with the other materials that use the same files, released with the last of them (see ResourceManager)
+    std::shared_ptr<Texture> pDiffuse; // base color of the material
+    std::shared_ptr<Texture> pSpecularExponent;
 
     Material() {}
 
-    ~Material()
+    size_t GetTextureBytes() const
+    {
+        return (pDiffuse ? pDiffuse->GetGpuBytes() : 0) + (pSpecularExponent ? pSpecularExponent->GetGpuBytes() : 0);
+    }
+
+    // The streamed textures of the material cover about the projected size of the object
+    void RequestTextureDetail(float screenPixels)
     {
-        if (pDiffuse)
-        {
-            free(pDiffuse);
+        if (pDiffuse) {
+            pDiffuse->RequestScreenSize(screenPixels);
         }
-        if (pSpecularExponent)
-        {
-            free(pSpecularExponent);
+        if (pSpecularExponent) {
+            pSpecularExponent->RequestScreenSize(screenPixels);
         }
     }
 };
@@ -0,0 +1,428 @@
+// Material table: the materials of the static and animated objects are stored in one storage buffer indexed per draw,
+// and their textures are referenced by bindless handles (ARB_bindless_texture) or by layers of texture arrays grouped
+// by format and size, so that all the meshes of an object are drawn without changing the texture bindings.
+// The index of the material of a draw is its base instance, read by the vertex shaders through an instanced attribute.
+
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <tuple>
+#include <string>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../shader.h"
+#include "../utils/memory_report.h"
+
+#include "utils.h"
+#include "material.h"
+
+// Binding point of the storage buffer and location of the material index, they must match the shaders
+#define MATERIAL_TABLE_BINDING          5
+#define MATERIAL_INDEX_LOCATION         9
+#define MAX_TABLE_MATERIALS             4096
+#define MAX_TEXTURE_ARRAYS              8
+#define TEXTURE_ARRAY_FIRST_UNIT_INDEX  8
+
+
+enum class MaterialBinding
+{
+    Bind,       // the textures of each mesh are bound before its draw
+    Arrays,     // the textures are layers of texture arrays, bound once per frame
+    Bindless    // the shaders sample the textures through their bindless handles
+};
+
+
+struct MaterialTableStatistics
+{
+    unsigned int Materials = 0;
+    unsigned int Textures = 0;
+    unsigned int Arrays = 0;
+    unsigned int UnplacedTextures = 0;      // no array left for their format and size, sampled as missing
+    unsigned int HandleUpdates = 0;         // handles created again after the streaming reallocated a texture
+    size_t ArrayBytes = 0;
+};
+
+
+/**
+ * @brief Enable the material index attribute on the bound VAO: it reads a buffer of consecutive indices
+ * once per instance, so that a draw of base instance N and of one instance reads N
+ *
+ */
+inline void bindMaterialIndexAttribute()
+{
+    static GLuint buffer = 0;
+    if (buffer == 0) {
+        std::vector<unsigned int> indices(MAX_TABLE_MATERIALS);
+        for (unsigned int i = 0 ; i < MAX_TABLE_MATERIALS ; i++) {
+            indices[i] = i;
+        }
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(MATERIAL_INDEX_LOCATION);
+    glVertexAttribIPointer(MATERIAL_INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0, 0);
+    glVertexAttribDivisor(MATERIAL_INDEX_LOCATION, 1);
+}
+
+
+class MaterialTable
+{
+private:
+    // Layout of a material in the storage buffer (std430), see MaterialRecord in the fragment shaders
+    struct GpuMaterial {
+        glm::vec4 AmbientColor;
+        glm::vec4 DiffuseColor;
+        glm::vec4 SpecularColor;
+        GLuint64 DiffuseHandle;     // uvec2 in the shaders, 0 without texture
+        GLuint64 SpecularHandle;
+        glm::ivec4 Layers;          // array and layer of the diffuse texture, then of the specular texture, -1 without texture
+    };
+
+    // Where the shaders find a texture
+    struct TextureSlot {
+        GLuint Object = 0;          // texture object of the handle, the streaming replaces it when the resident levels change
+        GLuint64 Handle = 0;
+        int Array = -1;
+        int Layer = -1;
+    };
+
+    struct Entry {
+        const Material* pMaterial = NULL;
+        bool Written = false;
+    };
+
+    MaterialBinding m_Mode = MaterialBinding::Bind;
+    GLuint m_Buffer = 0;
+    std::vector<Entry> m_Entries;
+    unsigned int m_NumBuilt = 0;                // the materials added before the last build
+    std::map<const Texture*, TextureSlot> m_Slots;
+    std::set<const Texture*> m_SharedTextures;  // also used outside of the table, they keep their own storage
+    std::vector<GLuint> m_Arrays;
+    MaterialTableStatistics m_Statistics;
+
+public:
+    /**
+     * @brief Choose how the materials reference their textures, before any object is loaded.
+     * The bindless handles fall back to the texture arrays when the driver doesn't support them.
+     *
+     */
+    void setMode(MaterialBinding mode)
+    {
+        if (mode == MaterialBinding::Bindless && !GLAD_GL_ARB_bindless_texture) {
+            std::cout << "ARB_bindless_texture is not supported, the materials use texture arrays" << std::endl;
+            mode = MaterialBinding::Arrays;
+        }
+        m_Mode = mode;
+    }
+
+    MaterialBinding getMode() const { return m_Mode; }
+
+    bool isEnabled() const { return m_Mode != MaterialBinding::Bind; }
+
+    const MaterialTableStatistics& getStatistics() const { return m_Statistics; }
+
+    /**
+     * @brief Add the materials of an object, they must stay at the same address as long as the table is used
+     *
+     * @return the index of the first material in the table, the base instance of the draws of its meshes
+     */
+    unsigned int addMaterials(const std::vector<Material>& materials)
+    {
+        if (!isEnabled()) {
+            return 0;
+        }
+
+        unsigned int first = (unsigned int)m_Entries.size();
+        if (first + materials.size() > MAX_TABLE_MATERIALS) {
+            std::cout << "Error: the material table is full (" << MAX_TABLE_MATERIALS << " materials)" << std::endl;
+            exit(1);
+        }
+        for (const Material& material : materials) {
+            m_Entries.push_back({ &material, false });
+        }
+        return first;
+    }
+
+    /**
+     * @brief Place the textures of the materials added since the last build, in texture arrays or as resident handles,
+     * and write their materials in the storage buffer. Called once the objects are loaded.
+     *
+     */
+    void build()
+    {
+        if (!isEnabled() || m_NumBuilt == m_Entries.size()) {
+            return;
+        }
+
+        if (m_Buffer == 0) {
+            glGenBuffers(1, &m_Buffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GpuMaterial) * MAX_TABLE_MATERIALS, NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        // The handles of the materials of the table, the other handles of a texture are held outside of it
+        std::map<const Texture*, long> uses;
+        for (const Entry& entry : m_Entries) {
+            for (const std::shared_ptr<Texture>* handle : { &entry.pMaterial->pDiffuse, &entry.pMaterial->pSpecularExponent }) {
+                if (*handle) {
+                    uses[handle->get()]++;
+                }
+            }
+        }
+
+        std::vector<Texture*> textures;
+        for (unsigned int i = m_NumBuilt ; i < m_Entries.size() ; i++) {
+            for (const std::shared_ptr<Texture>* handle : { &m_Entries[i].pMaterial->pDiffuse, &m_Entries[i].pMaterial->pSpecularExponent }) {
+                Texture* texture = handle->get();
+                if (texture && m_Slots.find(texture) == m_Slots.end()) {
+                    m_Slots[texture] = TextureSlot();
+                    textures.push_back(texture);
+                    if (handle->use_count() > uses[texture]) {
+                        m_SharedTextures.insert(texture);
+                    }
+                }
+            }
+        }
+
+        if (m_Mode == MaterialBinding::Arrays) {
+            buildArrays(textures);
+        }
+        else {
+            for (Texture* texture : textures) {
+                makeResident(texture, m_Slots[texture]);
+            }
+        }
+
+        m_NumBuilt = (unsigned int)m_Entries.size();
+        m_Statistics.Materials = m_NumBuilt;
+        m_Statistics.Textures = (unsigned int)m_Slots.size();
+        m_Statistics.Arrays = (unsigned int)m_Arrays.size();
+        writeMaterials();
+
+        // The textures keep their own size in the report of their object, the arrays hold the same levels
+        getMemoryReport().setAsset("material table", vectorBytes(m_Entries), sizeof(GpuMaterial) * MAX_TABLE_MATERIALS);
+    }
+
+    /**
+     * @brief Create the handles of the textures that the streaming reallocated since the last frame.
+     * Called once per frame after the texture streamer, never waits.
+     *
+     */
+    void update()
+    {
+        if (m_Mode != MaterialBinding::Bindless) {
+            return;
+        }
+
+        bool changed = false;
+        for (auto& slot : m_Slots) {
+            if (slot.first->GetTexture() != slot.second.Object) {
+                // the handle of the previous texture object was deleted with it
+                makeResident(slot.first, slot.second);
+                m_Statistics.HandleUpdates++;
+                changed = true;
+            }
+        }
+        if (changed) {
+            for (unsigned int i = 0 ; i < m_NumBuilt ; i++) {
+                m_Entries[i].Written = false;
+            }
+            writeMaterials();
+        }
+    }
+
+    /**
+     * @brief Bind the storage buffer and the texture arrays, once per frame instead of once per mesh
+     *
+     */
+    void bind() const
+    {
+        if (!isEnabled() || m_Buffer == 0) {
+            return;
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_TABLE_BINDING, m_Buffer);
+        for (unsigned int i = 0 ; i < m_Arrays.size() ; i++) {
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT_INDEX + i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, m_Arrays[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /**
+     * @brief Set the texture units of the samplers of the arrays in a shader compiled with MATERIAL_TABLE
+     *
+     */
+    void initShader(Shader& shader) const
+    {
+        if (m_Mode != MaterialBinding::Arrays) {
+            return;
+        }
+
+        shader.use();
+        for (unsigned int i = 0 ; i < MAX_TEXTURE_ARRAYS ; i++) {
+            std::string name = "gTextureArrays[" + std::to_string(i) + "]";
+            shader.setInteger(name.c_str(), TEXTURE_ARRAY_FIRST_UNIT_INDEX + i);
+        }
+    }
+
+    /**
+     * @brief Defines of the shaders that read the materials from the table
+     *
+     */
+    std::string getShaderDefines() const
+    {
+        switch (m_Mode) {
+        case MaterialBinding::Arrays: return "#define MATERIAL_TABLE\n";
+        case MaterialBinding::Bindless: return "#define MATERIAL_TABLE\n#define BINDLESS_TEXTURES\n";
+        default: return "";
+        }
+    }
+
+private:
+    void makeResident(const Texture* texture, TextureSlot& slot)
+    {
+        slot.Object = texture->GetTexture();
+        slot.Handle = glGetTextureHandleARB(slot.Object);
+        glMakeTextureHandleResidentARB(slot.Handle);
+    }
+
+    /**
+     * @brief Copy the textures in one array per format, size and number of levels, then release their own storage
+     * unless they are also used outside of the table. The textures that need more arrays than there are texture units
+     * for them are left out.
+     *
+     */
+    void buildArrays(const std::vector<Texture*>& textures)
+    {
+        typedef std::tuple<GLenum, int, int, int> ArrayKey;
+        std::map<ArrayKey, std::vector<Texture*>> groups;
+        for (Texture* texture : textures) {
+            // a streamed texture misses its large levels
+            if (texture->GetResidentLevel() != 0) {
+                m_Statistics.UnplacedTextures++;
+                continue;
+            }
+            groups[ArrayKey(texture->GetInternalFormat(), texture->GetLevelWidth(0), texture->GetLevelHeight(0), texture->GetNumLevels())].push_back(texture);
+        }
+
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        for (const auto& group : groups) {
+            const std::vector<Texture*>& members = group.second;
+            for (size_t first = 0 ; first < members.size() ; first += maxLayers) {
+                if (m_Arrays.size() == MAX_TEXTURE_ARRAYS) {
+                    std::cout << "Warning: more than " << MAX_TEXTURE_ARRAYS << " texture arrays, some textures of the materials are missing" << std::endl;
+                    m_Statistics.UnplacedTextures += (unsigned int)(members.size() - first);
+                    continue;
+                }
+                size_t count = std::min(members.size() - first, (size_t)maxLayers);
+                createArray(std::vector<Texture*>(members.begin() + first, members.begin() + first + count));
+            }
+        }
+    }
+
+    void createArray(const std::vector<Texture*>& layers)
+    {
+        const Texture& model = *layers[0];
+        int numLevels = model.GetNumLevels();
+
+        GLuint array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, numLevels, model.GetInternalFormat(), model.GetLevelWidth(0), model.GetLevelHeight(0), (GLsizei)layers.size());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        for (unsigned int layer = 0 ; layer < layers.size() ; layer++) {
+            Texture* texture = layers[layer];
+            for (int level = 0 ; level < numLevels ; level++) {
+                glCopyImageSubData(texture->GetTexture(), GL_TEXTURE_2D, level, 0, 0, 0,
+                                   array, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                                   texture->GetLevelWidth(level), texture->GetLevelHeight(level), 1);
+                m_Statistics.ArrayBytes += texture->GetLevelBytes(level);
+            }
+            if (m_SharedTextures.find(texture) == m_SharedTextures.end()) {
+                texture->ReleaseStorage();
+            }
+
+            TextureSlot& slot = m_Slots[texture];
+            slot.Array = (int)m_Arrays.size();
+            slot.Layer = (int)layer;
+        }
+
+        m_Arrays.push_back(array);
+    }
+
+    GpuMaterial getGpuMaterial(const Material& material) const
+    {
+        GpuMaterial result;
+        result.AmbientColor = glm::vec4(material.AmbientColor, 1.0f);
+        result.DiffuseColor = glm::vec4(material.DiffuseColor, 1.0f);
+        result.SpecularColor = glm::vec4(material.SpecularColor, 1.0f);
+        result.DiffuseHandle = 0;
+        result.SpecularHandle = 0;
+        result.Layers = glm::ivec4(-1);
+
+        if (material.pDiffuse) {
+            const TextureSlot& slot = m_Slots.at(material.pDiffuse.get());
+            result.DiffuseHandle = slot.Handle;
+            result.Layers.x = slot.Array;
+            result.Layers.y = slot.Layer;
+        }
+        if (material.pSpecularExponent) {
+            const TextureSlot& slot = m_Slots.at(material.pSpecularExponent.get());
+            result.SpecularHandle = slot.Handle;
+            result.Layers.z = slot.Array;
+            result.Layers.w = slot.Layer;
+        }
+        return result;
+    }
+
+    // Upload the materials not written yet, as one range from the first one
+    void writeMaterials()
+    {
+        unsigned int first = 0;
+        while (first < m_NumBuilt && m_Entries[first].Written) {
+            first++;
+        }
+        if (first == m_NumBuilt) {
+            return;
+        }
+
+        std::vector<GpuMaterial> records;
+        for (unsigned int i = first ; i < m_NumBuilt ; i++) {
+            records.push_back(getGpuMaterial(*m_Entries[i].pMaterial));
+            m_Entries[i].Written = true;
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_Buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GpuMaterial) * first, sizeof(GpuMaterial) * records.size(), records.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+
+
+inline MaterialTable& getMaterialTable()
+{
+    static MaterialTable table;
+    return table;
+}
+
+
+#endif
@@ -0,0 +1,548 @@
+// Triangle and vertex reordering run on the index buffers when a mesh is loaded.
+// The vertex cache pass follows "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+// (Sander, Nehab, Barczak - 2007), the overdraw pass and its analysis follow the approach of meshoptimizer
+// (https://github.com/zeux/meshoptimizer).
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#define VERTEX_CACHE_SIZE 16
+#define OVERDRAW_THRESHOLD 1.05f
+#define OVERDRAW_VIEWPORT 256
+
+
+struct VertexCacheStatistics
+{
+    unsigned int VerticesTransformed = 0;
+    unsigned int Triangles = 0;
+    unsigned int Vertices = 0;
+
+    // average cache miss ratio: transformed vertices per triangle (0.5 is the best possible value)
+    float ACMR() const { return Triangles == 0 ? 0.0f : (float)VerticesTransformed / Triangles; }
+
+    // average transform to vertex ratio: transformed vertices per vertex (1.0 is the best possible value)
+    float ATVR() const { return Vertices == 0 ? 0.0f : (float)VerticesTransformed / Vertices; }
+
+    void Add(const VertexCacheStatistics& other)
+    {
+        VerticesTransformed += other.VerticesTransformed;
+        Triangles += other.Triangles;
+        Vertices += other.Vertices;
+    }
+};
+
+
+struct OverdrawStatistics
+{
+    unsigned int PixelsCovered = 0;
+    unsigned int PixelsShaded = 0;
+
+    // shaded fragments per covered pixel (1.0 is the best possible value)
+    float Overdraw() const { return PixelsCovered == 0 ? 0.0f : (float)PixelsShaded / PixelsCovered; }
+
+    void Add(const OverdrawStatistics& other)
+    {
+        PixelsCovered += other.PixelsCovered;
+        PixelsShaded += other.PixelsShaded;
+    }
+};
+
+
+struct MeshOptimizationStatistics
+{
+    VertexCacheStatistics CacheBefore;
+    VertexCacheStatistics CacheAfter;
+    OverdrawStatistics OverdrawBefore;
+    OverdrawStatistics OverdrawAfter;
+
+    void Print(const char* name) const
+    {
+        std::cout << "Mesh optimization of " << name << ":" << std::endl;
+        std::cout << "  ACMR " << CacheBefore.ACMR() << " -> " << CacheAfter.ACMR()
+                  << ", ATVR " << CacheBefore.ATVR() << " -> " << CacheAfter.ATVR()
+                  << ", overdraw " << OverdrawBefore.Overdraw() << " -> " << OverdrawAfter.Overdraw() << std::endl;
+    }
+};
+
+
+/**
+ * @brief Update a FIFO cache simulated with timestamps with the vertices of a triangle
+ *
+ * @return the number of vertices that missed the cache
+ */
+inline unsigned int updateVertexCache(const unsigned int* triangle, std::vector<unsigned int>& timestamps, unsigned int& timestamp, unsigned int cacheSize)
+{
+    unsigned int misses = 0;
+
+    for (int k = 0 ; k < 3 ; k++) {
+        unsigned int v = triangle[k];
+        if (timestamp - timestamps[v] > cacheSize) {
+            timestamps[v] = timestamp++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+
+/**
+ * @brief Simulate a FIFO post-transform vertex cache on an index buffer
+ *
+ * @param indices the triangle list, indices are local to the mesh
+ * @param numIndices the number of indices (multiple of 3)
+ * @param numVertices the number of vertices of the mesh
+ */
+inline VertexCacheStatistics analyzeVertexCache(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStatistics stats;
+    std::vector<unsigned int> timestamps(numVertices, 0);
+    std::vector<bool> referenced(numVertices, false);
+    unsigned int timestamp = cacheSize + 1;
+
+    for (unsigned int i = 0 ; i + 2 < numIndices ; i += 3) {
+        stats.VerticesTransformed += updateVertexCache(&indices[i], timestamps, timestamp, cacheSize);
+        stats.Triangles++;
+    }
+
+    for (unsigned int i = 0 ; i < numIndices ; i++) {
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            stats.Vertices++;
+        }
+    }
+
+    return stats;
+}
+
+
+/**
+ * @brief Rasterize the mesh from the 6 axis-aligned directions with early depth test and count
+ * the covered pixels and the shaded fragments. The result depends on the triangle order.
+ */
+inline OverdrawStatistics analyzeOverdraw(const unsigned int* indices, unsigned int numIndices, const glm::vec3* positions)
+{
+    OverdrawStatistics stats;
+
+    if (numIndices == 0) {
+        return stats;
+    }
+
+    glm::vec3 minP(std::numeric_limits<float>::max());
+    glm::vec3 maxP(-std::numeric_limits<float>::max());
+    for (unsigned int i = 0 ; i < numIndices ; i++) {
+        minP = glm::min(minP, positions[indices[i]]);
+        maxP = glm::max(maxP, positions[indices[i]]);
+    }
+    glm::vec3 extent = maxP - minP;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    scale = scale > 0.0f ? (OVERDRAW_VIEWPORT - 1) / scale : 0.0f;
+
+    const int N = OVERDRAW_VIEWPORT;
+    std::vector<float> depth(2 * N * N);
+    std::vector<unsigned int> shaded(2 * N * N);
+
+    for (int axis = 0 ; axis < 3 ; axis++) {
+        std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+        std::fill(shaded.begin(), shaded.end(), 0);
+
+        for (unsigned int i = 0 ; i + 2 < numIndices ; i += 3) {
+            glm::vec3 p[3];
+            for (int k = 0 ; k < 3 ; k++) {
+                glm::vec3 v = (positions[indices[i + k]] - minP) * scale;
+                p[k] = glm::vec3(v[(axis + 1) % 3], v[(axis + 2) % 3], v[axis]);
+            }
+
+            float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+            if (area == 0.0f) {
+                continue;
+            }
+
+            // Triangles facing +axis are seen from the +axis side, the others from the -axis side
+            int layer = area > 0.0f ? 0 : 1;
+            float sign = area > 0.0f ? 1.0f : -1.0f;
+
+            int minX = std::max(0, (int)std::min(p[0].x, std::min(p[1].x, p[2].x)));
+            int maxX = std::min(N - 1, (int)std::max(p[0].x, std::max(p[1].x, p[2].x)));
+            int minY = std::max(0, (int)std::min(p[0].y, std::min(p[1].y, p[2].y)));
+            int maxY = std::min(N - 1, (int)std::max(p[0].y, std::max(p[1].y, p[2].y)));
+
+            for (int y = minY ; y <= maxY ; y++) {
+                for (int x = minX ; x <= maxX ; x++) {
+                    float px = x + 0.5f;
+                    float py = y + 0.5f;
+                    float w0 = ((p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x)) * sign;
+                    float w1 = ((p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x)) * sign;
+                    float w2 = ((p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x)) * sign;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                        continue;
+                    }
+
+                    float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / (area * sign);
+                    z = layer == 0 ? -z : z;
+
+                    unsigned int pixel = (layer * N + y) * N + x;
+                    if (z < depth[pixel]) {
+                        depth[pixel] = z;
+                        shaded[pixel]++;
+                    }
+                }
+            }
+        }
+
+        for (unsigned int pixel = 0 ; pixel < shaded.size() ; pixel++) {
+            if (shaded[pixel] > 0) {
+                stats.PixelsCovered++;
+                stats.PixelsShaded += shaded[pixel];
+            }
+        }
+    }
+
+    return stats;
+}
+
+
+/**
+ * @brief Reorder the triangles for the post-transform vertex cache with the Tipsify algorithm
+ *
+ * @param indices the triangle list, reordered in place
+ */
+inline void optimizeVertexCache(unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    unsigned int numTriangles = numIndices / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // Vertex-triangle adjacency in compressed form
+    std::vector<unsigned int> liveTriangles(numVertices, 0);
+    for (unsigned int i = 0 ; i < numTriangles * 3 ; i++) {
+        liveTriangles[indices[i]]++;
+    }
+
+    std::vector<unsigned int> adjacencyOffsets(numVertices + 1, 0);
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+
+    std::vector<unsigned int> adjacency(numTriangles * 3);
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (unsigned int t = 0 ; t < numTriangles ; t++) {
+        for (int k = 0 ; k < 3 ; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+        }
+    }
+
+    std::vector<unsigned int> timestamps(numVertices, 0);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(numTriangles * 3);
+
+    unsigned int timestamp = cacheSize + 1;
+    unsigned int cursor = 0;
+    int fanning = indices[0];
+
+    while (fanning >= 0) {
+        candidates.clear();
+
+        // Emit all the remaining triangles around the fanning vertex
+        for (unsigned int a = adjacencyOffsets[fanning] ; a < adjacencyOffsets[fanning + 1] ; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+
+            for (int k = 0 ; k < 3 ; k++) {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                if (timestamp - timestamps[v] > cacheSize) {
+                    timestamps[v] = timestamp++;
+                }
+            }
+
+            emitted[t] = true;
+        }
+
+        // Pick the candidate that will still be in the cache after its fan is emitted and that is the oldest
+        int next = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+
+            int priority = 0;
+            if (timestamp - timestamps[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = timestamp - timestamps[v];
+            }
+
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        // Dead end: go back to a recently used vertex, else to the next vertex in input order
+        while (next == -1 && !deadEnd.empty()) {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0) {
+                next = v;
+            }
+        }
+
+        while (next == -1 && cursor < numTriangles * 3) {
+            unsigned int v = indices[cursor++];
+            if (liveTriangles[v] > 0) {
+                next = v;
+            }
+        }
+
+        fanning = next;
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+
+/**
+ * @brief Reorder clusters of triangles to reduce overdraw while keeping most of the vertex cache efficiency.
+ * Must be called on an index buffer already optimized for the vertex cache.
+ *
+ * @param indices the triangle list, reordered in place
+ * @param threshold the maximum allowed degradation of the ACMR (1.05 allows 5%)
+ */
+inline void optimizeOverdraw(unsigned int* indices, unsigned int numIndices, const glm::vec3* positions, unsigned int numVertices,
+                             float threshold = OVERDRAW_THRESHOLD, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    unsigned int numTriangles = numIndices / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    std::vector<unsigned int> timestamps(numVertices, 0);
+    unsigned int timestamp = cacheSize + 1;
+
+    // Hard boundaries: a triangle with 3 cache misses starts a new patch of the mesh
+    std::vector<unsigned int> hardBoundaries;
+    for (unsigned int t = 0 ; t < numTriangles ; t++) {
+        if (updateVertexCache(&indices[t * 3], timestamps, timestamp, cacheSize) == 3 || t == 0) {
+            hardBoundaries.push_back(t);
+        }
+    }
+
+    // Soft boundaries: split the patches as soon as their ACMR is close enough to the one of the whole patch
+    std::vector<unsigned int> clusters;
+    for (unsigned int c = 0 ; c < hardBoundaries.size() ; c++) {
+        unsigned int start = hardBoundaries[c];
+        unsigned int end = c + 1 < hardBoundaries.size() ? hardBoundaries[c + 1] : numTriangles;
+
+        timestamp += cacheSize + 1;
+        unsigned int misses = 0;
+        for (unsigned int t = start ; t < end ; t++) {
+            misses += updateVertexCache(&indices[t * 3], timestamps, timestamp, cacheSize);
+        }
+        float clusterThreshold = threshold * (float)misses / (end - start);
+
+        clusters.push_back(start);
+        timestamp += cacheSize + 1;
+        unsigned int runningMisses = 0;
+        unsigned int runningTriangles = 0;
+
+        for (unsigned int t = start ; t < end ; t++) {
+            runningMisses += updateVertexCache(&indices[t * 3], timestamps, timestamp, cacheSize);
+            runningTriangles++;
+
+            if ((float)runningMisses / runningTriangles <= clusterThreshold && t + 1 < end) {
+                clusters.push_back(t + 1);
+                timestamp += cacheSize + 1;
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+
+        // The last cluster was cut by the end of the patch and has a poor ACMR, merge it with the previous one
+        if (runningTriangles > 0 && clusters.back() != start) {
+            clusters.pop_back();
+        }
+    }
+
+    // Sort the clusters so that the ones facing away from the center of the mesh are drawn first
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> sortKeys(clusters.size());
+    std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.0f));
+
+    for (unsigned int c = 0 ; c < clusters.size() ; c++) {
+        unsigned int start = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+        float clusterArea = 0.0f;
+
+        for (unsigned int t = start ; t < end ; t++) {
+            const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+
+            clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            clusterArea += area;
+        }
+
+        meshCentroid += clusterCentroids[c];
+        meshArea += clusterArea;
+        clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : clusterCentroids[c];
+        float normalLength = glm::length(clusterNormals[c]);
+        clusterNormals[c] = normalLength > 0.0f ? clusterNormals[c] / normalLength : clusterNormals[c];
+    }
+    meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : meshCentroid;
+
+    for (unsigned int c = 0 ; c < clusters.size() ; c++) {
+        sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+    }
+
+    std::vector<unsigned int> order(clusters.size());
+    for (unsigned int c = 0 ; c < order.size() ; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(numTriangles * 3);
+    for (unsigned int c : order) {
+        unsigned int start = clusters[c];
+        unsigned int end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+        result.insert(result.end(), indices + start * 3, indices + end * 3);
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+
+/**
+ * @brief Renumber the vertices in the order they are first referenced by the index buffer
+ *
+ * @param indices the triangle list, rewritten in place with the new vertex numbers
+ * @return the remap table: new index of each old vertex. Unreferenced vertices are moved to the end
+ */
+inline std::vector<unsigned int> optimizeVertexFetch(unsigned int* indices, unsigned int numIndices, unsigned int numVertices)
+{
+    const unsigned int Unused = 0xFFFFFFFF;
+    std::vector<unsigned int> remap(numVertices, Unused);
+    unsigned int next = 0;
+
+    for (unsigned int i = 0 ; i < numIndices ; i++) {
+        unsigned int& v = remap[indices[i]];
+        if (v == Unused) {
+            v = next++;
+        }
+        indices[i] = v;
+    }
+
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        if (remap[v] == Unused) {
+            remap[v] = next++;
+        }
+    }
+
+    return remap;
+}
+
+
+/**
+ * @brief Move the vertex attributes to their new place given by the remap table of optimizeVertexFetch
+ */
+template<typename T>
+void remapVertexBuffer(T* vertices, unsigned int numVertices, const std::vector<unsigned int>& remap)
+{
+    std::vector<T> copy(vertices, vertices + numVertices);
+
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        vertices[remap[v]] = copy[v];
+    }
+}
+
+
+/**
+ * @brief Invert the remap table of optimizeVertexFetch
+ *
+ * @return the old index of each new vertex
+ */
+inline std::vector<unsigned int> invertRemap(const std::vector<unsigned int>& remap)
+{
+    std::vector<unsigned int> order(remap.size());
+
+    for (unsigned int v = 0 ; v < remap.size() ; v++) {
+        order[remap[v]] = v;
+    }
+
+    return order;
+}
+
+
+/**
+ * @brief Write converted vertex attributes in the new vertex order. The destination is written sequentially,
+ * so it can be write-combined memory such as a mapped GL buffer
+ *
+ * @param dst the destination of the attributes, in the new order
+ * @param src the source attributes, in the old order
+ * @param order the old index of each new vertex, given by invertRemap
+ * @param convert the conversion from a source attribute to a destination one
+ */
+template<typename T, typename S, typename Convert>
+void gatherVertexBuffer(T* dst, const S* src, const std::vector<unsigned int>& order, Convert convert)
+{
+    for (unsigned int v = 0 ; v < order.size() ; v++) {
+        dst[v] = convert(src[order[v]]);
+    }
+}
+
+
+/**
+ * @brief Run the vertex cache and overdraw optimizations on one mesh and accumulate the statistics
+ */
+inline void optimizeTriangleOrder(unsigned int* indices, unsigned int numIndices, const glm::vec3* positions, unsigned int numVertices,
+                                  MeshOptimizationStatistics& stats)
+{
+    stats.CacheBefore.Add(analyzeVertexCache(indices, numIndices, numVertices));
+    stats.OverdrawBefore.Add(analyzeOverdraw(indices, numIndices, positions));
+
+    optimizeVertexCache(indices, numIndices, numVertices);
+    optimizeOverdraw(indices, numIndices, positions, numVertices);
+
+    stats.CacheAfter.Add(analyzeVertexCache(indices, numIndices, numVertices));
+    stats.OverdrawAfter.Add(analyzeOverdraw(indices, numIndices, positions));
+}
+
+
+/**
+ * @brief Run the vertex cache, overdraw and vertex fetch optimizations on one mesh and accumulate the statistics
+ *
+ * @return the remap table that must be applied to every vertex attribute of the mesh with remapVertexBuffer
+ */
+inline std::vector<unsigned int> optimizeMesh(unsigned int* indices, unsigned int numIndices, const glm::vec3* positions, unsigned int numVertices,
+                                              MeshOptimizationStatistics& stats)
+{
+    optimizeTriangleOrder(indices, numIndices, positions, numVertices, stats);
+
+    return optimizeVertexFetch(indices, numIndices, numVertices);
+}
+
+
+#endif
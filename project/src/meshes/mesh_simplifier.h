@@ -0,0 +1,305 @@
+// Quadric error mesh simplification used to build the levels of detail of the static meshes.
+// It is based on "Surface Simplification Using Quadric Error Metrics" (Garland, Heckbert - 1997) and collapses
+// edges onto existing vertices, so that every level of detail can share the vertex buffer of the full mesh.
+
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+
+struct Quadric
+{
+    // Symmetric matrix A, vector b and scalar c of the error p^T A p + 2 b.p + c, and the total area weight
+    float a00 = 0.0f, a11 = 0.0f, a22 = 0.0f, a10 = 0.0f, a20 = 0.0f, a21 = 0.0f;
+    float b0 = 0.0f, b1 = 0.0f, b2 = 0.0f;
+    float c = 0.0f;
+    float w = 0.0f;
+
+    static Quadric FromPlane(const glm::vec3& n, float d, float weight)
+    {
+        Quadric Q;
+        Q.a00 = n.x * n.x * weight;
+        Q.a11 = n.y * n.y * weight;
+        Q.a22 = n.z * n.z * weight;
+        Q.a10 = n.y * n.x * weight;
+        Q.a20 = n.z * n.x * weight;
+        Q.a21 = n.z * n.y * weight;
+        Q.b0 = n.x * d * weight;
+        Q.b1 = n.y * d * weight;
+        Q.b2 = n.z * d * weight;
+        Q.c = d * d * weight;
+        Q.w = weight;
+        return Q;
+    }
+
+    void Add(const Quadric& Q)
+    {
+        a00 += Q.a00; a11 += Q.a11; a22 += Q.a22;
+        a10 += Q.a10; a20 += Q.a20; a21 += Q.a21;
+        b0 += Q.b0; b1 += Q.b1; b2 += Q.b2;
+        c += Q.c;
+        w += Q.w;
+    }
+
+    // Mean squared distance from p to the planes accumulated in the quadric
+    float Error(const glm::vec3& p) const
+    {
+        float rx = a00 * p.x + a10 * p.y + a20 * p.z + 2.0f * b0;
+        float ry = a10 * p.x + a11 * p.y + a21 * p.z + 2.0f * b1;
+        float rz = a20 * p.x + a21 * p.y + a22 * p.z + 2.0f * b2;
+        float e = rx * p.x + ry * p.y + rz * p.z + c;
+        return w > 0.0f ? std::fabs(e) / w : 0.0f;
+    }
+};
+
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const {
+        size_t h = std::hash<float>()(p.x);
+        h ^= std::hash<float>()(p.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= std::hash<float>()(p.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+
+/**
+ * @brief Simplify a triangle list by collapsing edges until the target number of indices or the maximum error is reached.
+ * Vertices that share a position (attribute seams) are collapsed together, and the vertices of open borders are kept.
+ *
+ * @param indices the triangle list, indices are local to the mesh
+ * @param positions the positions of the mesh
+ * @param normals the normals of the mesh, used to select among the vertices of a seam (can be NULL)
+ * @param texCoords the texture coordinates of the mesh, used to select among the vertices of a seam (can be NULL)
+ * @param targetNumIndices the number of indices to reach
+ * @param maxError the maximum distance between the simplified and the original surface, in model units
+ * @param resultError the distance reached by the simplification, in model units
+ * @return the simplified triangle list, referencing the same vertices
+ */
+inline std::vector<unsigned int> simplifyMesh(const unsigned int* indices, unsigned int numIndices,
+                                              const glm::vec3* positions, const glm::vec3* normals, const glm::vec2* texCoords,
+                                              unsigned int numVertices, unsigned int targetNumIndices, float maxError, float& resultError)
+{
+    std::vector<unsigned int> result(indices, indices + numIndices);
+    resultError = 0.0f;
+
+    // Group the vertices that share the same position: the collapses are done on the groups
+    std::vector<unsigned int> group(numVertices);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> groupOfPosition;
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        group[v] = groupOfPosition.emplace(positions[v], v).first->second;
+    }
+
+    std::vector<unsigned int> wedgeOffsets(numVertices + 1, 0);
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        wedgeOffsets[group[v] + 1]++;
+    }
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        wedgeOffsets[v + 1] += wedgeOffsets[v];
+    }
+    std::vector<unsigned int> wedges(numVertices);
+    std::vector<unsigned int> fill(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        wedges[fill[group[v]]++] = v;
+    }
+
+    // Plane quadrics of the triangles, weighted by their area
+    std::vector<Quadric> quadrics(numVertices);
+    for (unsigned int i = 0 ; i + 2 < numIndices ; i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        const glm::vec3& p1 = positions[indices[i + 1]];
+        const glm::vec3& p2 = positions[indices[i + 2]];
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if (area == 0.0f) {
+            continue;
+        }
+        normal /= area;
+
+        Quadric Q = Quadric::FromPlane(normal, -glm::dot(normal, p0), area);
+        for (int k = 0 ; k < 3 ; k++) {
+            quadrics[group[indices[i + k]]].Add(Q);
+        }
+    }
+
+    // Lock the vertices of the open borders: an edge used by a single triangle
+    std::vector<bool> locked(numVertices, false);
+    {
+        std::unordered_map<unsigned long long, int> edgeCount;
+        for (unsigned int i = 0 ; i + 2 < numIndices ; i += 3) {
+            for (int k = 0 ; k < 3 ; k++) {
+                unsigned int a = group[indices[i + k]];
+                unsigned int b = group[indices[i + (k + 1) % 3]];
+                unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+                edgeCount[key]++;
+            }
+        }
+        for (const auto& edge : edgeCount) {
+            if (edge.second == 1) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFF] = true;
+            }
+        }
+    }
+
+    struct Collapse {
+        unsigned int From;
+        unsigned int To;
+        float Error;
+    };
+
+    std::vector<Collapse> candidates;
+    std::vector<unsigned int> adjacencyOffsets(numVertices + 1);
+    std::vector<unsigned int> adjacency;
+    std::vector<bool> used(numVertices);
+    std::vector<unsigned int> collapseTarget(numVertices);
+
+    while (result.size() > targetNumIndices) {
+        unsigned int numTriangles = (unsigned int)result.size() / 3;
+
+        // Triangles around each group
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned int i = 0 ; i < result.size() ; i++) {
+            adjacencyOffsets[group[result[i]] + 1]++;
+        }
+        for (unsigned int v = 0 ; v < numVertices ; v++) {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        adjacency.resize(result.size());
+        fill.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (unsigned int i = 0 ; i < result.size() ; i++) {
+            adjacency[fill[group[result[i]]]++] = i / 3;
+        }
+
+        // Cost of moving each end of each edge onto the other end
+        candidates.clear();
+        for (unsigned int i = 0 ; i < result.size() ; i++) {
+            unsigned int a = group[result[i]];
+            unsigned int b = group[result[i - i % 3 + (i + 1) % 3]];
+            if (a == b) {
+                continue;
+            }
+            if (!locked[a]) {
+                candidates.push_back({ a, b, quadrics[a].Error(positions[b]) });
+            }
+            if (!locked[b]) {
+                candidates.push_back({ b, a, quadrics[b].Error(positions[a]) });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.Error < y.Error; });
+
+        // Every collapse removes about 2 triangles, do at most half of the remaining reduction per pass
+        unsigned int targetTriangles = targetNumIndices / 3;
+        unsigned int maxCollapses = std::max(1u, (numTriangles - targetTriangles) / 4);
+        unsigned int numCollapses = 0;
+
+        std::fill(used.begin(), used.end(), false);
+        for (unsigned int v = 0 ; v < numVertices ; v++) {
+            collapseTarget[v] = v;
+        }
+
+        for (const Collapse& collapse : candidates) {
+            if (numCollapses >= maxCollapses || std::sqrt(collapse.Error) > maxError) {
+                break;
+            }
+            if (used[collapse.From] || used[collapse.To]) {
+                continue;
+            }
+
+            // Reject the collapse if it flips one of the remaining triangles around the moved vertex
+            bool flips = false;
+            for (unsigned int a = adjacencyOffsets[collapse.From] ; a < adjacencyOffsets[collapse.From + 1] && !flips ; a++) {
+                unsigned int t = adjacency[a];
+                glm::vec3 before[3];
+                glm::vec3 after[3];
+                bool degenerate = false;
+                for (int k = 0 ; k < 3 ; k++) {
+                    unsigned int g = group[result[t * 3 + k]];
+                    before[k] = positions[g];
+                    after[k] = g == collapse.From ? positions[collapse.To] : positions[g];
+                    degenerate = degenerate || g == collapse.To;
+                }
+                if (degenerate) {
+                    continue;
+                }
+                glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                flips = glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1);
+            }
+            if (flips) {
+                continue;
+            }
+
+            // The triangles around the moved vertex must stay still during this pass
+            for (unsigned int a = adjacencyOffsets[collapse.From] ; a < adjacencyOffsets[collapse.From + 1] ; a++) {
+                for (int k = 0 ; k < 3 ; k++) {
+                    used[group[result[adjacency[a] * 3 + k]]] = true;
+                }
+            }
+
+            collapseTarget[collapse.From] = collapse.To;
+            quadrics[collapse.To].Add(quadrics[collapse.From]);
+            resultError = std::max(resultError, std::sqrt(collapse.Error));
+            numCollapses++;
+        }
+
+        if (numCollapses == 0) {
+            break;
+        }
+
+        // Move the indices of the collapsed groups to the vertex of the target group with the closest attributes
+        for (unsigned int i = 0 ; i < result.size() ; i++) {
+            unsigned int from = result[i];
+            unsigned int to = collapseTarget[group[from]];
+            if (to == group[from]) {
+                continue;
+            }
+
+            unsigned int best = to;
+            float bestDistance = -1.0f;
+            for (unsigned int w = wedgeOffsets[to] ; w < wedgeOffsets[to + 1] ; w++) {
+                unsigned int candidate = wedges[w];
+                float distance = 0.0f;
+                if (normals) {
+                    glm::vec3 dn = normals[candidate] - normals[from];
+                    distance += glm::dot(dn, dn);
+                }
+                if (texCoords) {
+                    glm::vec2 dt = texCoords[candidate] - texCoords[from];
+                    distance += glm::dot(dt, dt);
+                }
+                if (bestDistance < 0.0f || distance < bestDistance) {
+                    bestDistance = distance;
+                    best = candidate;
+                }
+            }
+            result[i] = best;
+        }
+
+        // Remove the triangles that became degenerate
+        unsigned int kept = 0;
+        for (unsigned int i = 0 ; i + 2 < result.size() ; i += 3) {
+            unsigned int g0 = group[result[i]];
+            unsigned int g1 = group[result[i + 1]];
+            unsigned int g2 = group[result[i + 2]];
+            if (g0 != g1 && g1 != g2 && g0 != g2) {
+                result[kept++] = result[i];
+                result[kept++] = result[i + 1];
+                result[kept++] = result[i + 2];
+            }
+        }
+        result.resize(kept);
+    }
+
+    return result;
+}
+
+
+#endif
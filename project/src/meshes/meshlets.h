@@ -0,0 +1,194 @@
+// Splitting of the index buffers into small clusters of triangles (meshlets) that can be culled individually.
+// The normal cone culling test follows the one of meshoptimizer (https://github.com/zeux/meshoptimizer).
+
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+
+// Layout of the commands read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    unsigned int Count;
+    unsigned int InstanceCount;
+    unsigned int FirstIndex;
+    int BaseVertex;
+    unsigned int BaseInstance;
+};
+
+
+struct Meshlet
+{
+    unsigned int BaseIndex = 0;     // first index of the meshlet in the index buffer
+    unsigned int NumIndices = 0;
+
+    // Bounding sphere, in model space
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+
+    // Normal cone: all the triangles face away from a viewer inside the cone, a cutoff of 1 disables the test
+    glm::vec3 ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float ConeCutoff = 1.0f;
+
+    /**
+     * @brief Whether all the triangles of the meshlet are back facing for a camera at the given position (in model space)
+     */
+    bool IsBackFacing(const glm::vec3& cameraPos) const
+    {
+        glm::vec3 d = Center - cameraPos;
+        return glm::dot(d, ConeAxis) >= ConeCutoff * glm::length(d) + Radius;
+    }
+};
+
+
+/**
+ * @brief Compute the bounding sphere and the normal cone of the triangles of a meshlet
+ */
+inline void computeMeshletBounds(Meshlet& meshlet, const unsigned int* indices, const glm::vec3* positions)
+{
+    glm::vec3 minP = positions[indices[meshlet.BaseIndex]];
+    glm::vec3 maxP = minP;
+    for (unsigned int i = meshlet.BaseIndex ; i < meshlet.BaseIndex + meshlet.NumIndices ; i++) {
+        minP = glm::min(minP, positions[indices[i]]);
+        maxP = glm::max(maxP, positions[indices[i]]);
+    }
+
+    meshlet.Center = (minP + maxP) * 0.5f;
+    meshlet.Radius = 0.0f;
+    for (unsigned int i = meshlet.BaseIndex ; i < meshlet.BaseIndex + meshlet.NumIndices ; i++) {
+        meshlet.Radius = std::max(meshlet.Radius, glm::length(positions[indices[i]] - meshlet.Center));
+    }
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (unsigned int i = meshlet.BaseIndex ; i + 2 < meshlet.BaseIndex + meshlet.NumIndices ; i += 3) {
+        const glm::vec3& p0 = positions[indices[i]];
+        const glm::vec3& p1 = positions[indices[i + 1]];
+        const glm::vec3& p2 = positions[indices[i + 2]];
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if (area == 0.0f) {
+            continue;
+        }
+        normals.push_back(normal / area);
+        axis += normal / area;
+    }
+
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength == 0.0f) {
+        return;
+    }
+    meshlet.ConeAxis = axis / axisLength;
+
+    // The cone contains all the normals, it can only be used if it is narrower than a half space
+    float minDot = 1.0f;
+    for (const glm::vec3& normal : normals) {
+        minDot = std::min(minDot, glm::dot(normal, meshlet.ConeAxis));
+    }
+    meshlet.ConeCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+}
+
+
+/**
+ * @brief Split a triangle list into meshlets of at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles,
+ * following the order of the triangles (the index buffer should already be optimized for the vertex cache)
+ *
+ * @param indices the index buffer holding the triangle list
+ * @param baseIndex the first index of the triangle list in the buffer
+ * @param numIndices the number of indices of the triangle list
+ * @param positions the positions of the mesh referenced by the indices
+ * @param meshlets the vector the meshlets are appended to
+ */
+inline void buildMeshlets(const unsigned int* indices, unsigned int baseIndex, unsigned int numIndices, const glm::vec3* positions,
+                          std::vector<Meshlet>& meshlets)
+{
+    std::vector<unsigned int> meshletVertices;
+    Meshlet meshlet;
+    meshlet.BaseIndex = baseIndex;
+
+    for (unsigned int i = baseIndex ; i + 2 < baseIndex + numIndices ; i += 3) {
+        unsigned int newVertices = 0;
+        for (int k = 0 ; k < 3 ; k++) {
+            if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end()) {
+                newVertices++;
+            }
+        }
+
+        if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES || meshlet.NumIndices / 3 + 1 > MESHLET_MAX_TRIANGLES) {
+            computeMeshletBounds(meshlet, indices, positions);
+            meshlets.push_back(meshlet);
+
+            meshlet = Meshlet();
+            meshlet.BaseIndex = i;
+            meshletVertices.clear();
+        }
+
+        for (int k = 0 ; k < 3 ; k++) {
+            if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i + k]) == meshletVertices.end()) {
+                meshletVertices.push_back(indices[i + k]);
+            }
+        }
+        meshlet.NumIndices += 3;
+    }
+
+    if (meshlet.NumIndices > 0) {
+        computeMeshletBounds(meshlet, indices, positions);
+        meshlets.push_back(meshlet);
+    }
+}
+
+
+/**
+ * @brief Whether a mesh is closed with a consistent winding: every edge is shared by exactly two triangles that go
+ * through it in opposite directions. Only then are its back faces always hidden by its front faces, so that the
+ * back facing meshlets can be skipped without enabling GL_CULL_FACE. The vertices are compared by position,
+ * the ones split by a seam of the texture coordinates are the same vertex.
+ *
+ * @param indices the triangle list
+ * @param numIndices the number of indices of the triangle list
+ * @param positions the positions of the mesh referenced by the indices
+ * @param numVertices the number of vertices of the mesh
+ */
+inline bool isClosedMesh(const unsigned int* indices, unsigned int numIndices, const glm::vec3* positions, unsigned int numVertices)
+{
+    std::vector<unsigned int> canonical(numVertices);
+    std::map<std::tuple<float, float, float>, unsigned int> firstVertex;
+    for (unsigned int v = 0 ; v < numVertices ; v++) {
+        canonical[v] = firstVertex.emplace(std::make_tuple(positions[v].x, positions[v].y, positions[v].z), v).first->second;
+    }
+
+    std::unordered_map<uint64_t, unsigned int> edges;
+    for (unsigned int i = 0 ; i + 2 < numIndices ; i += 3) {
+        for (int k = 0 ; k < 3 ; k++) {
+            uint64_t a = canonical[indices[i + k]];
+            uint64_t b = canonical[indices[i + (k + 1) % 3]];
+            if (a != b) {
+                edges[(a << 32) | b]++;
+            }
+        }
+    }
+
+    for (const auto& edge : edges) {
+        auto opposite = edges.find((edge.first << 32) | (edge.first >> 32));
+        if (edge.second != 1 || opposite == edges.end() || opposite->second != 1) {
+            return false;
+        }
+    }
+    return !edges.empty();
+}
+
+
+#endif
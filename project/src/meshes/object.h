@@ -4,6 +4,8 @@
 #include<iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <cstddef>
 
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/scene.h>           // Output data structure
@@ -17,6 +19,10 @@
 
 #include "../shader.h"
 
+#include "bounds.h"
+#include "virtual_io_system.h"
+#include "../utils/memory_report.h"
+
 using namespace Assimp;
 
 #define POSITION_LOCATION    0
@@ -24,33 +30,54 @@ using namespace Assimp;
 #define NORMAL_LOCATION      2
 
 struct Vertex {
-	glm::vec3 Position;
-	glm::vec2 Texture;
-	glm::vec3 Normal;
+	glm::vec3 Position = glm::vec3(0.0f);
+	glm::vec2 Texture = glm::vec2(0.0f);
+	glm::vec3 Normal = glm::vec3(0.0f);
+
+	bool operator==(const Vertex& other) const {
+		return Position == other.Position && Texture == other.Texture && Normal == other.Normal;
+	}
+};
+
+// Hash of all the attributes of a vertex, used to weld the identical vertices
+struct VertexHash {
+	size_t operator()(const Vertex& v) const {
+		const float* data = &v.Position.x;
+		size_t h = 0;
+		for (int i = 0; i < 8; i++) {
+			h ^= std::hash<float>()(data[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		}
+		return h;
+	}
 };
 
 
 class Object
 {
 public:
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec2> textures;
-	std::vector<glm::vec3> normals;
 	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
 
 
 	int numVertices;
+	int numIndices;
 
-	GLuint VBO, VAO;
+	GLuint VBO, EBO, VAO;
 
 	glm::mat4 model = glm::mat4(1.0);
 
+	BoundingBox bounds;		// in model space
+	BoundingSphere sphere;
+
+	std::string name;		// the path of the file, used in the reports
+
 
 	Object(){}
 	
-	Object(const char* path) {
+	Object(const char* path) : name(path) {
 		//std::cout << "load " << path << std::endl;
 		Importer importer;
+		importer.SetIOHandler(new VirtualIOSystem());
 
 		const aiScene* scene = importer.ReadFile(path, 
 								aiProcess_Triangulate  				|
@@ -62,86 +89,96 @@ public:
 			std::cout << "Error parsing " << path << ": " << importer.GetErrorString() << std::endl;
   		}
 
-		for (int n=0; n < scene->mNumMeshes; n++){
+		// Weld the identical vertices of all the meshes into a single indexed vertex buffer
+		std::unordered_map<Vertex, GLuint, VertexHash> uniqueVertices;
+
+		for (unsigned int n=0; n < scene->mNumMeshes; n++){
 			const struct aiMesh* mesh = scene->mMeshes[n];
 			//std::cout << "mesh" << std::endl;
 
-			for (int t = 0; t < mesh->mNumFaces; ++t) {
-				const struct aiFace* face = &mesh->mFaces[t];
-				//std::cout << "face" << std::endl;
+			std::vector<GLuint> meshToObject(mesh->mNumVertices);
+			for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+				Vertex v;
 
-				for(int i = 0; i < face->mNumIndices; i++)		// go through all vertices in face
+				v.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+				if (mesh->HasTextureCoords(0))		//HasTextureCoords(texture_coordinates_set)
 				{
-					//std::cout << "vertex" << std::endl;
-					Vertex v;
-					
-					int vertexIndex = face->mIndices[i];	// get group index for current index
-					if(mesh->mNormals != nullptr)
+					v.Texture = glm::vec2(mesh->mTextureCoords[0][i].x, 1 - mesh->mTextureCoords[0][i].y); //mTextureCoords[channel][vertex]
+				}
+				if (mesh->mNormals != nullptr) {
+					v.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+				}
 
-						if(mesh->HasTextureCoords(0))		//HasTextureCoords(texture_coordinates_set)
-						{
-							v.Texture = glm::vec2(mesh->mTextureCoords[0][vertexIndex].x, 1 - mesh->mTextureCoords[0][vertexIndex].y); //mTextureCoords[channel][vertex]
-						}
+				auto inserted = uniqueVertices.emplace(v, (GLuint)vertices.size());
+				if (inserted.second) {
+					vertices.push_back(v);
+				}
+				meshToObject[i] = inserted.first->second;
+			}
 
-						v.Normal = glm::vec3(mesh->mNormals[vertexIndex].x, mesh->mNormals[vertexIndex].y, mesh->mNormals[vertexIndex].z);
-					v.Position = glm::vec3(mesh->mVertices[vertexIndex].x, mesh->mVertices[vertexIndex].y, mesh->mVertices[vertexIndex].z);
+			for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
+				const struct aiFace* face = &mesh->mFaces[t];
+				//std::cout << "face" << std::endl;
 
-					vertices.push_back(v);
+				for(unsigned int i = 0; i < face->mNumIndices; i++)		// go through all vertices in face
+				{
+					indices.push_back(meshToObject[face->mIndices[i]]);
 				}
 			}
 		}
-		//std::cout << "Load model with " << vertices.size() << " vertices" << std::endl;
+		//std::cout << "Load model with " << vertices.size() << " vertices and " << indices.size() << " indices" << std::endl;
 		numVertices = vertices.size();
-	}
-
-
-	void makeObject(Shader shader, bool texture = true) {
-		float* data = new float[8 * numVertices];
-		for (int i = 0; i < numVertices; i++) {
-			Vertex v = vertices.at(i);
-			data[i * 8] = v.Position.x;
-			data[i * 8 + 1] = v.Position.y;
-			data[i * 8 + 2] = v.Position.z;
+		numIndices = indices.size();
 
-			data[i * 8 + 3] = v.Texture.x;
-			data[i * 8 + 4] = v.Texture.y;
-
-			data[i * 8 + 5] = v.Normal.x;
-			data[i * 8 + 6] = v.Normal.y;
-			data[i * 8 + 7] = v.Normal.z;
+		for (const Vertex& v : vertices) {
+			bounds.Add(v.Position);
+		}
+		sphere.Center = bounds.GetCenter();
+		for (const Vertex& v : vertices) {
+			sphere.Radius = std::max(sphere.Radius, glm::length(v.Position - sphere.Center));
 		}
+	}
+
 
+	void makeObject(const Shader& shader, bool texture = true) {
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
 
 		//define VBO and VAO as active buffer and active vertex array
 		glBindVertexArray(VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * numVertices, data, GL_STATIC_DRAW);
+		glBufferStorage(GL_ARRAY_BUFFER, sizeof(Vertex) * numVertices, vertices.data(), 0);
 
 		glEnableVertexAttribArray(POSITION_LOCATION);
-		glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, false, 8 * sizeof(float), (void*)0);
+		glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, Position));
 
 		
 		if (texture) {
 			glEnableVertexAttribArray(TEX_COORD_LOCATION);
-			glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, false, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, Texture));
 			
 		}
 		
 		glEnableVertexAttribArray(NORMAL_LOCATION);
-		glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, false, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+		glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, false, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * numIndices, indices.data(), 0);
+
+		// The GPU holds the only copy of the geometry from now on
+		std::vector<Vertex>().swap(vertices);
+		std::vector<GLuint>().swap(indices);
+		getMemoryReport().setAsset(name, vectorBytes(vertices) + vectorBytes(indices), sizeof(Vertex) * numVertices + sizeof(GLuint) * numIndices);
 		
 		//desactive the buffer
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindVertexArray(0);
-		delete[] data;
-
 	}
 
 	void draw() {
 		glBindVertexArray(this->VAO);
-		glDrawArrays(GL_TRIANGLES, 0, numVertices);
+		glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, (void*)0);
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,253 @@
+// Shared resources: the textures, the shaders and the simple meshes are loaded once per canonical path and load parameters,
+// and handed out as reference counted handles. A request for a loaded resource returns the same GPU resource,
+// and a resource is released as soon as its last handle is dropped.
+
+#ifndef RESOURCE_MANAGER_H
+#define RESOURCE_MANAGER_H
+
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+#include <functional>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "../shader.h"
+#include "../utils/virtual_file_system.h"
+#include "../utils/memory_report.h"
+#include "texture.h"
+#include "object.h"
+
+
+class ResourceManager;
+inline ResourceManager& getResourceManager();
+
+
+enum class ResourceType { Texture, Shader, Mesh, Count };
+
+
+struct ResourceStatistics
+{
+    unsigned int Loaded[(int)ResourceType::Count] = { 0 };     // resources created
+    unsigned int Reused[(int)ResourceType::Count] = { 0 };     // requests served by a resource already loaded
+    unsigned int Released[(int)ResourceType::Count] = { 0 };
+    double LoadMs = 0.0;
+    size_t ReusedTextureBytes = 0;      // GPU memory that the reused textures would have taken again
+
+    unsigned int GetLoaded() const { return Loaded[0] + Loaded[1] + Loaded[2]; }
+
+    unsigned int GetReused() const { return Reused[0] + Reused[1] + Reused[2]; }
+};
+
+
+class ResourceManager
+{
+public:
+    ResourceManager() {}
+
+    ResourceManager(const ResourceManager&) = delete;
+    ResourceManager& operator=(const ResourceManager&) = delete;
+
+    /**
+     * @brief Load a texture from its file, or share the texture already loaded from it
+     *
+     * @param streaming true to stream its large levels when the streaming is enabled (see Texture::EnableStreaming)
+     * @param color false for the textures of data, such as the specular exponents (see Texture::SetColor)
+     * @return an empty handle when the texture can't be loaded
+     */
+    std::shared_ptr<Texture> loadTexture(const std::string& path, bool streaming = false, bool color = true)
+    {
+        bool streamed = streaming && getTextureStreamingSettings().Enabled;
+        std::string key = getTextureKey(path, color) + (streamed ? "|streamed" : "");
+        std::shared_ptr<Texture> texture = find(m_Textures, key, ResourceType::Texture);
+        if (texture) {
+            m_Statistics.ReusedTextureBytes += texture->GetGpuBytes();
+            return texture;
+        }
+
+        double start = glfwGetTime();
+        Texture* pTexture = new Texture(GL_TEXTURE_2D, path);
+        pTexture->SetColor(color);
+        if (streaming) {
+            pTexture->EnableStreaming();
+        }
+        if (!pTexture->Load()) {
+            delete pTexture;
+            return std::shared_ptr<Texture>();
+        }
+
+        texture = std::shared_ptr<Texture>(pTexture, [key](Texture* pTexture) {
+            getResourceManager().release(getResourceManager().m_Textures, key, ResourceType::Texture);
+            delete pTexture;
+        });
+        return add(m_Textures, key, texture, ResourceType::Texture, start);
+    }
+
+    /**
+     * @brief Share the texture already loaded from a file, streamed or not
+     *
+     * @return an empty handle when no texture of the file is loaded
+     */
+    std::shared_ptr<Texture> findTexture(const std::string& path, bool color = true)
+    {
+        std::string key = getTextureKey(path, color);
+        std::shared_ptr<Texture> texture = find(m_Textures, key, ResourceType::Texture);
+        if (!texture) {
+            texture = find(m_Textures, key + "|streamed", ResourceType::Texture);
+        }
+        if (texture) {
+            m_Statistics.ReusedTextureBytes += texture->GetGpuBytes();
+        }
+        return texture;
+    }
+
+    /**
+     * @brief Create a texture from an image decoded on a loading thread, its levels are uploaded by the texture uploader
+     * (see Texture::QueueRaw). The other requests for the file share it from now, even before it is complete.
+     *
+     * @param onComplete called once the texture is uploaded
+     */
+    std::shared_ptr<Texture> queueTexture(const std::string& path, int width, int height, int bpp, std::vector<unsigned char>&& pixels,
+                                          std::vector<MipLevel>&& levels, std::function<void()> onComplete, bool color = true)
+    {
+        std::string key = getTextureKey(path, color);
+        double start = glfwGetTime();
+        Texture* pTexture = new Texture(GL_TEXTURE_2D, path);
+        pTexture->SetColor(color);
+        pTexture->QueueRaw(width, height, bpp, std::move(pixels), std::move(levels), onComplete);
+
+        std::shared_ptr<Texture> texture(pTexture, [key](Texture* pTexture) {
+            getResourceManager().release(getResourceManager().m_Textures, key, ResourceType::Texture);
+            delete pTexture;
+        });
+        return add(m_Textures, key, texture, ResourceType::Texture, start);
+    }
+
+    /**
+     * @brief Compile a program, or share the program already compiled from the same sources and defines
+     *
+     */
+    std::shared_ptr<Shader> loadShader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
+    {
+        std::string key = VirtualFileSystem::normalizePath(vertexPath) + "|" + VirtualFileSystem::normalizePath(fragmentPath) + "|" + defines;
+        std::shared_ptr<Shader> shader = find(m_Shaders, key, ResourceType::Shader);
+        if (shader) {
+            return shader;
+        }
+
+        // The renderers share the non-copyable shader through its handle, the program is deleted with the last handle
+        double start = glfwGetTime();
+        shader = std::shared_ptr<Shader>(new Shader(vertexPath, fragmentPath, defines), [key](Shader* pShader) {
+            getResourceManager().release(getResourceManager().m_Shaders, key, ResourceType::Shader);
+            glDeleteProgram(pShader->ID);
+            delete pShader;
+        });
+        return add(m_Shaders, key, shader, ResourceType::Shader, start);
+    }
+
+    /**
+     * @brief Load a mesh and upload it (see Object::makeObject), or share the mesh already loaded from the file
+     *
+     * @param texture true to upload the texture coordinates
+     */
+    std::shared_ptr<Object> loadObject(const char* path, const Shader& shader, bool texture = true)
+    {
+        std::string key = VirtualFileSystem::normalizePath(path) + (texture ? "" : "|untextured");
+        std::shared_ptr<Object> object = find(m_Objects, key, ResourceType::Mesh);
+        if (object) {
+            return object;
+        }
+
+        double start = glfwGetTime();
+        return uploadObject(new Object(path), key, shader, texture, start);
+    }
+
+    /**
+     * @brief Upload a mesh imported on a loading thread (see AssetLoader), or share the mesh already loaded from its file
+     *
+     * @param imported the mesh read by Object(path), without any GL object yet
+     */
+    std::shared_ptr<Object> loadObject(std::unique_ptr<Object> imported, const Shader& shader, bool texture = true)
+    {
+        std::string key = VirtualFileSystem::normalizePath(imported->name) + (texture ? "" : "|untextured");
+        std::shared_ptr<Object> object = find(m_Objects, key, ResourceType::Mesh);
+        if (object) {
+            return object;
+        }
+        return uploadObject(imported.release(), key, shader, texture, glfwGetTime());
+    }
+
+    unsigned int getNumResources() const { return (unsigned int)(m_Textures.size() + m_Shaders.size() + m_Objects.size()); }
+
+    const ResourceStatistics& getStatistics() const { return m_Statistics; }
+
+private:
+    std::map<std::string, std::weak_ptr<Texture>> m_Textures;
+    std::map<std::string, std::weak_ptr<Shader>> m_Shaders;
+    std::map<std::string, std::weak_ptr<Object>> m_Objects;
+    ResourceStatistics m_Statistics;
+
+    // The data textures of a file are not shared with its color textures, their levels are filtered differently
+    static std::string getTextureKey(const std::string& path, bool color)
+    {
+        return VirtualFileSystem::normalizePath(path) + (color ? "" : "|data");
+    }
+
+    std::shared_ptr<Object> uploadObject(Object* pObject, const std::string& key, const Shader& shader, bool texture, double start)
+    {
+        pObject->makeObject(shader, texture);
+        std::shared_ptr<Object> object(pObject, [key](Object* pObject) {
+            getResourceManager().release(getResourceManager().m_Objects, key, ResourceType::Mesh);
+            glDeleteVertexArrays(1, &pObject->VAO);
+            glDeleteBuffers(1, &pObject->VBO);
+            glDeleteBuffers(1, &pObject->EBO);
+            getMemoryReport().removeAsset(pObject->name);
+            delete pObject;
+        });
+        return add(m_Objects, key, object, ResourceType::Mesh, start);
+    }
+
+    template<typename T>
+    std::shared_ptr<T> find(std::map<std::string, std::weak_ptr<T>>& resources, const std::string& key, ResourceType type)
+    {
+        auto it = resources.find(key);
+        std::shared_ptr<T> resource = it == resources.end() ? std::shared_ptr<T>() : it->second.lock();
+        if (resource) {
+            m_Statistics.Reused[(int)type]++;
+        }
+        return resource;
+    }
+
+    template<typename T>
+    std::shared_ptr<T> add(std::map<std::string, std::weak_ptr<T>>& resources, const std::string& key, const std::shared_ptr<T>& resource,
+                           ResourceType type, double start)
+    {
+        resources[key] = resource;
+        m_Statistics.Loaded[(int)type]++;
+        m_Statistics.LoadMs += (glfwGetTime() - start) * 1000.0;
+        return resource;
+    }
+
+    // Called by the deleter of the last handle, a new resource may already have replaced the released one
+    template<typename T>
+    void release(std::map<std::string, std::weak_ptr<T>>& resources, const std::string& key, ResourceType type)
+    {
+        auto it = resources.find(key);
+        if (it != resources.end() && it->second.expired()) {
+            resources.erase(it);
+        }
+        m_Statistics.Released[(int)type]++;
+    }
+};
+
+
+inline ResourceManager& getResourceManager()
+{
+    static ResourceManager manager;
+    return manager;
+}
+
+
+#endif
@@ -0,0 +1,289 @@
+// Skeletons and animation clips of the engine, independent of the format they are loaded from.
+
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+
+/**
+ * @brief Local transform of a joint, relative to its parent
+ *
+ */
+struct JointPose
+{
+    glm::vec3 Translation = glm::vec3(0.0f);
+    glm::quat Rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 Scale = glm::vec3(1.0f);
+
+    glm::mat4 GetMatrix() const
+    {
+        return glm::translate(glm::mat4(1.0f), Translation) * glm::toMat4(Rotation) * glm::scale(glm::mat4(1.0f), Scale);
+    }
+
+    /**
+     * @brief Split a transform into translation, rotation and scale, the matrix must not be sheared
+     */
+    static JointPose FromMatrix(const glm::mat4& matrix)
+    {
+        JointPose pose;
+        pose.Translation = glm::vec3(matrix[3]);
+        pose.Scale = glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2])));
+        if (pose.Scale.x == 0.0f || pose.Scale.y == 0.0f || pose.Scale.z == 0.0f) {
+            return pose;
+        }
+
+        glm::mat3 rotation(glm::vec3(matrix[0]) / pose.Scale.x, glm::vec3(matrix[1]) / pose.Scale.y, glm::vec3(matrix[2]) / pose.Scale.z);
+        if (glm::determinant(rotation) < 0.0f) {
+            // A mirror, carried by the scale
+            pose.Scale.x = -pose.Scale.x;
+            rotation[0] = -rotation[0];
+        }
+        pose.Rotation = glm::quat_cast(rotation);
+        return pose;
+    }
+};
+
+
+struct Joint
+{
+    std::string Name;
+    int Parent = -1;                                // index of the parent joint, -1 for a root
+    glm::mat4 InverseBindMatrix = glm::mat4(1.0f);  // from the model space to the space of the joint in the bind pose
+    glm::mat4 RootTransform = glm::mat4(1.0f);      // transform of the ancestors that are not joints, for a root
+    JointPose BindPose;                             // local transform when no animation drives the joint
+};
+
+
+class Skeleton
+{
+public:
+    std::vector<Joint> Joints;
+    glm::mat4 GlobalInverseTransform = glm::mat4(1.0f);    // inverse of the transform of the skinned mesh
+
+    /**
+     * @brief Compute the order in which the joints are evaluated, must be called once the joints are set
+     *
+     */
+    void Finalize()
+    {
+        m_EvaluationOrder.clear();
+        std::vector<bool> placed(Joints.size(), false);
+
+        // The joints can be listed in any order, every pass places the joints whose parent is placed
+        while (m_EvaluationOrder.size() < Joints.size()) {
+            size_t numPlaced = m_EvaluationOrder.size();
+            for (unsigned int j = 0 ; j < Joints.size() ; j++) {
+                if (!placed[j] && (Joints[j].Parent < 0 || placed[Joints[j].Parent])) {
+                    placed[j] = true;
+                    m_EvaluationOrder.push_back(j);
+                }
+            }
+            if (m_EvaluationOrder.size() == numPlaced) {
+                // A cycle in the hierarchy, the remaining joints are evaluated as roots
+                for (unsigned int j = 0 ; j < Joints.size() ; j++) {
+                    if (!placed[j]) {
+                        Joints[j].Parent = -1;
+                    }
+                }
+            }
+        }
+    }
+
+    int FindJoint(const std::string& name) const
+    {
+        for (unsigned int j = 0 ; j < Joints.size() ; j++) {
+            if (Joints[j].Name == name) {
+                return (int)j;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Heap bytes held by the skeleton, for the memory reports
+     */
+    size_t GetMemoryBytes() const
+    {
+        size_t bytes = Joints.capacity() * sizeof(Joint) + m_EvaluationOrder.capacity() * sizeof(unsigned int)
+                     + m_GlobalTransforms.capacity() * sizeof(glm::mat4);
+        for (const Joint& joint : Joints) {
+            bytes += joint.Name.capacity();
+        }
+        return bytes;
+    }
+
+    void GetBindPose(std::vector<JointPose>& pose) const
+    {
+        pose.resize(Joints.size());
+        for (unsigned int j = 0 ; j < Joints.size() ; j++) {
+            pose[j] = Joints[j].BindPose;
+        }
+    }
+
+    /**
+     * @brief Compute the matrices sent to the skinning shader, from the model space in the bind pose to the model space in the pose
+     *
+     * @param pose the local transform of every joint
+     * @param matrices the skinning matrix of every joint
+     */
+    void ComputeSkinningMatrices(const std::vector<JointPose>& pose, std::vector<glm::mat4>& matrices) const
+    {
+        m_GlobalTransforms.resize(Joints.size());
+        matrices.resize(Joints.size());
+
+        for (unsigned int j : m_EvaluationOrder) {
+            const Joint& joint = Joints[j];
+            glm::mat4 parentTransform = joint.Parent < 0 ? joint.RootTransform : m_GlobalTransforms[joint.Parent];
+            m_GlobalTransforms[j] = parentTransform * pose[j].GetMatrix();
+            matrices[j] = GlobalInverseTransform * m_GlobalTransforms[j] * joint.InverseBindMatrix;
+        }
+    }
+
+private:
+    std::vector<unsigned int> m_EvaluationOrder;    // parents before their children
+    mutable std::vector<glm::mat4> m_GlobalTransforms;
+};
+
+
+enum class AnimationPath
+{
+    Translation,
+    Rotation,
+    Scale
+};
+
+
+enum class AnimationInterpolation
+{
+    Step,
+    Linear,
+    CubicSpline
+};
+
+
+/**
+ * @brief Keys of one component of the transform of one joint
+ *
+ */
+struct AnimationChannel
+{
+    unsigned int Joint = 0;
+    AnimationPath Path = AnimationPath::Translation;
+    AnimationInterpolation Interpolation = AnimationInterpolation::Linear;
+    std::vector<float> Times;           // in seconds, increasing
+    std::vector<glm::vec4> Values;      // xyz or quaternion xyzw, as in-tangent, value, out-tangent triplets for the cubic splines
+
+    /**
+     * @brief Value of the channel at the given time, clamped to the first and last keys
+     */
+    glm::vec4 Sample(float time) const
+    {
+        const unsigned int stride = Interpolation == AnimationInterpolation::CubicSpline ? 3 : 1;
+        const unsigned int valueOffset = Interpolation == AnimationInterpolation::CubicSpline ? 1 : 0;
+
+        if (Times.empty()) {
+            return glm::vec4(0.0f);
+        }
+        if (time <= Times.front() || Times.size() == 1) {
+            return Values[valueOffset];
+        }
+        if (time >= Times.back()) {
+            return Values[(Times.size() - 1) * stride + valueOffset];
+        }
+
+        unsigned int k = (unsigned int)(std::upper_bound(Times.begin(), Times.end(), time) - Times.begin()) - 1;
+        float dt = Times[k + 1] - Times[k];
+        float t = dt > 0.0f ? (time - Times[k]) / dt : 0.0f;
+
+        switch (Interpolation) {
+        case AnimationInterpolation::Step:
+            return Values[k];
+
+        case AnimationInterpolation::CubicSpline: {
+            const glm::vec4& v0 = Values[k * 3 + 1];
+            const glm::vec4& b0 = Values[k * 3 + 2];
+            const glm::vec4& a1 = Values[(k + 1) * 3];
+            const glm::vec4& v1 = Values[(k + 1) * 3 + 1];
+            float t2 = t * t;
+            float t3 = t2 * t;
+            glm::vec4 value = (2.0f * t3 - 3.0f * t2 + 1.0f) * v0 + dt * (t3 - 2.0f * t2 + t) * b0
+                            + (-2.0f * t3 + 3.0f * t2) * v1 + dt * (t3 - t2) * a1;
+            return Path == AnimationPath::Rotation ? glm::normalize(value) : value;
+        }
+
+        default:
+            if (Path == AnimationPath::Rotation) {
+                glm::quat q0(Values[k].w, Values[k].x, Values[k].y, Values[k].z);
+                glm::quat q1(Values[k + 1].w, Values[k + 1].x, Values[k + 1].y, Values[k + 1].z);
+                glm::quat q = glm::slerp(q0, q1, t);
+                return glm::vec4(q.x, q.y, q.z, q.w);
+            }
+            return glm::mix(Values[k], Values[k + 1], t);
+        }
+    }
+};
+
+
+class AnimationClip
+{
+public:
+    std::string Name;
+    float Duration = 0.0f;      // in seconds
+    std::vector<AnimationChannel> Channels;
+
+    /**
+     * @brief Heap bytes held by the clip, for the memory reports
+     */
+    size_t GetMemoryBytes() const
+    {
+        size_t bytes = Name.capacity() + Channels.capacity() * sizeof(AnimationChannel);
+        for (const AnimationChannel& channel : Channels) {
+            bytes += channel.Times.capacity() * sizeof(float) + channel.Values.capacity() * sizeof(glm::vec4);
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief Overwrite the animated components of the pose with their value at the given time, the clip is looped
+     *
+     * @param time the time in seconds since the start of the clip
+     * @param pose the local transform of every joint, usually initialized with the bind pose
+     */
+    void SamplePose(float time, std::vector<JointPose>& pose) const
+    {
+        float clipTime = Duration > 0.0f ? std::fmod(time, Duration) : 0.0f;
+
+        for (const AnimationChannel& channel : Channels) {
+            if (channel.Joint >= pose.size()) {
+                continue;
+            }
+
+            glm::vec4 value = channel.Sample(clipTime);
+            JointPose& jointPose = pose[channel.Joint];
+
+            switch (channel.Path) {
+            case AnimationPath::Translation:
+                jointPose.Translation = glm::vec3(value);
+                break;
+            case AnimationPath::Rotation:
+                jointPose.Rotation = glm::quat(value.w, value.x, value.y, value.z);
+                break;
+            case AnimationPath::Scale:
+                jointPose.Scale = glm::vec3(value);
+                break;
+            }
+        }
+    }
+};
+
+
+#endif
@@ -0,0 +1,549 @@
+// Static batching: the meshes of static objects are pre-transformed into world space at load time and merged
+// into shared buffers, grouped by material and by cell of a world grid so that the groups can still be culled.
+
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include "../shader.h"
+#include "../utils/thread_pool.h"
+#include "../utils/memory_report.h"
+
+#include "utils.h"
+#include "texture.h"
+#include "resource_manager.h"
+#include "mesh_optimizer.h"
+#include "meshlets.h"
+#include "frustum.h"
+#include "bounds.h"
+#include "virtual_io_system.h"
+#include "draw_uniforms.h"
+
+#define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a)/sizeof(a[0]))
+#define STATIC_BATCH_POSITION_LOCATION    0
+#define STATIC_BATCH_TEX_COORD_LOCATION   1
+#define STATIC_BATCH_NORMAL_LOCATION      2
+
+
+/**
+ * @brief Batches and draw calls submitted by the render calls since the last reset
+ *
+ */
+struct StaticBatchStatistics
+{
+    unsigned long BatchesRendered = 0;
+    unsigned long BatchesCulled = 0;
+    unsigned long DrawCalls = 0;
+    unsigned long TrianglesRendered = 0;
+};
+
+
+class StaticBatcher
+{
+private:
+    enum BUFFER_TYPE {
+        INDEX_BUFFER    = 0,
+        POS_VB          = 1,
+        TEXCOORD_VB     = 2,
+        NORMAL_VB       = 3,
+        INDIRECT_BUFFER = 4,
+        NUM_BUFFERS     = 5
+    };
+
+    GLuint m_VAO = 0;
+    GLuint m_Buffers[NUM_BUFFERS] = { 0 };
+
+    // Textures are shared by the materials that reference the same file, their handles are held here
+    struct BatchMaterial {
+        glm::vec3 AmbientColor = glm::vec3(1.0f);
+        glm::vec3 DiffuseColor = glm::vec3(0.0f);
+        glm::vec3 SpecularColor = glm::vec3(0.0f);
+        Texture* pDiffuse = NULL;
+        Texture* pSpecularExponent = NULL;
+    };
+
+    // A mesh of an added object, with the transform baked into its vertices
+    struct BatchedMesh {
+        const aiMesh* Mesh;
+        glm::mat4 Model;
+        unsigned int MaterialIndex;
+        glm::ivec3 Cell;
+    };
+
+    // Meshes of the same material and cell, drawn as one range of the index buffer
+    struct Batch {
+        unsigned int MaterialIndex = 0;
+        unsigned int BaseVertex = 0;
+        unsigned int NumVertices = 0;
+        unsigned int BaseIndex = 0;
+        unsigned int NumIndices = 0;
+        unsigned int FirstMesh = 0;     // in the sorted meshes
+        unsigned int NumMeshes = 0;
+        BoundingBox Bounds;         // in world space
+        BoundingSphere Sphere;
+    };
+
+    float m_CellSize;
+
+    // The scenes stay imported until the batches are built, a file added several times is imported once
+    std::map<std::string, std::unique_ptr<Assimp::Importer>> m_Importers;
+    std::map<std::string, std::vector<unsigned int>> m_FileMaterials;   // index of the batch material of each scene material
+    std::vector<BatchedMesh> m_PendingMeshes;
+    unsigned int m_NumObjects = 0;
+
+    std::map<std::string, unsigned int> m_MaterialKeys;
+    std::vector<BatchMaterial> m_Materials;
+    std::vector<std::shared_ptr<Texture>> m_Textures;
+
+    std::vector<Batch> m_Batches;               // sorted by material
+    std::vector<unsigned int> m_FirstBatch;     // first batch of each material, and the number of batches at the end
+    std::vector<DrawElementsIndirectCommand> m_DrawCommands;    // commands of the visible batches, rebuilt every render
+
+    StaticBatchStatistics m_RenderStatistics;
+
+public:
+    /**
+     * @param cellSize the size in world units of the cells of the grid that splits the material groups for the culling
+     */
+    StaticBatcher(float cellSize = 32.0f) : m_CellSize(cellSize) {}
+
+    StaticBatcher(const StaticBatcher&) = delete;
+    StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+    ~StaticBatcher()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        if (m_Buffers[0] != 0) {
+            glDeleteBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+            std::fill_n(m_Buffers, (unsigned int)NUM_BUFFERS, 0);
+        }
+
+        if (m_VAO != 0) {
+            glDeleteVertexArrays(1, &m_VAO);
+            m_VAO = 0;
+        }
+
+        m_Batches.clear();
+        m_FirstBatch.clear();
+    }
+
+    const StaticBatchStatistics& getRenderStatistics() const { return m_RenderStatistics; }
+
+    void resetRenderStatistics() { m_RenderStatistics = StaticBatchStatistics(); }
+
+    // true if a material of the batches has a specular exponent texture, the shader variant samples it
+    bool hasSpecularMap() const
+    {
+        for (const BatchMaterial& material : m_Materials) {
+            if (material.pSpecularExponent) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned int getNumBatches() const { return (unsigned int)m_Batches.size(); }
+
+    unsigned int getNumMaterials() const { return (unsigned int)m_Materials.size(); }
+
+    /**
+     * @brief Add an instance of the file in path to the batches, must be called before build
+     *
+     * @param path the path of the file to load
+     * @param model the model matrix of the instance, baked into the vertices
+     */
+    void addObject(const char* path, const glm::mat4& model)
+    {
+        const aiScene* scene = importScene(path);
+        if (!scene) {
+            return;
+        }
+
+        const std::vector<unsigned int>& materials = m_FileMaterials[path];
+
+        for (unsigned int i = 0 ; i < scene->mNumMeshes ; i++) {
+            const aiMesh* mesh = scene->mMeshes[i];
+            if (mesh->mNumFaces == 0) {
+                continue;
+            }
+
+            // The mesh goes to the cell of the center of its transformed bounds
+            BoundingBox bounds;
+            for (unsigned int v = 0 ; v < mesh->mNumVertices ; v++) {
+                bounds.Add(glm::vec3(model * glm::vec4(assimpToGlmVec3(mesh->mVertices[v]), 1.0f)));
+            }
+            glm::ivec3 cell = glm::ivec3(glm::floor(bounds.GetCenter() / m_CellSize));
+
+            m_PendingMeshes.push_back({ mesh, model, materials[mesh->mMaterialIndex], cell });
+        }
+
+        m_NumObjects++;
+    }
+
+    /**
+     * @brief Merge the added meshes into the shared buffers and release the imported scenes
+     *
+     * @param name the name of the batches, used in the report
+     */
+    void build(const char* name)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        Clear();
+
+        glGenVertexArrays(1, &m_VAO);
+        glBindVertexArray(m_VAO);
+        glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
+
+        // Group the meshes by material, then by cell
+        std::sort(m_PendingMeshes.begin(), m_PendingMeshes.end(), [](const BatchedMesh& a, const BatchedMesh& b) {
+            if (a.MaterialIndex != b.MaterialIndex) {
+                return a.MaterialIndex < b.MaterialIndex;
+            }
+            if (a.Cell.x != b.Cell.x) {
+                return a.Cell.x < b.Cell.x;
+            }
+            if (a.Cell.y != b.Cell.y) {
+                return a.Cell.y < b.Cell.y;
+            }
+            return a.Cell.z < b.Cell.z;
+        });
+
+        unsigned int NumVertices = 0;
+        unsigned int NumIndices = 0;
+        for (unsigned int i = 0 ; i < m_PendingMeshes.size() ; i++) {
+            const BatchedMesh& batched = m_PendingMeshes[i];
+            if (m_Batches.empty() || m_Batches.back().MaterialIndex != batched.MaterialIndex ||
+                m_PendingMeshes[i - 1].Cell != batched.Cell) {
+                Batch batch;
+                batch.MaterialIndex = batched.MaterialIndex;
+                batch.BaseVertex = NumVertices;
+                batch.BaseIndex = NumIndices;
+                batch.FirstMesh = i;
+                m_Batches.push_back(batch);
+            }
+
+            Batch& batch = m_Batches.back();
+            batch.NumVertices += batched.Mesh->mNumVertices;
+            batch.NumIndices += batched.Mesh->mNumFaces * 3;
+            batch.NumMeshes++;
+
+            NumVertices += batched.Mesh->mNumVertices;
+            NumIndices += batched.Mesh->mNumFaces * 3;
+        }
+
+        m_FirstBatch.assign(m_Materials.size() + 1, (unsigned int)m_Batches.size());
+        for (unsigned int b = (unsigned int)m_Batches.size() ; b-- > 0 ; ) {
+            m_FirstBatch[m_Batches[b].MaterialIndex] = b;
+        }
+        for (unsigned int m = (unsigned int)m_Materials.size() ; m-- > 0 ; ) {
+            m_FirstBatch[m] = std::min(m_FirstBatch[m], m_FirstBatch[m + 1]);
+        }
+
+        glm::vec3* mappedPositions = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB], sizeof(glm::vec3) * NumVertices);
+        glm::vec2* mappedTexCoords = (glm::vec2*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB], sizeof(glm::vec2) * NumVertices);
+        glm::vec3* mappedNormals = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB], sizeof(glm::vec3) * NumVertices);
+        unsigned int* mappedIndices = (unsigned int*)createMappedBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER],
+                                                                        sizeof(unsigned int) * NumIndices);
+
+        getThreadPool().parallelFor((unsigned int)m_Batches.size(), [&](unsigned int b) {
+            buildBatch(m_Batches[b], mappedPositions, mappedTexCoords, mappedNormals, mappedIndices);
+        });
+
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        populateBuffers();
+
+        std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Static batches of " << name << ": " << m_NumObjects << " objects, " << m_PendingMeshes.size() << " meshes -> "
+                  << m_Batches.size() << " batches of " << m_Materials.size() << " materials (" << NumIndices / 3
+                  << " triangles), built in " << buildTime.count() << " ms" << std::endl;
+
+        // The geometry is in the GL buffers now
+        m_PendingMeshes.clear();
+        m_PendingMeshes.shrink_to_fit();
+        m_Importers.clear();
+        m_FileMaterials.clear();
+
+        size_t textureBytes = 0;
+        for (const std::shared_ptr<Texture>& texture : m_Textures) {
+            textureBytes += texture->GetGpuBytes();
+        }
+        getMemoryReport().setAsset(std::string("static batch ") + name,
+                                   vectorBytes(m_Materials) + vectorBytes(m_Batches) + vectorBytes(m_FirstBatch) + vectorBytes(m_DrawCommands),
+                                   (size_t)NumVertices * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + (size_t)NumIndices * sizeof(unsigned int)
+                                   + m_Batches.size() * sizeof(DrawElementsIndirectCommand) + textureBytes);
+    }
+
+    /**
+     * @brief Render the batches inside the view frustum, with one indirect multi-draw per material.
+     * The vertices are in world space, so the model matrix of the shader must be the identity.
+     *
+     * The colors of each material go through the per-draw uniforms.
+     *
+     * @param view the view matrix
+     * @param projection the projection matrix
+     */
+    void render(const glm::mat4& view, const glm::mat4& projection)
+    {
+        Frustum frustum(projection * view);
+
+        m_DrawCommands.clear();
+        std::vector<unsigned int> firstCommand(m_Materials.size() + 1, 0);
+
+        for (unsigned int m = 0 ; m < m_Materials.size() ; m++) {
+            firstCommand[m] = (unsigned int)m_DrawCommands.size();
+
+            for (unsigned int b = m_FirstBatch[m] ; b < m_FirstBatch[m + 1] ; b++) {
+                const Batch& batch = m_Batches[b];
+
+                if (!frustum.IsSphereVisible(batch.Sphere.Center, batch.Sphere.Radius)) {
+                    m_RenderStatistics.BatchesCulled++;
+                    continue;
+                }
+
+                m_DrawCommands.push_back({ batch.NumIndices, 1, batch.BaseIndex, (int)batch.BaseVertex, 0 });
+                m_RenderStatistics.BatchesRendered++;
+                m_RenderStatistics.TrianglesRendered += batch.NumIndices / 3;
+            }
+        }
+        firstCommand[m_Materials.size()] = (unsigned int)m_DrawCommands.size();
+
+        if (m_DrawCommands.empty()) {
+            return;
+        }
+
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+
+        // Orphan the previous commands that may still be used by the GPU
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_Batches.size(), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * m_DrawCommands.size(), m_DrawCommands.data());
+
+        for (unsigned int m = 0 ; m < m_Materials.size() ; m++) {
+            unsigned int numCommands = firstCommand[m + 1] - firstCommand[m];
+            if (numCommands == 0) {
+                continue;
+            }
+
+            const BatchMaterial& material = m_Materials[m];
+            getDrawUniforms().setMaterial(material.AmbientColor, material.DiffuseColor, material.SpecularColor);
+            getDrawUniforms().bind();
+
+            if (material.pDiffuse) {
+                material.pDiffuse->Bind(COLOR_TEXTURE_UNIT);
+            }
+
+            if (material.pSpecularExponent) {
+                material.pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
+            }
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        (void*)(sizeof(DrawElementsIndirectCommand) * firstCommand[m]),
+                                        numCommands, 0);
+            m_RenderStatistics.DrawCalls++;
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        // Make sure the VAO is not changed from the outside
+        glBindVertexArray(0);
+    }
+
+private:
+    const aiScene* importScene(const char* path)
+    {
+        auto it = m_Importers.find(path);
+        if (it != m_Importers.end()) {
+            return it->second->GetScene();
+        }
+
+        std::unique_ptr<Assimp::Importer> importer(new Assimp::Importer());
+        importer->SetIOHandler(new VirtualIOSystem());
+        const aiScene* scene = importer->ReadFile(path,
+                                                  aiProcess_Triangulate             |
+                                                  aiProcess_GenNormals              |
+                                                  aiProcess_JoinIdenticalVertices   |
+                                                  aiProcess_ValidateDataStructure);
+        if (!scene) {
+            std::cout << "Error parsing " << path << ": " << importer->GetErrorString() << std::endl;
+            return NULL;
+        }
+
+        std::string directory = getDirFromPath(path);
+        std::vector<unsigned int>& materials = m_FileMaterials[path];
+        for (unsigned int i = 0 ; i < scene->mNumMaterials ; i++) {
+            materials.push_back(addMaterial(directory, scene->mMaterials[i]));
+        }
+
+        m_Importers[path] = std::move(importer);
+        return scene;
+    }
+
+    /**
+     * @brief Find or create the batch material with the same textures and colors as an assimp material
+     *
+     * @return the index of the batch material
+     */
+    unsigned int addMaterial(const std::string& directory, const aiMaterial* material)
+    {
+        BatchMaterial result;
+        std::string diffusePath = getAssimpTexturePath(directory, material, aiTextureType_DIFFUSE);
+        std::string specularPath = getAssimpTexturePath(directory, material, aiTextureType_SHININESS);
+
+        aiColor3D color(0.0f, 0.0f, 0.0f);
+        if (material->Get(AI_MATKEY_COLOR_AMBIENT, color) == AI_SUCCESS) {
+            result.AmbientColor = glm::vec3(color.r, color.g, color.b);
+        }
+        if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS) {
+            result.DiffuseColor = glm::vec3(color.r, color.g, color.b);
+        }
+        if (material->Get(AI_MATKEY_COLOR_SPECULAR, color) == AI_SUCCESS) {
+            result.SpecularColor = glm::vec3(color.r, color.g, color.b);
+        }
+
+        std::string key = diffusePath + "|" + specularPath;
+        for (const glm::vec3& c : { result.AmbientColor, result.DiffuseColor, result.SpecularColor }) {
+            key += "|" + std::to_string(c.r) + "," + std::to_string(c.g) + "," + std::to_string(c.b);
+        }
+
+        auto it = m_MaterialKeys.find(key);
+        if (it != m_MaterialKeys.end()) {
+            return it->second;
+        }
+
+        result.pDiffuse = loadTexture(diffusePath, true);
+        result.pSpecularExponent = loadTexture(specularPath, false);
+
+        m_MaterialKeys[key] = (unsigned int)m_Materials.size();
+        m_Materials.push_back(result);
+        return (unsigned int)m_Materials.size() - 1;
+    }
+
+    Texture* loadTexture(const std::string& path, bool color)
+    {
+        if (path.empty()) {
+            return NULL;
+        }
+
+        // the objects drawn one by one share the same textures
+        std::shared_ptr<Texture> texture = getResourceManager().loadTexture(path, false, color);
+        if (!texture) {
+            std::cout << "Error loading texture " << path << std::endl;
+            exit(0);
+        }
+
+        if (std::find(m_Textures.begin(), m_Textures.end(), texture) == m_Textures.end()) {
+            m_Textures.push_back(texture);
+        }
+        return texture.get();
+    }
+
+    /**
+     * @brief Transform the meshes of a batch into world space, optimize their merged triangles for the vertex cache
+     * and write them into the mappings
+     *
+     */
+    void buildBatch(Batch& batch, glm::vec3* mappedPositions, glm::vec2* mappedTexCoords, glm::vec3* mappedNormals,
+                    unsigned int* mappedIndices)
+    {
+        std::vector<glm::vec3> positions(batch.NumVertices);
+        std::vector<unsigned int> indices(batch.NumIndices);
+
+        unsigned int baseVertex = 0;
+        unsigned int baseIndex = 0;
+        for (unsigned int i = batch.FirstMesh ; i < batch.FirstMesh + batch.NumMeshes ; i++) {
+            const aiMesh* mesh = m_PendingMeshes[i].Mesh;
+            const glm::mat4& model = m_PendingMeshes[i].Model;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+            for (unsigned int v = 0 ; v < mesh->mNumVertices ; v++) {
+                positions[baseVertex + v] = glm::vec3(model * glm::vec4(assimpToGlmVec3(mesh->mVertices[v]), 1.0f));
+            }
+
+            glm::vec3* normals = &mappedNormals[batch.BaseVertex + baseVertex];
+            for (unsigned int v = 0 ; v < mesh->mNumVertices ; v++) {
+                glm::vec3 n = mesh->mNormals ? normalMatrix * assimpToGlmVec3(mesh->mNormals[v]) : glm::vec3(0.0f, 1.0f, 0.0f);
+                float length = glm::length(n);
+                normals[v] = length > 0.0f ? n / length : n;
+            }
+
+            if (mesh->HasTextureCoords(0)) {
+                assimpToGlmVec2Array(mesh->mTextureCoords[0], &mappedTexCoords[batch.BaseVertex + baseVertex], mesh->mNumVertices);
+            } else {
+                std::fill_n(&mappedTexCoords[batch.BaseVertex + baseVertex], mesh->mNumVertices, glm::vec2(0.0f));
+            }
+
+            for (unsigned int f = 0 ; f < mesh->mNumFaces ; f++) {
+                const aiFace& Face = mesh->mFaces[f];
+                indices[baseIndex++] = baseVertex + Face.mIndices[0];
+                indices[baseIndex++] = baseVertex + Face.mIndices[1];
+                indices[baseIndex++] = baseVertex + Face.mIndices[2];
+            }
+
+            baseVertex += mesh->mNumVertices;
+        }
+
+        optimizeVertexCache(indices.data(), batch.NumIndices, batch.NumVertices);
+
+        std::copy(positions.begin(), positions.end(), mappedPositions + batch.BaseVertex);
+        std::copy(indices.begin(), indices.end(), mappedIndices + batch.BaseIndex);
+
+        batch.Bounds = computeBoundingBox(positions.data(), batch.NumVertices);
+        batch.Sphere = computeBoundingSphere(positions.data(), batch.NumVertices, batch.Bounds);
+    }
+
+    /**
+     * @brief Unmap the vertex buffers and describe their layout in the VAO, with the locations of the static objects
+     *
+     */
+    void populateBuffers()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB]);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glEnableVertexAttribArray(STATIC_BATCH_POSITION_LOCATION);
+        glVertexAttribPointer(STATIC_BATCH_POSITION_LOCATION, 3, GL_FLOAT, false, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB]);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glEnableVertexAttribArray(STATIC_BATCH_TEX_COORD_LOCATION);
+        glVertexAttribPointer(STATIC_BATCH_TEX_COORD_LOCATION, 2, GL_FLOAT, false, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB]);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glEnableVertexAttribArray(STATIC_BATCH_NORMAL_LOCATION);
+        glVertexAttribPointer(STATIC_BATCH_NORMAL_LOCATION, 3, GL_FLOAT, false, 0, 0);
+
+        // At most one draw command per batch, rewritten every render
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * std::max((size_t)1, m_Batches.size()), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+};
+
+
+#endif
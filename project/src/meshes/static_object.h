@@ -3,6 +3,10 @@
 
 #include <iostream>
 #include <vector>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <memory>
 
 // Assimp library to load the mesh file
 #include <assimp/Importer.hpp>      // C++ importer interface
@@ -18,8 +22,20 @@
 
 #include "utils.h"
 #include "material.h"
+#include "material_table.h"
 #include "texture.h"
+#include "resource_manager.h"
 #include "world_transform.h"
+#include "mesh_optimizer.h"
+#include "virtual_io_system.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
+#include "frustum.h"
+#include "bounds.h"
+#include "draw_uniforms.h"
+#include "../utils/thread_pool.h"
+#include "../utils/memory_usage.h"
+#include "../utils/memory_report.h"
 
 using namespace Assimp;
 
@@ -28,6 +44,35 @@ using namespace Assimp;
 #define TEX_COORD_LOCATION   1
 #define NORMAL_LOCATION      2
 
+
+/**
+ * @brief Settings of the level of detail chain built when a static mesh is loaded
+ * 
+ */
+struct LodSettings
+{
+    unsigned int NumLods = 4;           // number of levels, including the full resolution one
+    float TriangleRatio = 0.5f;         // number of triangles of a level relative to the previous one
+    float MaxError = 0.05f;             // maximum simplification error, relative to the radius of the object
+    float FirstLodScreenSize = 0.4f;    // projected diameter (fraction of the viewport height) under which the level 1 is used
+    float ScreenSizeRatio = 0.5f;       // projected diameter of each next level relative to the previous one
+    float Hysteresis = 0.1f;            // relative margin around the thresholds to avoid popping between two levels
+};
+
+
+/**
+ * @brief Triangles submitted by the render calls since the last reset
+ * 
+ */
+struct RenderStatistics
+{
+    unsigned long TrianglesRendered = 0;
+    unsigned long TrianglesFullDetail = 0;
+    unsigned long TrianglesBackFaceCulled = 0;    // rejected by the normal cones of the meshlets
+    unsigned long TrianglesFrustumCulled = 0;     // rejected by the bounding spheres of the meshlets
+};
+
+
 class StaticObject
 {
 private:
@@ -38,7 +83,8 @@ private:
         POS_VB        = 1,
         TEXCOORD_VB   = 2,
         NORMAL_VB     = 3,
-        NUM_BUFFERS   = 4
+        INDIRECT_BUFFER = 4,
+        NUM_BUFFERS   = 5
     };
 
     WorldTrans m_worldTransform;
@@ -47,6 +93,14 @@ private:
     GLuint m_VAO = 0;
     GLuint m_Buffers[NUM_BUFFERS] = { 0 };
 
+    struct LodLevel {
+        unsigned int BaseIndex;
+        unsigned int NumIndices;
+        float Error;
+        unsigned int FirstMeshlet;
+        unsigned int NumMeshlets;
+    };
+
     struct BasicMeshEntry {
         BasicMeshEntry()
         {
@@ -62,18 +116,41 @@ private:
         unsigned int BaseVertex;
         unsigned int BaseIndex;
         unsigned int MaterialIndex;
+        bool SingleSided = false;       // closed and not double-sided, its back facing meshlets are never visible
+        BoundingBox Bounds;             // in model space
+        std::vector<LodLevel> Lods;     // the level 0 is the full resolution mesh
     };
 
-    Assimp::Importer importer;  // the assimp importer
-    const aiScene* scene;   // the assimp scene
+    const aiScene* scene = NULL;   // the assimp scene, only set during the loading
+    std::unique_ptr<Assimp::Importer> m_Importer;   // owns the scene between ImportMesh and FinishLoad
+    std::string m_Path;
+    double m_ImportMs = 0.0;
+    size_t m_PeakMemoryBefore = 0;      // peak resident memory when the loading started
     std::vector<BasicMeshEntry> m_Meshes;   // meshes
     std::vector<Material> m_Materials;  //materials
+    unsigned int m_FirstMaterial = 0;   // index of the first material in the material table, when it is used
+
+    std::vector<std::string> m_DiffusePaths;    // texture files of each material, loaded by FinishLoad
+    std::vector<std::string> m_SpecularPaths;
+
+    // Indices and meshlets of every level of detail of a mesh and its vertex fetch order, built by ImportMesh
+    // and kept until FinishLoad writes the mesh into the mapped buffers
+    struct MeshLoadResult {
+        std::vector<std::vector<unsigned int>> LodIndices;
+        std::vector<std::vector<Meshlet>> LodMeshlets;
+        std::vector<unsigned int> Order;        // vertex of the scene at each place of the vertex buffer
+    };
+    std::vector<MeshLoadResult> m_LoadResults;
+
+    LodSettings m_LodSettings;
+    unsigned int m_NumLods = 1;
+    BoundingBox m_BoundingBox;          // in model space
+    BoundingSphere m_BoundingSphere;
+
+    std::vector<Meshlet> m_Meshlets;
+    std::vector<DrawElementsIndirectCommand> m_DrawCommands;    // commands of the visible meshlets, rebuilt every render
 
-    // Temporary space for vertex stuff before we load them into the GPU
-    std::vector<glm::vec3> m_Positions;
-    std::vector<glm::vec3> m_Normals;
-    std::vector<glm::vec2> m_TexCoords;
-    std::vector<unsigned int> m_Indices;
+    RenderStatistics m_RenderStatistics;
 
 
 public:
@@ -102,6 +179,26 @@ public:
 
     WorldTrans& getWorldTransform() { return m_worldTransform; }
 
+    /**
+     * @brief Set the settings of the level of detail chain, must be called before LoadMesh
+     * 
+     */
+    void setLodSettings(const LodSettings& settings) { m_LodSettings = settings; }
+
+    unsigned int getNumLods() const { return m_NumLods; }
+
+    const RenderStatistics& getRenderStatistics() const { return m_RenderStatistics; }
+
+    void resetRenderStatistics() { m_RenderStatistics = RenderStatistics(); }
+
+    const BoundingBox& getBoundingBox() const { return m_BoundingBox; }
+
+    const BoundingSphere& getBoundingSphere() const { return m_BoundingSphere; }
+
+    unsigned int getNumMeshes() const { return (unsigned int)m_Meshes.size(); }
+
+    const BoundingBox& getMeshBoundingBox(unsigned int meshIndex) const { return m_Meshes[meshIndex].Bounds; }
+
     /**
      * @brief Load meshes from the file in path
      * 
@@ -109,6 +206,66 @@ public:
      */
     void LoadMesh(const char* path)
     {
+        if (ImportMesh(path)) {
+            FinishLoad();
+        }
+    }
+
+    /**
+     * @brief First part of LoadMesh, without any GL call so that it can run on a loading thread: import the file,
+     * optimize the meshes and build their levels of detail and meshlets. The vertices stay in the scene until
+     * FinishLoad, which must then be called on the GL thread, writes them into the mapped buffers.
+     *
+     * @param prefetchImages true to also decode the images of the materials here (see ImagePrefetcher)
+     * @return false if the file can't be imported
+     */
+    bool ImportMesh(const char* path, bool prefetchImages = false)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_Path = path;
+        m_PeakMemoryBefore = getPeakResidentMemory();
+
+        // Import the file content with the assimp library, through the virtual file system.
+        // The importer owns the scene, it is released with the importer once the data is on the GPU
+        m_Importer.reset(new Assimp::Importer());
+        m_Importer->SetIOHandler(new VirtualIOSystem());
+        scene = m_Importer->ReadFile(path, 
+								aiProcess_Triangulate  				|
+                                aiProcess_GenNormals                |
+								aiProcess_JoinIdenticalVertices		|
+								aiProcess_ValidateDataStructure);
+
+        if (!scene) {
+            std::cout << "Error parsing " << path << ": " << m_Importer->GetErrorString() << std::endl;
+            m_Importer.reset();
+            return false;
+        }
+
+        std::string directory = getDirFromPath(path);
+        for (unsigned int i = 0 ; prefetchImages && i < scene->mNumMaterials ; i++) {
+            for (aiTextureType type : { aiTextureType_DIFFUSE, aiTextureType_SHININESS }) {
+                std::string texturePath = getAssimpTexturePath(directory, scene->mMaterials[i], type);
+                if (!texturePath.empty()) {
+                    getImagePrefetcher().prefetch(texturePath, type == aiTextureType_DIFFUSE);
+                }
+            }
+        }
+
+        initFromScene(path);
+
+        m_ImportMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    /**
+     * @brief Second part of LoadMesh, on the GL thread: allocate and map the buffers, write the meshes processed
+     * by ImportMesh straight into the mapping, describe the buffers in the VAO and load the textures
+     *
+     */
+    void FinishLoad()
+    {
+        auto start = std::chrono::steady_clock::now();
+
         // Release the previously loaded mesh (if it exists)
         Clear();
 
@@ -119,23 +276,75 @@ public:
         // Create the buffers for the vertices attributes
         glGenBuffers(ARRAY_SIZE_IN_ELEMENTS(m_Buffers), m_Buffers);
 
-        // Import the file content with the assimp library
-        scene = importer.ReadFile(path, 
-								aiProcess_Triangulate  				|
-                                aiProcess_GenNormals                |
-								aiProcess_JoinIdenticalVertices		|
-								aiProcess_ValidateDataStructure);
+        loadTextures();
+        m_FirstMaterial = getMaterialTable().addMaterials(m_Materials);
 
-        if (scene) {
-            initFromScene(path);
+        populateBuffers();
+
+        std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Loaded " << m_Path << ": " << m_ImportMs << " ms to import and process, " << loadTime.count()
+                  << " ms on the GL thread" << std::endl;
+        std::cout << "Peak resident memory while loading " << m_Path << ": " << toMiB(m_PeakMemoryBefore) << " MiB -> "
+                  << toMiB(getPeakResidentMemory()) << " MiB" << std::endl;
+
+        reportMemory(m_Path);
+        std::vector<MeshLoadResult>().swap(m_LoadResults);
+        scene = NULL;
+        m_Importer.reset();
+    }
+
+    bool isLoaded() const { return m_VAO != 0 && !m_Importer; }
+
+    /**
+     * @brief true if a material of the object has a specular exponent texture, the shader variant samples it
+     *
+     */
+    bool hasSpecularMap() const
+    {
+        for (const Material& material : m_Materials) {
+            if (material.pSpecularExponent) {
+                return true;
+            }
         }
-        else {
-            std::cout << "Error parsing " << path << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    /**
+     * @brief Report the memory kept by the object to the memory report
+     * 
+     * @param name the name of the object in the report
+     */
+    void reportMemory(const std::string& name) const
+    {
+        size_t NumVertices = 0;
+        size_t NumIndices = 0;
+        size_t cpuBytes = vectorBytes(m_Meshes) + vectorBytes(m_Materials) + vectorBytes(m_Meshlets) + vectorBytes(m_DrawCommands);
+        for (const BasicMeshEntry& mesh : m_Meshes) {
+            NumVertices += mesh.NumVertices;
+            for (const LodLevel& level : mesh.Lods) {
+                NumIndices += level.NumIndices;
+            }
+            cpuBytes += vectorBytes(mesh.Lods);
+        }
+
+        size_t gpuBytes = NumVertices * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + NumIndices * sizeof(unsigned int)
+                        + m_Meshlets.size() * sizeof(DrawElementsIndirectCommand);
+        for (const Material& material : m_Materials) {
+            gpuBytes += material.GetTextureBytes();
         }
+        getMemoryReport().setAsset(name, cpuBytes, gpuBytes);
     }
 
+    /**
+     * @brief Optimize the meshes of the scene with the thread pool and place them in the buffers, from the counts
+     * of the scene. No GL call: the buffers are written by FinishLoad.
+     * 
+     * @param path the path of the loaded file, used in the reports
+     */
     void initFromScene(const char* path)
     {
+        auto start = std::chrono::steady_clock::now();
+
         m_Meshes.resize(scene->mNumMeshes);
         m_Materials.resize(scene->mNumMaterials);
 
@@ -144,12 +353,18 @@ public:
 
         countVerticesAndIndices(NumVertices, NumIndices);
 
-        reserveSpace(NumVertices, NumIndices);
+        computeBounds();
 
-        initAllMeshes();
-        initMaterials(path);
+        m_LoadResults.clear();
+        m_LoadResults.resize(m_Meshes.size());
+        initAllMeshes(path, m_LoadResults);
+        placeLods(path, m_LoadResults);
 
-        populateBuffers();
+        std::chrono::duration<double, std::milli> meshTime = std::chrono::steady_clock::now() - start;
+        std::cout << "Meshes of " << path << " processed in " << meshTime.count() << " ms with "
+                  << getThreadPool().getNumThreads() << " worker threads" << std::endl;
+
+        initMaterials(path);
     }
 
     void countVerticesAndIndices(unsigned int& NumVertices, unsigned int& NumIndices)
@@ -166,134 +381,338 @@ public:
         }
     }
 
-    void reserveSpace(unsigned int NumVertices, unsigned int NumIndices)
+    /**
+     * @brief Import and optimize the meshes in parallel and print the optimization statistics
+     * 
+     * @param path the path of the loaded file, used in the report
+     * @param results the indices and meshlets of each mesh
+     */
+    void initAllMeshes(const char* path, std::vector<MeshLoadResult>& results)
+    {
+        std::vector<MeshOptimizationStatistics> meshStats(m_Meshes.size());
+
+        getThreadPool().parallelFor((unsigned int)m_Meshes.size(), [&](unsigned int i) {
+            initSingleMesh(i, scene->mMeshes[i], results[i], meshStats[i]);
+        });
+
+        MeshOptimizationStatistics stats;
+        for (const MeshOptimizationStatistics& s : meshStats) {
+            stats.CacheBefore.Add(s.CacheBefore);
+            stats.CacheAfter.Add(s.CacheAfter);
+            stats.OverdrawBefore.Add(s.OverdrawBefore);
+            stats.OverdrawAfter.Add(s.OverdrawAfter);
+        }
+        stats.Print(path);
+    }
+
+    /**
+     * @brief Optimize a mesh and build its levels of detail and meshlets with the original vertex numbering, reading the
+     * attributes in place from assimp, then renumber the vertices for the vertex fetch
+     * 
+     * @param meshIndex the index of the mesh
+     * @param mesh the assimp mesh
+     * @param result the indices and meshlets of the mesh and its vertex fetch order
+     * @param stats the optimization statistics of the mesh
+     */
+    void initSingleMesh(uint meshIndex, const aiMesh* mesh, MeshLoadResult& result, MeshOptimizationStatistics& stats)
+    {
+        BasicMeshEntry& entry = m_Meshes[meshIndex];
+
+        std::vector<glm::vec3> positionStorage;
+        std::vector<glm::vec3> normalStorage;
+        const glm::vec3* positions = assimpAsGlmVec3Array(mesh->mVertices, mesh->mNumVertices, positionStorage);
+        const glm::vec3* normals = mesh->mNormals ? assimpAsGlmVec3Array(mesh->mNormals, mesh->mNumVertices, normalStorage) : NULL;
+
+        // Populate the index buffer of the level 0
+        std::vector<std::vector<unsigned int>>& lodIndices = result.LodIndices;
+        lodIndices.resize(1);
+        lodIndices[0].resize(entry.NumIndices);
+        for (unsigned int i = 0 ; i < mesh->mNumFaces ; i++) {
+            const aiFace& Face = mesh->mFaces[i];
+            //        printf("num indices %d\n", Face.mNumIndices);
+            //        assert(Face.mNumIndices == 3);
+            lodIndices[0][3 * i] = Face.mIndices[0];
+            lodIndices[0][3 * i + 1] = Face.mIndices[1];
+            lodIndices[0][3 * i + 2] = Face.mIndices[2];
+        }
+
+        optimizeTriangleOrder(lodIndices[0].data(), entry.NumIndices, positions, entry.NumVertices, stats);
+
+        // GL_CULL_FACE is disabled, the back faces of the open meshes (the foliage planes) are drawn
+        int twoSided = 0;
+        scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_TWOSIDED, twoSided);
+        entry.SingleSided = !twoSided && isClosedMesh(lodIndices[0].data(), entry.NumIndices, positions, entry.NumVertices);
+
+        buildLods(entry, lodIndices, mesh, positions, normals);
+
+        result.LodMeshlets.resize(lodIndices.size());
+        for (unsigned int lod = 0 ; lod < lodIndices.size() ; lod++) {
+            buildMeshlets(lodIndices[lod].data(), 0, (unsigned int)lodIndices[lod].size(), positions, result.LodMeshlets[lod]);
+        }
+
+        // The vertices of the levels of detail are a subset of the ones of the level 0
+        std::vector<unsigned int> remap = optimizeVertexFetch(lodIndices[0].data(), entry.NumIndices, entry.NumVertices);
+        for (unsigned int lod = 1 ; lod < lodIndices.size() ; lod++) {
+            for (unsigned int& index : lodIndices[lod]) {
+                index = remap[index];
+            }
+        }
+        result.Order = invertRemap(remap);
+    }
+
+    /**
+     * @brief Write the vertices of a mesh in its vertex fetch order at its base vertex in the mapped buffers
+     * 
+     * @param meshIndex the index of the mesh
+     */
+    void writeMeshVertices(unsigned int meshIndex, glm::vec3* positions, glm::vec3* normals, glm::vec2* texCoords)
     {
-        m_Positions.reserve(NumVertices);
-        m_Normals.reserve(NumVertices);
-        m_TexCoords.reserve(NumVertices);
-        m_Indices.reserve(NumIndices);
+        const aiMesh* mesh = scene->mMeshes[meshIndex];
+        const BasicMeshEntry& entry = m_Meshes[meshIndex];
+        const std::vector<unsigned int>& order = m_LoadResults[meshIndex].Order;
+
+        gatherVertexBuffer(positions + entry.BaseVertex, mesh->mVertices, order, assimpToGlmVec3);
+
+        if (mesh->mNormals) {
+            gatherVertexBuffer(normals + entry.BaseVertex, mesh->mNormals, order, assimpToGlmVec3);
+        } else {
+            std::fill_n(normals + entry.BaseVertex, mesh->mNumVertices, glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+
+        if (mesh->HasTextureCoords(0)) {
+            gatherVertexBuffer(texCoords + entry.BaseVertex, mesh->mTextureCoords[0], order,
+                               [](const aiVector3D& t) { return glm::vec2(t.x, t.y); });
+        } else {
+            std::fill_n(texCoords + entry.BaseVertex, mesh->mNumVertices, glm::vec2(0.0f));
+        }
     }
 
-    void initAllMeshes()
+
+    /**
+     * @brief Compute the bounding box of every mesh and the bounding box and sphere of the object, in model space
+     * 
+     */
+    void computeBounds()
     {
+        std::vector<std::vector<glm::vec3>> positionStorage(m_Meshes.size());
+        std::vector<const glm::vec3*> positions(m_Meshes.size());
+
+        m_BoundingBox = BoundingBox();
         for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
             const aiMesh* mesh = scene->mMeshes[i];
-            initSingleMesh(i, mesh);
+            positions[i] = assimpAsGlmVec3Array(mesh->mVertices, mesh->mNumVertices, positionStorage[i]);
+            m_Meshes[i].Bounds = computeBoundingBox(positions[i], mesh->mNumVertices);
+            m_BoundingBox.Add(m_Meshes[i].Bounds);
+        }
+
+        m_BoundingSphere = BoundingSphere();
+        for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+            BoundingSphere sphere = computeBoundingSphere(positions[i], scene->mMeshes[i]->mNumVertices, m_BoundingBox);
+            m_BoundingSphere.Center = sphere.Center;
+            m_BoundingSphere.Radius = std::max(m_BoundingSphere.Radius, sphere.Radius);
         }
     }
 
-    void initSingleMesh(uint meshIndex, const aiMesh* mesh)
+
+    /**
+     * @brief Simplify a mesh into a chain of levels of detail, that reference the vertices of the full resolution mesh
+     * 
+     * @param entry the mesh entry, its levels are set except their place in the index buffer
+     * @param lodIndices the indices of the level 0, the indices of the next levels are appended
+     * @param mesh the assimp mesh
+     * @param positions the positions of the mesh
+     * @param normals the normals of the mesh (can be NULL)
+     */
+    void buildLods(BasicMeshEntry& entry, std::vector<std::vector<unsigned int>>& lodIndices, const aiMesh* mesh,
+                   const glm::vec3* positions, const glm::vec3* normals)
     {
-        const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+        float maxError = m_LodSettings.MaxError * m_BoundingSphere.Radius;
 
-        // Populate the vertex attribute vectors
-        for (unsigned int i = 0 ; i < mesh->mNumVertices ; i++) {
+        entry.Lods.clear();
+        entry.Lods.push_back({ 0, entry.NumIndices, 0.0f, 0, 0 });
 
-            const aiVector3D& pos = mesh->mVertices[i];
-            m_Positions.push_back(glm::vec3(pos.x, pos.y, pos.z));
+        // The texture coordinates are only used to choose among the vertices of a seam
+        std::vector<glm::vec2> texCoords;
+        if (mesh->HasTextureCoords(0) && m_LodSettings.NumLods > 1) {
+            texCoords.resize(mesh->mNumVertices);
+            assimpToGlmVec2Array(mesh->mTextureCoords[0], texCoords.data(), mesh->mNumVertices);
+        }
+
+        while (entry.Lods.size() < m_LodSettings.NumLods) {
+            const LodLevel previous = entry.Lods.back();
+            unsigned int target = (unsigned int)(previous.NumIndices * m_LodSettings.TriangleRatio) / 3 * 3;
 
-            if (mesh->mNormals) {
-                const aiVector3D& normal = mesh->mNormals[i];
-                m_Normals.push_back(glm::vec3(normal.x, normal.y, normal.z));
-            } else {
-                m_Normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+            float error = 0.0f;
+            std::vector<unsigned int> indices = simplifyMesh(lodIndices.back().data(), previous.NumIndices,
+                                                             positions, normals, texCoords.empty() ? NULL : texCoords.data(),
+                                                             entry.NumVertices, target, maxError - previous.Error, error);
+
+            // Stop when the simplification is blocked by the error limit or by the locked vertices
+            if (indices.empty() || indices.size() > previous.NumIndices * 0.9f) {
+                break;
             }
 
-            const aiVector3D& texCoord = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : Zero3D;
-            m_TexCoords.push_back(glm::vec2(texCoord.x, texCoord.y));
-        }
+            optimizeVertexCache(indices.data(), (unsigned int)indices.size(), entry.NumVertices);
 
-        // Populate the index buffer
-        for (unsigned int i = 0 ; i < mesh->mNumFaces ; i++) {
-            const aiFace& Face = mesh->mFaces[i];
-            //        printf("num indices %d\n", Face.mNumIndices);
-            //        assert(Face.mNumIndices == 3);
-            m_Indices.push_back(Face.mIndices[0]);
-            m_Indices.push_back(Face.mIndices[1]);
-            m_Indices.push_back(Face.mIndices[2]);
+            entry.Lods.push_back({ 0, (unsigned int)indices.size(), previous.Error + error, 0, 0 });
+            lodIndices.push_back(std::move(indices));
         }
     }
 
 
-    void initMaterials(const char* path)
+    /**
+     * @brief Place the levels of detail of every mesh one after the other in the index buffer, with their meshlets,
+     * and print the number of triangles of each level
+     * 
+     * @param path the path of the loaded file, used in the report
+     * @param results the indices and meshlets of each mesh
+     */
+    void placeLods(const char* path, const std::vector<MeshLoadResult>& results)
     {
-        std::string directory = getDirFromPath(path);
+        m_NumLods = 1;
+        m_Meshlets.clear();
 
-        // Initialize the materials
-        for (unsigned int i = 0 ; i < scene->mNumMaterials ; i++) {
-            const aiMaterial* material = scene->mMaterials[i];
+        unsigned int NumIndices = 0;
+        for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+            BasicMeshEntry& entry = m_Meshes[i];
+            entry.BaseIndex = NumIndices;
+
+            for (unsigned int lod = 0 ; lod < entry.Lods.size() ; lod++) {
+                LodLevel& level = entry.Lods[lod];
+                level.BaseIndex = NumIndices;
+                level.FirstMeshlet = (unsigned int)m_Meshlets.size();
+                level.NumMeshlets = (unsigned int)results[i].LodMeshlets[lod].size();
+
+                for (Meshlet meshlet : results[i].LodMeshlets[lod]) {
+                    meshlet.BaseIndex += level.BaseIndex;
+                    m_Meshlets.push_back(meshlet);
+                }
 
-            loadTextures(directory, material, i);
+                NumIndices += level.NumIndices;
+            }
 
-            loadColors(material, i);
+            m_NumLods = std::max(m_NumLods, (unsigned int)entry.Lods.size());
         }
+
+        std::cout << "Levels of detail of " << path << ":";
+        for (unsigned int lod = 0 ; lod < m_NumLods ; lod++) {
+            unsigned int numTriangles = 0;
+            for (const BasicMeshEntry& entry : m_Meshes) {
+                numTriangles += entry.Lods[std::min(lod, (unsigned int)entry.Lods.size() - 1)].NumIndices / 3;
+            }
+            std::cout << " " << numTriangles;
+        }
+        std::cout << " triangles" << std::endl;
     }
 
 
-    void loadTextures(const std::string& directory, const aiMaterial* material, int index)
+    /**
+     * @brief Projected diameter of the bounding sphere of the object, as a fraction of the viewport height
+     * 
+     */
+    float projectedScreenSize(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection) const
     {
-        loadDiffuseTexture(directory, material, index);
-        loadSpecularTexture(directory, material, index);
+        glm::mat4 modelView = view * model;
+        glm::vec3 center = glm::vec3(modelView * glm::vec4(m_BoundingSphere.Center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float radius = m_BoundingSphere.Radius * scale;
+
+        return ::projectedScreenSize(center, radius, projection);
     }
-    
-    void loadDiffuseTexture(const std::string& directory, const aiMaterial* material, int index)
-    {
-        m_Materials[index].pDiffuse = NULL;
 
-        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-            aiString Path;
 
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string p(Path.data);
+    /**
+     * @brief Request the levels of the streamed textures needed by an instance of the object
+     *
+     * @param screenPixels the projected size of the instance, in pixels
+     */
+    void requestTextureDetail(float screenPixels)
+    {
+        for (Material& material : m_Materials) {
+            material.RequestTextureDetail(screenPixels);
+        }
+    }
 
-                if (p.substr(0, 2) == ".\\") {
-                    p = p.substr(2, p.size() - 2);
-                }
 
-                std::string FullPath = directory + "/" + p;
+    float lodScreenSize(unsigned int lod) const
+    {
+        return m_LodSettings.FirstLodScreenSize * std::pow(m_LodSettings.ScreenSizeRatio, (float)lod - 1.0f);
+    }
 
-                m_Materials[index].pDiffuse = new Texture(GL_TEXTURE_2D, FullPath.c_str());
 
-                if (!m_Materials[index].pDiffuse->Load()) {
-                    std::cout << "Error loading diffuse texture " << FullPath.c_str() << std::endl;
-                    exit(0);
-                }
-                else {
-                    //std::cout << "Loaded diffuse texture " << FullPath.c_str() << std::endl;
-                }
-            }
+    /**
+     * @brief Select the level of detail of an instance of the object from its projected size on the screen
+     * 
+     * @param model the model matrix of the instance
+     * @param view the view matrix
+     * @param projection the projection matrix
+     * @param currentLod the level used by the instance in the previous frame, updated with the new one
+     * @return the level of detail to render
+     */
+    unsigned int selectLod(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, unsigned int& currentLod) const
+    {
+        float screenSize = projectedScreenSize(model, view, projection);
+        float h = m_LodSettings.Hysteresis;
+        unsigned int lod = std::min(currentLod, m_NumLods - 1);
+
+        // The switch only happens when the size is out of the threshold by the hysteresis margin
+        while (lod + 1 < m_NumLods && screenSize < lodScreenSize(lod + 1) * (1.0f - h)) {
+            lod++;
+        }
+        while (lod > 0 && screenSize > lodScreenSize(lod) * (1.0f + h)) {
+            lod--;
         }
+
+        currentLod = lod;
+        return lod;
     }
-    
-    void loadSpecularTexture(const std::string& directory, const aiMaterial* material, int index)
+
+
+    /**
+     * @brief Read the colors and the texture files of the materials, the textures are loaded by FinishLoad
+     *
+     */
+    void initMaterials(const char* path)
     {
-        m_Materials[index].pSpecularExponent = NULL;
+        std::string directory = getDirFromPath(path);
 
-        if (material->GetTextureCount(aiTextureType_SHININESS) > 0) {
-            aiString Path;
+        m_DiffusePaths.resize(scene->mNumMaterials);
+        m_SpecularPaths.resize(scene->mNumMaterials);
 
-            if (material->GetTexture(aiTextureType_SHININESS, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string p(Path.data);
+        // Initialize the materials
+        for (unsigned int i = 0 ; i < scene->mNumMaterials ; i++) {
+            const aiMaterial* material = scene->mMaterials[i];
 
-                if (p == "C:\\\\") {
-                    p = "";
-                } else if (p.substr(0, 2) == ".\\") {
-                    p = p.substr(2, p.size() - 2);
-                }
+            m_DiffusePaths[i] = getAssimpTexturePath(directory, material, aiTextureType_DIFFUSE);
+            m_SpecularPaths[i] = getAssimpTexturePath(directory, material, aiTextureType_SHININESS);
 
-                std::string FullPath = directory + "/" + p;
+            loadColors(material, i);
+        }
+    }
 
-                m_Materials[index].pSpecularExponent = new Texture(GL_TEXTURE_2D, FullPath.c_str());
 
-                if (!m_Materials[index].pSpecularExponent->Load()) {
-                    std::cout << "Error loading specular texture " << FullPath.c_str() << std::endl;
-                    exit(0);
-                }
-                else {
-                    //std::cout << "Loaded specular texture " << FullPath.c_str() << std::endl;
-                }
-            }
+    void loadTextures()
+    {
+        for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+            m_Materials[i].pDiffuse = loadMaterialTexture(m_DiffusePaths[i], "diffuse", true);
+            m_Materials[i].pSpecularExponent = loadMaterialTexture(m_SpecularPaths[i], "specular", false);
+        }
+    }
+
+    std::shared_ptr<Texture> loadMaterialTexture(const std::string& path, const char* type, bool color)
+    {
+        if (path.empty()) {
+            return std::shared_ptr<Texture>();
+        }
+
+        // shared with the other objects that load the same file
+        std::shared_ptr<Texture> texture = getResourceManager().loadTexture(path, true, color);
+
+        if (!texture) {
+            std::cout << "Error loading " << type << " texture " << path << std::endl;
+            exit(0);
         }
+        return texture;
     }
     
     void loadColors(const aiMaterial* material, int index)
@@ -334,25 +753,63 @@ public:
     }
 
 
+    /**
+     * @brief Allocate and map the buffers, write the meshes into the mapping with the thread pool, then unmap
+     * the buffers and describe their layout in the VAO
+     * 
+     */
     void populateBuffers()
     {
+        unsigned int NumVertices = 0;
+        unsigned int NumIndices = 0;
+        for (const BasicMeshEntry& entry : m_Meshes) {
+            NumVertices += entry.NumVertices;
+            for (const LodLevel& level : entry.Lods) {
+                NumIndices += level.NumIndices;
+            }
+        }
+
+        glm::vec3* positions = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB], sizeof(glm::vec3) * NumVertices);
+        glm::vec2* texCoords = (glm::vec2*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB], sizeof(glm::vec2) * NumVertices);
+        glm::vec3* normals = (glm::vec3*)createMappedBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB], sizeof(glm::vec3) * NumVertices);
+
+        // The VAO is bound, so it keeps this index buffer
+        unsigned int* indices = (unsigned int*)createMappedBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER],
+                                                                  sizeof(unsigned int) * NumIndices);
+
+        getThreadPool().parallelFor((unsigned int)m_Meshes.size(), [&](unsigned int i) {
+            writeMeshVertices(i, positions, normals, texCoords);
+            for (unsigned int lod = 0 ; lod < m_Meshes[i].Lods.size() ; lod++) {
+                const std::vector<unsigned int>& lodIndices = m_LoadResults[i].LodIndices[lod];
+                std::copy(lodIndices.begin(), lodIndices.end(), indices + m_Meshes[i].Lods[lod].BaseIndex);
+            }
+        });
+
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[POS_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_Positions[0]) * m_Positions.size(), &m_Positions[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(POSITION_LOCATION);
         glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, false, 0, 0);
         
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[TEXCOORD_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_TexCoords[0]) * m_TexCoords.size(), &m_TexCoords[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(TEX_COORD_LOCATION);
         glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, false, 0, 0);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[NORMAL_VB]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(m_Normals[0]) * m_Normals.size(), &m_Normals[0], GL_STATIC_DRAW);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
         glEnableVertexAttribArray(NORMAL_LOCATION);
         glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, false, 0, 0);
-        
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(m_Indices[0]) * m_Indices.size(), &m_Indices[0], GL_STATIC_DRAW);
+
+        if (getMaterialTable().isEnabled()) {
+            bindMaterialIndexAttribute();
+        }
+
+        // At most one draw command per meshlet, rewritten every render
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_Meshlets.size(), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
         //desactive the buffer
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -363,36 +820,150 @@ public:
     /**
      * @brief Render the object in the screen
      * 
+     * @param lod the level of detail to render
      */
-    void render()
+    void render(unsigned int lod = 0)
     {
+        // the model matrix and the material of the object, set by the caller
+        getDrawUniforms().bind();
         glBindVertexArray(m_VAO);
 
         for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
             unsigned int MaterialIndex = m_Meshes[i].MaterialIndex;
 
-            assert(MaterialIndex < m_Materials.size());
+            bindTextures(MaterialIndex);
 
-            if (m_Materials[MaterialIndex].pDiffuse) {
-                m_Materials[MaterialIndex].pDiffuse->Bind(COLOR_TEXTURE_UNIT);
-            }
+            const LodLevel& level = m_Meshes[i].Lods[std::min(lod, (unsigned int)m_Meshes[i].Lods.size() - 1)];
+
+            // the base instance is the index of the material in the material table
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                                                          level.NumIndices,
+                                                          GL_UNSIGNED_INT,
+                                                          (void*)(sizeof(unsigned int) * level.BaseIndex),
+                                                          1,
+                                                          m_Meshes[i].BaseVertex,
+                                                          m_FirstMaterial + MaterialIndex);
+
+            m_RenderStatistics.TrianglesRendered += level.NumIndices / 3;
+            m_RenderStatistics.TrianglesFullDetail += m_Meshes[i].NumIndices / 3;
+        }
+
+        // Make sure the VAO is not changed from the outside
+        glBindVertexArray(0);
+    }
+
+
+    /**
+     * @brief Render the object in the screen, skipping the meshlets that are outside of the view frustum
+     * or back facing (only in the single-sided meshes), with one indirect multi-draw per mesh
+     * 
+     * @param model the model matrix of the instance
+     * @param view the view matrix
+     * @param projection the projection matrix
+     * @param lod the level of detail to render
+     */
+    void render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, unsigned int lod)
+    {
+        // Frustum and camera in model space, where the bounds of the meshlets are
+        Frustum frustum(projection * view * model);
+        glm::vec3 cameraPos = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+        m_DrawCommands.clear();
+        std::vector<unsigned int> firstCommand(m_Meshes.size() + 1, 0);
+
+        for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+            const LodLevel& level = m_Meshes[i].Lods[std::min(lod, (unsigned int)m_Meshes[i].Lods.size() - 1)];
+            firstCommand[i] = (unsigned int)m_DrawCommands.size();
+
+            for (unsigned int m = level.FirstMeshlet ; m < level.FirstMeshlet + level.NumMeshlets ; m++) {
+                const Meshlet& meshlet = m_Meshlets[m];
+
+                if (!frustum.IsSphereVisible(meshlet.Center, meshlet.Radius)) {
+                    m_RenderStatistics.TrianglesFrustumCulled += meshlet.NumIndices / 3;
+                    continue;
+                }
+                if (m_Meshes[i].SingleSided && meshlet.IsBackFacing(cameraPos)) {
+                    m_RenderStatistics.TrianglesBackFaceCulled += meshlet.NumIndices / 3;
+                    continue;
+                }
 
-            if (m_Materials[MaterialIndex].pSpecularExponent) {
-                m_Materials[MaterialIndex].pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
+                // Visible meshlets that follow each other in the index buffer share the same command
+                if (m_DrawCommands.size() > firstCommand[i] &&
+                    m_DrawCommands.back().FirstIndex + m_DrawCommands.back().Count == meshlet.BaseIndex) {
+                    m_DrawCommands.back().Count += meshlet.NumIndices;
+                }
+                else {
+                    m_DrawCommands.push_back({ meshlet.NumIndices, 1, meshlet.BaseIndex, (int)m_Meshes[i].BaseVertex,
+                                               m_FirstMaterial + m_Meshes[i].MaterialIndex });
+                }
+                m_RenderStatistics.TrianglesRendered += meshlet.NumIndices / 3;
             }
 
-            glDrawElementsBaseVertex(GL_TRIANGLES,
-                                    m_Meshes[i].NumIndices,
-                                    GL_UNSIGNED_INT,
-                                    (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
-                                    m_Meshes[i].BaseVertex);
+            m_RenderStatistics.TrianglesFullDetail += m_Meshes[i].NumIndices / 3;
+        }
+        firstCommand[m_Meshes.size()] = (unsigned int)m_DrawCommands.size();
+
+        if (m_DrawCommands.empty()) {
+            return;
         }
 
+        // the model matrix and the material of the object, set by the caller
+        getDrawUniforms().bind();
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_Buffers[INDIRECT_BUFFER]);
+
+        // Orphan the previous commands that may still be used by the GPU
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * m_Meshlets.size(), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * m_DrawCommands.size(), m_DrawCommands.data());
+
+        // With the material table, the commands find their material by their base instance, the whole object is one draw
+        if (getMaterialTable().isEnabled()) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)m_DrawCommands.size(), 0);
+        }
+        else {
+            for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+                unsigned int numCommands = firstCommand[i + 1] - firstCommand[i];
+                if (numCommands == 0) {
+                    continue;
+                }
+
+                bindTextures(m_Meshes[i].MaterialIndex);
+
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                            (void*)(sizeof(DrawElementsIndirectCommand) * firstCommand[i]),
+                                            numCommands, 0);
+            }
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
         // Make sure the VAO is not changed from the outside
         glBindVertexArray(0);
     }
 
 
+    /**
+     * @brief Bind the textures of a material, unless the shaders find them in the material table
+     * 
+     */
+    void bindTextures(unsigned int MaterialIndex)
+    {
+        assert(MaterialIndex < m_Materials.size());
+
+        if (getMaterialTable().isEnabled()) {
+            return;
+        }
+
+        if (m_Materials[MaterialIndex].pDiffuse) {
+            m_Materials[MaterialIndex].pDiffuse->Bind(COLOR_TEXTURE_UNIT);
+        }
+
+        if (m_Materials[MaterialIndex].pSpecularExponent) {
+            m_Materials[MaterialIndex].pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
+        }
+    }
+
+
     const Material& getMaterial()
     {
         for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
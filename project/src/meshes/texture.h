@@ -22,7 +22,15 @@
 #define TEXTURE_H
 
 #include <string>
+#include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -31,57 +39,356 @@
 #include "stb_image.h"
 #include "stb_image_write.h"
 
+#include "../utils/virtual_file_system.h"
+#include "texture_cache.h"
+#include "texture_uploader.h"
+
+
+struct StreamedLevel
+{
+    int Level = 0;
+    std::vector<unsigned char> Data;    // the pixels, or the blocks of a compressed texture
+};
+
+
+/**
+ * @brief An image read and decoded by a loading thread, with its mip chain, taken by the texture of its file on the GL thread
+ *
+ */
+struct PrefetchedImage
+{
+    int Width = 0;
+    int Height = 0;
+    int BPP = 0;
+    std::vector<unsigned char> Pixels;
+    std::vector<MipLevel> Levels;       // empty with the driver filter, the driver generates them at the upload
+    bool GammaCorrect = false;          // the levels were filtered in linear space
+    double GenerateMs = 0.0;
+    double Drift = 0.0;
+};
+
+
+/**
+ * @brief The images decoded ahead of their textures by the asset loader, so that Texture::Load only uploads them.
+ * The compressed textures are read from their cache by Texture::Load, they are not prefetched.
+ *
+ */
+class ImagePrefetcher
+{
+public:
+    /**
+     * @brief Read and decode an image as Texture::Load does, called by the loading threads
+     *
+     * @param color false for the images of data, such as the specular exponents, filtered without the gamma correction
+     */
+    void prefetch(const std::string& path, bool color = true)
+    {
+        if (getTextureCompressionSettings().Enabled) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Claimed.insert(path).second) {
+                return;
+            }
+        }
+
+        // The flag of stb_image is global, the loading threads use their own
+        stbi_set_flip_vertically_on_load_thread(1);
+
+        PrefetchedImage image;
+        FileData file;
+        unsigned char* data = NULL;
+        if (getVirtualFileSystem().readFile(path, file)) {
+            data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &image.Width, &image.Height, &image.BPP, 0);
+        }
+        if (!data) {
+            // Texture::Load reports the error
+            return;
+        }
+        image.Pixels.assign(data, data + (size_t)image.Width * image.Height * image.BPP);
+        stbi_image_free(data);
+
+        const TextureMipSettings& mips = getTextureMipSettings();
+        if (mips.Filter != MipFilter::Driver) {
+            image.GammaCorrect = mips.GammaCorrect && color;
+            auto start = std::chrono::steady_clock::now();
+            generateMipChain(image.Pixels.data(), image.Width, image.Height, image.BPP, mips.Filter, image.GammaCorrect, image.Levels);
+            image.GenerateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            image.Drift = getBrightnessDrift(image.Pixels.data(), image.Width, image.Height, image.BPP, image.GammaCorrect, image.Levels);
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Images[path] = std::move(image);
+    }
+
+    bool take(const std::string& path, PrefetchedImage& image)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_Images.find(path);
+        if (it == m_Images.end()) {
+            return false;
+        }
+        image = std::move(it->second);
+        m_Images.erase(it);
+        return true;
+    }
+
+    // Drop the images that no texture took, once the loading is over
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Images.clear();
+        m_Claimed.clear();
+    }
+
+private:
+    std::mutex m_Mutex;
+    std::map<std::string, PrefetchedImage> m_Images;
+    std::set<std::string> m_Claimed;            // the images prefetched or being prefetched
+};
+
+
+inline ImagePrefetcher& getImagePrefetcher()
+{
+    static ImagePrefetcher prefetcher;
+    return prefetcher;
+}
+
 
 class Texture
 {
 private:
     std::string m_fileName;
     GLenum m_textureTarget;
-    GLuint m_textureObj;
+    GLuint m_textureObj = 0;
     int m_imageWidth = 0;
     int m_imageHeight = 0;
     int m_imageBPP = 0;
-    
-    void LoadInternal(void* image_data)
+    GLenum m_internalFormat = 0;
+    GLenum m_pixelFormat = 0;         // format of the uploaded pixels, 0 for a block compressed texture
+    BlockFormat m_blockFormat = BlockFormat::BC1;
+    int m_numLevels = 1;              // levels of the full mip chain
+    int m_residentLevel = 0;          // finest level in the GPU memory, the storage holds the levels from it to the last one
+    bool m_streaming = false;         // only the small levels are loaded, the others are streamed by the texture streamer
+    bool m_color = true;              // false for the data textures, their levels are filtered without the gamma correction
+    uint32_t m_sourceHash = 0;        // hash of the image, to find its compressed levels again
+    int m_requestedLevel = -1;        // finest level needed by the frame, -1 when the texture was not requested
+    GLuint m_pendingObj = 0;          // storage of the finer levels being uploaded by the texture uploader
+
+    void SetRawFormat()
     {
-        glGenTextures(1, &m_textureObj);
-        glBindTexture(m_textureTarget, m_textureObj);
+        switch (m_imageBPP) {
+        case 1:
+            m_internalFormat = GL_R8;
+            m_pixelFormat = GL_RED;
+            break;
+
+        case 2:
+            m_internalFormat = GL_RG8;
+            m_pixelFormat = GL_RG;
+            break;
+
+        case 3:
+            m_internalFormat = GL_RGB8;
+            m_pixelFormat = GL_RGB;
+            break;
+
+        default:
+            m_internalFormat = GL_RGBA8;
+            m_pixelFormat = GL_RGBA;
+            break;
+        }
+    }
+
+    // First level loaded by a streamed texture, the largest one that fits in the resident size
+    int GetStreamingStartLevel() const
+    {
+        int level = 0;
+        while (level + 1 < m_numLevels && std::max(GetLevelWidth(level), GetLevelHeight(level)) > getTextureStreamingSettings().ResidentSize) {
+            level++;
+        }
+        return level;
+    }
+
+    // Create and bind the immutable storage of the levels from firstLevel to the last one
+    GLuint CreateStorage(int firstLevel)
+    {
+        GLuint textureObj;
+        glGenTextures(1, &textureObj);
+        glBindTexture(m_textureTarget, textureObj);
+        glTexStorage2D(m_textureTarget, m_numLevels - firstLevel, m_internalFormat, GetLevelWidth(firstLevel), GetLevelHeight(firstLevel));
+
+        glTexParameteri(m_textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(m_textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(m_textureTarget, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(m_textureTarget, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        return textureObj;
+    }
 
-        if (m_textureTarget == GL_TEXTURE_2D) {
-            switch (m_imageBPP) {
-            case 1:
-                glTexImage2D(m_textureTarget, 0, GL_RED, m_imageWidth, m_imageHeight, 0, GL_RED, GL_UNSIGNED_BYTE, image_data);
-                break;
+    // Same as above for the texture object, the previous texture object is not deleted
+    void AllocateStorage(int firstLevel)
+    {
+        m_residentLevel = firstLevel;
+        m_textureObj = CreateStorage(firstLevel);
+    }
 
-            case 2:
-                glTexImage2D(m_textureTarget, 0, GL_RG, m_imageWidth, m_imageHeight, 0, GL_RG, GL_UNSIGNED_BYTE, image_data);
-                break;
+    // Copy the resident levels from firstLevel on in a storage created by CreateStorage(firstLevel), on the GPU
+    void CopyResidentLevels(GLuint textureObj, int firstLevel)
+    {
+        for (int l = std::max(firstLevel, m_residentLevel) ; l < m_numLevels ; l++) {
+            glCopyImageSubData(m_textureObj, m_textureTarget, l - m_residentLevel, 0, 0, 0,
+                               textureObj, m_textureTarget, l - firstLevel, 0, 0, 0, GetLevelWidth(l), GetLevelHeight(l), 1);
+        }
+    }
 
-            case 3:
-                glTexImage2D(m_textureTarget, 0, GL_RGB, m_imageWidth, m_imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, image_data);
-                break;
+    // Size of a level of the decoded image, its pixels are tightly packed
+    size_t GetRawLevelBytes(int level) const
+    {
+        return (size_t)GetLevelWidth(level) * GetLevelHeight(level) * m_imageBPP;
+    }
 
-            case 4:
-                glTexImage2D(m_textureTarget, 0, GL_RGBA, m_imageWidth, m_imageHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-                break;
+    // Upload a level of the full chain in the storage bound to the target, through the ring of the texture uploader
+    void UploadLevel(int level, const unsigned char* data, size_t size)
+    {
+        getTextureUploader().upload(m_textureTarget, level - m_residentLevel, GetLevelWidth(level), GetLevelHeight(level),
+                                    m_pixelFormat, m_internalFormat, data, size);
+    }
 
-            //default:
-                //NOT_IMPLEMENTED;
-            }
-        } else {
+    // A level of the full chain to upload later in a storage of which firstLevel is the finest level
+    TextureLevelUpload MakeLevelUpload(int level, int firstLevel, std::vector<unsigned char>&& data) const
+    {
+        TextureLevelUpload upload;
+        upload.Target = m_textureTarget;
+        upload.Level = level - firstLevel;
+        upload.Width = GetLevelWidth(level);
+        upload.Height = GetLevelHeight(level);
+        upload.PixelFormat = m_pixelFormat;
+        upload.InternalFormat = m_internalFormat;
+        upload.Data = std::move(data);
+        return upload;
+    }
+
+    void LoadInternal(void* image_data, const std::vector<MipLevel>* levels = NULL)
+    {
+        if (m_textureTarget != GL_TEXTURE_2D) {
             std::cout << "Support for texture target " << m_textureTarget << " is not implemented" << std::endl;
             exit(1);
         }
 
-        glTexParameteri(m_textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(m_textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(m_textureTarget, GL_TEXTURE_BASE_LEVEL, 0);
-        glTexParameteri(m_textureTarget, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(m_textureTarget, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        SetRawFormat();
+        m_numLevels = getNumMipLevels(m_imageWidth, m_imageHeight);
+
+        // Immutable storage for the mip chain, the levels are uploaded one by one
+        if (getTextureMipSettings().Filter == MipFilter::Driver && !levels && !m_streaming) {
+            AllocateStorage(0);
+            UploadLevel(0, (const unsigned char*)image_data, GetRawLevelBytes(0));
+            GenerateDriverMipLevels((const unsigned char*)image_data);
+        }
+        else {
+            std::vector<MipLevel> generatedLevels;
+            if (!levels || levels->empty()) {
+                GenerateMipLevels((const unsigned char*)image_data, generatedLevels);
+                levels = &generatedLevels;
+            }
 
+            // A streamed texture starts with its small levels only
+            AllocateStorage(m_streaming ? GetStreamingStartLevel() : 0);
+            for (int level = m_residentLevel ; level < m_numLevels ; level++) {
+                if (level == 0) {
+                    UploadLevel(0, (const unsigned char*)image_data, GetRawLevelBytes(0));
+                }
+                else {
+                    UploadLevel(level, (*levels)[level - 1].Pixels.data(), (*levels)[level - 1].Pixels.size());
+                }
+            }
+        }
+
+        glBindTexture(m_textureTarget, 0);
+    }
+
+    // Generate the levels below the base level on the CPU, the streamed textures need them even with the driver filter
+    void GenerateMipLevels(const unsigned char* image_data, std::vector<MipLevel>& levels)
+    {
+        const TextureMipSettings& settings = getTextureMipSettings();
+        MipFilter filter = settings.Filter == MipFilter::Driver ? MipFilter::Box : settings.Filter;
+
+        double start = glfwGetTime();
+        generateMipChain(image_data, m_imageWidth, m_imageHeight, m_imageBPP, filter, IsGammaCorrected(), levels);
+        double generateMs = (glfwGetTime() - start) * 1000.0;
+        getTextureMipStatistics().AddTexture(generateMs, getBrightnessDrift(image_data, m_imageWidth, m_imageHeight, m_imageBPP,
+                                                                            IsGammaCorrected(), levels));
+    }
+
+    // Fill the levels below the base level with glGenerateMipmap
+    void GenerateDriverMipLevels(const unsigned char* image_data)
+    {
+        double start = glfwGetTime();
         glGenerateMipmap(m_textureTarget);
+        glFinish();
+        double generateMs = (glfwGetTime() - start) * 1000.0;
+
+        // The levels of the driver are read back to measure them like the levels of the CPU
+        std::vector<MipLevel> levels;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = 1 ; level < m_numLevels ; level++) {
+            levels.emplace_back();
+            levels.back().Width = GetLevelWidth(level);
+            levels.back().Height = GetLevelHeight(level);
+            levels.back().Pixels.resize((size_t)levels.back().Width * levels.back().Height * m_imageBPP);
+            glGetTexImage(m_textureTarget, level, m_pixelFormat, GL_UNSIGNED_BYTE, levels.back().Pixels.data());
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        getTextureMipStatistics().AddTexture(generateMs, getBrightnessDrift(image_data, m_imageWidth, m_imageHeight, m_imageBPP,
+                                                                            IsGammaCorrected(), levels));
+    }
 
+    // Upload a block compressed image with all its levels, false when the driver doesn't support its format
+    bool LoadCompressed(const CompressedImage& image)
+    {
+        if (image.Levels.empty() || !isBlockFormatSupported(image.Format)) {
+            return false;
+        }
+
+        m_imageWidth = image.Levels[0].Width;
+        m_imageHeight = image.Levels[0].Height;
+        m_imageBPP = getEncoderChannels(image.Format);
+        m_blockFormat = image.Format;
+        m_internalFormat = getCompressedFormat(image.Format);
+        m_pixelFormat = 0;
+        m_numLevels = (int)image.Levels.size();
+
+        AllocateStorage(m_streaming ? GetStreamingStartLevel() : 0);
+        for (int level = m_residentLevel ; level < m_numLevels ; level++) {
+            UploadLevel(level, image.Levels[level].Data.data(), image.Levels[level].Data.size());
+        }
         glBindTexture(m_textureTarget, 0);
+
+        TextureCompressionStatistics& statistics = getTextureCompressionStatistics();
+        statistics.CompressedBytes += image.GetBytes();
+        statistics.RawBytes += (size_t)m_imageWidth * m_imageHeight * (m_imageBPP == 3 ? 4 : m_imageBPP) * 4 / 3;
+        return true;
+    }
+
+    // Compress a decoded image, write it in the cache and upload it
+    bool CompressAndLoad(unsigned char* image_data, uint32_t sourceHash)
+    {
+        BlockFormat format = chooseBlockFormat(image_data, m_imageWidth, m_imageHeight, m_imageBPP);
+        if (!isBlockFormatSupported(format)) {
+            return false;
+        }
+
+        double start = glfwGetTime();
+        CompressedImage image;
+        const TextureMipSettings& mips = getTextureMipSettings();
+        compressImage(convertChannels(image_data, m_imageWidth, m_imageHeight, m_imageBPP, getEncoderChannels(format)),
+                      m_imageWidth, m_imageHeight, format, mips.Filter, IsGammaCorrected(), image);
+        image.SourceHash = sourceHash;
+        getTextureCompressionStatistics().EncodeMs += (glfwGetTime() - start) * 1000.0;
+        getTextureCompressionStatistics().EncodedTextures++;
+
+        storeCompressedTexture(m_fileName, image, m_color);
+        return LoadCompressed(image);
     }
 
 public:
@@ -96,22 +403,86 @@ public:
         m_textureTarget = TextureTarget;
     }
 
+    // The texture owns its GL object, it is shared through handles (see ResourceManager) rather than copied
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
+    ~Texture();
+
+    // Stream the large levels of the texture from its file when the streaming is enabled, to call before Load
+    void EnableStreaming()
+    {
+        m_streaming = getTextureStreamingSettings().Enabled && m_textureTarget == GL_TEXTURE_2D && !m_fileName.empty();
+    }
+
+    // False when the texture holds data rather than colors (e.g. specular exponents), its levels are then filtered without
+    // the gamma correction, to call before Load
+    void SetColor(bool color) { m_color = color; }
+
+    bool IsColor() const { return m_color; }
+
+    // The levels below the base level are filtered in linear space
+    bool IsGammaCorrected() const { return m_color && getTextureMipSettings().GammaCorrect; }
+
     // Should be called once to load the texture
     bool Load()
     {
+        // The image may have been decoded by a loading thread
+        PrefetchedImage prefetched;
+        if (m_textureTarget == GL_TEXTURE_2D && getImagePrefetcher().take(m_fileName, prefetched)) {
+            m_imageWidth = prefetched.Width;
+            m_imageHeight = prefetched.Height;
+            m_imageBPP = prefetched.BPP;
+            // The levels of an image prefetched as a color for a data texture, or the reverse, are filtered again
+            bool useLevels = !prefetched.Levels.empty() && prefetched.GammaCorrect == IsGammaCorrected();
+            if (useLevels) {
+                getTextureMipStatistics().AddTexture(prefetched.GenerateMs, prefetched.Drift);
+            }
+            LoadInternal(prefetched.Pixels.data(), useLevels ? &prefetched.Levels : NULL);
+            registerStreamedTexture();
+            return true;
+        }
+
         stbi_set_flip_vertically_on_load(1);
-        unsigned char* image_data = stbi_load(m_fileName.c_str(), &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
+        FileData file;
+        unsigned char* image_data = NULL;
+        bool readable = getVirtualFileSystem().readFile(m_fileName, file);
+
+        // With the compression, the block compressed image is used when it was cooked or cached before
+        bool compression = getTextureCompressionSettings().Enabled && m_textureTarget == GL_TEXTURE_2D;
+        m_sourceHash = compression && readable ? hashSource(file.GetData(), file.GetSize()) : 0;
+        if (compression) {
+            CompressedImage image;
+            if (loadCompressedTexture(m_fileName, m_sourceHash, image, m_color) && LoadCompressed(image)) {
+                registerStreamedTexture();
+                return true;
+            }
+        }
+
+        if (readable) {
+            image_data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
+        }
         if (!image_data) {
-            std::cout << "Can't load texture from '" << m_fileName.c_str() << "' - " << stbi_failure_reason() << std::endl;
+            std::cout << "Can't load texture from '" << m_fileName.c_str() << "' - " << (file.GetData() ? stbi_failure_reason() : "can't read the file") << std::endl;
             exit(0);
         }
         //std::cout << "Width " << m_imageWidth << ", height " << m_imageHeight << ", bpp " << m_imageBPP << std::endl;
-        LoadInternal(image_data);
+        if (!compression || !CompressAndLoad(image_data, m_sourceHash)) {
+            if (compression) {
+                getTextureCompressionStatistics().RawTextures++;
+            }
+            LoadInternal(image_data);
+        }
+        registerStreamedTexture();
+
+        // The image is only needed on the GPU
+        stbi_image_free(image_data);
         return true;
     }
 
     void Load(unsigned int BufferSize, void* pData)
     {
+        m_streaming = false;
         void* image_data = stbi_load_from_memory((const stbi_uc*)pData, BufferSize, &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
         LoadInternal(image_data);
         stbi_image_free(image_data);
@@ -130,10 +501,53 @@ public:
         m_imageWidth = Width;
         m_imageHeight = Height;
         m_imageBPP = BPP;
+        m_streaming = false;
 
         LoadInternal(pData);
     }
 
+    // Same as above with the levels below the base level already generated (see generateMipChain)
+    void LoadRaw(int Width, int Height, int BPP, unsigned char* pData, const std::vector<MipLevel>& Levels)
+    {
+        m_imageWidth = Width;
+        m_imageHeight = Height;
+        m_imageBPP = BPP;
+        m_streaming = false;
+
+        LoadInternal(pData, &Levels);
+    }
+
+    /**
+     * @brief Same as LoadRaw with the levels below the base level, but the levels are uploaded over the next frames
+     * by the texture uploader. The texture must not be used before onComplete is called.
+     *
+     * @param Levels the levels below the base level, generated here when empty
+     */
+    void QueueRaw(int Width, int Height, int BPP, std::vector<unsigned char>&& Pixels, std::vector<MipLevel>&& Levels,
+                  std::function<void()> onComplete)
+    {
+        m_imageWidth = Width;
+        m_imageHeight = Height;
+        m_imageBPP = BPP;
+        m_streaming = false;
+
+        SetRawFormat();
+        m_numLevels = getNumMipLevels(m_imageWidth, m_imageHeight);
+        if (Levels.empty()) {
+            GenerateMipLevels(Pixels.data(), Levels);
+        }
+
+        AllocateStorage(0);
+        glBindTexture(m_textureTarget, 0);
+
+        std::vector<TextureLevelUpload> uploads;
+        uploads.push_back(MakeLevelUpload(0, 0, std::move(Pixels)));
+        for (int level = 1 ; level < m_numLevels ; level++) {
+            uploads.push_back(MakeLevelUpload(level, 0, std::move(Levels[level - 1].Pixels)));
+        }
+        getTextureUploader().queue(m_textureObj, m_textureTarget, std::move(uploads), onComplete);
+    }
+
     // Must be called at least once for the specific texture unit
     void Bind(GLenum TextureUnit)
     {
@@ -149,7 +563,177 @@ public:
 
     GLuint GetTexture() const { return m_textureObj; }
 
+    GLenum GetInternalFormat() const { return m_internalFormat; }
+
+    const std::string& GetFileName() const { return m_fileName; }
+
+    int GetLevelWidth(int level) const { return std::max(1, m_imageWidth >> level); }
+
+    int GetLevelHeight(int level) const { return std::max(1, m_imageHeight >> level); }
+
+    int GetNumLevels() const { return m_numLevels; }
+
+    int GetResidentLevel() const { return m_residentLevel; }
+
+    bool IsStreamed() const { return m_streaming; }
+
+    bool IsCompressed() const { return m_pixelFormat == 0; }
+
+    BlockFormat GetBlockFormat() const { return m_blockFormat; }
+
+    int GetBPP() const { return m_imageBPP; }
+
+    uint32_t GetSourceHash() const { return m_sourceHash; }
+
+    /**
+     * @brief Estimated size of a level in the GPU memory, the RGB images are stored as RGBA by the drivers
+     */
+    size_t GetLevelBytes(int level) const
+    {
+        if (IsCompressed()) {
+            return getLevelBytes(m_blockFormat, GetLevelWidth(level), GetLevelHeight(level));
+        }
+        size_t texelBytes = m_imageBPP == 3 ? 4 : (size_t)m_imageBPP;
+        return (size_t)GetLevelWidth(level) * GetLevelHeight(level) * texelBytes;
+    }
+
+    /**
+     * @brief Estimated size of the resident levels of the texture in the GPU memory
+     */
+    size_t GetGpuBytes() const
+    {
+        size_t bytes = 0;
+        for (int level = m_residentLevel ; level < m_numLevels ; level++) {
+            bytes += GetLevelBytes(level);
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief Record the level needed to draw the texture over a footprint on the screen, about one texel per pixel
+     *
+     * @param screenPixels the size of the footprint, in pixels
+     */
+    void RequestScreenSize(float screenPixels)
+    {
+        if (!m_streaming) {
+            return;
+        }
+        float texels = (float)std::max(m_imageWidth, m_imageHeight);
+        int level = screenPixels >= 1.0f ? (int)std::floor(std::log2(std::max(texels / screenPixels, 1.0f))) : m_numLevels - 1;
+        level = std::min(level, m_numLevels - 1);
+        m_requestedLevel = m_requestedLevel < 0 ? level : std::min(m_requestedLevel, level);
+    }
+
+    // Finest level requested since the last call, -1 if none
+    int TakeRequestedLevel()
+    {
+        int level = m_requestedLevel;
+        m_requestedLevel = -1;
+        return level;
+    }
+
+    /**
+     * @brief Change the resident levels: the storage is reallocated, the levels kept are copied on the GPU
+     * and the new finer levels are uploaded
+     *
+     * @param level the new finest resident level
+     * @param finerLevels the levels from the new finest level to the previous one, when the texture gets finer
+     */
+    void SetResidentLevel(int level, const std::vector<StreamedLevel>& finerLevels)
+    {
+        GLuint previousObj = m_textureObj;
+        GLuint textureObj = CreateStorage(level);
+        CopyResidentLevels(textureObj, level);
+
+        int previousLevel = m_residentLevel;
+        m_textureObj = textureObj;
+        m_residentLevel = level;
+        for (const StreamedLevel& finer : finerLevels) {
+            if (finer.Level >= level && finer.Level < previousLevel) {
+                UploadLevel(finer.Level, finer.Data.data(), finer.Data.size());
+            }
+        }
+
+        glBindTexture(m_textureTarget, 0);
+        glDeleteTextures(1, &previousObj);
+    }
+
+    /**
+     * @brief Same as SetResidentLevel for finer levels, uploaded over the next frames by the texture uploader:
+     * the texture keeps its resident levels until the new storage is complete. The resident levels must not change until then.
+     *
+     * @param onComplete called once the texture uses the new storage
+     */
+    void QueueResidentLevel(int level, std::vector<StreamedLevel>&& finerLevels, std::function<void()> onComplete)
+    {
+        CancelUploads();
+        m_pendingObj = CreateStorage(level);
+        CopyResidentLevels(m_pendingObj, level);
+        glBindTexture(m_textureTarget, 0);
+
+        std::vector<TextureLevelUpload> uploads;
+        for (StreamedLevel& finer : finerLevels) {
+            if (finer.Level >= level && finer.Level < m_residentLevel) {
+                uploads.push_back(MakeLevelUpload(finer.Level, level, std::move(finer.Data)));
+            }
+        }
+        getTextureUploader().queue(m_pendingObj, m_textureTarget, std::move(uploads), [this, level, onComplete]() {
+            glDeleteTextures(1, &m_textureObj);
+            m_textureObj = m_pendingObj;
+            m_pendingObj = 0;
+            m_residentLevel = level;
+            if (onComplete) {
+                onComplete();
+            }
+        });
+    }
+
+    // Drop the upload started by QueueResidentLevel, if any
+    void CancelUploads()
+    {
+        if (m_pendingObj) {
+            getTextureUploader().cancel(m_pendingObj);
+            glDeleteTextures(1, &m_pendingObj);
+            m_pendingObj = 0;
+        }
+    }
+
+    /**
+     * @brief Delete the storage of the texture once its levels were copied elsewhere (see MaterialTable), it can't be bound anymore.
+     * Its size is still reported by its object, the copy holds the same levels.
+     */
+    void ReleaseStorage()
+    {
+        glDeleteTextures(1, &m_textureObj);
+        m_textureObj = 0;
+    }
+
+private:
+    void registerStreamedTexture();
 };
 
 
+#include "texture_streamer.h"
+
+
+inline Texture::~Texture()
+{
+    if (m_streaming) {
+        getTextureStreamer().unregisterTexture(this);
+    }
+    CancelUploads();
+    getTextureUploader().cancel(m_textureObj);
+    glDeleteTextures(1, &m_textureObj);
+}
+
+
+inline void Texture::registerStreamedTexture()
+{
+    if (m_streaming) {
+        getTextureStreamer().registerTexture(this);
+    }
+}
+
+
 #endif  /* TEXTURE_H */
@@ -0,0 +1,207 @@
+// Block compressed textures: the DDS files cooked next to the images by texture_cooker, and the cache
+// of the images compressed at the first run. The cache entries keep the hash of their source to be rebuilt when it changes.
+// The settings of the mip chains and of the streaming of all the textures are here too.
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <filesystem>
+
+#include <glad/glad.h>
+
+#include "../utils/dds.h"
+#include "../utils/hash.h"
+#include "../utils/texture_encoder.h"
+#include "../utils/mip_generator.h"
+#include "../utils/virtual_file_system.h"
+
+
+struct TextureCompressionSettings
+{
+    bool Enabled = false;
+    std::string CacheDirectory = "texture_cache";
+};
+
+
+struct TextureCompressionStatistics
+{
+    unsigned int CookedTextures = 0;        // read from a DDS file next to the image
+    unsigned int CachedTextures = 0;        // read from the cache
+    unsigned int EncodedTextures = 0;       // compressed at the loading, then written in the cache
+    unsigned int RawTextures = 0;           // uploaded uncompressed, the format is not supported
+    double EncodeMs = 0.0;
+    size_t CompressedBytes = 0;
+    size_t RawBytes = 0;                    // size of the same textures uncompressed, with their mipmaps
+};
+
+
+struct TextureMipSettings
+{
+    MipFilter Filter = MipFilter::Kaiser;
+    bool GammaCorrect = true;   // the colors of the RGB and RGBA images are filtered in linear space
+};
+
+
+struct TextureMipStatistics
+{
+    unsigned int Textures = 0;
+    double GenerateMs = 0.0;            // on the CPU, or by the driver (waited with glFinish)
+    double DriftSum = 0.0;
+    double MaxDrift = 0.0;              // largest change of the mean brightness in a mip chain, in percent (see getBrightnessDrift)
+
+    void AddTexture(double generateMs, double drift)
+    {
+        Textures++;
+        GenerateMs += generateMs;
+        DriftSum += drift;
+        MaxDrift = std::max(MaxDrift, drift);
+    }
+};
+
+
+struct TextureStreamingSettings
+{
+    bool Enabled = false;
+    int ResidentSize = 64;                      // largest size of the levels loaded with the textures, the larger ones are streamed
+    size_t Budget = 32 * 1024 * 1024;           // GPU memory of the streamed textures, the least recently needed levels are evicted above it
+    unsigned int MaxRequestsInFlight = 2;
+};
+
+
+inline TextureCompressionSettings& getTextureCompressionSettings()
+{
+    static TextureCompressionSettings settings;
+    return settings;
+}
+
+
+inline TextureCompressionStatistics& getTextureCompressionStatistics()
+{
+    static TextureCompressionStatistics statistics;
+    return statistics;
+}
+
+
+inline TextureMipSettings& getTextureMipSettings()
+{
+    static TextureMipSettings settings;
+    return settings;
+}
+
+
+inline TextureMipStatistics& getTextureMipStatistics()
+{
+    static TextureMipStatistics statistics;
+    return statistics;
+}
+
+
+inline TextureStreamingSettings& getTextureStreamingSettings()
+{
+    static TextureStreamingSettings settings;
+    return settings;
+}
+
+
+/**
+ * @brief GL internal format of a block format
+ */
+inline GLenum getCompressedFormat(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+    default: return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+
+/**
+ * @brief The RGTC formats are core since OpenGL 3.0, the S3TC formats need the extension
+ */
+inline bool isBlockFormatSupported(BlockFormat format)
+{
+    if (format == BlockFormat::BC4 || format == BlockFormat::BC5) {
+        return true;
+    }
+    return GLAD_GL_EXT_texture_compression_s3tc != 0;
+}
+
+
+/**
+ * @brief Path of the cache entry of an image: its name, and the hash of its full path and of the settings of its mip chain
+ * to tell apart the images of the same name in different directories and the chains of the different filters
+ *
+ * @param color false for the data textures, of which the chain is filtered without the gamma correction
+ */
+inline std::string getTextureCachePath(const std::string& imagePath, bool color = true)
+{
+    std::string path = VirtualFileSystem::normalizePath(imagePath);
+    const TextureMipSettings& mips = getTextureMipSettings();
+    std::string key = path + "|" + std::to_string((int)mips.Filter) + (mips.GammaCorrect && color ? "|srgb" : "|linear");
+    uint32_t pathHash = hashSource((const unsigned char*)key.data(), key.size());
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%08x.dds", pathHash);
+    return getTextureCompressionSettings().CacheDirectory + "/" + std::filesystem::path(path).filename().string() + suffix;
+}
+
+
+/**
+ * @brief Read the compressed image of a texture: the DDS file cooked next to it, or the entry of the cache.
+ * A cooked file is used as long as its source is not newer (when the source is not packed, it has no hash to check),
+ * an entry of the cache must match its source. It can be called by the workers, it changes no statistics.
+ *
+ * @param sourceHash the hash of the source image, 0 when the source can't be read
+ * @param cooked set to true when the image is the cooked file
+ */
+inline bool readCompressedTexture(const std::string& imagePath, uint32_t sourceHash, CompressedImage& image, bool& cooked,
+                                  bool color = true)
+{
+    FileData file;
+    cooked = true;
+    if (getVirtualFileSystem().readFile(imagePath + ".dds", file) && readDds(file.GetData(), file.GetSize(), image)
+        && (sourceHash == 0 || image.SourceHash == 0 || image.SourceHash == sourceHash)) {
+        return true;
+    }
+
+    cooked = false;
+    return getVirtualFileSystem().readFile(getTextureCachePath(imagePath, color), file) && readDds(file.GetData(), file.GetSize(), image)
+        && image.SourceHash == sourceHash;
+}
+
+
+inline bool loadCompressedTexture(const std::string& imagePath, uint32_t sourceHash, CompressedImage& image, bool color = true)
+{
+    bool cooked;
+    if (!readCompressedTexture(imagePath, sourceHash, image, cooked, color)) {
+        return false;
+    }
+    if (cooked) {
+        getTextureCompressionStatistics().CookedTextures++;
+    }
+    else {
+        getTextureCompressionStatistics().CachedTextures++;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Write a compressed image in the cache, a failure only costs the compression at the next run
+ */
+inline void storeCompressedTexture(const std::string& imagePath, const CompressedImage& image, bool color = true)
+{
+    std::error_code error;
+    std::filesystem::create_directories(getTextureCompressionSettings().CacheDirectory, error);
+    std::string cachePath = getTextureCachePath(imagePath, color);
+    if (error || !writeDds(cachePath, image)) {
+        std::cout << "Warning: can't write the compressed texture " << cachePath << std::endl;
+    }
+}
+
+
+#endif
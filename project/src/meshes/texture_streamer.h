@@ -0,0 +1,376 @@
+// Streaming of the large mip levels of the textures: the textures start with their small levels, the renderers request
+// the level that the footprint of each object on the screen needs, the missing levels are read again from the files
+// by the thread pool, uploaded over the next frames by the texture uploader, and the least recently needed levels are
+// evicted to stay within a GPU memory budget.
+// Included at the end of texture.h, where the Texture class is complete and stb_image is already included.
+
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include "texture_cache.h"
+#include "../utils/thread_pool.h"
+#include "../utils/mip_generator.h"
+#include "../utils/virtual_file_system.h"
+
+
+struct TextureStreamingStatistics
+{
+    unsigned int StreamedTextures = 0;
+    unsigned int ResidentLevels = 0;
+    unsigned int TotalLevels = 0;
+    unsigned int PendingRequests = 0;       // levels being read by the workers
+    unsigned int WaitingRequests = 0;       // textures that need finer levels, waiting for a free slot or for the budget
+    unsigned int LevelsLoaded = 0;
+    unsigned int LevelsEvicted = 0;
+    size_t ResidentBytes = 0;
+    size_t FullBytes = 0;                   // the streamed textures with all their levels
+    size_t Budget = 0;
+    size_t BytesUploaded = 0;
+};
+
+
+/**
+ * @brief Levels of a texture to read again from its file, with everything the worker needs so that it never touches the texture
+ *
+ */
+struct TextureLevelsRequest
+{
+    unsigned int TextureId = 0;
+    std::string Path;
+    bool Compressed = false;
+    BlockFormat Format = BlockFormat::BC1;
+    int BPP = 0;
+    uint32_t SourceHash = 0;
+    int FirstLevel = 0;
+    int EndLevel = 0;                       // the levels from FirstLevel to EndLevel excluded
+    MipFilter Filter = MipFilter::Box;
+    bool GammaCorrect = true;               // false for the data textures, also for the entry of the cache they were compressed in
+
+    std::vector<StreamedLevel> Levels;
+    bool Succeeded = false;
+};
+
+
+/**
+ * @brief Read the levels of a request, from the compressed image or from the image decoded and filtered as at the loading
+ *
+ */
+inline void loadTextureLevels(TextureLevelsRequest& request)
+{
+    if (request.Compressed) {
+        CompressedImage image;
+        bool cooked;
+        if (!readCompressedTexture(request.Path, request.SourceHash, image, cooked, request.GammaCorrect) || image.Format != request.Format
+            || (int)image.Levels.size() < request.EndLevel) {
+            return;
+        }
+        for (int level = request.FirstLevel ; level < request.EndLevel ; level++) {
+            request.Levels.push_back({ level, std::move(image.Levels[level].Data) });
+        }
+        request.Succeeded = true;
+        return;
+    }
+
+    FileData file;
+    if (!getVirtualFileSystem().readFile(request.Path, file)) {
+        return;
+    }
+
+    // The flag of stb_image is global, the workers use their own
+    stbi_set_flip_vertically_on_load_thread(1);
+    int width, height, bpp;
+    unsigned char* pixels = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &width, &height, &bpp, request.BPP);
+    if (!pixels) {
+        return;
+    }
+
+    std::vector<MipLevel> levels;
+    if (request.EndLevel > 1) {
+        generateMipChain(pixels, width, height, request.BPP, request.Filter, request.GammaCorrect, levels);
+    }
+    for (int level = request.FirstLevel ; level < request.EndLevel && level <= (int)levels.size() ; level++) {
+        if (level == 0) {
+            request.Levels.push_back({ 0, std::vector<unsigned char>(pixels, pixels + (size_t)width * height * request.BPP) });
+        }
+        else {
+            request.Levels.push_back({ level, std::move(levels[level - 1].Pixels) });
+        }
+    }
+    stbi_image_free(pixels);
+    request.Succeeded = (int)request.Levels.size() == request.EndLevel - request.FirstLevel;
+}
+
+
+class TextureStreamer
+{
+public:
+    void registerTexture(Texture* texture)
+    {
+        Entry entry;
+        entry.Id = m_NextId++;
+        entry.pTexture = texture;
+        entry.MinLevel = texture->GetResidentLevel();
+        entry.NeededFrame.assign(texture->GetNumLevels(), 0);
+        m_Entries.push_back(entry);
+    }
+
+    void unregisterTexture(Texture* texture)
+    {
+        texture->CancelUploads();
+        m_Entries.erase(std::remove_if(m_Entries.begin(), m_Entries.end(), [texture](const Entry& entry) {
+            return entry.pTexture == texture;
+        }), m_Entries.end());
+    }
+
+    /**
+     * @brief Upload the levels read by the workers, then start the loadings of the levels requested during the previous frame
+     * and evict the levels that are no longer needed when the budget is exceeded. Called once per frame, never waits.
+     *
+     */
+    void update()
+    {
+        m_Frame++;
+        const TextureStreamingSettings& settings = getTextureStreamingSettings();
+
+        std::vector<std::shared_ptr<TextureLevelsRequest>> completed;
+        {
+            std::lock_guard<std::mutex> lock(m_Queue->Mutex);
+            completed.swap(m_Queue->Completed);
+        }
+        for (std::shared_ptr<TextureLevelsRequest>& request : completed) {
+            m_InFlight--;
+            uploadLevels(*request);
+        }
+
+        // The levels needed by the last frame, and all the smaller ones, are marked as used
+        for (Entry& entry : m_Entries) {
+            entry.WantedLevel = entry.pTexture->TakeRequestedLevel();
+            for (int level = std::max(entry.WantedLevel, 0) ; entry.WantedLevel >= 0 && level < entry.pTexture->GetNumLevels() ; level++) {
+                entry.NeededFrame[level] = m_Frame;
+            }
+        }
+
+        // The textures that miss the most detail are loaded first
+        std::vector<Entry*> candidates;
+        for (Entry& entry : m_Entries) {
+            if (!entry.Pending && entry.WantedLevel >= 0 && entry.WantedLevel < entry.pTexture->GetResidentLevel()) {
+                candidates.push_back(&entry);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b) {
+            return a->pTexture->GetResidentLevel() - a->WantedLevel > b->pTexture->GetResidentLevel() - b->WantedLevel;
+        });
+
+        unsigned int waiting = 0;
+        for (Entry* entry : candidates) {
+            if (m_InFlight >= settings.MaxRequestsInFlight || !makeRoom(getLevelsBytes(*entry->pTexture, entry->WantedLevel), entry)) {
+                waiting++;
+                continue;
+            }
+            startLoading(*entry);
+        }
+
+        // The budget may have been lowered, or exceeded by the levels that were needed
+        makeRoom(0, NULL);
+
+        updateStatistics(waiting);
+    }
+
+    const TextureStreamingStatistics& getStatistics() const { return m_Statistics; }
+
+private:
+    struct Entry {
+        unsigned int Id = 0;
+        Texture* pTexture = NULL;
+        int MinLevel = 0;                       // the levels loaded with the texture, never evicted
+        int WantedLevel = -1;                   // finest level needed by the last frame, -1 if the texture was not drawn
+        bool Pending = false;                   // the levels are read by a worker or uploaded by the texture uploader
+        std::vector<uint64_t> NeededFrame;      // last frame that needed each level
+    };
+
+    // Loadings completed by the workers, shared with them so that they never touch the streamer
+    struct LoadQueue {
+        std::mutex Mutex;
+        std::vector<std::shared_ptr<TextureLevelsRequest>> Completed;
+    };
+
+    std::vector<Entry> m_Entries;
+    std::shared_ptr<LoadQueue> m_Queue = std::make_shared<LoadQueue>();
+    unsigned int m_InFlight = 0;
+    unsigned int m_NextId = 1;
+    uint64_t m_Frame = 0;
+    TextureStreamingStatistics m_Statistics;
+
+    Entry* findEntry(unsigned int id)
+    {
+        for (Entry& entry : m_Entries) {
+            if (entry.Id == id) {
+                return &entry;
+            }
+        }
+        return NULL;
+    }
+
+    static size_t getLevelsBytes(const Texture& texture, int firstLevel)
+    {
+        size_t bytes = 0;
+        for (int level = firstLevel ; level < texture.GetResidentLevel() ; level++) {
+            bytes += texture.GetLevelBytes(level);
+        }
+        return bytes;
+    }
+
+    size_t getResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (const Entry& entry : m_Entries) {
+            bytes += entry.pTexture->GetGpuBytes();
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief Evict the least recently needed levels until the new levels fit in the budget, the levels needed
+     * by the last frame, the levels loaded with the textures and the textures being loaded are kept
+     *
+     * @param bytes the size of the levels to load
+     * @param loading the texture of the levels to load, kept as well
+     * @return false when there is not enough memory to evict
+     */
+    bool makeRoom(size_t bytes, const Entry* loading)
+    {
+        size_t budget = getTextureStreamingSettings().Budget;
+        size_t residentBytes = getResidentBytes();
+        while (residentBytes + bytes > budget) {
+            Entry* victim = NULL;
+            for (Entry& entry : m_Entries) {
+                int level = entry.pTexture->GetResidentLevel();
+                if (&entry == loading || entry.Pending || level >= entry.MinLevel || entry.NeededFrame[level] >= m_Frame) {
+                    continue;
+                }
+                if (!victim || entry.NeededFrame[level] < victim->NeededFrame[victim->pTexture->GetResidentLevel()]) {
+                    victim = &entry;
+                }
+            }
+            if (!victim) {
+                return false;
+            }
+
+            int level = victim->pTexture->GetResidentLevel();
+            residentBytes -= victim->pTexture->GetLevelBytes(level);
+            victim->pTexture->SetResidentLevel(level + 1, {});
+            m_Statistics.LevelsEvicted++;
+        }
+        return true;
+    }
+
+    void startLoading(Entry& entry)
+    {
+        const Texture& texture = *entry.pTexture;
+        const TextureMipSettings& mips = getTextureMipSettings();
+
+        auto request = std::make_shared<TextureLevelsRequest>();
+        request->TextureId = entry.Id;
+        request->Path = texture.GetFileName();
+        request->Compressed = texture.IsCompressed();
+        request->Format = texture.GetBlockFormat();
+        request->BPP = texture.GetBPP();
+        request->SourceHash = texture.GetSourceHash();
+        request->FirstLevel = entry.WantedLevel;
+        request->EndLevel = texture.GetResidentLevel();
+        // the same filter as the levels generated at the loading
+        request->Filter = mips.Filter == MipFilter::Driver ? MipFilter::Box : mips.Filter;
+        request->GammaCorrect = texture.IsGammaCorrected();
+
+        entry.Pending = true;
+        m_InFlight++;
+
+        std::shared_ptr<LoadQueue> queue = m_Queue;
+        getThreadPool().submit([request, queue]() {
+            loadTextureLevels(*request);
+            std::lock_guard<std::mutex> lock(queue->Mutex);
+            queue->Completed.push_back(request);
+        });
+    }
+
+    /**
+     * @brief Queue the upload of the levels read by a worker, the entry stays pending until the texture uses them
+     *
+     */
+    void uploadLevels(TextureLevelsRequest& request)
+    {
+        // The texture may have been released during the loading
+        Entry* entry = findEntry(request.TextureId);
+        if (!entry) {
+            return;
+        }
+        entry->Pending = false;
+
+        Texture& texture = *entry->pTexture;
+        if (!request.Succeeded || request.EndLevel != texture.GetResidentLevel()) {
+            std::cout << "Can't stream the levels of " << request.Path << std::endl;
+            return;
+        }
+
+        // The budget was checked at the start of the loading, other levels may have been needed since then
+        if (!makeRoom(getLevelsBytes(texture, request.FirstLevel), entry)) {
+            return;
+        }
+
+        entry->Pending = true;
+        size_t bytes = 0;
+        for (const StreamedLevel& level : request.Levels) {
+            bytes += level.Data.size();
+        }
+        unsigned int id = entry->Id;
+        unsigned int numLevels = request.EndLevel - request.FirstLevel;
+        texture.QueueResidentLevel(request.FirstLevel, std::move(request.Levels), [this, id, numLevels, bytes]() {
+            Entry* uploaded = findEntry(id);
+            if (uploaded) {
+                uploaded->Pending = false;
+            }
+            m_Statistics.LevelsLoaded += numLevels;
+            m_Statistics.BytesUploaded += bytes;
+        });
+    }
+
+    void updateStatistics(unsigned int waiting)
+    {
+        m_Statistics.StreamedTextures = (unsigned int)m_Entries.size();
+        m_Statistics.ResidentLevels = 0;
+        m_Statistics.TotalLevels = 0;
+        m_Statistics.FullBytes = 0;
+        for (const Entry& entry : m_Entries) {
+            const Texture& texture = *entry.pTexture;
+            m_Statistics.ResidentLevels += texture.GetNumLevels() - texture.GetResidentLevel();
+            m_Statistics.TotalLevels += texture.GetNumLevels();
+            for (int level = 0 ; level < texture.GetNumLevels() ; level++) {
+                m_Statistics.FullBytes += texture.GetLevelBytes(level);
+            }
+        }
+        m_Statistics.PendingRequests = m_InFlight;
+        m_Statistics.WaitingRequests = waiting;
+        m_Statistics.ResidentBytes = getResidentBytes();
+        m_Statistics.Budget = getTextureStreamingSettings().Budget;
+    }
+};
+
+
+/**
+ * @brief Streamer of all the textures loaded with EnableStreaming
+ *
+ */
+inline TextureStreamer& getTextureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+
+#endif
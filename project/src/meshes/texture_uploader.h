@@ -0,0 +1,350 @@
+// Texture uploads through a ring of pixel buffer objects: the pixels are copied in a slot of the ring and the texture
+// is filled from the buffer by the GPU, so the driver doesn't copy them from the client memory in the call.
+// A fence per slot tells when the GPU has read it. The queued uploads are split in bands of rows spread over
+// the frames within a per-frame budget, so that the upload of a large texture never makes a frame late.
+
+#ifndef TEXTURE_UPLOADER_H
+#define TEXTURE_UPLOADER_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <glad/glad.h>
+
+
+struct TextureUploadSettings
+{
+    size_t SlotSize = 4u << 20;         // bytes of a buffer of the ring, the bands of rows are cut to fit in it
+    unsigned int NumSlots = 4;
+    size_t FrameBudget = 4u << 20;      // bytes of the queued uploads issued per frame
+};
+
+
+struct TextureUploadStatistics
+{
+    unsigned long SubUploads = 0;       // bands of rows uploaded from the ring
+    size_t BytesUploaded = 0;
+    unsigned int QueuedUploads = 0;     // textures waiting for the end of their upload
+    size_t QueuedBytes = 0;
+    unsigned int SlotWaits = 0;         // the immediate uploads waited for a slot still read by the GPU
+    double WaitMs = 0.0;
+    double CopyMs = 0.0;                // CPU time spent filling the slots and issuing the uploads
+    unsigned long Frames = 0;
+    double FrameMsSum = 0.0;            // CPU time of the queued uploads in the frames
+    double MaxFrameMs = 0.0;
+
+    // Rate at which the render thread hands the pixels to the GPU, in MiB/s
+    double GetBandwidth() const { return CopyMs > 0.0 ? BytesUploaded / (1024.0 * 1024.0) / (CopyMs / 1000.0) : 0.0; }
+
+    double GetAverageFrameMs() const { return Frames > 0 ? FrameMsSum / Frames : 0.0; }
+};
+
+
+/**
+ * @brief A level of a texture to upload, with its pixels or its blocks
+ *
+ */
+struct TextureLevelUpload
+{
+    GLenum Target = GL_TEXTURE_2D;      // target of the image, a face for a cube map
+    GLint Level = 0;                    // level in the storage of the texture
+    int Width = 0;
+    int Height = 0;
+    GLenum PixelFormat = 0;             // 0 for a block compressed level
+    GLenum InternalFormat = 0;
+    std::vector<unsigned char> Data;
+};
+
+
+inline TextureUploadSettings& getTextureUploadSettings()
+{
+    static TextureUploadSettings settings;
+    return settings;
+}
+
+
+class TextureUploader
+{
+private:
+    struct Slot {
+        GLuint Buffer = 0;
+        GLsync Fence = 0;               // signaled when the GPU has read the last band written in the slot
+    };
+
+    // Levels of a texture uploaded over the frames, the texture is not used before the end of the upload
+    struct Batch {
+        GLuint Texture = 0;
+        GLenum BindTarget = GL_TEXTURE_2D;
+        std::vector<TextureLevelUpload> Levels;
+        std::function<void()> OnComplete;
+        size_t NextLevel = 0;
+        int NextRow = 0;                // in rows of pixels, or rows of blocks
+    };
+
+    std::vector<Slot> m_Slots;
+    size_t m_SlotSize = 0;
+    unsigned int m_NextSlot = 0;
+    std::deque<Batch> m_Queue;
+    TextureUploadStatistics m_Statistics;
+
+public:
+    TextureUploader() {}
+
+    TextureUploader(const TextureUploader&) = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+
+    const TextureUploadStatistics& getStatistics() const { return m_Statistics; }
+
+    /**
+     * @brief Upload a level in the texture bound to its target, now: the bands are written in the slots of the ring
+     * as they are freed by the GPU, the call only waits when the ring is full
+     *
+     * @param size the size of data, at least the rows of the level: the tightly packed pixels or the blocks
+     */
+    void upload(GLenum target, GLint level, int width, int height, GLenum pixelFormat, GLenum internalFormat,
+                const unsigned char* data, size_t size)
+    {
+        init();
+        auto start = std::chrono::steady_clock::now();
+
+        TextureLevelUpload region;
+        region.Target = target;
+        region.Level = level;
+        region.Width = width;
+        region.Height = height;
+        region.PixelFormat = pixelFormat;
+        region.InternalFormat = internalFormat;
+
+        int numRows = getNumRows(region);
+        size_t rowBytes = getRowBytes(region);
+        if (size < rowBytes * numRows) {
+            std::cout << "Error uploading the level " << level << " of a texture: " << size << " bytes for "
+                      << rowBytes * numRows << " bytes of rows" << std::endl;
+            return;
+        }
+        for (int row = 0 ; row < numRows ; ) {
+            int rows = std::min(numRows - row, (int)std::max((size_t)1, m_SlotSize / rowBytes));
+            uploadBand(acquireSlot(true), region, data, row, rows);
+            row += rows;
+        }
+
+        m_Statistics.CopyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Queue the upload of the levels of a texture, spread over the next frames by update
+     *
+     * @param texture the texture object, its storage must be allocated for the levels
+     * @param onComplete called by update once all the levels are uploaded, the texture can be used from then
+     */
+    void queue(GLuint texture, GLenum bindTarget, std::vector<TextureLevelUpload>&& levels, std::function<void()> onComplete)
+    {
+        Batch batch;
+        batch.Texture = texture;
+        batch.BindTarget = bindTarget;
+        batch.Levels = std::move(levels);
+        batch.OnComplete = onComplete;
+        m_Queue.push_back(std::move(batch));
+    }
+
+    /**
+     * @brief Drop the queued uploads of a texture that is deleted, their callbacks are not called
+     *
+     */
+    void cancel(GLuint texture)
+    {
+        m_Queue.erase(std::remove_if(m_Queue.begin(), m_Queue.end(), [texture](const Batch& batch) {
+            return batch.Texture == texture;
+        }), m_Queue.end());
+    }
+
+    /**
+     * @brief Issue the queued uploads, in order, within the budget of the frame. Never waits for the GPU:
+     * the uploads stop for this frame when the next slot of the ring is still read. Called once per frame.
+     *
+     */
+    void update()
+    {
+        if (m_Queue.empty()) {
+            updateQueueStatistics();
+            return;
+        }
+        init();
+        auto start = std::chrono::steady_clock::now();
+
+        size_t budget = getTextureUploadSettings().FrameBudget;
+        size_t uploaded = 0;
+        while (!m_Queue.empty()) {
+            Batch& batch = m_Queue.front();
+            glBindTexture(batch.BindTarget, batch.Texture);
+
+            bool stalled = false;
+            while (batch.NextLevel < batch.Levels.size()) {
+                TextureLevelUpload& level = batch.Levels[batch.NextLevel];
+                Slot* slot = uploaded < budget ? acquireSlot(false) : NULL;
+                if (!slot) {
+                    stalled = true;
+                    break;
+                }
+
+                // at least one row, as many as the slot and the rest of the budget hold
+                size_t rowBytes = getRowBytes(level);
+                size_t maxBytes = std::min(m_SlotSize, budget - uploaded);
+                int rows = std::min(getNumRows(level) - batch.NextRow, (int)std::max((size_t)1, maxBytes / rowBytes));
+                uploadBand(slot, level, level.Data.data(), batch.NextRow, rows);
+                uploaded += rows * rowBytes;
+                batch.NextRow += rows;
+
+                if (batch.NextRow == getNumRows(level)) {
+                    std::vector<unsigned char>().swap(level.Data);
+                    batch.NextLevel++;
+                    batch.NextRow = 0;
+                }
+            }
+            glBindTexture(batch.BindTarget, 0);
+            if (stalled) {
+                break;
+            }
+
+            std::function<void()> onComplete = std::move(batch.OnComplete);
+            m_Queue.pop_front();
+            if (onComplete) {
+                onComplete();
+            }
+        }
+
+        double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_Statistics.CopyMs += frameMs;
+        m_Statistics.Frames++;
+        m_Statistics.FrameMsSum += frameMs;
+        m_Statistics.MaxFrameMs = std::max(m_Statistics.MaxFrameMs, frameMs);
+        updateQueueStatistics();
+    }
+
+private:
+    void init()
+    {
+        if (!m_Slots.empty()) {
+            return;
+        }
+
+        const TextureUploadSettings& settings = getTextureUploadSettings();
+        m_SlotSize = settings.SlotSize;
+        m_Slots.resize(std::max(1u, settings.NumSlots));
+        for (Slot& slot : m_Slots) {
+            glGenBuffers(1, &slot.Buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.Buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_SlotSize, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    /**
+     * @brief Take the next slot of the ring once the GPU has read it
+     *
+     * @param wait false to return NULL instead of waiting when the GPU still reads it
+     */
+    Slot* acquireSlot(bool wait)
+    {
+        Slot& slot = m_Slots[m_NextSlot];
+        if (slot.Fence) {
+            if (glClientWaitSync(slot.Fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                if (!wait) {
+                    return NULL;
+                }
+                auto start = std::chrono::steady_clock::now();
+                while (glClientWaitSync(slot.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {}
+                m_Statistics.SlotWaits++;
+                m_Statistics.WaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            glDeleteSync(slot.Fence);
+            slot.Fence = 0;
+        }
+        m_NextSlot = (m_NextSlot + 1) % m_Slots.size();
+        return &slot;
+    }
+
+    // The raw levels are cut in rows of pixels, the compressed ones in rows of 4x4 blocks
+    static int getNumRows(const TextureLevelUpload& level)
+    {
+        return level.PixelFormat ? level.Height : (level.Height + 3) / 4;
+    }
+
+    static size_t getRowBytes(const TextureLevelUpload& level)
+    {
+        if (level.PixelFormat) {
+            int channels = level.PixelFormat == GL_RED ? 1 : (level.PixelFormat == GL_RG ? 2 : (level.PixelFormat == GL_RGB ? 3 : 4));
+            return (size_t)level.Width * channels;
+        }
+        bool smallBlocks = level.InternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || level.InternalFormat == GL_COMPRESSED_RED_RGTC1;
+        return (size_t)((level.Width + 3) / 4) * (smallBlocks ? 8 : 16);
+    }
+
+    /**
+     * @brief Write rows of a level in a slot and upload them from it in the texture bound to the target
+     *
+     */
+    void uploadBand(Slot* slot, const TextureLevelUpload& level, const unsigned char* data, int firstRow, int rows)
+    {
+        size_t rowBytes = getRowBytes(level);
+        size_t bytes = rows * rowBytes;
+        const unsigned char* source = data + firstRow * rowBytes;
+        int rowHeight = level.PixelFormat ? 1 : 4;
+        int y = firstRow * rowHeight;
+        int height = std::min(rows * rowHeight, level.Height - y);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // A row larger than a slot is uploaded from the client memory
+        const void* pixels = source;
+        if (bytes <= m_SlotSize) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->Buffer);
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            memcpy(mapped, source, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            pixels = (const void*)0;
+        }
+
+        if (level.PixelFormat) {
+            glTexSubImage2D(level.Target, level.Level, 0, y, level.Width, height, level.PixelFormat, GL_UNSIGNED_BYTE, pixels);
+        }
+        else {
+            glCompressedTexSubImage2D(level.Target, level.Level, 0, y, level.Width, height, level.InternalFormat, (GLsizei)bytes, pixels);
+        }
+
+        if (bytes <= m_SlotSize) {
+            slot->Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        m_Statistics.SubUploads++;
+        m_Statistics.BytesUploaded += bytes;
+    }
+
+    void updateQueueStatistics()
+    {
+        m_Statistics.QueuedUploads = (unsigned int)m_Queue.size();
+        m_Statistics.QueuedBytes = 0;
+        for (const Batch& batch : m_Queue) {
+            for (size_t i = batch.NextLevel ; i < batch.Levels.size() ; i++) {
+                m_Statistics.QueuedBytes += batch.Levels[i].Data.size();
+            }
+        }
+    }
+};
+
+
+inline TextureUploader& getTextureUploader()
+{
+    static TextureUploader uploader;
+    return uploader;
+}
+
+
+#endif
@@ -2,6 +2,9 @@
 #define SKIN_MESH_UTILS_H
 
 #include <string>
+#include <cstring>
+#include <vector>
+#include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
@@ -47,6 +50,30 @@ std::string getDirFromPath(const std::string& Filename)
 }
 
 
+/**
+ * @brief Path of the first texture of a type of an assimp material, relative to the directory of the model
+ *
+ * @return the path of the texture, empty if the material has none
+ */
+inline std::string getAssimpTexturePath(const std::string& directory, const aiMaterial* material, aiTextureType type)
+{
+    aiString Path;
+    if (material->GetTextureCount(type) == 0 ||
+        material->GetTexture(type, 0, &Path, NULL, NULL, NULL, NULL, NULL) != AI_SUCCESS) {
+        return "";
+    }
+
+    std::string p(Path.data);
+    if (p == "C:\\\\") {
+        return "";
+    }
+    if (p.substr(0, 2) == ".\\") {
+        p = p.substr(2, p.size() - 2);
+    }
+    return directory + "/" + p;
+}
+
+
 inline glm::mat4 assimpToGlmMatrix4x4(aiMatrix4x4 mat) 
 {
 	glm::mat4 m;
@@ -77,6 +104,69 @@ inline glm::vec3 assimpToGlmVec3(aiVector3D vec)
 }
 
 
+/**
+ * @brief Convert an array of assimp vectors to glm vectors, in a single copy when both have the same layout
+ */
+inline void assimpToGlmVec3Array(const aiVector3D* src, glm::vec3* dst, unsigned int count)
+{
+	if (sizeof(aiVector3D) == sizeof(glm::vec3)) {
+		std::memcpy(dst, src, sizeof(glm::vec3) * count);
+		return;
+	}
+	for (unsigned int i = 0; i < count; i++){
+		dst[i] = glm::vec3(src[i].x, src[i].y, src[i].z);
+	}
+}
+
+
+/**
+ * @brief View an array of assimp vectors as glm vectors, converting it into storage only when the layouts differ
+ */
+inline const glm::vec3* assimpAsGlmVec3Array(const aiVector3D* src, unsigned int count, std::vector<glm::vec3>& storage)
+{
+	if (sizeof(aiVector3D) == sizeof(glm::vec3)) {
+		return reinterpret_cast<const glm::vec3*>(src);
+	}
+	storage.resize(count);
+	assimpToGlmVec3Array(src, storage.data(), count);
+	return storage.data();
+}
+
+
+/**
+ * @brief Convert an array of assimp texture coordinates to glm vectors, dropping the third coordinate.
+ * The loop has no dependency between iterations so that the compiler can vectorize it.
+ */
+inline void assimpToGlmVec2Array(const aiVector3D* __restrict src, glm::vec2* __restrict dst, unsigned int count)
+{
+	const ai_real* in = &src[0].x;
+	float* out = &dst[0].x;
+	for (unsigned int i = 0; i < count; i++){
+		out[2 * i] = (float)in[3 * i];
+		out[2 * i + 1] = (float)in[3 * i + 1];
+	}
+}
+
+
+/**
+ * @brief Allocate the immutable storage of a buffer and map it persistently for writing, so that it can be
+ * filled by the loading threads while the GL thread goes on. It must be unmapped before being drawn.
+ *
+ * @return the mapped storage
+ */
+inline void* createMappedBuffer(GLenum target, GLuint buffer, size_t size)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+
+	// An empty storage is not allowed
+	size = size > 0 ? size : 4;
+
+	glBindBuffer(target, buffer);
+	glBufferStorage(target, size, NULL, flags);
+	return glMapBufferRange(target, 0, size, flags);
+}
+
+
 inline glm::quat assimpToGlmQuat(aiQuaternion quat)
 {
 	glm::quat q;
@@ -0,0 +1,31 @@
+// Programmable vertex pulling: the vertex shaders read the indices and the vertices from storage buffers
+// with gl_VertexID, so every draw uses the same empty VAO and the vertex format is only known by the shaders.
+
+#ifndef VERTEX_PULLING_H
+#define VERTEX_PULLING_H
+
+#include <glad/glad.h>
+
+// Binding points of the storage buffers, they must match the shaders
+#define PULLING_INDEX_BINDING     0
+#define PULLING_POSITION_BINDING  1
+#define PULLING_TEX_COORD_BINDING 2
+#define PULLING_NORMAL_BINDING    3
+#define PULLING_BONE_BINDING      4
+
+
+/**
+ * @brief VAO without any attribute, shared by all the draws of the vertex pulling path (the core profile needs one)
+ *
+ */
+inline GLuint getEmptyVertexArray()
+{
+    static GLuint vao = 0;
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+    }
+    return vao;
+}
+
+
+#endif
@@ -0,0 +1,109 @@
+// Assimp file access through the virtual file system, so the meshes and the files they reference
+// (animations, materials) can be read from the archives.
+
+#ifndef VIRTUAL_IO_SYSTEM_H
+#define VIRTUAL_IO_SYSTEM_H
+
+#include <cstring>
+#include <algorithm>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "../utils/virtual_file_system.h"
+
+
+/**
+ * @brief Read-only stream over a file of the virtual file system
+ *
+ */
+class VirtualIOStream : public Assimp::IOStream
+{
+public:
+    FileData File;
+
+    size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override
+    {
+        if (pSize == 0) {
+            return 0;
+        }
+        size_t count = std::min(pCount, (File.GetSize() - m_Position) / pSize);
+        std::memcpy(pvBuffer, File.GetData() + m_Position, count * pSize);
+        m_Position += count * pSize;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override
+    {
+        size_t base = pOrigin == aiOrigin_SET ? 0 : (pOrigin == aiOrigin_CUR ? m_Position : File.GetSize());
+        if (pOrigin == aiOrigin_END) {
+            if (pOffset > File.GetSize()) {
+                return AI_FAILURE;
+            }
+            m_Position = File.GetSize() - pOffset;
+            return AI_SUCCESS;
+        }
+        if (pOffset > File.GetSize() - base) {
+            return AI_FAILURE;
+        }
+        m_Position = base + pOffset;
+        return AI_SUCCESS;
+    }
+
+    size_t Tell() const override { return m_Position; }
+
+    size_t FileSize() const override { return File.GetSize(); }
+
+    void Flush() override {}
+
+private:
+    size_t m_Position = 0;
+};
+
+
+/**
+ * @brief Assimp IO handler reading the files through the virtual file system, the importers take its ownership:
+ * importer.SetIOHandler(new VirtualIOSystem())
+ *
+ */
+class VirtualIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char* pFile) const override
+    {
+        return getVirtualFileSystem().exists(pFile);
+    }
+
+    char getOsSeparator() const override
+    {
+        return '/';
+    }
+
+    Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+    {
+        // The assets are never written
+        if (std::strchr(pMode, 'w') || std::strchr(pMode, 'a')) {
+            return NULL;
+        }
+
+        VirtualIOStream* stream = new VirtualIOStream();
+        if (!getVirtualFileSystem().readFile(pFile, stream->File)) {
+            delete stream;
+            return NULL;
+        }
+        return stream;
+    }
+
+    void Close(Assimp::IOStream* pFile) override
+    {
+        delete pFile;
+    }
+};
+
+
+#endif
@@ -0,0 +1,923 @@
+// Out-of-core world: the objects are grouped in square chunks of the ground plane, and the chunks around the camera
+// are loaded on the thread pool and uploaded on the render thread within a memory budget, the others are released.
+
+#ifndef WORLD_STREAMER_H
+#define WORLD_STREAMER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include "../shader.h"
+#include "../utils/thread_pool.h"
+#include "../utils/memory_report.h"
+#include "../utils/virtual_file_system.h"
+
+#include "utils.h"
+#include "texture.h"
+#include "resource_manager.h"
+#include "mesh_optimizer.h"
+#include "frustum.h"
+#include "bounds.h"
+#include "virtual_io_system.h"
+#include "draw_uniforms.h"
+
+#define WORLD_POSITION_LOCATION    0
+#define WORLD_TEX_COORD_LOCATION   1
+#define WORLD_NORMAL_LOCATION      2
+
+
+struct StreamingSettings
+{
+    float ChunkSize = 32.0f;            // side of the chunks in world units
+    float LoadRadius = 96.0f;           // the chunks closer to the camera are loaded
+    float UnloadRadius = 128.0f;        // the chunks farther from the camera are released, larger than LoadRadius to avoid reloads
+    size_t MemoryBudget = 256u << 20;   // CPU and GPU bytes of the loaded chunks
+    size_t UploadBudget = 8u << 20;     // bytes uploaded to the GPU per frame, at least one chunk is uploaded
+    unsigned int MaxLoadsInFlight = 2;  // chunks loaded at the same time, the other workers stay free for the frame
+    double StallThresholdMs = 2.0;      // an update longer than this counts as a stall of the frame
+};
+
+
+/**
+ * @brief State of the streaming, the counters are cumulated since the creation of the streamer
+ *
+ */
+struct StreamingStatistics
+{
+    unsigned int ResidentChunks = 0;
+    unsigned int LoadingChunks = 0;
+    unsigned int QueuedChunks = 0;      // in the load radius, waiting for a loader or for memory
+    unsigned int ReadyChunks = 0;       // loaded, waiting for their upload
+    unsigned long ChunksLoaded = 0;
+    unsigned long ChunksEvicted = 0;
+    unsigned long Stalls = 0;
+    double LastUpdateMs = 0.0;
+    double MaxUpdateMs = 0.0;
+    size_t CpuBytes = 0;
+    size_t GpuBytes = 0;
+    size_t BytesUploaded = 0;
+};
+
+
+/**
+ * @brief An object placed in the world
+ *
+ */
+struct WorldObject
+{
+    std::string Path;
+    glm::mat4 Model = glm::mat4(1.0f);
+    bool Animated = false;      // drawn by the caller with its shared animated model, the chunk only tells if it is loaded
+};
+
+
+class WorldStreamer
+{
+private:
+    enum BUFFER_TYPE {
+        INDEX_BUFFER = 0,
+        POS_VB       = 1,
+        TEXCOORD_VB  = 2,
+        NORMAL_VB    = 3,
+        NUM_BUFFERS  = 4
+    };
+
+    enum class ChunkState {
+        Unloaded,
+        Loading,
+        Ready,
+        Resident
+    };
+
+    struct ChunkMaterial {
+        glm::vec3 AmbientColor = glm::vec3(1.0f);
+        glm::vec3 DiffuseColor = glm::vec3(0.0f);
+        glm::vec3 SpecularColor = glm::vec3(0.0f);
+        std::string DiffusePath;
+        std::string SpecularPath;
+        Texture* pDiffuse = NULL;           // set once the texture is uploaded, the material is drawn untextured until then
+        Texture* pSpecularExponent = NULL;
+
+        std::string GetKey() const
+        {
+            std::string key = DiffusePath + "|" + SpecularPath;
+            for (const glm::vec3& c : { AmbientColor, DiffuseColor, SpecularColor }) {
+                key += "|" + std::to_string(c.r) + "," + std::to_string(c.g) + "," + std::to_string(c.b);
+            }
+            return key;
+        }
+    };
+
+    // Meshes of the same material in a chunk, drawn with one call
+    struct ChunkRange {
+        unsigned int MaterialIndex = 0;     // in the materials of the geometry, then in the materials of the streamer
+        unsigned int BaseVertex = 0;
+        unsigned int NumVertices = 0;
+        unsigned int BaseIndex = 0;
+        unsigned int NumIndices = 0;
+    };
+
+    struct DecodedImage {
+        std::string Path;
+        int Width = 0;
+        int Height = 0;
+        int BPP = 0;
+        std::vector<unsigned char> Pixels;      // empty if the image can not be read
+        std::vector<MipLevel> Levels;           // the mip chain below the base level, generated by the worker
+        bool Color = true;                      // false for the specular exponents, filtered without the gamma correction
+    };
+
+    // Result of the loading of a chunk on a worker, in world space
+    struct ChunkGeometry {
+        std::vector<glm::vec3> Positions;
+        std::vector<glm::vec2> TexCoords;
+        std::vector<glm::vec3> Normals;
+        std::vector<unsigned int> Indices;
+        std::vector<ChunkMaterial> Materials;
+        std::vector<ChunkRange> Ranges;
+        std::vector<DecodedImage> Images;       // the textures that no other chunk decoded before
+        BoundingBox Bounds;
+
+        size_t GetBytes() const
+        {
+            size_t bytes = vectorBytes(Positions) + vectorBytes(TexCoords) + vectorBytes(Normals) + vectorBytes(Indices)
+                         + vectorBytes(Materials) + vectorBytes(Ranges);
+            for (const DecodedImage& image : Images) {
+                bytes += vectorBytes(image.Pixels);
+                for (const MipLevel& level : image.Levels) {
+                    bytes += vectorBytes(level.Pixels);
+                }
+            }
+            return bytes;
+        }
+
+        size_t GetUploadBytes() const
+        {
+            size_t bytes = vectorBytes(Positions) + vectorBytes(TexCoords) + vectorBytes(Normals) + vectorBytes(Indices);
+            for (const DecodedImage& image : Images) {
+                bytes += image.Pixels.size();
+                for (const MipLevel& level : image.Levels) {
+                    bytes += level.Pixels.size();
+                }
+            }
+            return bytes;
+        }
+    };
+
+    struct Chunk {
+        glm::ivec2 Coord = glm::ivec2(0);       // cell of the chunk on the x and z axes
+        std::vector<WorldObject> Objects;
+        ChunkState State = ChunkState::Unloaded;
+        bool Cancelled = false;                 // no longer needed while it was loading
+        float Distance = 0.0f;                  // from the camera to the cell of the chunk, on the ground plane
+
+        std::unique_ptr<ChunkGeometry> Geometry;    // while the chunk is ready
+        GLuint VAO = 0;
+        GLuint Buffers[NUM_BUFFERS] = { 0 };
+        std::vector<ChunkRange> Ranges;
+        BoundingBox Bounds;
+        size_t Bytes = 0;                       // CPU and GPU bytes of the chunk, kept after its release to estimate the next load
+    };
+
+    // Shared with the loading tasks, which may outlive the streamer
+    struct LoaderState {
+        std::mutex Mutex;
+        std::vector<std::pair<unsigned int, std::unique_ptr<ChunkGeometry>>> Completed;
+        std::set<std::string> ClaimedImages;    // the images decoded by a task, each image is decoded once
+    };
+
+    StreamingSettings m_Settings;
+    std::vector<Chunk> m_Chunks;
+    std::map<std::pair<int, int>, unsigned int> m_ChunkIndices;
+    std::shared_ptr<LoaderState> m_Loader = std::make_shared<LoaderState>();
+
+    // The materials and textures are shared by the chunks and stay loaded, the textures through the resource manager
+    std::vector<ChunkMaterial> m_Materials;
+    std::map<std::string, unsigned int> m_MaterialKeys;
+    std::map<std::string, std::shared_ptr<Texture>> m_Textures;
+    std::map<std::string, std::shared_ptr<Texture>> m_UploadingTextures;   // given to the materials once uploaded
+    size_t m_TextureBytes = 0;          // of the textures uploaded by the streamer, not of the ones shared with other objects
+
+    unsigned int m_NumLoading = 0;
+    StreamingStatistics m_Statistics;
+    std::string m_Name;
+
+public:
+    /**
+     * @param name the name of the world in the memory report
+     */
+    WorldStreamer(const std::string& name, const StreamingSettings& settings = StreamingSettings())
+        : m_Settings(settings), m_Name(name) {}
+
+    WorldStreamer(const WorldStreamer&) = delete;
+    WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+    ~WorldStreamer()
+    {
+        for (Chunk& chunk : m_Chunks) {
+            releaseChunk(chunk);
+        }
+        // The uploads still queued would call back the streamer
+        for (auto& texture : m_UploadingTextures) {
+            getTextureUploader().cancel(texture.second->GetTexture());
+        }
+        getMemoryReport().removeAsset(m_Name);
+    }
+
+    const StreamingSettings& getSettings() const { return m_Settings; }
+
+    const StreamingStatistics& getStatistics() const { return m_Statistics; }
+
+    unsigned int getNumChunks() const { return (unsigned int)m_Chunks.size(); }
+
+    /**
+     * @brief Place an object in the chunk of its origin, must be called before the first update
+     *
+     * @param path the path of the model file
+     * @param model the model matrix of the object
+     * @param animated true if the object is drawn by the caller, see getResidentAnimatedObjects
+     */
+    void addObject(const std::string& path, const glm::mat4& model, bool animated = false)
+    {
+        glm::ivec2 coord = glm::ivec2(glm::floor(glm::vec2(model[3].x, model[3].z) / m_Settings.ChunkSize));
+        auto key = std::make_pair(coord.x, coord.y);
+
+        auto it = m_ChunkIndices.find(key);
+        if (it == m_ChunkIndices.end()) {
+            it = m_ChunkIndices.insert({ key, (unsigned int)m_Chunks.size() }).first;
+            m_Chunks.emplace_back();
+            m_Chunks.back().Coord = coord;
+        }
+        m_Chunks[it->second].Objects.push_back({ path, model, animated });
+    }
+
+    /**
+     * @brief Update the streaming for the position of the camera: collect the loaded chunks, release the far ones,
+     * start the loading of the near ones by order of distance and upload the ready ones within the upload budget.
+     * Never waits for a loading task.
+     *
+     */
+    void update(const glm::vec3& cameraPosition)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        collectLoadedChunks();
+
+        for (Chunk& chunk : m_Chunks) {
+            chunk.Distance = getDistance(chunk, cameraPosition);
+        }
+
+        // Release the chunks out of the unload radius
+        for (Chunk& chunk : m_Chunks) {
+            if (chunk.Distance <= m_Settings.UnloadRadius) {
+                chunk.Cancelled = false;
+                continue;
+            }
+            if (chunk.State == ChunkState::Loading) {
+                chunk.Cancelled = true;
+            } else if (chunk.State != ChunkState::Unloaded) {
+                releaseChunk(chunk);
+            }
+        }
+
+        scheduleLoads();
+        uploadReadyChunks();
+        updateStatistics();
+
+        std::chrono::duration<double, std::milli> updateTime = std::chrono::steady_clock::now() - start;
+        m_Statistics.LastUpdateMs = updateTime.count();
+        m_Statistics.MaxUpdateMs = std::max(m_Statistics.MaxUpdateMs, updateTime.count());
+        if (updateTime.count() > m_Settings.StallThresholdMs) {
+            m_Statistics.Stalls++;
+        }
+    }
+
+    /**
+     * @brief Whether a material of the loaded chunks has the given textures, see render
+     *
+     */
+    bool hasMaterials(bool textured, bool specularMap) const
+    {
+        for (const ChunkMaterial& material : m_Materials) {
+            if ((material.pDiffuse != NULL) == textured && (material.pSpecularExponent != NULL) == specularMap) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Render the resident chunks that are in the view frustum, only the meshes whose material has the given textures:
+     * the shader variant of the caller samples exactly these textures
+     *
+     * The model matrix of the per-draw uniforms must be the identity, the colors of each material are set here.
+     *
+     * @param textured true for the materials with an uploaded diffuse texture
+     * @param specularMap true for the materials with an uploaded specular exponent texture
+     */
+    void render(const glm::mat4& view, const glm::mat4& projection, bool textured, bool specularMap)
+    {
+        Frustum frustum(projection * view);
+
+        for (const Chunk& chunk : m_Chunks) {
+            if (chunk.State != ChunkState::Resident || chunk.Ranges.empty() ||
+                !frustum.IsBoxVisible(chunk.Bounds.Min, chunk.Bounds.Max)) {
+                continue;
+            }
+
+            glBindVertexArray(chunk.VAO);
+            for (const ChunkRange& range : chunk.Ranges) {
+                const ChunkMaterial& material = m_Materials[range.MaterialIndex];
+                if ((material.pDiffuse != NULL) != textured || (material.pSpecularExponent != NULL) != specularMap) {
+                    continue;
+                }
+                getDrawUniforms().setMaterial(material.AmbientColor, material.DiffuseColor, material.SpecularColor);
+                getDrawUniforms().bind();
+
+                if (material.pDiffuse) {
+                    material.pDiffuse->Bind(COLOR_TEXTURE_UNIT);
+                }
+
+                if (material.pSpecularExponent) {
+                    material.pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
+                }
+
+                glDrawElementsBaseVertex(GL_TRIANGLES, range.NumIndices, GL_UNSIGNED_INT,
+                                         (void*)(sizeof(unsigned int) * range.BaseIndex), range.BaseVertex);
+            }
+        }
+
+        // Make sure the VAO is not changed from the outside
+        glBindVertexArray(0);
+    }
+
+    /**
+     * @brief The animated objects of the resident chunks
+     *
+     */
+    void getResidentAnimatedObjects(std::vector<const WorldObject*>& objects) const
+    {
+        objects.clear();
+        for (const Chunk& chunk : m_Chunks) {
+            if (chunk.State != ChunkState::Resident) {
+                continue;
+            }
+            for (const WorldObject& object : chunk.Objects) {
+                if (object.Animated) {
+                    objects.push_back(&object);
+                }
+            }
+        }
+    }
+
+private:
+    float getDistance(const Chunk& chunk, const glm::vec3& cameraPosition) const
+    {
+        glm::vec2 cellMin = glm::vec2(chunk.Coord) * m_Settings.ChunkSize;
+        glm::vec2 position(cameraPosition.x, cameraPosition.z);
+        glm::vec2 closest = glm::clamp(position, cellMin, cellMin + glm::vec2(m_Settings.ChunkSize));
+        return glm::length(position - closest);
+    }
+
+    size_t getUsedBytes() const
+    {
+        size_t used = 0;
+        for (const Chunk& chunk : m_Chunks) {
+            if (chunk.State != ChunkState::Unloaded) {
+                used += chunk.Bytes;
+            }
+        }
+        return used + m_TextureBytes;
+    }
+
+    /**
+     * @brief Bytes expected for a chunk that was never loaded: the average of the chunks loaded before
+     */
+    size_t estimateBytes(const Chunk& chunk) const
+    {
+        if (chunk.Bytes > 0) {
+            return chunk.Bytes;
+        }
+        size_t total = 0;
+        size_t count = 0;
+        for (const Chunk& c : m_Chunks) {
+            if (c.Bytes > 0) {
+                total += c.Bytes;
+                count++;
+            }
+        }
+        return count > 0 ? total / count : 0;
+    }
+
+    /**
+     * @brief Start the loading of the nearest chunks of the load radius, releasing farther chunks when the budget is full
+     *
+     */
+    void scheduleLoads()
+    {
+        std::vector<unsigned int> candidates;
+        for (unsigned int i = 0 ; i < m_Chunks.size() ; i++) {
+            if (m_Chunks[i].State == ChunkState::Unloaded && m_Chunks[i].Distance <= m_Settings.LoadRadius) {
+                candidates.push_back(i);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](unsigned int a, unsigned int b) {
+            return m_Chunks[a].Distance < m_Chunks[b].Distance;
+        });
+
+        m_Statistics.QueuedChunks = (unsigned int)candidates.size();
+
+        for (unsigned int i : candidates) {
+            if (m_NumLoading >= m_Settings.MaxLoadsInFlight) {
+                break;
+            }
+
+            Chunk& chunk = m_Chunks[i];
+            size_t needed = estimateBytes(chunk);
+            if (getUsedBytes() + needed > m_Settings.MemoryBudget && !evictFartherThan(chunk.Distance, needed)) {
+                // The nearer chunks fill the budget, the farther candidates would not fit either
+                break;
+            }
+
+            startLoading(i);
+            m_Statistics.QueuedChunks--;
+        }
+    }
+
+    /**
+     * @brief Release the farthest resident chunks until the needed bytes fit in the budget, only the chunks farther than distance
+     *
+     * @return false if the bytes do not fit
+     */
+    bool evictFartherThan(float distance, size_t needed)
+    {
+        std::vector<unsigned int> resident;
+        for (unsigned int i = 0 ; i < m_Chunks.size() ; i++) {
+            if ((m_Chunks[i].State == ChunkState::Resident || m_Chunks[i].State == ChunkState::Ready) && m_Chunks[i].Distance > distance) {
+                resident.push_back(i);
+            }
+        }
+        std::sort(resident.begin(), resident.end(), [this](unsigned int a, unsigned int b) {
+            return m_Chunks[a].Distance > m_Chunks[b].Distance;
+        });
+
+        for (unsigned int i : resident) {
+            if (getUsedBytes() + needed <= m_Settings.MemoryBudget) {
+                break;
+            }
+            releaseChunk(m_Chunks[i]);
+        }
+        return getUsedBytes() + needed <= m_Settings.MemoryBudget;
+    }
+
+    void startLoading(unsigned int chunkIndex)
+    {
+        Chunk& chunk = m_Chunks[chunkIndex];
+        chunk.Bytes = estimateBytes(chunk);
+        chunk.State = ChunkState::Loading;
+        chunk.Cancelled = false;
+        m_NumLoading++;
+
+        // The task only uses copies and the shared loader state, the streamer can be destroyed before it ends
+        std::vector<WorldObject> objects = chunk.Objects;
+        std::shared_ptr<LoaderState> loader = m_Loader;
+        getThreadPool().submit([chunkIndex, objects, loader]() {
+            std::unique_ptr<ChunkGeometry> geometry = loadChunk(objects, *loader);
+            std::lock_guard<std::mutex> lock(loader->Mutex);
+            loader->Completed.push_back({ chunkIndex, std::move(geometry) });
+        });
+    }
+
+    void collectLoadedChunks()
+    {
+        std::vector<std::pair<unsigned int, std::unique_ptr<ChunkGeometry>>> completed;
+        {
+            std::lock_guard<std::mutex> lock(m_Loader->Mutex);
+            completed.swap(m_Loader->Completed);
+        }
+
+        for (auto& result : completed) {
+            Chunk& chunk = m_Chunks[result.first];
+            m_NumLoading--;
+
+            // The images are decoded once, they are kept even if the chunk is no longer needed
+            for (DecodedImage& image : result.second->Images) {
+                uploadImage(image);
+            }
+            result.second->Images.clear();
+
+            if (chunk.Cancelled) {
+                chunk.State = ChunkState::Unloaded;
+                chunk.Cancelled = false;
+                continue;
+            }
+            chunk.Bytes = result.second->GetBytes();
+            chunk.Geometry = std::move(result.second);
+            chunk.State = ChunkState::Ready;
+            m_Statistics.ChunksLoaded++;
+        }
+    }
+
+    /**
+     * @brief Upload the ready chunks by order of distance until the upload budget of the frame is spent
+     *
+     */
+    void uploadReadyChunks()
+    {
+        std::vector<unsigned int> ready;
+        for (unsigned int i = 0 ; i < m_Chunks.size() ; i++) {
+            if (m_Chunks[i].State == ChunkState::Ready) {
+                ready.push_back(i);
+            }
+        }
+        std::sort(ready.begin(), ready.end(), [this](unsigned int a, unsigned int b) {
+            return m_Chunks[a].Distance < m_Chunks[b].Distance;
+        });
+
+        size_t uploaded = 0;
+        for (unsigned int i : ready) {
+            size_t bytes = m_Chunks[i].Geometry->GetUploadBytes();
+            if (uploaded > 0 && uploaded + bytes > m_Settings.UploadBudget) {
+                break;
+            }
+            uploadChunk(m_Chunks[i]);
+            uploaded += bytes;
+        }
+        m_Statistics.BytesUploaded += uploaded;
+    }
+
+    void uploadChunk(Chunk& chunk)
+    {
+        ChunkGeometry& geometry = *chunk.Geometry;
+
+        glGenVertexArrays(1, &chunk.VAO);
+        glBindVertexArray(chunk.VAO);
+        glGenBuffers(NUM_BUFFERS, chunk.Buffers);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.Buffers[POS_VB]);
+        glBufferStorage(GL_ARRAY_BUFFER, std::max((size_t)4, sizeof(glm::vec3) * geometry.Positions.size()), geometry.Positions.data(), 0);
+        glEnableVertexAttribArray(WORLD_POSITION_LOCATION);
+        glVertexAttribPointer(WORLD_POSITION_LOCATION, 3, GL_FLOAT, false, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.Buffers[TEXCOORD_VB]);
+        glBufferStorage(GL_ARRAY_BUFFER, std::max((size_t)4, sizeof(glm::vec2) * geometry.TexCoords.size()), geometry.TexCoords.data(), 0);
+        glEnableVertexAttribArray(WORLD_TEX_COORD_LOCATION);
+        glVertexAttribPointer(WORLD_TEX_COORD_LOCATION, 2, GL_FLOAT, false, 0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.Buffers[NORMAL_VB]);
+        glBufferStorage(GL_ARRAY_BUFFER, std::max((size_t)4, sizeof(glm::vec3) * geometry.Normals.size()), geometry.Normals.data(), 0);
+        glEnableVertexAttribArray(WORLD_NORMAL_LOCATION);
+        glVertexAttribPointer(WORLD_NORMAL_LOCATION, 3, GL_FLOAT, false, 0, 0);
+
+        // The VAO is bound, so it keeps this index buffer
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.Buffers[INDEX_BUFFER]);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, std::max((size_t)4, sizeof(unsigned int) * geometry.Indices.size()), geometry.Indices.data(), 0);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // The materials of the chunk are merged into the shared ones
+        chunk.Ranges = geometry.Ranges;
+        for (ChunkRange& range : chunk.Ranges) {
+            range.MaterialIndex = addMaterial(geometry.Materials[range.MaterialIndex]);
+        }
+        chunk.Bounds = geometry.Bounds;
+
+        // Only the ranges stay in the process memory
+        chunk.Bytes = vectorBytes(chunk.Ranges) + vectorBytes(geometry.Positions) + vectorBytes(geometry.TexCoords)
+                    + vectorBytes(geometry.Normals) + vectorBytes(geometry.Indices);
+        chunk.Geometry.reset();
+        chunk.State = ChunkState::Resident;
+    }
+
+    void releaseChunk(Chunk& chunk)
+    {
+        if (chunk.Buffers[0] != 0) {
+            glDeleteBuffers(NUM_BUFFERS, chunk.Buffers);
+            std::fill_n(chunk.Buffers, NUM_BUFFERS, 0);
+        }
+        if (chunk.VAO != 0) {
+            glDeleteVertexArrays(1, &chunk.VAO);
+            chunk.VAO = 0;
+        }
+        if (chunk.State == ChunkState::Resident || chunk.State == ChunkState::Ready) {
+            m_Statistics.ChunksEvicted++;
+        }
+
+        chunk.Geometry.reset();
+        std::vector<ChunkRange>().swap(chunk.Ranges);
+        chunk.State = ChunkState::Unloaded;
+    }
+
+    unsigned int addMaterial(const ChunkMaterial& material)
+    {
+        std::string key = material.GetKey();
+        auto it = m_MaterialKeys.find(key);
+        if (it != m_MaterialKeys.end()) {
+            return it->second;
+        }
+
+        ChunkMaterial result = material;
+        result.pDiffuse = findTexture(result.DiffusePath);
+        result.pSpecularExponent = findTexture(result.SpecularPath);
+
+        m_MaterialKeys[key] = (unsigned int)m_Materials.size();
+        m_Materials.push_back(result);
+        return (unsigned int)m_Materials.size() - 1;
+    }
+
+    Texture* findTexture(const std::string& path) const
+    {
+        auto it = m_Textures.find(path);
+        return it == m_Textures.end() ? NULL : it->second.get();
+    }
+
+    /**
+     * @brief Queue the upload of a decoded image in the texture uploader, the materials get the texture once it is complete.
+     * The image is dropped when another object already loaded the file, its texture is shared instead.
+     *
+     */
+    void uploadImage(DecodedImage& image)
+    {
+        if (image.Pixels.empty()) {
+            return;
+        }
+
+        std::string path = image.Path;
+        std::shared_ptr<Texture> texture = getResourceManager().findTexture(path, image.Color);
+        if (texture) {
+            useTexture(path, texture);
+            return;
+        }
+
+        texture = getResourceManager().queueTexture(path, image.Width, image.Height, image.BPP, std::move(image.Pixels),
+                                                    std::move(image.Levels), [this, path]() {
+            useUploadedTexture(path);
+        }, image.Color);
+        m_TextureBytes += texture->GetGpuBytes();
+        m_UploadingTextures[path] = texture;
+    }
+
+    void useUploadedTexture(const std::string& path)
+    {
+        std::shared_ptr<Texture> texture = m_UploadingTextures[path];
+        m_UploadingTextures.erase(path);
+        useTexture(path, texture);
+    }
+
+    void useTexture(const std::string& path, const std::shared_ptr<Texture>& texture)
+    {
+        // A material may have been created by a chunk uploaded before its texture
+        for (ChunkMaterial& material : m_Materials) {
+            if (material.DiffusePath == path) {
+                material.pDiffuse = texture.get();
+            }
+            if (material.SpecularPath == path) {
+                material.pSpecularExponent = texture.get();
+            }
+        }
+        m_Textures[path] = texture;
+    }
+
+    void updateStatistics()
+    {
+        m_Statistics.ResidentChunks = 0;
+        m_Statistics.LoadingChunks = m_NumLoading;
+        m_Statistics.ReadyChunks = 0;
+        m_Statistics.CpuBytes = vectorBytes(m_Materials);
+        m_Statistics.GpuBytes = m_TextureBytes;
+
+        for (const Chunk& chunk : m_Chunks) {
+            if (chunk.State == ChunkState::Resident) {
+                m_Statistics.ResidentChunks++;
+                m_Statistics.CpuBytes += vectorBytes(chunk.Ranges);
+                m_Statistics.GpuBytes += chunk.Bytes - vectorBytes(chunk.Ranges);
+            } else if (chunk.State == ChunkState::Ready) {
+                m_Statistics.ReadyChunks++;
+                m_Statistics.CpuBytes += chunk.Bytes;
+            }
+        }
+        getMemoryReport().setAsset(m_Name, m_Statistics.CpuBytes, m_Statistics.GpuBytes);
+    }
+
+    /**
+     * @brief Import the static objects of a chunk and bake them into world space, grouped by material.
+     * Runs on a worker: no GL call, the textures are only decoded.
+     *
+     */
+    static std::unique_ptr<ChunkGeometry> loadChunk(const std::vector<WorldObject>& objects, LoaderState& loader)
+    {
+        std::unique_ptr<ChunkGeometry> geometry(new ChunkGeometry());
+
+        struct PlacedMesh {
+            const aiMesh* Mesh;
+            const glm::mat4* Model;
+            unsigned int MaterialIndex;
+        };
+
+        // Every file is imported once per chunk, the scenes are released at the end of the loading
+        std::map<std::string, std::unique_ptr<Assimp::Importer>> importers;
+        std::map<std::string, std::vector<unsigned int>> fileMaterials;
+        std::map<std::string, unsigned int> materialKeys;
+        std::vector<PlacedMesh> meshes;
+
+        for (const WorldObject& object : objects) {
+            if (object.Animated) {
+                continue;
+            }
+
+            auto it = importers.find(object.Path);
+            if (it == importers.end()) {
+                std::unique_ptr<Assimp::Importer> importer(new Assimp::Importer());
+                importer->SetIOHandler(new VirtualIOSystem());
+                const aiScene* scene = importer->ReadFile(object.Path,
+                                                          aiProcess_Triangulate             |
+                                                          aiProcess_GenNormals              |
+                                                          aiProcess_JoinIdenticalVertices   |
+                                                          aiProcess_ValidateDataStructure);
+                if (!scene) {
+                    std::cout << "Error parsing " << object.Path << ": " << importer->GetErrorString() << std::endl;
+                }
+                else {
+                    std::string directory = getDirFromPath(object.Path);
+                    std::vector<unsigned int>& materials = fileMaterials[object.Path];
+                    for (unsigned int i = 0 ; i < scene->mNumMaterials ; i++) {
+                        materials.push_back(addChunkMaterial(*geometry, materialKeys, directory, scene->mMaterials[i]));
+                    }
+                }
+                it = importers.insert({ object.Path, std::move(importer) }).first;
+            }
+
+            const aiScene* scene = it->second->GetScene();
+            if (!scene) {
+                continue;
+            }
+            for (unsigned int i = 0 ; i < scene->mNumMeshes ; i++) {
+                if (scene->mMeshes[i]->mNumFaces > 0) {
+                    meshes.push_back({ scene->mMeshes[i], &object.Model, fileMaterials[object.Path][scene->mMeshes[i]->mMaterialIndex] });
+                }
+            }
+        }
+
+        std::stable_sort(meshes.begin(), meshes.end(), [](const PlacedMesh& a, const PlacedMesh& b) {
+            return a.MaterialIndex < b.MaterialIndex;
+        });
+
+        unsigned int NumVertices = 0;
+        unsigned int NumIndices = 0;
+        for (const PlacedMesh& placed : meshes) {
+            NumVertices += placed.Mesh->mNumVertices;
+            NumIndices += placed.Mesh->mNumFaces * 3;
+        }
+        geometry->Positions.reserve(NumVertices);
+        geometry->TexCoords.reserve(NumVertices);
+        geometry->Normals.reserve(NumVertices);
+        geometry->Indices.reserve(NumIndices);
+
+        for (const PlacedMesh& placed : meshes) {
+            if (geometry->Ranges.empty() || geometry->Ranges.back().MaterialIndex != placed.MaterialIndex) {
+                ChunkRange range;
+                range.MaterialIndex = placed.MaterialIndex;
+                range.BaseVertex = (unsigned int)geometry->Positions.size();
+                range.BaseIndex = (unsigned int)geometry->Indices.size();
+                geometry->Ranges.push_back(range);
+            }
+            appendMesh(*geometry, geometry->Ranges.back(), placed.Mesh, *placed.Model);
+        }
+
+        for (ChunkRange& range : geometry->Ranges) {
+            optimizeVertexCache(&geometry->Indices[range.BaseIndex], range.NumIndices, range.NumVertices);
+        }
+        geometry->Bounds = computeBoundingBox(geometry->Positions.data(), (unsigned int)geometry->Positions.size());
+
+        decodeImages(*geometry, loader);
+        return geometry;
+    }
+
+    static unsigned int addChunkMaterial(ChunkGeometry& geometry, std::map<std::string, unsigned int>& materialKeys,
+                                         const std::string& directory, const aiMaterial* material)
+    {
+        ChunkMaterial result;
+        result.DiffusePath = getAssimpTexturePath(directory, material, aiTextureType_DIFFUSE);
+        result.SpecularPath = getAssimpTexturePath(directory, material, aiTextureType_SHININESS);
+
+        aiColor3D color(0.0f, 0.0f, 0.0f);
+        if (material->Get(AI_MATKEY_COLOR_AMBIENT, color) == AI_SUCCESS) {
+            result.AmbientColor = glm::vec3(color.r, color.g, color.b);
+        }
+        if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS) {
+            result.DiffuseColor = glm::vec3(color.r, color.g, color.b);
+        }
+        if (material->Get(AI_MATKEY_COLOR_SPECULAR, color) == AI_SUCCESS) {
+            result.SpecularColor = glm::vec3(color.r, color.g, color.b);
+        }
+
+        std::string key = result.GetKey();
+        auto it = materialKeys.find(key);
+        if (it != materialKeys.end()) {
+            return it->second;
+        }
+        materialKeys[key] = (unsigned int)geometry.Materials.size();
+        geometry.Materials.push_back(result);
+        return (unsigned int)geometry.Materials.size() - 1;
+    }
+
+    /**
+     * @brief Append a mesh transformed by its model matrix to the last range of the geometry
+     *
+     */
+    static void appendMesh(ChunkGeometry& geometry, ChunkRange& range, const aiMesh* mesh, const glm::mat4& model)
+    {
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        unsigned int baseVertex = range.NumVertices;
+
+        for (unsigned int v = 0 ; v < mesh->mNumVertices ; v++) {
+            geometry.Positions.push_back(glm::vec3(model * glm::vec4(assimpToGlmVec3(mesh->mVertices[v]), 1.0f)));
+
+            glm::vec3 n = mesh->mNormals ? normalMatrix * assimpToGlmVec3(mesh->mNormals[v]) : glm::vec3(0.0f, 1.0f, 0.0f);
+            float length = glm::length(n);
+            geometry.Normals.push_back(length > 0.0f ? n / length : n);
+
+            geometry.TexCoords.push_back(mesh->HasTextureCoords(0) ? glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y)
+                                                                   : glm::vec2(0.0f));
+        }
+
+        for (unsigned int f = 0 ; f < mesh->mNumFaces ; f++) {
+            const aiFace& Face = mesh->mFaces[f];
+            geometry.Indices.push_back(baseVertex + Face.mIndices[0]);
+            geometry.Indices.push_back(baseVertex + Face.mIndices[1]);
+            geometry.Indices.push_back(baseVertex + Face.mIndices[2]);
+        }
+
+        range.NumVertices += mesh->mNumVertices;
+        range.NumIndices += mesh->mNumFaces * 3;
+    }
+
+    /**
+     * @brief Decode the textures of the materials that no other task claimed, as Texture::Load does
+     *
+     */
+    static void decodeImages(ChunkGeometry& geometry, LoaderState& loader)
+    {
+        std::vector<std::pair<std::string, bool>> paths;   // the paths and whether they hold colors
+        {
+            std::lock_guard<std::mutex> lock(loader.Mutex);
+            for (const ChunkMaterial& material : geometry.Materials) {
+                for (const std::string& path : { material.DiffusePath, material.SpecularPath }) {
+                    if (!path.empty() && loader.ClaimedImages.insert(path).second) {
+                        paths.emplace_back(path, path == material.DiffusePath);
+                    }
+                }
+            }
+        }
+
+        // The flag of stb_image is global, the workers use their own
+        stbi_set_flip_vertically_on_load_thread(1);
+
+        for (const auto& entry : paths) {
+            const std::string& path = entry.first;
+            DecodedImage image;
+            image.Path = path;
+            image.Color = entry.second;
+
+            FileData file;
+            unsigned char* data = NULL;
+            if (getVirtualFileSystem().readFile(path, file)) {
+                data = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &image.Width, &image.Height, &image.BPP, 0);
+            }
+            if (data) {
+                image.Pixels.assign(data, data + (size_t)image.Width * image.Height * image.BPP);
+                stbi_image_free(data);
+
+                // The mip chain is filtered here rather than on the main thread at the upload
+                const TextureMipSettings& mips = getTextureMipSettings();
+                if (mips.Filter != MipFilter::Driver) {
+                    generateMipChain(image.Pixels.data(), image.Width, image.Height, image.BPP, mips.Filter, mips.GammaCorrect && image.Color, image.Levels);
+                }
+            } else {
+                std::cout << "Can't load texture from '" << path << "'" << std::endl;
+            }
+            geometry.Images.push_back(std::move(image));
+        }
+    }
+};
+
+
+#endif
@@ -8,6 +8,56 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <set>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#include "shader_cache.h"
+
+
+// Uniform calls of all the programs, to compare the cached setters with the lookups by name
+struct UniformStatistics
+{
+    unsigned long long Uploads = 0;     // glUniform* calls
+    unsigned long long Skipped = 0;     // values already held by the program, not sent again
+    unsigned long long Lookups = 0;     // glGetUniformLocation calls
+    unsigned int Frames = 0;
+
+    void Reset() { *this = UniformStatistics(); }
+};
+
+inline UniformStatistics& getUniformStatistics()
+{
+    static UniformStatistics statistics;
+    return statistics;
+}
+
+
+struct UniformSettings
+{
+    bool Cache = true;      // false to look every uniform up by name and send every value, as without the reflection table
+};
+
+inline UniformSettings& getUniformSettings()
+{
+    static UniformSettings settings;
+    return settings;
+}
+
+
+/**
+ * @brief A uniform of a program resolved once, for the hot paths (see Shader::getUniform)
+ *
+ */
+struct UniformHandle
+{
+    int Index = -1;     // in the table of the program, -1 if the uniform is not active
+
+    bool isValid() const { return Index >= 0; }
+};
+
 
 class Shader
 {
@@ -16,7 +66,12 @@ public:
 
     Shader(){}
 
-	Shader(const char* vertexPath, const char* fragmentPath)
+    // the table of the uniforms caches the values held by the program, a copy would miss the changes of the original
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+	// defines: lines of #define inserted after the #version line of both shaders, to compile variants of the same files
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
 	{
         // std::cout << vertexPath << "\n" << fragmentPath << std::endl;
         // 1. retrieve the vertex/fragment source code from filePath
@@ -48,48 +103,308 @@ public:
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
             exit(1);
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-
-        GLuint vertex = compileShader(vertexCode, GL_VERTEX_SHADER);
-        GLuint fragment = compileShader(fragmentCode, GL_FRAGMENT_SHADER);
-        ID = compileProgram(vertex, fragment);
+        std::set<std::string> vertexIncludes, fragmentIncludes;
+        resolveIncludes(vertexCode, getDirectory(vertexPath), vertexIncludes);
+        resolveIncludes(fragmentCode, getDirectory(fragmentPath), fragmentIncludes);
+        insertDefines(vertexCode, defines);
+        insertDefines(fragmentCode, defines);
+        build(vertexCode, fragmentCode);
 	}
 
     Shader(std::string vShaderCode, std::string fShaderCode)
     {
-        GLuint vertex = compileShader(vShaderCode, GL_VERTEX_SHADER);
-        GLuint fragment = compileShader(fShaderCode, GL_FRAGMENT_SHADER);
-        ID = compileProgram(vertex, fragment);
+        build(vShaderCode, fShaderCode);
     }
 
     void use() {
         glUseProgram(ID);
     }
+
+    /**
+     * @brief Find a uniform in the table built after the link, without any GL call
+     *
+     * @param name the name of the uniform, an element of an array or a member of a struct as in the GLSL ("gLights[1].Color")
+     */
+    UniformHandle getUniform(const GLchar* name) const {
+        auto it = m_UniformIndices.find(name);
+        UniformHandle uniform;
+        uniform.Index = it == m_UniformIndices.end() ? -1 : it->second;
+        return uniform;
+    }
+
+    unsigned int getNumUniforms() const { return (unsigned int)m_Uniforms.size(); }
+
+    // The setters by name find the uniform in the table, the values equal to the last ones sent are skipped.
+    // Without the cache, they look the location up and send the value at every call.
     void setInteger(const GLchar *name, GLint value) {
-        glUniform1i(glGetUniformLocation(ID, name), value);
+        if (!getUniformSettings().Cache) {
+            glUniform1i(lookUpLocation(name), value);
+            return;
+        }
+        setInteger(getUniform(name), value);
     }
     void setFloat(const GLchar* name, GLfloat value) {
-        glUniform1f(glGetUniformLocation(ID, name), value);
+        if (!getUniformSettings().Cache) {
+            glUniform1f(lookUpLocation(name), value);
+            return;
+        }
+        setFloat(getUniform(name), value);
     }
 
     void setVector2f(const GLchar* name, GLfloat x, GLfloat y) {
-        glUniform2f(glGetUniformLocation(ID, name), x, y);
+        if (!getUniformSettings().Cache) {
+            glUniform2f(lookUpLocation(name), x, y);
+            return;
+        }
+        setVector2f(getUniform(name), x, y);
     }
     void setVector3f(const GLchar* name, GLfloat x, GLfloat y, GLfloat z) {
-        glUniform3f(glGetUniformLocation(ID, name), x, y, z);
+        setVector3f(name, glm::vec3(x, y, z));
     }
     void setVector3f(const GLchar* name, const glm::vec3& value) {
-        glUniform3f(glGetUniformLocation(ID, name), value.x, value.y, value.z);
+        if (!getUniformSettings().Cache) {
+            glUniform3f(lookUpLocation(name), value.x, value.y, value.z);
+            return;
+        }
+        setVector3f(getUniform(name), value);
     }
     void setMatrix4(const GLchar* name, const glm::mat4& matrix) {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(matrix));
+        if (!getUniformSettings().Cache) {
+            glUniformMatrix4fv(lookUpLocation(name), 1, GL_FALSE, glm::value_ptr(matrix));
+            return;
+        }
+        setMatrix4(getUniform(name), matrix);
+    }
+    void setMatrix4Array(const GLchar* name, const std::vector<glm::mat4>& matrix, uint size) {
+        if (!getUniformSettings().Cache) {
+            glUniformMatrix4fv(lookUpLocation(name), size, GL_FALSE, glm::value_ptr(matrix[0]));
+            return;
+        }
+        setMatrix4Array(getUniform(name), matrix, size);
+    }
+
+    void setInteger(UniformHandle uniform, GLint value) {
+        if (updateValue(uniform, GL_INT, &value, sizeof(value))) {
+            glUniform1i(m_Uniforms[uniform.Index].Location, value);
+        }
     }
-    void setMatrix4Array(const GLchar* name, const std::vector<glm::mat4> matrix, uint size) {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name), size, GL_FALSE, glm::value_ptr(matrix[0]));
+    void setFloat(UniformHandle uniform, GLfloat value) {
+        if (updateValue(uniform, GL_FLOAT, &value, sizeof(value))) {
+            glUniform1f(m_Uniforms[uniform.Index].Location, value);
+        }
+    }
+    void setVector2f(UniformHandle uniform, GLfloat x, GLfloat y) {
+        GLfloat value[2] = { x, y };
+        if (updateValue(uniform, GL_FLOAT_VEC2, value, sizeof(value))) {
+            glUniform2f(m_Uniforms[uniform.Index].Location, x, y);
+        }
+    }
+    void setVector3f(UniformHandle uniform, const glm::vec3& value) {
+        if (updateValue(uniform, GL_FLOAT_VEC3, glm::value_ptr(value), sizeof(value))) {
+            glUniform3f(m_Uniforms[uniform.Index].Location, value.x, value.y, value.z);
+        }
+    }
+    void setMatrix4(UniformHandle uniform, const glm::mat4& matrix) {
+        if (updateValue(uniform, GL_FLOAT_MAT4, glm::value_ptr(matrix), sizeof(matrix))) {
+            glUniformMatrix4fv(m_Uniforms[uniform.Index].Location, 1, GL_FALSE, glm::value_ptr(matrix));
+        }
+    }
+    // The arrays are always sent
+    void setMatrix4Array(UniformHandle uniform, const std::vector<glm::mat4>& matrix, uint size) {
+        if (uniform.isValid() && size > 0) {
+            glUniformMatrix4fv(m_Uniforms[uniform.Index].Location, size, GL_FALSE, glm::value_ptr(matrix[0]));
+            getUniformStatistics().Uploads++;
+        }
     }
 
 private:
+    // An active uniform of the program, with the last value sent to it
+    struct Uniform {
+        GLint Location;
+        GLenum Type;
+        bool Cached = false;
+        unsigned char Value[sizeof(GLfloat) * 16];      // up to a mat4
+    };
+
+    std::vector<Uniform> m_Uniforms;
+    std::unordered_map<std::string, int> m_UniformIndices;
+
+    /**
+     * @brief Load the program from the cache of the binaries, or compile it and store its binary.
+     * The uniforms are reflected in both cases, the binary holds no table of the uniforms.
+     *
+     */
+    void build(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ShaderCacheStatistics& statistics = getShaderCacheStatistics();
+        statistics.Programs++;
+
+        std::string key = getProgramCacheKey(vertexCode, fragmentCode);
+        std::string cachePath = getProgramCachePath(key);
+        ID = cachePath.empty() ? 0 : loadProgramBinary(cachePath, key);
+        if (ID != 0) {
+            statistics.CachedPrograms++;
+            statistics.CachedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        else {
+            GLuint vertex = compileShader(vertexCode, GL_VERTEX_SHADER);
+            GLuint fragment = compileShader(fragmentCode, GL_FRAGMENT_SHADER);
+            ID = compileProgram(vertex, fragment, !cachePath.empty());
+            if (!cachePath.empty()) {
+                storeProgramBinary(ID, cachePath, key);
+            }
+            statistics.CompiledPrograms++;
+            statistics.CompiledMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        reflectUniforms();
+    }
+
+    /**
+     * @brief Build the table of the active uniforms, every element of the arrays gets its own entry,
+     * and the name of an array without index stands for its first element
+     *
+     */
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+
+        for (GLint i = 0 ; i < count ; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), length);
+
+            // the members of the uniform blocks have no location
+            if (glGetUniformLocation(ID, uniformName.c_str()) < 0) {
+                continue;
+            }
+
+            size_t bracket = uniformName.size() >= 3 ? uniformName.size() - 3 : std::string::npos;
+            if (bracket != std::string::npos && uniformName.compare(bracket, 3, "[0]") == 0) {
+                std::string base = uniformName.substr(0, bracket);
+                for (GLint element = 0 ; element < size ; element++) {
+                    addUniform(base + "[" + std::to_string(element) + "]", type);
+                }
+                m_UniformIndices[base] = m_UniformIndices[uniformName];
+            }
+            else {
+                addUniform(uniformName, type);
+            }
+        }
+    }
+
+    void addUniform(const std::string& name, GLenum type)
+    {
+        Uniform uniform;
+        uniform.Location = glGetUniformLocation(ID, name.c_str());
+        uniform.Type = type;
+        m_UniformIndices[name] = (int)m_Uniforms.size();
+        m_Uniforms.push_back(uniform);
+    }
+
+    GLint lookUpLocation(const GLchar* name)
+    {
+        getUniformStatistics().Lookups++;
+        getUniformStatistics().Uploads++;
+        return glGetUniformLocation(ID, name);
+    }
+
+    /**
+     * @brief Keep the value sent to a uniform
+     *
+     * @return false if the uniform is not active or already holds the value, the GL call is then skipped
+     */
+    bool updateValue(UniformHandle uniform, GLenum type, const void* value, size_t size)
+    {
+        if (!uniform.isValid()) {
+            return false;
+        }
+        Uniform& entry = m_Uniforms[uniform.Index];
+#ifndef NDEBUG
+        // the integers also set the samplers and the booleans
+        if (type != GL_INT && entry.Type != type) {
+            std::cout << "Uniform of type " << entry.Type << " set as " << type << " in program " << ID << std::endl;
+        }
+#endif
+        if (getUniformSettings().Cache) {
+            if (entry.Cached && std::memcmp(entry.Value, value, size) == 0) {
+                getUniformStatistics().Skipped++;
+                return false;
+            }
+            std::memcpy(entry.Value, value, size);
+            entry.Cached = true;
+        }
+        getUniformStatistics().Uploads++;
+        return true;
+    }
+
+    static std::string getDirectory(const char* path)
+    {
+        std::string directory(path);
+        size_t slash = directory.find_last_of("/\\");
+        return slash == std::string::npos ? "." : directory.substr(0, slash);
+    }
+
+    /**
+     * @brief Replace the lines #include "file" by the content of the file, found next to the shader.
+     * A file is included once, the following includes of the same file are removed.
+     *
+     */
+    void resolveIncludes(std::string& shaderCode, const std::string& directory, std::set<std::string>& included)
+    {
+        size_t lineStart = 0;
+        while (lineStart < shaderCode.size()) {
+            size_t lineEnd = shaderCode.find('\n', lineStart);
+            if (lineEnd == std::string::npos) {
+                lineEnd = shaderCode.size();
+            }
+            if (shaderCode.compare(lineStart, 8, "#include") != 0) {
+                lineStart = lineEnd + 1;
+                continue;
+            }
+
+            size_t nameStart = shaderCode.find('"', lineStart);
+            size_t nameEnd = nameStart < lineEnd ? shaderCode.find('"', nameStart + 1) : std::string::npos;
+            if (nameEnd == std::string::npos || nameEnd > lineEnd) {
+                std::cout << "ERROR::SHADER::INVALID_INCLUDE: " << shaderCode.substr(lineStart, lineEnd - lineStart) << std::endl;
+                exit(1);
+            }
+            std::string path = directory + "/" + shaderCode.substr(nameStart + 1, nameEnd - nameStart - 1);
+
+            std::string includedCode;
+            if (included.insert(path).second) {
+                std::ifstream file(path);
+                if (!file) {
+                    std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << path << std::endl;
+                    exit(1);
+                }
+                std::stringstream stream;
+                stream << file.rdbuf();
+                includedCode = stream.str();
+                resolveIncludes(includedCode, directory, included);
+                if (!includedCode.empty() && includedCode.back() != '\n') {
+                    includedCode += '\n';
+                }
+            }
+            shaderCode.replace(lineStart, std::min(lineEnd + 1, shaderCode.size()) - lineStart, includedCode);
+            lineStart += includedCode.size();
+        }
+    }
+
+    void insertDefines(std::string& shaderCode, const std::string& defines)
+    {
+        if (defines.empty()) {
+            return;
+        }
+        size_t versionEnd = shaderCode.find('\n', shaderCode.find("#version"));
+        shaderCode.insert(versionEnd == std::string::npos ? shaderCode.size() : versionEnd + 1, defines);
+    }
+
     GLuint compileShader(std::string shaderCode, GLenum shaderType)
     {
         GLuint shader = glCreateShader(shaderType);
@@ -116,12 +431,16 @@ private:
         return shader;
     }
 
-    GLuint compileProgram(GLuint vertexShader, GLuint fragmentShader)
+    // retrievable: the binary of the program will be read for the cache
+    GLuint compileProgram(GLuint vertexShader, GLuint fragmentShader, bool retrievable = false)
     {
         GLuint programID = glCreateProgram();
 
         glAttachShader(programID, vertexShader);
         glAttachShader(programID, fragmentShader);
+        if (retrievable) {
+            glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
         glLinkProgram(programID);
 
 
@@ -0,0 +1,172 @@
+// Cache of the linked programs: the binary of a program is written at its first link with glGetProgramBinary,
+// and reloaded at the next runs with glProgramBinary instead of compiling the shaders again.
+// An entry is found by the hash of the sources of the program (with their defines) and of the driver, and holds
+// this whole key so that two programs with the same hash never share a binary. A binary rejected by the driver
+// (after an update of the driver) is compiled again and rewritten.
+
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "utils/hash.h"
+
+
+// "GLPK", the entries without their key were written with "GLPB"
+#define PROGRAM_CACHE_MAGIC ((uint32_t)'G' | ((uint32_t)'L' << 8) | ((uint32_t)'P' << 16) | ((uint32_t)'K' << 24))
+
+
+struct ShaderCacheSettings
+{
+    bool Enabled = true;
+    std::string CacheDirectory = "shader_cache";
+};
+
+
+struct ShaderCacheStatistics
+{
+    unsigned int Programs = 0;
+    unsigned int CachedPrograms = 0;        // loaded from the cache
+    unsigned int CompiledPrograms = 0;      // compiled and linked from the sources
+    unsigned int RejectedPrograms = 0;      // found in the cache, but rejected by the driver
+    double CachedMs = 0.0;
+    double CompiledMs = 0.0;
+};
+
+
+inline ShaderCacheSettings& getShaderCacheSettings()
+{
+    static ShaderCacheSettings settings;
+    return settings;
+}
+
+
+inline ShaderCacheStatistics& getShaderCacheStatistics()
+{
+    static ShaderCacheStatistics statistics;
+    return statistics;
+}
+
+
+// Header of a cache entry, followed by the key and the binary
+struct ProgramCacheHeader
+{
+    uint32_t Magic;
+    uint32_t KeyHash;
+    uint32_t KeySize;
+    uint32_t Format;        // binary format returned by glGetProgramBinary
+    uint32_t Length;
+};
+
+
+/**
+ * @brief Key of a program: its sources and the driver that compiled them, a binary is only valid for the same driver
+ */
+inline std::string getProgramCacheKey(const std::string& vertexCode, const std::string& fragmentCode)
+{
+    std::string key = vertexCode + "\n//fragment\n" + fragmentCode;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const GLubyte* value = glGetString(name);
+        key += "|" + std::string(value ? (const char*)value : "");
+    }
+    return key;
+}
+
+
+/**
+ * @brief Path of the cache entry of a program, empty when the cache is disabled or the driver has no binary format
+ */
+inline std::string getProgramCachePath(const std::string& key)
+{
+    if (!getShaderCacheSettings().Enabled) {
+        return "";
+    }
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0) {
+        return "";
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "program_%08x.bin", hashSource((const unsigned char*)key.data(), key.size()));
+    return getShaderCacheSettings().CacheDirectory + "/" + name;
+}
+
+
+/**
+ * @brief Create a program from its cache entry
+ *
+ * @return the linked program, 0 if the entry is missing, does not match the key or is rejected by the driver
+ */
+inline GLuint loadProgramBinary(const std::string& cachePath, const std::string& key)
+{
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+    ProgramCacheHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.Magic != PROGRAM_CACHE_MAGIC
+        || header.KeySize != key.size() || header.KeyHash != hashSource((const unsigned char*)key.data(), key.size())) {
+        return 0;
+    }
+    // The name and the hash can collide, only the same key gives the binary of the same program
+    std::vector<char> storedKey(header.KeySize);
+    if (!file.read(storedKey.data(), storedKey.size()) || memcmp(storedKey.data(), key.data(), key.size()) != 0) {
+        return 0;
+    }
+    std::vector<char> binary(header.Length);
+    if (!file.read(binary.data(), binary.size())) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.Format, binary.data(), (GLsizei)binary.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        getShaderCacheStatistics().RejectedPrograms++;
+        return 0;
+    }
+    return program;
+}
+
+
+/**
+ * @brief Write the binary of a linked program in the cache, a failure only costs the compilation at the next run
+ */
+inline void storeProgramBinary(GLuint program, const std::string& cachePath, const std::string& key)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    ProgramCacheHeader header;
+    header.Magic = PROGRAM_CACHE_MAGIC;
+    header.KeyHash = hashSource((const unsigned char*)key.data(), key.size());
+    header.KeySize = (uint32_t)key.size();
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.Format = format;
+    header.Length = (uint32_t)length;
+
+    std::error_code error;
+    std::filesystem::create_directories(getShaderCacheSettings().CacheDirectory, error);
+    std::ofstream file(cachePath, std::ios::binary);
+    if (error || !file.write((const char*)&header, sizeof(header)) || !file.write(key.data(), key.size())
+        || !file.write(binary.data(), header.Length)) {
+        std::cout << "Warning: can't write the program binary " << cachePath << std::endl;
+    }
+}
+
+
+#endif
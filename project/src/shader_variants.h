@@ -0,0 +1,126 @@
+// Shader permutations: the lit programs are compiled for the features of the objects that use them (the number of lights,
+// of bones per vertex, the textures of their materials), so that each variant has no dead branch and no loop
+// bounded by a uniform. A variant is compiled the first time an object asks for it, then kept for the next frames.
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include "shader.h"
+#include "light.h"
+#include "meshes/resource_manager.h"
+#include "utils/gpu_timer.h"
+
+
+/**
+ * @brief The feature keys of a variant, each one becomes a #define of its shaders
+ *
+ */
+struct ShaderFeatures
+{
+    unsigned int NumPointLights = NUM_POINT_LIGHTS;
+    unsigned int NumSpotLights = NUM_SPOT_LIGHTS;
+    unsigned int NumBoneInfluences = 0;     // 0 for the static objects, rounded up to 4, 8 or 10 for the skinned ones
+    bool Textured = true;                   // false to draw with a flat color
+    bool SpecularMap = true;                // false to use a constant specular exponent
+
+    std::string getDefines() const
+    {
+        std::string defines = "#define NUM_POINT_LIGHTS " + std::to_string(NumPointLights) + "\n"
+                            + "#define NUM_SPOT_LIGHTS " + std::to_string(NumSpotLights) + "\n";
+        if (NumBoneInfluences > 0) {
+            defines += "#define NUM_BONE_INFLUENCES " + std::to_string(getBoneInfluences()) + "\n";
+        }
+        if (Textured) {
+            defines += "#define TEXTURED\n";
+        }
+        if (SpecularMap) {
+            defines += "#define SPECULAR_MAP\n";
+        }
+        return defines;
+    }
+
+    // short description for the reports
+    std::string getName() const
+    {
+        std::string name = std::to_string(NumPointLights) + " point, " + std::to_string(NumSpotLights) + " spot";
+        if (NumBoneInfluences > 0) {
+            name += ", " + std::to_string(getBoneInfluences()) + " bones";
+        }
+        name += Textured ? ", textured" : ", untextured";
+        name += SpecularMap ? ", specular map" : "";
+        return name;
+    }
+
+    // the vertex attributes hold the bones by 4, 4 and 2
+    unsigned int getBoneInfluences() const
+    {
+        return NumBoneInfluences <= 4 ? 4 : (NumBoneInfluences <= 8 ? 8 : 10);
+    }
+};
+
+
+struct ShaderVariant
+{
+    std::string Name;
+    std::shared_ptr<Shader> Program;
+    double CompileMs = 0.0;
+    GpuTimer Timer;         // GPU time of the draws of the variant, measured by the renderer
+};
+
+
+class ShaderVariants
+{
+public:
+    /**
+     * @param init called once on each new program, to set its samplers
+     */
+    ShaderVariants(std::function<void(Shader&)> init) : m_Init(init) {}
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    /**
+     * @brief The variant of a pair of shaders for some features, compiled at the first call
+     *
+     * @param name the name of the variant in the reports, given by the first object that uses it
+     * @param defines other defines of the shaders, the ones of the material table
+     */
+    ShaderVariant& get(const std::string& name, const char* vertexPath, const char* fragmentPath, const ShaderFeatures& features,
+                       const std::string& defines = "")
+    {
+        std::string allDefines = features.getDefines() + defines;
+        std::string key = std::string(vertexPath) + "|" + fragmentPath + "|" + allDefines;
+        auto it = m_Variants.find(key);
+        if (it != m_Variants.end()) {
+            return *it->second;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<ShaderVariant> variant(new ShaderVariant());
+        variant->Name = name + " (" + features.getName() + (defines.empty() ? ")" : ", material table)");
+        variant->Program = getResourceManager().loadShader(vertexPath, fragmentPath, allDefines);
+        m_Init(*variant->Program);
+        variant->CompileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Shader variant " << variant->Name << " ready in " << variant->CompileMs << " ms" << std::endl;
+
+        ShaderVariant& result = *variant;
+        m_Variants[key] = std::move(variant);
+        return result;
+    }
+
+    const std::map<std::string, std::unique_ptr<ShaderVariant>>& getVariants() const { return m_Variants; }
+
+private:
+    std::function<void(Shader&)> m_Init;
+    std::map<std::string, std::unique_ptr<ShaderVariant>> m_Variants;
+};
+
+
+#endif
@@ -0,0 +1,124 @@
+#version 440 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+// Fragment shader of the character, of the trees and of the glTF assets. Its variants are compiled with the feature
+// keys of shader_variants.h: NUM_POINT_LIGHTS and NUM_SPOT_LIGHTS, TEXTURED (the diffuse texture or a flat color)
+// and SPECULAR_MAP (the specular exponent texture or a constant exponent).
+
+in vec2 TexCoord0;
+in vec3 Normal0;
+in vec3 WorldPos0;
+
+out vec4 FragColor;
+
+#include "uniform_blocks.cpp"
+
+// the color of the untextured objects, the trees are drawn in green
+const vec3 UNTEXTURED_COLOR = vec3(0.0, 0.4, 0.0);
+// exponent without specular map, also given by the missing specular texture of the material table. An exponent of 0
+// would light the whole surface with the specular color, whatever the direction of the light
+const float DEFAULT_SPECULAR_EXPONENT = 32.0;
+
+struct Material
+{
+    vec3 AmbientColor;
+    vec3 DiffuseColor;
+    vec3 SpecularColor;
+};
+
+Material gMaterial;
+float gSpecularExponent;
+
+#ifdef MATERIAL_TABLE
+// The materials of all the objects, indexed by the base instance of the draw (see meshes/material_table.h)
+struct MaterialRecord
+{
+    vec4 AmbientColor;
+    vec4 DiffuseColor;
+    vec4 SpecularColor;
+    uvec2 DiffuseHandle;
+    uvec2 SpecularHandle;
+    ivec4 Layers;       // array and layer of the diffuse texture, then of the specular texture, -1 without texture
+};
+
+layout (std430, binding = 5) readonly buffer MaterialBuffer { MaterialRecord materials[]; };
+
+const int MAX_TEXTURE_ARRAYS = 8;
+#ifndef BINDLESS_TEXTURES
+uniform sampler2DArray gTextureArrays[MAX_TEXTURE_ARRAYS];
+#endif
+
+flat in uint MaterialIndex0;
+
+
+// The material is the same for the whole draw, so the indexing of the samplers is dynamically uniform
+vec4 SampleMaterialTexture(uvec2 Handle, int Array, int Layer, vec4 Missing)
+{
+#ifdef BINDLESS_TEXTURES
+    if (Handle == uvec2(0)) {
+        return Missing;
+    }
+    return texture(sampler2D(Handle), TexCoord0);
+#else
+    if (Array < 0) {
+        return Missing;
+    }
+    return texture(gTextureArrays[Array], vec3(TexCoord0, float(Layer)));
+#endif
+}
+
+vec4 SampleDiffuse()
+{
+    MaterialRecord Record = materials[MaterialIndex0];
+    return SampleMaterialTexture(Record.DiffuseHandle, Record.Layers.x, Record.Layers.y, vec4(1.0));
+}
+
+vec4 SampleSpecularExponent()
+{
+    MaterialRecord Record = materials[MaterialIndex0];
+    return SampleMaterialTexture(Record.SpecularHandle, Record.Layers.z, Record.Layers.w, vec4(DEFAULT_SPECULAR_EXPONENT / 255.0));
+}
+#else
+uniform sampler2D gSampler;
+uniform sampler2D gSamplerSpecularExponent;
+
+vec4 SampleDiffuse()
+{
+    return texture(gSampler, TexCoord0);
+}
+
+vec4 SampleSpecularExponent()
+{
+    return texture(gSamplerSpecularExponent, TexCoord0);
+}
+#endif
+
+#include "lighting.cpp"
+
+
+void main()
+{
+#ifdef MATERIAL_TABLE
+    MaterialRecord Record = materials[MaterialIndex0];
+    gMaterial = Material(Record.AmbientColor.rgb, Record.DiffuseColor.rgb, Record.SpecularColor.rgb);
+#else
+    gMaterial = Material(gAmbientColor.rgb, gDiffuseColor.rgb, gSpecularColor.rgb);
+#endif
+
+#ifdef SPECULAR_MAP
+    gSpecularExponent = SampleSpecularExponent().r * 255.0;
+#else
+    gSpecularExponent = DEFAULT_SPECULAR_EXPONENT;
+#endif
+
+    vec4 TotalLight = CalcTotalLight(normalize(Normal0));
+
+#ifdef TEXTURED
+    vec3 color = SampleDiffuse().rgb;
+#else
+    vec3 color = UNTEXTURED_COLOR;
+#endif
+    FragColor = vec4(color, 1.0) * TotalLight;
+}
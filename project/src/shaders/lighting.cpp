@@ -0,0 +1,98 @@
+// Phong lighting of the point and spot lights of the frame, based on the fragment shader of Etay Meiri in its tutorial
+// (https://github.com/emeiri/ogldev/blob/master/tutorial28_youtube/skinning.fs).
+// The including shader declares WorldPos0, gMaterial and gSpecularExponent, and uniform_blocks.cpp before this file.
+// The loops run over NUM_POINT_LIGHTS and NUM_SPOT_LIGHTS, set by the shader variant, so they are unrolled.
+
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS MAX_POINT_LIGHTS
+#endif
+#ifndef NUM_SPOT_LIGHTS
+#define NUM_SPOT_LIGHTS MAX_SPOT_LIGHTS
+#endif
+
+struct BaseLight
+{
+    vec3 Color;
+    float AmbientIntensity;
+    float DiffuseIntensity;
+};
+
+
+vec4 CalcLightInternal(BaseLight Light, vec3 LightDirection, vec3 Normal)
+{
+    vec4 AmbientColor = vec4(Light.Color, 1.0f) *
+                        Light.AmbientIntensity *
+                        vec4(gMaterial.AmbientColor, 1.0f);
+
+    float DiffuseFactor = dot(Normal, -LightDirection);
+
+    vec4 DiffuseColor = vec4(0, 0, 0, 0);
+    vec4 SpecularColor = vec4(0, 0, 0, 0);
+
+    if (DiffuseFactor > 0) {
+        DiffuseColor = vec4(Light.Color, 1.0f) *
+                       Light.DiffuseIntensity *
+                       vec4(gMaterial.DiffuseColor, 1.0f) *
+                       DiffuseFactor;
+
+        vec3 PixelToCamera = normalize(gCameraWorldPos.xyz - WorldPos0);
+        vec3 LightReflect = normalize(reflect(LightDirection, Normal));
+        float SpecularFactor = dot(PixelToCamera, LightReflect);
+        if (SpecularFactor > 0) {
+            SpecularFactor = pow(SpecularFactor, gSpecularExponent);
+            SpecularColor = vec4(Light.Color, 1.0f) *
+                            Light.DiffuseIntensity * // using the diffuse intensity for diffuse/specular
+                            vec4(gMaterial.SpecularColor, 1.0f) *
+                            SpecularFactor;
+        }
+    }
+
+    return (AmbientColor + DiffuseColor + SpecularColor);
+}
+
+
+vec4 CalcPointLight(PointLightData l, vec3 Normal)
+{
+    vec3 LightDirection = WorldPos0 - l.Position.xyz;
+    float Distance = length(LightDirection);
+    LightDirection = normalize(LightDirection);
+
+    BaseLight Base = BaseLight(l.Color.rgb, l.Color.a, l.Position.w);
+    vec4 Color = CalcLightInternal(Base, LightDirection, Normal);
+    float Attenuation =  l.Atten.x +
+                         l.Atten.y * Distance +
+                         l.Atten.z * Distance * Distance;
+
+    return Color / Attenuation;
+}
+
+vec4 CalcSpotLight(SpotLightData l, vec3 Normal)
+{
+    vec3 LightToPixel = normalize(WorldPos0 - l.Base.Position.xyz);
+    float SpotFactor = dot(LightToPixel, l.Direction.xyz);
+    float Cutoff = l.Direction.w;
+
+    if (SpotFactor > Cutoff) {
+        vec4 Color = CalcPointLight(l.Base, Normal);
+        float SpotLightIntensity = (1.0 - (1.0 - SpotFactor)/(1.0 - Cutoff));
+        return Color * SpotLightIntensity;
+    }
+    else {
+        return vec4(0,0,0,0);
+    }
+}
+
+vec4 CalcTotalLight(vec3 Normal)
+{
+    vec4 TotalLight = vec4(0.0);
+
+    for (int i = 0 ;i < NUM_POINT_LIGHTS ;i++) {
+        TotalLight += CalcPointLight(gPointLights[i], Normal);
+    }
+
+    for (int i = 0 ;i < NUM_SPOT_LIGHTS ;i++) {
+        TotalLight += CalcSpotLight(gSpotLights[i], Normal);
+    }
+
+    return TotalLight;
+}
@@ -0,0 +1,40 @@
+// Uniform blocks of the lit programs, included by their vertex and fragment shaders: a block must be declared
+// the same way in all the stages of a program.
+
+#define MAX_POINT_LIGHTS 2
+#define MAX_SPOT_LIGHTS 2
+
+// The lights of the frame in world space, packed in vec4 for the std140 layout (see light.h)
+struct PointLightData
+{
+    vec4 Color;         // rgb, a: ambient intensity
+    vec4 Position;      // xyz, w: diffuse intensity
+    vec4 Atten;         // constant, linear, exp
+};
+
+struct SpotLightData
+{
+    PointLightData Base;
+    vec4 Direction;     // xyz, w: cosine of the cutoff
+};
+
+// Written once per frame and shared by all the programs (see frame_uniforms.h)
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 gView;
+    mat4 gProjection;
+    mat4 gViewProjection;
+    vec4 gCameraWorldPos;
+    ivec4 gNumLights;       // x: point lights, y: spot lights, the variants are compiled for these counts
+    PointLightData gPointLights[MAX_POINT_LIGHTS];
+    SpotLightData gSpotLights[MAX_SPOT_LIGHTS];
+};
+
+// Model matrix and material of the draw, written per draw in the ring of draw_uniforms.h
+layout (std140, binding = 1) uniform DrawUniforms
+{
+    mat4 gModel;
+    vec4 gAmbientColor;
+    vec4 gDiffuseColor;
+    vec4 gSpecularColor;
+};
@@ -1,20 +1,25 @@
-#version 330 core
+#version 440 core
 
 in vec3 position;
 in vec2 tex_coords;
 in vec3 normal;
 
 //only P and V are necessary
-uniform mat4 V;
-uniform mat4 P;
+// Written once per frame and shared by all the programs (see frame_uniforms.h), only the camera is read here
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 gView;
+    mat4 gProjection;
+    mat4 gViewProjection;
+};
 
 out vec3 texCoord_v;
 
 void main(){
     texCoord_v = position;
     //remove translation info from view matrix to only keep rotation
-    mat4 V_no_rot = mat4(mat3(V)) ;
-    vec4 pos = P * V_no_rot * vec4(position, 1.0);
+    mat4 V_no_rot = mat4(mat3(gView)) ;
+    vec4 pos = gProjection * V_no_rot * vec4(position, 1.0);
     // the positions xyz are divided by w after the vertex shader
     // the z component is equal to the depth value
     // we want a z always equal to 1.0 here, so we set z = w!
@@ -1,4 +1,4 @@
-#version 330 core
+#version 440 core
 
 layout (location = 0) in vec3 position;
 layout (location = 2) in vec3 normal;
@@ -6,10 +6,15 @@ layout (location = 2) in vec3 normal;
 out vec4 v_col;
 
 uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
+// Written once per frame and shared by all the programs (see frame_uniforms.h), only the camera is read here
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 gView;
+    mat4 gProjection;
+    mat4 gViewProjection;
+};
 
 void main(){
-    gl_Position = P*V*M*vec4(position, 1);
+    gl_Position = gViewProjection*M*vec4(position, 1);
     v_col = vec4(normal*0.5 + 0.5, 1.0);
 };
\ No newline at end of file
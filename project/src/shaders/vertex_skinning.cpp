@@ -13,16 +13,30 @@ layout (location = 6) in vec4 Weights0_3;
 layout (location = 7) in vec4 Weights4_7;
 layout (location = 8) in vec2 Weights8_9;
 
+#ifdef MATERIAL_TABLE
+// index of the material of the draw in the material table, read once per instance from the base instance
+layout (location = 9) in uint materialIndex;
+flat out uint MaterialIndex0;
+#endif
+
 out vec2 TexCoord0;
 out vec3 Normal0;
-out vec3 LocalPos0;
+out vec3 WorldPos0;
 
 const int MAX_BONES = 100;
 
-uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
-uniform mat4 gBones[MAX_BONES];
+// bones read per vertex, set by the shader variant to the largest number of the object (4, 8 or 10)
+#ifndef NUM_BONE_INFLUENCES
+#define NUM_BONE_INFLUENCES 10
+#endif
+
+#include "uniform_blocks.cpp"
+
+// Bone palette of the object, written once per object and frame in the same ring
+layout (std140, binding = 2) uniform BonePalette
+{
+    mat4 gBones[MAX_BONES];
+};
 
 void main(){
     mat4 boneTransform = mat4(0.0);
@@ -31,18 +45,27 @@ void main(){
     boneTransform += gBones[int(BoneIDs0_3.z)] * Weights0_3.z;
     boneTransform += gBones[int(BoneIDs0_3.w)] * Weights0_3.w;
 
+#if NUM_BONE_INFLUENCES > 4
     boneTransform += gBones[int(BoneIDs4_7.x)] * Weights4_7.x;
     boneTransform += gBones[int(BoneIDs4_7.y)] * Weights4_7.y;
     boneTransform += gBones[int(BoneIDs4_7.z)] * Weights4_7.z;
     boneTransform += gBones[int(BoneIDs4_7.w)] * Weights4_7.w;
+#endif
 
+#if NUM_BONE_INFLUENCES > 8
     boneTransform += gBones[int(BoneIDs8_9.x)] * Weights8_9.x;
     boneTransform += gBones[int(BoneIDs8_9.y)] * Weights8_9.y;
+#endif
     //if (boneTransform == mat4(0.0)) boneTransform = mat4(1.0);
 
     vec4 PosL = boneTransform * vec4(position, 1.0);
-    gl_Position = P*V*M * PosL;
+    vec4 PosW = gModel * PosL;
+    gl_Position = gViewProjection * PosW;
     TexCoord0 = texCoord;
-    Normal0 = normal;
-    LocalPos0 = position;//vec3(M*PosL);
+    // the lights are in world space, the normals follow the pose and the scale of the model
+    Normal0 = transpose(inverse(mat3(gModel))) * (mat3(boneTransform) * normal);
+    WorldPos0 = PosW.xyz;
+#ifdef MATERIAL_TABLE
+    MaterialIndex0 = materialIndex;
+#endif
 }
@@ -0,0 +1,66 @@
+#version 440 core
+
+// Same skinning as vertex_skinning.cpp, but the vertices are fetched from storage buffers with gl_VertexID
+// instead of vertex attributes (programmable vertex pulling), so the draws only need an empty VAO.
+// The draws are glDrawArrays calls over the range of the index buffer of a mesh.
+
+struct VertexBoneData
+{
+    float BoneIDs[10];
+    float Weights[10];
+};
+
+layout (std430, binding = 0) readonly buffer IndexBuffer { uint indices[]; };
+layout (std430, binding = 1) readonly buffer PositionBuffer { float positions[]; };     // packed vec3
+layout (std430, binding = 2) readonly buffer TexCoordBuffer { vec2 texCoords[]; };
+layout (std430, binding = 3) readonly buffer NormalBuffer { float normals[]; };         // packed vec3
+layout (std430, binding = 4) readonly buffer BoneBuffer { VertexBoneData bones[]; };
+
+out vec2 TexCoord0;
+out vec3 Normal0;
+out vec3 WorldPos0;
+
+const int MAX_BONES = 100;
+
+// bones read per vertex, set by the shader variant to the largest number of the object (4, 8 or 10)
+#ifndef NUM_BONE_INFLUENCES
+#define NUM_BONE_INFLUENCES 10
+#endif
+
+#include "uniform_blocks.cpp"
+
+// Bone palette of the object, written once per object and frame in the same ring
+layout (std140, binding = 2) uniform BonePalette
+{
+    mat4 gBones[MAX_BONES];
+};
+uniform int gBaseVertex;
+
+#ifdef MATERIAL_TABLE
+// index of the material of the draw in the material table, the empty VAO has no attribute to read it from
+uniform int gMaterialIndex;
+flat out uint MaterialIndex0;
+#endif
+
+void main(){
+    uint vertex = indices[gl_VertexID] + uint(gBaseVertex);
+
+    vec3 position = vec3(positions[3u * vertex], positions[3u * vertex + 1u], positions[3u * vertex + 2u]);
+    vec3 normal = vec3(normals[3u * vertex], normals[3u * vertex + 1u], normals[3u * vertex + 2u]);
+
+    mat4 boneTransform = mat4(0.0);
+    for (int i = 0; i < NUM_BONE_INFLUENCES; i++) {
+        boneTransform += gBones[int(bones[vertex].BoneIDs[i])] * bones[vertex].Weights[i];
+    }
+
+    vec4 PosL = boneTransform * vec4(position, 1.0);
+    vec4 PosW = gModel * PosL;
+    gl_Position = gViewProjection * PosW;
+    TexCoord0 = texCoords[vertex];
+    // the lights are in world space, the normals follow the pose and the scale of the model
+    Normal0 = transpose(inverse(mat3(gModel))) * (mat3(boneTransform) * normal);
+    WorldPos0 = PosW.xyz;
+#ifdef MATERIAL_TABLE
+    MaterialIndex0 = uint(gMaterialIndex);
+#endif
+}
@@ -4,18 +4,27 @@ layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texCoord;
 layout (location = 2) in vec3 normal;
 
+#ifdef MATERIAL_TABLE
+// index of the material of the draw in the material table, read once per instance from the base instance
+layout (location = 9) in uint materialIndex;
+flat out uint MaterialIndex0;
+#endif
+
 out vec2 TexCoord0;
 out vec3 Normal0;
-out vec3 LocalPos0;
+out vec3 WorldPos0;
+
+#include "uniform_blocks.cpp"
 
-uniform mat4 M;
-uniform mat4 V;
-uniform mat4 P;
 
 void main(){
-    vec4 PosL = vec4(position, 1.0);
-    gl_Position = P*V*M * PosL;
+    vec4 PosW = gModel * vec4(position, 1.0);
+    gl_Position = gViewProjection * PosW;
     TexCoord0 = texCoord;
-    Normal0 = normal;
-    LocalPos0 = vec3(M*PosL);
+    // the lights are in world space
+    Normal0 = transpose(inverse(mat3(gModel))) * normal;
+    WorldPos0 = PosW.xyz;
+#ifdef MATERIAL_TABLE
+    MaterialIndex0 = materialIndex;
+#endif
 };
\ No newline at end of file
@@ -0,0 +1,167 @@
+// Offline cooker of the asset archives read by utils/archive.h
+//
+// Usage: asset_cooker [--no-compression] <archive> <root> <path>...
+// The files of each path (a file or a directory, relative to root) are packed in the order of the arguments,
+// which should be the order in which the application loads them so the archive is read sequentially.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#include "../utils/archive.h"
+#include "../utils/lz4.h"
+
+
+// An entry is only compressed when it saves at least this fraction of its size (the images are already compressed)
+#define MIN_COMPRESSION_SAVING 0.125
+
+
+/**
+ * @brief Files of a path, sorted when it is a directory
+ */
+std::vector<std::filesystem::path> listFiles(const std::filesystem::path& path)
+{
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(path)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    }
+    else if (std::filesystem::is_regular_file(path)) {
+        files.push_back(path);
+    }
+    return files;
+}
+
+
+void writePadding(std::ofstream& out, uint64_t& offset, uint64_t alignment)
+{
+    static const char zeros[ARCHIVE_ALIGNMENT] = { 0 };
+    uint64_t padding = (alignment - offset % alignment) % alignment;
+    out.write(zeros, (std::streamsize)padding);
+    offset += padding;
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool compression = true;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--no-compression") {
+            compression = false;
+        }
+        else {
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    if (arguments.size() < 3) {
+        std::cout << "Usage: asset_cooker [--no-compression] <archive> <root> <path>..." << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::filesystem::path root = std::filesystem::absolute(arguments[1]).lexically_normal();
+
+    // Each file is packed once, at the place of its first path
+    std::vector<std::filesystem::path> files;
+    std::set<std::filesystem::path> packed;
+    for (size_t i = 2; i < arguments.size(); i++) {
+        std::filesystem::path path = std::filesystem::path(arguments[i]).is_absolute() ? std::filesystem::path(arguments[i]) : root / arguments[i];
+        std::vector<std::filesystem::path> pathFiles = listFiles(path.lexically_normal());
+        if (pathFiles.empty()) {
+            std::cout << "Warning: no file in " << path.string() << std::endl;
+        }
+        for (const std::filesystem::path& file : pathFiles) {
+            if (packed.insert(file).second) {
+                files.push_back(file);
+            }
+        }
+    }
+
+    std::ofstream out(arguments[0], std::ios::binary);
+    if (!out) {
+        std::cout << "Error creating " << arguments[0] << std::endl;
+        return 1;
+    }
+
+    ArchiveHeader header = {};
+    header.Magic = ARCHIVE_MAGIC;
+    header.Version = ARCHIVE_VERSION;
+    header.Alignment = ARCHIVE_ALIGNMENT;
+    out.write((const char*)&header, sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    std::vector<ArchiveEntry> entries;
+    uint64_t totalSize = 0;
+    uint64_t totalStored = 0;
+
+    std::vector<unsigned char> compressed;
+    for (const std::filesystem::path& file : files) {
+        std::ifstream in(file, std::ios::binary);
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        ArchiveEntry entry;
+        entry.Name = file.lexically_relative(root).generic_string();
+        entry.Size = data.size();
+
+        const std::vector<unsigned char>* stored = &data;
+        if (compression && !data.empty()) {
+            lz4Compress(data.data(), data.size(), compressed);
+            if (compressed.size() <= data.size() * (1.0 - MIN_COMPRESSION_SAVING)) {
+                stored = &compressed;
+                entry.Flags |= ARCHIVE_ENTRY_LZ4;
+            }
+        }
+
+        // Every entry starts on its own page
+        writePadding(out, offset, ARCHIVE_ALIGNMENT);
+        entry.Offset = offset;
+        entry.StoredSize = stored->size();
+        out.write((const char*)stored->data(), (std::streamsize)stored->size());
+        offset += stored->size();
+
+        std::cout << "  " << entry.Name << ": " << entry.Size << " -> " << entry.StoredSize << " bytes"
+                  << (entry.IsCompressed() ? " (lz4)" : "") << std::endl;
+        totalSize += entry.Size;
+        totalStored += entry.StoredSize;
+        entries.push_back(entry);
+    }
+
+    // Table of contents at the end, then the final header at the start
+    writePadding(out, offset, 8);
+    header.NumEntries = (uint32_t)entries.size();
+    header.TocOffset = offset;
+    for (const ArchiveEntry& entry : entries) {
+        ArchiveTocEntry tocEntry = { entry.Offset, entry.StoredSize, entry.Size, entry.Flags, (uint32_t)entry.Name.size() };
+        out.write((const char*)&tocEntry, sizeof(tocEntry));
+        out.write(entry.Name.data(), (std::streamsize)entry.Name.size());
+        offset += sizeof(tocEntry) + entry.Name.size();
+    }
+    header.TocSize = offset - header.TocOffset;
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.close();
+
+    if (!out) {
+        std::cout << "Error writing " << arguments[0] << std::endl;
+        return 1;
+    }
+
+    std::chrono::duration<double, std::milli> cookTime = std::chrono::steady_clock::now() - start;
+    std::cout << "Cooked " << entries.size() << " files in " << arguments[0] << ": " << totalSize << " bytes stored in "
+              << totalStored << " bytes, archive of " << offset << " bytes, in " << cookTime.count() << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Offline cooker of the block compressed textures read by meshes/texture.h
+//
+// Usage: texture_cooker [--mip-filter box|kaiser] [--linear] [--pack-alpha <image>] <image>...
+// Each image is compressed with its mip chain in <image>.dds, next to it, where the textures look for it first.
+// The mip chain is filtered in linear space unless "--linear" tells that the colors are not in sRGB.
+// "--pack-alpha" stores the first channel of another image (for example the specular exponent) in the alpha
+// of the next image, which is then compressed in BC3.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "../utils/dds.h"
+#include "../utils/texture_encoder.h"
+#include "../utils/virtual_file_system.h"
+
+
+struct CookRequest
+{
+    std::string Image;
+    std::string AlphaImage;
+};
+
+
+/**
+ * @brief Decode an image as the textures do, with the rows from the bottom to the top
+ */
+unsigned char* loadImage(const std::string& path, const FileData& file, int& width, int& height, int& bpp)
+{
+    unsigned char* pixels = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &width, &height, &bpp, 0);
+    if (!pixels) {
+        std::cout << "Error decoding " << path << ": " << stbi_failure_reason() << std::endl;
+    }
+    return pixels;
+}
+
+
+bool cookTexture(const CookRequest& request, MipFilter filter, bool srgb, size_t& sourceBytes, size_t& cookedBytes)
+{
+    FileData file;
+    if (!getVirtualFileSystem().readFile(request.Image, file)) {
+        std::cout << "Error reading " << request.Image << std::endl;
+        return false;
+    }
+
+    int width, height, bpp;
+    unsigned char* pixels = loadImage(request.Image, file, width, height, bpp);
+    if (!pixels) {
+        return false;
+    }
+
+    BlockFormat format = chooseBlockFormat(pixels, width, height, bpp);
+    std::vector<unsigned char> encoderPixels;
+    if (!request.AlphaImage.empty()) {
+        FileData alphaFile;
+        int alphaWidth, alphaHeight, alphaBpp;
+        unsigned char* alphaPixels = getVirtualFileSystem().readFile(request.AlphaImage, alphaFile)
+            ? loadImage(request.AlphaImage, alphaFile, alphaWidth, alphaHeight, alphaBpp) : NULL;
+        if (!alphaPixels || alphaWidth != width || alphaHeight != height) {
+            std::cout << "Error: " << request.AlphaImage << " can't be packed in " << request.Image
+                      << (alphaPixels ? ", the sizes differ" : "") << std::endl;
+            stbi_image_free(alphaPixels);
+            stbi_image_free(pixels);
+            return false;
+        }
+
+        format = BlockFormat::BC3;
+        encoderPixels = convertChannels(pixels, width, height, bpp, 4);
+        packAlphaChannel(encoderPixels, alphaPixels, alphaBpp);
+        stbi_image_free(alphaPixels);
+    }
+    else {
+        encoderPixels = convertChannels(pixels, width, height, bpp, getEncoderChannels(format));
+    }
+    stbi_image_free(pixels);
+
+    CompressedImage image;
+    compressImage(encoderPixels, width, height, format, filter, srgb, image);
+    image.SourceHash = hashSource(file.GetData(), file.GetSize());
+
+    std::string output = request.Image + ".dds";
+    if (!writeDds(output, image)) {
+        std::cout << "Error writing " << output << std::endl;
+        return false;
+    }
+
+    std::cout << "  " << request.Image << ": " << width << "x" << height << " " << getBlockFormatName(format) << ", "
+              << image.Levels.size() << " levels, " << image.GetBytes() << " bytes" << std::endl;
+    sourceBytes += (size_t)width * height * (bpp == 3 ? 4 : bpp) * 4 / 3;
+    cookedBytes += image.GetBytes();
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::vector<CookRequest> requests;
+    std::string alphaImage;
+    MipFilter filter = MipFilter::Kaiser;
+    bool srgb = true;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--pack-alpha" && i + 1 < argc) {
+            alphaImage = argv[++i];
+        }
+        else if (std::string(argv[i]) == "--mip-filter" && i + 1 < argc) {
+            filter = std::string(argv[++i]) == "box" ? MipFilter::Box : MipFilter::Kaiser;
+        }
+        else if (std::string(argv[i]) == "--linear") {
+            srgb = false;
+        }
+        else {
+            requests.push_back({ argv[i], alphaImage });
+            alphaImage.clear();
+        }
+    }
+
+    if (requests.empty()) {
+        std::cout << "Usage: texture_cooker [--mip-filter box|kaiser] [--linear] [--pack-alpha <image>] <image>..." << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // The images must be decoded the same way as by the textures
+    stbi_set_flip_vertically_on_load(1);
+
+    unsigned int numCooked = 0;
+    size_t sourceBytes = 0;
+    size_t cookedBytes = 0;
+    for (const CookRequest& request : requests) {
+        if (cookTexture(request, filter, srgb, sourceBytes, cookedBytes)) {
+            numCooked++;
+        }
+    }
+
+    std::chrono::duration<double, std::milli> cookTime = std::chrono::steady_clock::now() - start;
+    std::cout << "Cooked " << numCooked << " of " << requests.size() << " textures: " << sourceBytes << " bytes uncompressed in "
+              << cookedBytes << " bytes, in " << cookTime.count() << " ms" << std::endl;
+
+    return numCooked == requests.size() ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+// Packed asset archive: the files are stored one after the other, aligned on pages, optionally compressed with LZ4,
+// and listed in a table of contents at the end of the archive. The archives are written by tools/asset_cooker.cpp.
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "mapped_file.h"
+
+#define ARCHIVE_MAGIC       0x4B505047      // "GPPK"
+#define ARCHIVE_VERSION     1
+#define ARCHIVE_ALIGNMENT   4096
+#define ARCHIVE_ENTRY_LZ4   1
+
+
+struct ArchiveHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumEntries;
+    uint32_t Alignment;
+    uint64_t TocOffset;
+    uint64_t TocSize;
+};
+
+
+// Followed by the name of the entry, without terminating zero
+struct ArchiveTocEntry
+{
+    uint64_t Offset;
+    uint64_t StoredSize;    // size in the archive
+    uint64_t Size;          // size once decompressed
+    uint32_t Flags;
+    uint32_t NameLength;
+};
+
+
+struct ArchiveEntry
+{
+    std::string Name;       // path relative to the root of the archive, with '/' separators
+    uint64_t Offset = 0;
+    uint64_t StoredSize = 0;
+    uint64_t Size = 0;
+    uint32_t Flags = 0;
+
+    bool IsCompressed() const { return (Flags & ARCHIVE_ENTRY_LZ4) != 0; }
+};
+
+
+/**
+ * @brief Read access to an archive, mapped in memory. The entries are read from the mapping without any copy
+ * when they are not compressed.
+ *
+ */
+class Archive
+{
+public:
+    Archive() {}
+
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+
+    /**
+     * @brief Map the archive in path and read its table of contents
+     *
+     * @return false if the file is not a valid archive
+     */
+    bool Open(const char* path)
+    {
+        m_Entries.clear();
+        m_EntryIndices.clear();
+
+        if (!m_File.Open(path)) {
+            std::cout << "Error opening the archive " << path << std::endl;
+            return false;
+        }
+
+        const unsigned char* data = m_File.GetData();
+        size_t size = m_File.GetSize();
+
+        ArchiveHeader header;
+        if (size < sizeof(header)) {
+            std::cout << "Error parsing the archive " << path << ": file too small" << std::endl;
+            m_File.Close();
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (header.Magic != ARCHIVE_MAGIC || header.Version != ARCHIVE_VERSION ||
+            header.TocOffset > size || header.TocSize > size - header.TocOffset) {
+            std::cout << "Error parsing the archive " << path << ": invalid header" << std::endl;
+            m_File.Close();
+            return false;
+        }
+
+        size_t offset = (size_t)header.TocOffset;
+        size_t end = (size_t)(header.TocOffset + header.TocSize);
+        for (uint32_t i = 0 ; i < header.NumEntries ; i++) {
+            ArchiveTocEntry tocEntry;
+            if (end - offset < sizeof(tocEntry)) {
+                break;
+            }
+            std::memcpy(&tocEntry, data + offset, sizeof(tocEntry));
+            offset += sizeof(tocEntry);
+            if (end - offset < tocEntry.NameLength || tocEntry.Offset > size || tocEntry.StoredSize > size - tocEntry.Offset) {
+                break;
+            }
+            // The bytes of an uncompressed entry are read in place, so they must all be stored
+            if ((tocEntry.Flags & ARCHIVE_ENTRY_LZ4) == 0 && tocEntry.Size != tocEntry.StoredSize) {
+                break;
+            }
+
+            ArchiveEntry entry;
+            entry.Name.assign((const char*)data + offset, tocEntry.NameLength);
+            entry.Offset = tocEntry.Offset;
+            entry.StoredSize = tocEntry.StoredSize;
+            entry.Size = tocEntry.Size;
+            entry.Flags = tocEntry.Flags;
+            offset += tocEntry.NameLength;
+
+            m_EntryIndices[entry.Name] = (unsigned int)m_Entries.size();
+            m_Entries.push_back(entry);
+        }
+
+        if (m_Entries.size() != header.NumEntries) {
+            std::cout << "Error parsing the archive " << path << ": invalid table of contents" << std::endl;
+            m_Entries.clear();
+            m_EntryIndices.clear();
+            m_File.Close();
+            return false;
+        }
+
+        // The entries are stored in the order of the loading
+        m_File.AdviseSequential();
+        return true;
+    }
+
+    bool IsOpen() const { return m_File.GetData() != NULL; }
+
+    const std::vector<ArchiveEntry>& GetEntries() const { return m_Entries; }
+
+    /**
+     * @return the entry with the given name, NULL if there is none
+     */
+    const ArchiveEntry* Find(const std::string& name) const
+    {
+        auto it = m_EntryIndices.find(name);
+        return it == m_EntryIndices.end() ? NULL : &m_Entries[it->second];
+    }
+
+    /**
+     * @return the stored bytes of an entry, in the mapping
+     */
+    const unsigned char* GetStoredData(const ArchiveEntry& entry) const
+    {
+        return m_File.GetData() + entry.Offset;
+    }
+
+private:
+    MappedFile m_File;
+    std::vector<ArchiveEntry> m_Entries;
+    std::unordered_map<std::string, unsigned int> m_EntryIndices;
+};
+
+
+#endif
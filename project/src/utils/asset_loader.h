@@ -0,0 +1,167 @@
+// Asynchronous loading of the scene: the file reads, the imports and the image decoding of each asset run on the
+// thread pool, and the render thread only finishes the loaded assets (the GL uploads) within a time budget per frame,
+// so that the first frames are rendered while the assets arrive.
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <algorithm>
+
+#include "thread_pool.h"
+
+
+struct AssetLoadStatistics
+{
+    unsigned int Assets = 0;        // assets added to the loader
+    unsigned int Finished = 0;      // assets finished on the render thread
+    unsigned int Failed = 0;        // assets that could not be prepared
+    double PrepareMs = 0.0;         // sum of the preparation times on the loading threads
+    double FinishMs = 0.0;          // sum of the finishing times on the render thread
+    double MaxFrameMs = 0.0;        // longest finishing time in a frame
+    double BudgetMs = 0.0;          // budget of the frames, given to update
+    unsigned int FramesOverBudget = 0;  // frames whose finishing time went over the budget
+    double TotalMs = 0.0;           // from the first asset added to the last asset finished
+};
+
+
+/**
+ * @brief Load assets in two steps: Prepare on a loading thread (no GL call), then Finish on the render thread
+ *
+ */
+class AssetLoader
+{
+public:
+    AssetLoader() {}
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // The assets that are not prepared yet are skipped, the running preparations are waited for
+    ~AssetLoader()
+    {
+        m_State->Cancelled = true;
+        for (std::future<void>& task : m_Tasks) {
+            task.wait();
+        }
+    }
+
+    /**
+     * @brief Start the loading of an asset
+     *
+     * @param name the name of the asset in the reports
+     * @param prepare called on a loading thread, returns false if the asset can't be loaded
+     * @param finish called on the render thread by update, once prepare succeeded
+     */
+    void add(const std::string& name, std::function<bool()> prepare, std::function<void()> finish)
+    {
+        if (m_Statistics.Assets == 0) {
+            m_Start = std::chrono::steady_clock::now();
+        }
+        m_Statistics.Assets++;
+
+        std::shared_ptr<LoaderState> state = m_State;
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->Name = name;
+        job->Prepare = std::move(prepare);
+        job->Finish = std::move(finish);
+        m_Tasks.push_back(getThreadPool().submit([state, job]() {
+            if (state->Cancelled) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            job->Prepared = job->Prepare();
+            job->PrepareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->Completed.push_back(job);
+        }));
+    }
+
+    /**
+     * @brief Finish the prepared assets, called once per frame on the render thread. At least one asset is finished
+     * per call, the others while the time spent stays under the budget.
+     *
+     * @return the number of assets finished
+     */
+    unsigned int update(double budgetMs)
+    {
+        std::vector<std::shared_ptr<Job>> completed;
+        {
+            std::lock_guard<std::mutex> lock(m_State->Mutex);
+            completed.swap(m_State->Completed);
+        }
+        m_Pending.insert(m_Pending.end(), completed.begin(), completed.end());
+
+        auto start = std::chrono::steady_clock::now();
+        double frameMs = 0.0;
+        unsigned int finished = 0;
+        while (!m_Pending.empty() && (finished == 0 || frameMs < budgetMs)) {
+            std::shared_ptr<Job> job = m_Pending.front();
+            m_Pending.erase(m_Pending.begin());
+
+            auto jobStart = std::chrono::steady_clock::now();
+            if (job->Prepared) {
+                job->Finish();
+            }
+            else {
+                std::cout << "Failed to load " << job->Name << std::endl;
+                m_Statistics.Failed++;
+            }
+            double jobMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+            m_Statistics.Finished++;
+            m_Statistics.PrepareMs += job->PrepareMs;
+            m_Statistics.FinishMs += jobMs;
+            finished++;
+
+            frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (finished > 0) {
+            m_Statistics.MaxFrameMs = std::max(m_Statistics.MaxFrameMs, frameMs);
+            m_Statistics.BudgetMs = budgetMs;
+            if (frameMs > budgetMs) {
+                m_Statistics.FramesOverBudget++;
+            }
+            if (isDone()) {
+                m_Statistics.TotalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+            }
+        }
+        return finished;
+    }
+
+    // true once every asset added is finished
+    bool isDone() const { return m_Statistics.Finished == m_Statistics.Assets; }
+
+    const AssetLoadStatistics& getStatistics() const { return m_Statistics; }
+
+private:
+    struct Job {
+        std::string Name;
+        std::function<bool()> Prepare;
+        std::function<void()> Finish;
+        bool Prepared = false;
+        double PrepareMs = 0.0;
+    };
+
+    struct LoaderState {
+        std::mutex Mutex;
+        std::vector<std::shared_ptr<Job>> Completed;
+        std::atomic<bool> Cancelled{false};
+    };
+
+    std::shared_ptr<LoaderState> m_State = std::make_shared<LoaderState>();
+    std::vector<std::future<void>> m_Tasks;
+    std::vector<std::shared_ptr<Job>> m_Pending;    // prepared, waiting for the render thread
+    std::chrono::steady_clock::time_point m_Start;
+    AssetLoadStatistics m_Statistics;
+};
+
+
+#endif
@@ -0,0 +1,235 @@
+// Block compressed images and their DDS container, used as the cache of the compressed textures.
+// Only the legacy DX9 header is written (DXT1, DXT5, ATI1 and ATI2 FourCCs), which every DDS reader understands.
+
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include "hash.h"
+
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DDS_MAGIC DDS_FOURCC('D', 'D', 'S', ' ')
+#define DDS_SOURCE_TAG DDS_FOURCC('S', 'R', 'C', 'H')   // the hash of the source image follows it in the reserved fields
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+
+enum class BlockFormat
+{
+    BC1,    // RGB, 8 bytes per block
+    BC3,    // RGBA, 16 bytes per block
+    BC4,    // R, 8 bytes per block
+    BC5     // RG, 16 bytes per block
+};
+
+
+inline size_t getBlockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+
+inline const char* getBlockFormatName(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC1: return "BC1";
+    case BlockFormat::BC3: return "BC3";
+    case BlockFormat::BC4: return "BC4";
+    default: return "BC5";
+    }
+}
+
+
+struct CompressedLevel
+{
+    int Width = 0;
+    int Height = 0;
+    std::vector<unsigned char> Data;    // the blocks, row by row
+};
+
+
+/**
+ * @brief Block compressed image with its full mip chain. The rows are in the order of the GL upload (bottom row first),
+ * like the images decoded by the textures.
+ *
+ */
+struct CompressedImage
+{
+    BlockFormat Format = BlockFormat::BC1;
+    uint32_t SourceHash = 0;    // hash of the source file, to detect the stale cache entries
+    std::vector<CompressedLevel> Levels;
+
+    size_t GetBytes() const
+    {
+        size_t bytes = 0;
+        for (const CompressedLevel& level : Levels) {
+            bytes += level.Data.size();
+        }
+        return bytes;
+    }
+};
+
+
+struct DdsPixelFormat
+{
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t FourCC;
+    uint32_t RGBBitCount;
+    uint32_t RBitMask;
+    uint32_t GBitMask;
+    uint32_t BBitMask;
+    uint32_t ABitMask;
+};
+
+
+struct DdsHeader
+{
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t Height;
+    uint32_t Width;
+    uint32_t PitchOrLinearSize;
+    uint32_t Depth;
+    uint32_t MipMapCount;
+    uint32_t Reserved1[11];
+    DdsPixelFormat PixelFormat;
+    uint32_t Caps;
+    uint32_t Caps2;
+    uint32_t Caps3;
+    uint32_t Caps4;
+    uint32_t Reserved2;
+};
+
+static_assert(sizeof(DdsHeader) == 124, "the DDS header is 124 bytes");
+
+
+inline uint32_t getDdsFourCC(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC1: return DDS_FOURCC('D', 'X', 'T', '1');
+    case BlockFormat::BC3: return DDS_FOURCC('D', 'X', 'T', '5');
+    case BlockFormat::BC4: return DDS_FOURCC('A', 'T', 'I', '1');
+    default: return DDS_FOURCC('A', 'T', 'I', '2');
+    }
+}
+
+
+inline size_t getLevelBytes(BlockFormat format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+
+/**
+ * @brief Write a compressed image in a DDS file
+ *
+ * @return false when the file can't be written
+ */
+inline bool writeDds(const std::string& path, const CompressedImage& image)
+{
+    if (image.Levels.empty()) {
+        return false;
+    }
+
+    DdsHeader header = {};
+    header.Size = sizeof(DdsHeader);
+    header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.Width = (uint32_t)image.Levels[0].Width;
+    header.Height = (uint32_t)image.Levels[0].Height;
+    header.PitchOrLinearSize = (uint32_t)image.Levels[0].Data.size();
+    header.MipMapCount = (uint32_t)image.Levels.size();
+    header.Reserved1[0] = DDS_SOURCE_TAG;
+    header.Reserved1[1] = image.SourceHash;
+    header.PixelFormat.Size = sizeof(DdsPixelFormat);
+    header.PixelFormat.Flags = DDPF_FOURCC;
+    header.PixelFormat.FourCC = getDdsFourCC(image.Format);
+    header.Caps = DDSCAPS_TEXTURE | (image.Levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    std::ofstream out(path, std::ios::binary);
+    uint32_t magic = DDS_MAGIC;
+    out.write((const char*)&magic, sizeof(magic));
+    out.write((const char*)&header, sizeof(header));
+    for (const CompressedLevel& level : image.Levels) {
+        out.write((const char*)level.Data.data(), (std::streamsize)level.Data.size());
+    }
+    return (bool)out;
+}
+
+
+/**
+ * @brief Read a compressed image from the content of a DDS file
+ *
+ * @return false when the file is not a DDS file in one of the block formats
+ */
+inline bool readDds(const unsigned char* data, size_t size, CompressedImage& image)
+{
+    image.Levels.clear();
+    if (size < sizeof(uint32_t) + sizeof(DdsHeader)) {
+        return false;
+    }
+
+    uint32_t magic;
+    DdsHeader header;
+    std::memcpy(&magic, data, sizeof(magic));
+    std::memcpy(&header, data + sizeof(magic), sizeof(header));
+    if (magic != DDS_MAGIC || header.Size != sizeof(DdsHeader) || !(header.PixelFormat.Flags & DDPF_FOURCC)
+        || header.Width == 0 || header.Height == 0) {
+        return false;
+    }
+
+    bool known = false;
+    for (BlockFormat format : { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5 }) {
+        if (header.PixelFormat.FourCC == getDdsFourCC(format)) {
+            image.Format = format;
+            known = true;
+        }
+    }
+    if (!known) {
+        return false;
+    }
+    image.SourceHash = header.Reserved1[0] == DDS_SOURCE_TAG ? header.Reserved1[1] : 0;
+
+    size_t offset = sizeof(magic) + sizeof(header);
+    int width = (int)header.Width;
+    int height = (int)header.Height;
+    unsigned int numLevels = std::max(1u, header.MipMapCount);
+    for (unsigned int i = 0 ; i < numLevels ; i++) {
+        size_t levelBytes = getLevelBytes(image.Format, width, height);
+        if (offset + levelBytes > size) {
+            image.Levels.clear();
+            return false;
+        }
+
+        CompressedLevel level;
+        level.Width = width;
+        level.Height = height;
+        level.Data.assign(data + offset, data + offset + levelBytes);
+        image.Levels.push_back(std::move(level));
+
+        offset += levelBytes;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+
+/**
+ * @brief GPU time of a sequence of commands, measured with timer queries. The result of a query is read
+ * a few frames later so that the CPU never waits for the GPU.
+ *
+ */
+class GpuTimer
+{
+public:
+    GpuTimer() {}
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    ~GpuTimer()
+    {
+        if (m_Queries[0] != 0) {
+            glDeleteQueries(NUM_QUERIES, m_Queries);
+        }
+    }
+
+    void begin()
+    {
+        if (m_Queries[0] == 0) {
+            glGenQueries(NUM_QUERIES, m_Queries);
+        }
+
+        // Collect the oldest query before reusing it
+        if (m_Pending[m_Current]) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(m_Queries[m_Current], GL_QUERY_RESULT, &elapsed);
+            m_TotalNs += elapsed;
+            m_NumSamples++;
+            m_Pending[m_Current] = false;
+        }
+
+        glBeginQuery(GL_TIME_ELAPSED, m_Queries[m_Current]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_Pending[m_Current] = true;
+        m_Current = (m_Current + 1) % NUM_QUERIES;
+    }
+
+    /**
+     * @brief Average time of the measures collected since the last reset, in milliseconds
+     */
+    double getAverageMs() const
+    {
+        return m_NumSamples > 0 ? m_TotalNs / 1e6 / m_NumSamples : 0.0;
+    }
+
+    void reset()
+    {
+        m_TotalNs = 0;
+        m_NumSamples = 0;
+    }
+
+private:
+    static const int NUM_QUERIES = 4;
+
+    GLuint m_Queries[NUM_QUERIES] = { 0 };
+    bool m_Pending[NUM_QUERIES] = { false };
+    int m_Current = 0;
+    GLuint64 m_TotalNs = 0;
+    unsigned int m_NumSamples = 0;
+};
+
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * @brief FNV-1a hash of a block of bytes, used to name the cache entries and to check that they match their source
+ */
+inline uint32_t hashSource(const unsigned char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0 ; i < size ; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+#endif
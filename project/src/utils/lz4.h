@@ -0,0 +1,180 @@
+// Compression in the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+// The compressor is a simple greedy one, the output can be decompressed by any LZ4 implementation.
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5       // the last bytes of a block are always literals
+#define LZ4_MATCH_FIND_LIMIT 12     // no match starts in the last bytes of a block
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_HASH_BITS       16
+
+
+inline uint32_t lz4Read32(const unsigned char* p)
+{
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+inline void lz4WriteLength(std::vector<unsigned char>& dst, size_t length)
+{
+    while (length >= 255) {
+        dst.push_back(255);
+        length -= 255;
+    }
+    dst.push_back((unsigned char)length);
+}
+
+
+/**
+ * @brief Compress a block of data, the size of the original data must be stored elsewhere to decompress it
+ *
+ * @param src the data to compress
+ * @param srcSize the size of the data
+ * @param dst the compressed data, replaced
+ */
+inline void lz4Compress(const unsigned char* src, size_t srcSize, std::vector<unsigned char>& dst)
+{
+    dst.clear();
+    dst.reserve(srcSize + srcSize / 255 + 16);
+
+    // Last position of each hashed 4 bytes sequence
+    std::vector<int64_t> table((size_t)1 << LZ4_HASH_BITS, -1);
+
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    if (srcSize > LZ4_MATCH_FIND_LIMIT) {
+        const size_t matchLimit = srcSize - LZ4_LAST_LITERALS;
+
+        while (ip + LZ4_MATCH_FIND_LIMIT <= srcSize) {
+            uint32_t sequence = lz4Read32(src + ip);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            int64_t ref = table[hash];
+            table[hash] = (int64_t)ip;
+
+            if (ref < 0 || ip - (size_t)ref > LZ4_MAX_OFFSET || lz4Read32(src + ref) != sequence) {
+                ip++;
+                continue;
+            }
+
+            size_t matchLength = LZ4_MIN_MATCH;
+            while (ip + matchLength < matchLimit && src[ref + matchLength] == src[ip + matchLength]) {
+                matchLength++;
+            }
+
+            // Sequence: token, literals, offset, match length
+            size_t literalLength = ip - anchor;
+            size_t extraMatchLength = matchLength - LZ4_MIN_MATCH;
+            dst.push_back((unsigned char)(((literalLength < 15 ? literalLength : 15) << 4) | (extraMatchLength < 15 ? extraMatchLength : 15)));
+            if (literalLength >= 15) {
+                lz4WriteLength(dst, literalLength - 15);
+            }
+            dst.insert(dst.end(), src + anchor, src + ip);
+
+            size_t offset = ip - (size_t)ref;
+            dst.push_back((unsigned char)(offset & 0xFF));
+            dst.push_back((unsigned char)(offset >> 8));
+            if (extraMatchLength >= 15) {
+                lz4WriteLength(dst, extraMatchLength - 15);
+            }
+
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    // The block ends with a sequence of literals only
+    size_t literalLength = srcSize - anchor;
+    dst.push_back((unsigned char)((literalLength < 15 ? literalLength : 15) << 4));
+    if (literalLength >= 15) {
+        lz4WriteLength(dst, literalLength - 15);
+    }
+    dst.insert(dst.end(), src + anchor, src + srcSize);
+}
+
+
+/**
+ * @brief Decompress a block of data
+ *
+ * @param src the compressed data
+ * @param srcSize the size of the compressed data
+ * @param dst the decompressed data, of the size of the original data
+ * @param dstSize the size of the original data
+ * @return false if the block is corrupted or does not decompress to dstSize bytes
+ */
+inline bool lz4Decompress(const unsigned char* src, size_t srcSize, unsigned char* dst, size_t dstSize)
+{
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < srcSize) {
+        unsigned char token = src[ip++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15) {
+            unsigned char b;
+            do {
+                if (ip >= srcSize) {
+                    return false;
+                }
+                b = src[ip++];
+                literalLength += b;
+            } while (b == 255);
+        }
+        if (literalLength > srcSize - ip || literalLength > dstSize - op) {
+            return false;
+        }
+        std::memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence has no match
+        if (ip == srcSize) {
+            break;
+        }
+
+        if (srcSize - ip < 2) {
+            return false;
+        }
+        size_t offset = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15) {
+            unsigned char b;
+            do {
+                if (ip >= srcSize) {
+                    return false;
+                }
+                b = src[ip++];
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += LZ4_MIN_MATCH;
+        if (matchLength > dstSize - op) {
+            return false;
+        }
+
+        // The match can overlap the bytes it produces
+        for (size_t i = 0 ; i < matchLength ; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op == dstSize;
+}
+
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * @brief Read-only memory mapping of a whole file, the pages are loaded by the system when they are accessed
+ *
+ */
+class MappedFile
+{
+public:
+    MappedFile() {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    /**
+     * @brief Map the file in path
+     *
+     * @return false if the file can not be opened or mapped
+     */
+    bool Open(const char* path)
+    {
+        Close();
+
+#ifdef _WIN32
+        m_File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (m_File == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        m_Size = (size_t)size.QuadPart;
+        m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_Mapping == NULL) {
+            Close();
+            return false;
+        }
+        m_Data = (const unsigned char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        m_File = open(path, O_RDONLY);
+        if (m_File < 0) {
+            return false;
+        }
+        struct stat status;
+        if (fstat(m_File, &status) != 0 || status.st_size == 0) {
+            Close();
+            return false;
+        }
+        m_Size = (size_t)status.st_size;
+        void* data = mmap(NULL, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+        m_Data = data == MAP_FAILED ? NULL : (const unsigned char*)data;
+#endif
+
+        if (m_Data == NULL) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_Data) {
+            UnmapViewOfFile(m_Data);
+        }
+        if (m_Mapping) {
+            CloseHandle(m_Mapping);
+        }
+        if (m_File != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_File);
+        }
+        m_Mapping = NULL;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if (m_Data) {
+            munmap((void*)m_Data, m_Size);
+        }
+        if (m_File >= 0) {
+            close(m_File);
+        }
+        m_File = -1;
+#endif
+        m_Data = NULL;
+        m_Size = 0;
+    }
+
+    /**
+     * @brief Hint the system that the mapping is read from the start to the end, so the pages are read ahead
+     *
+     */
+    void AdviseSequential()
+    {
+#ifndef _WIN32
+        if (m_Data) {
+            posix_madvise((void*)m_Data, m_Size, POSIX_MADV_SEQUENTIAL);
+        }
+#endif
+    }
+
+    const unsigned char* GetData() const { return m_Data; }
+
+    size_t GetSize() const { return m_Size; }
+
+private:
+    const unsigned char* m_Data = NULL;
+    size_t m_Size = 0;
+
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = NULL;
+#else
+    int m_File = -1;
+#endif
+};
+
+
+#endif
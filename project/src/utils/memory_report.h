@@ -0,0 +1,123 @@
+// Memory kept by the loaded assets: the CPU bytes are the data that stays in the process after the loading
+// (what the animation and the queries need), the GPU bytes are the buffers and textures created for the asset.
+
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "memory_usage.h"
+
+
+struct AssetMemory
+{
+    std::string Name;
+    size_t CpuBytes = 0;
+    size_t GpuBytes = 0;
+};
+
+
+/**
+ * @brief Heap bytes held by a vector
+ */
+template<typename T>
+inline size_t vectorBytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+
+class MemoryReport
+{
+public:
+    /**
+     * @brief Set the memory of an asset, replacing the previous values when it was already reported
+     *
+     * @param name the name of the asset, usually its path
+     * @param cpuBytes the bytes kept in the process memory
+     * @param gpuBytes the bytes of the buffers and textures
+     */
+    void setAsset(const std::string& name, size_t cpuBytes, size_t gpuBytes)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (AssetMemory& asset : m_Assets) {
+            if (asset.Name == name) {
+                asset.CpuBytes = cpuBytes;
+                asset.GpuBytes = gpuBytes;
+                return;
+            }
+        }
+        m_Assets.push_back({ name, cpuBytes, gpuBytes });
+    }
+
+    void removeAsset(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (size_t i = 0 ; i < m_Assets.size() ; i++) {
+            if (m_Assets[i].Name == name) {
+                m_Assets.erase(m_Assets.begin() + i);
+                return;
+            }
+        }
+    }
+
+    std::vector<AssetMemory> getAssets() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Assets;
+    }
+
+    size_t getTotalCpuBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        size_t total = 0;
+        for (const AssetMemory& asset : m_Assets) {
+            total += asset.CpuBytes;
+        }
+        return total;
+    }
+
+    size_t getTotalGpuBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        size_t total = 0;
+        for (const AssetMemory& asset : m_Assets) {
+            total += asset.GpuBytes;
+        }
+        return total;
+    }
+
+    void print() const
+    {
+        std::vector<AssetMemory> assets = getAssets();
+        std::cout << "Memory of the assets (CPU / GPU MiB):" << std::endl;
+        for (const AssetMemory& asset : assets) {
+            std::cout << "  " << asset.Name << ": " << std::fixed << std::setprecision(2) << toMiB(asset.CpuBytes)
+                      << " / " << toMiB(asset.GpuBytes) << std::defaultfloat << std::endl;
+        }
+        std::cout << "  total: " << std::fixed << std::setprecision(2) << toMiB(getTotalCpuBytes()) << " / "
+                  << toMiB(getTotalGpuBytes()) << std::defaultfloat << std::endl;
+    }
+
+private:
+    mutable std::mutex m_Mutex;     // the assets can be loaded on several threads
+    std::vector<AssetMemory> m_Assets;
+};
+
+
+/**
+ * @brief Memory report shared by all the loaders
+ *
+ */
+inline MemoryReport& getMemoryReport()
+{
+    static MemoryReport report;
+    return report;
+}
+
+
+#endif
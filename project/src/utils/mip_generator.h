@@ -0,0 +1,348 @@
+// CPU generation of the mip chains: each level is filtered from the previous one in linear space, as 4 floats
+// per texel so that the kernels work on one SSE register per texel, and the rows are split over the thread pool.
+
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2
+#endif
+
+#include "thread_pool.h"
+
+
+enum class MipFilter
+{
+    Driver,     // glGenerateMipmap, the levels are not generated on the CPU
+    Box,        // average of 2x2 texels
+    Kaiser      // separable Kaiser windowed sinc over 6x6 texels, sharper than the box
+};
+
+
+struct MipLevel
+{
+    int Width = 0;
+    int Height = 0;
+    std::vector<unsigned char> Pixels;  // the texels with the channels of the base level, tightly packed
+};
+
+
+/**
+ * @brief Texel of 4 channels, one SSE register when it is available
+ */
+struct MipTexel
+{
+#ifdef MIP_GENERATOR_SSE2
+    __m128 V;
+
+    static MipTexel Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static MipTexel Splat(float f) { return { _mm_set1_ps(f) }; }
+    void Store(float* p) const { _mm_storeu_ps(p, V); }
+    MipTexel operator+(const MipTexel& t) const { return { _mm_add_ps(V, t.V) }; }
+    MipTexel operator*(const MipTexel& t) const { return { _mm_mul_ps(V, t.V) }; }
+    MipTexel Saturate() const { return { _mm_min_ps(_mm_max_ps(V, _mm_setzero_ps()), _mm_set1_ps(1.0f)) }; }
+#else
+    float V[4];
+
+    static MipTexel Load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    static MipTexel Splat(float f) { return { { f, f, f, f } }; }
+    void Store(float* p) const { std::copy(V, V + 4, p); }
+    MipTexel operator+(const MipTexel& t) const { return { { V[0] + t.V[0], V[1] + t.V[1], V[2] + t.V[2], V[3] + t.V[3] } }; }
+    MipTexel operator*(const MipTexel& t) const { return { { V[0] * t.V[0], V[1] * t.V[1], V[2] * t.V[2], V[3] * t.V[3] } }; }
+    MipTexel Saturate() const
+    {
+        MipTexel t;
+        for (int i = 0 ; i < 4 ; i++) {
+            t.V[i] = std::min(std::max(V[i], 0.0f), 1.0f);
+        }
+        return t;
+    }
+#endif
+};
+
+
+inline float srgbToLinear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+
+inline float linearToSrgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+
+#define MIP_SRGB_TABLE_SIZE 16384
+
+
+/**
+ * @brief Conversion tables between the 8 bit sRGB values and the linear values
+ */
+struct SrgbTables
+{
+    float ToLinear[256];
+    unsigned char FromLinear[MIP_SRGB_TABLE_SIZE + 1];
+
+    SrgbTables()
+    {
+        for (int i = 0 ; i < 256 ; i++) {
+            ToLinear[i] = srgbToLinear(i / 255.0f);
+        }
+        for (int i = 0 ; i <= MIP_SRGB_TABLE_SIZE ; i++) {
+            FromLinear[i] = (unsigned char)(linearToSrgb((float)i / MIP_SRGB_TABLE_SIZE) * 255.0f + 0.5f);
+        }
+    }
+};
+
+
+inline const SrgbTables& getSrgbTables()
+{
+    static SrgbTables tables;
+    return tables;
+}
+
+
+/**
+ * @brief Number of channels stored in sRGB: the colors of the RGB and RGBA images, the alpha and the
+ * one and two channel images (masks, exponents) are linear
+ */
+inline int getSrgbChannels(int channels, bool srgb)
+{
+    return srgb && channels >= 3 ? 3 : 0;
+}
+
+
+inline std::vector<float> toLinearTexels(const unsigned char* pixels, int width, int height, int channels, bool srgb)
+{
+    const SrgbTables& tables = getSrgbTables();
+    int srgbChannels = getSrgbChannels(channels, srgb);
+    size_t numTexels = (size_t)width * height;
+    std::vector<float> texels(numTexels * 4, 0.0f);
+    for (size_t i = 0 ; i < numTexels ; i++) {
+        for (int c = 0 ; c < channels ; c++) {
+            unsigned char value = pixels[i * channels + c];
+            texels[i * 4 + c] = c < srgbChannels ? tables.ToLinear[value] : value / 255.0f;
+        }
+    }
+    return texels;
+}
+
+
+inline void fromLinearTexels(const std::vector<float>& texels, int channels, bool srgb, std::vector<unsigned char>& pixels)
+{
+    const SrgbTables& tables = getSrgbTables();
+    int srgbChannels = getSrgbChannels(channels, srgb);
+    size_t numTexels = texels.size() / 4;
+    pixels.resize(numTexels * channels);
+    for (size_t i = 0 ; i < numTexels ; i++) {
+        for (int c = 0 ; c < channels ; c++) {
+            float value = texels[i * 4 + c];
+            pixels[i * channels + c] = c < srgbChannels ? tables.FromLinear[(int)(value * MIP_SRGB_TABLE_SIZE + 0.5f)]
+                                                        : (unsigned char)(value * 255.0f + 0.5f);
+        }
+    }
+}
+
+
+/**
+ * @brief Weights of the Kaiser windowed sinc that halves a level, at the 6 texels around the center of the new texel
+ * (-2.5 to 2.5 texels away). They are the same for every texel since the size is exactly halved.
+ */
+struct KaiserWeights
+{
+    float Weights[6];
+
+    KaiserWeights()
+    {
+        const double alpha = 4.0;
+        const double radius = 3.0;
+        const double pi = 3.14159265358979323846;
+
+        double total = 0.0;
+        for (int i = 0 ; i < 6 ; i++) {
+            double d = i - 2.5;
+            double x = d / 2.0;     // the cutoff is half of the frequency of the level
+            double sinc = std::sin(pi * x) / (pi * x);
+            double r = d / radius;
+            double window = bessel0(alpha * std::sqrt(1.0 - r * r)) / bessel0(alpha);
+            Weights[i] = (float)(sinc * window);
+            total += Weights[i];
+        }
+        for (int i = 0 ; i < 6 ; i++) {
+            Weights[i] = (float)(Weights[i] / total);
+        }
+    }
+
+    // Modified Bessel function of the first kind, for the window
+    static double bessel0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1 ; k < 20 ; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+};
+
+
+inline const float* getKaiserWeights()
+{
+    static KaiserWeights weights;
+    return weights.Weights;
+}
+
+
+inline std::vector<float> downsampleBox(const std::vector<float>& texels, int width, int height, int nextWidth, int nextHeight)
+{
+    std::vector<float> result((size_t)nextWidth * nextHeight * 4);
+    getThreadPool().parallelFor((unsigned int)nextHeight, [&](unsigned int y) {
+        const float* row0 = texels.data() + (size_t)std::min(2 * (int)y, height - 1) * width * 4;
+        const float* row1 = texels.data() + (size_t)std::min(2 * (int)y + 1, height - 1) * width * 4;
+        float* dst = result.data() + (size_t)y * nextWidth * 4;
+        MipTexel quarter = MipTexel::Splat(0.25f);
+        for (int x = 0 ; x < nextWidth ; x++) {
+            int x0 = std::min(2 * x, width - 1) * 4;
+            int x1 = std::min(2 * x + 1, width - 1) * 4;
+            MipTexel sum = MipTexel::Load(row0 + x0) + MipTexel::Load(row0 + x1) + MipTexel::Load(row1 + x0) + MipTexel::Load(row1 + x1);
+            (sum * quarter).Store(dst + x * 4);
+        }
+    });
+    return result;
+}
+
+
+inline std::vector<float> downsampleKaiser(const std::vector<float>& texels, int width, int height, int nextWidth, int nextHeight)
+{
+    const float* weights = getKaiserWeights();
+    MipTexel w[6];
+    for (int i = 0 ; i < 6 ; i++) {
+        w[i] = MipTexel::Splat(weights[i]);
+    }
+
+    // Horizontal pass, then vertical pass, the texels outside of the level are clamped to its edges
+    std::vector<float> columns((size_t)nextWidth * height * 4);
+    getThreadPool().parallelFor((unsigned int)height, [&](unsigned int y) {
+        const float* src = texels.data() + (size_t)y * width * 4;
+        float* dst = columns.data() + (size_t)y * nextWidth * 4;
+        for (int x = 0 ; x < nextWidth ; x++) {
+            MipTexel sum = MipTexel::Splat(0.0f);
+            for (int i = 0 ; i < 6 ; i++) {
+                int sx = std::min(std::max(2 * x - 2 + i, 0), width - 1);
+                sum = sum + MipTexel::Load(src + sx * 4) * w[i];
+            }
+            sum.Store(dst + x * 4);
+        }
+    });
+
+    std::vector<float> result((size_t)nextWidth * nextHeight * 4);
+    getThreadPool().parallelFor((unsigned int)nextHeight, [&](unsigned int y) {
+        const float* rows[6];
+        for (int i = 0 ; i < 6 ; i++) {
+            rows[i] = columns.data() + (size_t)std::min(std::max(2 * (int)y - 2 + i, 0), height - 1) * nextWidth * 4;
+        }
+        float* dst = result.data() + (size_t)y * nextWidth * 4;
+        for (int x = 0 ; x < nextWidth ; x++) {
+            MipTexel sum = MipTexel::Splat(0.0f);
+            for (int i = 0 ; i < 6 ; i++) {
+                sum = sum + MipTexel::Load(rows[i] + x * 4) * w[i];
+            }
+            // the negative lobes of the sinc can overshoot
+            sum.Saturate().Store(dst + x * 4);
+        }
+    });
+    return result;
+}
+
+
+/**
+ * @brief Number of levels of a full mip chain, down to 1x1
+ */
+inline int getNumMipLevels(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+
+/**
+ * @brief Generate the levels below the base level of an image, down to 1x1
+ *
+ * @param pixels the base level, tightly packed
+ * @param channels the number of channels of the pixels, 1 to 4
+ * @param filter the filter of the levels, Box or Kaiser
+ * @param srgb true when the colors are in sRGB, they are filtered in linear space
+ * @param levels the levels 1 to N
+ */
+inline void generateMipChain(const unsigned char* pixels, int width, int height, int channels, MipFilter filter, bool srgb,
+                             std::vector<MipLevel>& levels)
+{
+    levels.clear();
+    std::vector<float> texels = toLinearTexels(pixels, width, height, channels, srgb);
+    while (width > 1 || height > 1) {
+        int nextWidth = std::max(1, width / 2);
+        int nextHeight = std::max(1, height / 2);
+        texels = filter == MipFilter::Kaiser ? downsampleKaiser(texels, width, height, nextWidth, nextHeight)
+                                             : downsampleBox(texels, width, height, nextWidth, nextHeight);
+        width = nextWidth;
+        height = nextHeight;
+
+        levels.emplace_back();
+        levels.back().Width = width;
+        levels.back().Height = height;
+        fromLinearTexels(texels, channels, srgb, levels.back().Pixels);
+    }
+}
+
+
+/**
+ * @brief Mean linear brightness of the color channels of a level, which a correct filter keeps in all the levels
+ */
+inline double getMeanBrightness(const unsigned char* pixels, int width, int height, int channels, bool srgb)
+{
+    const SrgbTables& tables = getSrgbTables();
+    int colorChannels = channels == 4 ? 3 : (channels == 2 ? 1 : channels);
+    bool linearize = getSrgbChannels(channels, srgb) > 0;
+    size_t numTexels = (size_t)width * height;
+    double sum = 0.0;
+    for (size_t i = 0 ; i < numTexels ; i++) {
+        for (int c = 0 ; c < colorChannels ; c++) {
+            unsigned char value = pixels[i * channels + c];
+            sum += linearize ? tables.ToLinear[value] : value / 255.0f;
+        }
+    }
+    return numTexels > 0 ? sum / (numTexels * colorChannels) : 0.0;
+}
+
+
+/**
+ * @brief Largest change of the mean brightness between the base level and its mip levels, in percent of the base
+ */
+inline double getBrightnessDrift(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+                                 const std::vector<MipLevel>& levels)
+{
+    double base = getMeanBrightness(pixels, width, height, channels, srgb);
+    if (base <= 0.0) {
+        return 0.0;
+    }
+    double drift = 0.0;
+    for (const MipLevel& level : levels) {
+        double mean = getMeanBrightness(level.Pixels.data(), level.Width, level.Height, channels, srgb);
+        drift = std::max(drift, std::abs(mean - base) / base * 100.0);
+    }
+    return drift;
+}
+
+
+#endif
@@ -0,0 +1,162 @@
+// CPU encoder of the block compressed textures: the mip chain is generated from the decoded image (utils/mip_generator.h),
+// then the 4x4 blocks of each level are compressed with stb_dxt, one row of blocks per task of the thread pool.
+
+#ifndef TEXTURE_ENCODER_H
+#define TEXTURE_ENCODER_H
+
+#include <vector>
+#include <algorithm>
+
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+
+#include "dds.h"
+#include "thread_pool.h"
+#include "mip_generator.h"
+
+
+/**
+ * @brief Number of channels of the pixels given to the block encoder of a format
+ */
+inline int getEncoderChannels(BlockFormat format)
+{
+    switch (format) {
+    case BlockFormat::BC4: return 1;
+    case BlockFormat::BC5: return 2;
+    default: return 4;
+    }
+}
+
+
+/**
+ * @brief Format of a decoded image: the alpha is only kept when it is not fully opaque,
+ * the one and two channel images keep their channels (the textures upload them as GL_RED and GL_RG)
+ */
+inline BlockFormat chooseBlockFormat(const unsigned char* pixels, int width, int height, int bpp)
+{
+    if (bpp == 1) {
+        return BlockFormat::BC4;
+    }
+    if (bpp == 2) {
+        return BlockFormat::BC5;
+    }
+    if (bpp == 4) {
+        size_t numPixels = (size_t)width * height;
+        for (size_t i = 0 ; i < numPixels ; i++) {
+            if (pixels[i * 4 + 3] != 255) {
+                return BlockFormat::BC3;
+            }
+        }
+    }
+    return BlockFormat::BC1;
+}
+
+
+/**
+ * @brief Copy the channels of an image to the number of channels of the encoder, the missing alpha is opaque
+ * and a grey image is replicated in the three colors
+ */
+inline std::vector<unsigned char> convertChannels(const unsigned char* pixels, int width, int height, int bpp, int channels)
+{
+    size_t numPixels = (size_t)width * height;
+    std::vector<unsigned char> result(numPixels * channels);
+    for (size_t i = 0 ; i < numPixels ; i++) {
+        const unsigned char* src = pixels + i * bpp;
+        unsigned char* dst = result.data() + i * channels;
+        if (channels == 4 && bpp <= 2) {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = bpp == 2 ? src[1] : 255;
+        }
+        else {
+            for (int c = 0 ; c < channels ; c++) {
+                dst[c] = c < bpp ? src[c] : 255;
+            }
+        }
+    }
+    return result;
+}
+
+
+/**
+ * @brief Pack the first channel of another image of the same size in the alpha of an RGBA image,
+ * for example the specular exponent in the alpha of the diffuse color
+ */
+inline void packAlphaChannel(std::vector<unsigned char>& rgba, const unsigned char* pixels, int bpp)
+{
+    size_t numPixels = rgba.size() / 4;
+    for (size_t i = 0 ; i < numPixels ; i++) {
+        rgba[i * 4 + 3] = pixels[i * bpp];
+    }
+}
+
+
+/**
+ * @brief Compress one level, the blocks that cross the edges of the level are padded with its last row and column
+ */
+inline void compressLevel(const std::vector<unsigned char>& pixels, int width, int height, BlockFormat format, CompressedLevel& level)
+{
+    int channels = getEncoderChannels(format);
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockBytes = getBlockBytes(format);
+
+    level.Width = width;
+    level.Height = height;
+    level.Data.resize((size_t)blocksX * blocksY * blockBytes);
+
+    getThreadPool().parallelFor((unsigned int)blocksY, [&](unsigned int by) {
+        unsigned char block[16 * 4];
+        for (int bx = 0 ; bx < blocksX ; bx++) {
+            for (int y = 0 ; y < 4 ; y++) {
+                int py = std::min((int)by * 4 + y, height - 1);
+                for (int x = 0 ; x < 4 ; x++) {
+                    int px = std::min(bx * 4 + x, width - 1);
+                    const unsigned char* src = pixels.data() + ((size_t)py * width + px) * channels;
+                    std::copy(src, src + channels, block + (y * 4 + x) * channels);
+                }
+            }
+
+            unsigned char* dst = level.Data.data() + ((size_t)by * blocksX + bx) * blockBytes;
+            switch (format) {
+            case BlockFormat::BC1:
+                stb_compress_dxt_block(dst, block, 0, STB_DXT_HIGHQUAL);
+                break;
+            case BlockFormat::BC3:
+                stb_compress_dxt_block(dst, block, 1, STB_DXT_HIGHQUAL);
+                break;
+            case BlockFormat::BC4:
+                stb_compress_bc4_block(dst, block);
+                break;
+            case BlockFormat::BC5:
+                stb_compress_bc5_block(dst, block);
+                break;
+            }
+        }
+    });
+}
+
+
+/**
+ * @brief Compress an image and its mip chain, down to 1x1
+ *
+ * @param pixels the pixels, with the number of channels of the encoder of the format (see convertChannels)
+ * @param filter the filter of the mip chain, the box filter for the levels of the driver
+ * @param srgb true when the colors are in sRGB, the levels are then filtered in linear space
+ */
+inline void compressImage(const std::vector<unsigned char>& pixels, int width, int height, BlockFormat format, MipFilter filter,
+                          bool srgb, CompressedImage& image)
+{
+    std::vector<MipLevel> levels;
+    generateMipChain(pixels.data(), width, height, getEncoderChannels(format), filter == MipFilter::Kaiser ? MipFilter::Kaiser : MipFilter::Box,
+                     srgb, levels);
+
+    image.Format = format;
+    image.Levels.resize(levels.size() + 1);
+    compressLevel(pixels, width, height, format, image.Levels[0]);
+    for (size_t i = 0 ; i < levels.size() ; i++) {
+        compressLevel(levels[i].Pixels, levels[i].Width, levels[i].Height, format, image.Levels[i + 1]);
+    }
+}
+
+
+#endif
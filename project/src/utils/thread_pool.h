@@ -0,0 +1,143 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Fixed set of worker threads executing the tasks pushed in a queue
+ *
+ */
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned int i = 0 ; i < numThreads ; i++) {
+            m_Workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Condition.notify_all();
+
+        for (std::thread& worker : m_Workers) {
+            worker.join();
+        }
+    }
+
+    unsigned int getNumThreads() const { return (unsigned int)m_Workers.size(); }
+
+    /**
+     * @brief Push a task in the queue
+     *
+     * @return a future to wait for the end of the task
+     */
+    std::future<void> submit(std::function<void()> task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.push([packaged]() { (*packaged)(); });
+        }
+        m_Condition.notify_one();
+        return future;
+    }
+
+    /**
+     * @brief Call body(i) for every i in [0, count) on the workers and on the calling thread, and wait for all the calls.
+     * The calling thread only waits for the iterations, so it can safely be a worker of the pool itself.
+     *
+     */
+    void parallelFor(unsigned int count, const std::function<void(unsigned int)>& body)
+    {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1) {
+            body(0);
+            return;
+        }
+
+        struct Loop {
+            std::atomic<unsigned int> Next{0};
+            std::atomic<unsigned int> Done{0};
+            std::mutex Mutex;
+            std::condition_variable Finished;
+        };
+        auto loop = std::make_shared<Loop>();
+
+        auto run = [loop, count, &body]() {
+            for (unsigned int i = loop->Next++ ; i < count ; i = loop->Next++) {
+                body(i);
+                if (++loop->Done == count) {
+                    std::lock_guard<std::mutex> lock(loop->Mutex);
+                    loop->Finished.notify_all();
+                }
+            }
+        };
+
+        // Helpers that start after the end of the loop find no iteration left and never touch body
+        unsigned int numHelpers = std::min(count - 1, getNumThreads());
+        for (unsigned int i = 0 ; i < numHelpers ; i++) {
+            submit(run);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(loop->Mutex);
+        loop->Finished.wait(lock, [&]() { return loop->Done == count; });
+    }
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stopping = false;
+
+    void workerLoop()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+                if (m_Stopping && m_Tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop();
+            }
+            task();
+        }
+    }
+};
+
+
+/**
+ * @brief The thread pool shared by the loaders
+ *
+ */
+inline ThreadPool& getThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+
+#endif
@@ -22,8 +22,8 @@ int deltaFrame = 0;
 Camera camera(glm::vec3(0.0, 1.0, 10));
 
 
-//fps function
-auto fps(double now)
+//fps function, returns true when the line was printed
+bool fps(double now)
 {
 	double deltaTime = now - prev;
 	deltaFrame++;
@@ -33,7 +33,9 @@ auto fps(double now)
 		deltaFrame = 0;
 		std::cout << "\r FPS: " << fpsCount;
 		std::cout.flush();
+		return true;
 	}
+	return false;
 }
 
 
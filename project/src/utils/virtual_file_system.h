@@ -0,0 +1,235 @@
+// Virtual file layer of the assets: the files are read from the mounted archives when they contain them,
+// and from the disk otherwise, so the loaders do not depend on where the assets are stored.
+
+#ifndef VIRTUAL_FILE_SYSTEM_H
+#define VIRTUAL_FILE_SYSTEM_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <fstream>
+
+#include "archive.h"
+#include "lz4.h"
+#include "mapped_file.h"
+
+
+/**
+ * @brief Content of a file read through the virtual file system: a span in a mapping,
+ * or the decompressed copy of a compressed entry. The span is valid as long as this object lives.
+ *
+ */
+class FileData
+{
+public:
+    FileData() {}
+
+    FileData(const FileData&) = delete;
+    FileData& operator=(const FileData&) = delete;
+
+    const unsigned char* GetData() const { return m_Data; }
+
+    size_t GetSize() const { return m_Size; }
+
+    void Close()
+    {
+        m_Mapping.Close();
+        std::vector<unsigned char>().swap(m_Storage);
+        m_Data = NULL;
+        m_Size = 0;
+    }
+
+private:
+    friend class VirtualFileSystem;
+
+    const unsigned char* m_Data = NULL;
+    size_t m_Size = 0;
+    MappedFile m_Mapping;                   // for the loose files
+    std::vector<unsigned char> m_Storage;   // for the compressed entries
+};
+
+
+/**
+ * @brief Number of files read through the virtual file system, and where they were read from
+ *
+ */
+struct FileSystemStatistics
+{
+    unsigned int ArchiveReads = 0;
+    unsigned int LooseReads = 0;        // each one opens a file on the disk
+    size_t BytesRead = 0;
+    size_t BytesDecompressed = 0;
+};
+
+
+class VirtualFileSystem
+{
+public:
+    /**
+     * @brief Mount an archive, the names of its entries are relative to root
+     *
+     * @param path the path of the archive
+     * @param root the directory of the loose files packed in the archive
+     * @return false if the archive can not be opened
+     */
+    bool mountArchive(const char* path, const std::string& root)
+    {
+        std::unique_ptr<Archive> archive(new Archive());
+        if (!archive->Open(path)) {
+            return false;
+        }
+
+        std::cout << "Mounted the archive " << path << " (" << archive->GetEntries().size() << " entries) on " << root << std::endl;
+        m_Mounts.push_back({ normalizePath(root), std::move(archive) });
+        return true;
+    }
+
+    /**
+     * @brief Read a whole file, from the last mounted archive that contains it or from the disk
+     *
+     * @param path the path of the file, as on the disk
+     * @param file the content of the file
+     * @return false if the file does not exist or can not be read
+     */
+    bool readFile(const std::string& path, FileData& file)
+    {
+        file.Close();
+
+        const Archive* archive = NULL;
+        const ArchiveEntry* entry = findEntry(path, archive);
+        if (entry) {
+            const unsigned char* stored = archive->GetStoredData(*entry);
+            if (entry->IsCompressed()) {
+                file.m_Storage.resize((size_t)entry->Size);
+                if (!lz4Decompress(stored, (size_t)entry->StoredSize, file.m_Storage.data(), file.m_Storage.size())) {
+                    std::cout << "Error decompressing " << entry->Name << " from the archive" << std::endl;
+                    file.Close();
+                    return false;
+                }
+                file.m_Data = file.m_Storage.data();
+                m_BytesDecompressed += (size_t)entry->Size;
+            }
+            else {
+                file.m_Data = stored;
+            }
+            file.m_Size = (size_t)entry->Size;
+            m_ArchiveReads++;
+            m_BytesRead += (size_t)entry->StoredSize;
+            return true;
+        }
+
+        if (!file.m_Mapping.Open(path.c_str())) {
+            return false;
+        }
+        file.m_Data = file.m_Mapping.GetData();
+        file.m_Size = file.m_Mapping.GetSize();
+        m_LooseReads++;
+        m_BytesRead += file.m_Size;
+        return true;
+    }
+
+    bool exists(const std::string& path) const
+    {
+        const Archive* archive = NULL;
+        if (findEntry(path, archive)) {
+            return true;
+        }
+        std::ifstream file(path, std::ios::binary);
+        return file.good();
+    }
+
+    FileSystemStatistics getStatistics() const
+    {
+        FileSystemStatistics statistics;
+        statistics.ArchiveReads = m_ArchiveReads;
+        statistics.LooseReads = m_LooseReads;
+        statistics.BytesRead = m_BytesRead;
+        statistics.BytesDecompressed = m_BytesDecompressed;
+        return statistics;
+    }
+
+    /**
+     * @brief Path with '/' separators and without "." and ".." components, as the names of the archive entries
+     */
+    static std::string normalizePath(const std::string& path)
+    {
+        std::vector<std::string> parts;
+        std::string part;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+        for (size_t i = 0 ; i <= path.size() ; i++) {
+            if (i == path.size() || path[i] == '/' || path[i] == '\\') {
+                if (part == "..") {
+                    if (!parts.empty() && parts.back() != "..") {
+                        parts.pop_back();
+                    } else if (!absolute) {
+                        parts.push_back(part);
+                    }
+                } else if (!part.empty() && part != ".") {
+                    parts.push_back(part);
+                }
+                part.clear();
+            } else {
+                part += path[i];
+            }
+        }
+
+        std::string result = absolute ? "/" : "";
+        for (size_t i = 0 ; i < parts.size() ; i++) {
+            result += (i > 0 ? "/" : "") + parts[i];
+        }
+        return result;
+    }
+
+private:
+    struct Mount {
+        std::string Root;
+        std::unique_ptr<Archive> Package;
+    };
+
+    std::vector<Mount> m_Mounts;
+
+    // The loaders can run on several threads
+    std::atomic<unsigned int> m_ArchiveReads{ 0 };
+    std::atomic<unsigned int> m_LooseReads{ 0 };
+    std::atomic<size_t> m_BytesRead{ 0 };
+    std::atomic<size_t> m_BytesDecompressed{ 0 };
+
+    const ArchiveEntry* findEntry(const std::string& path, const Archive*& archive) const
+    {
+        if (m_Mounts.empty()) {
+            return NULL;
+        }
+
+        std::string normalized = normalizePath(path);
+        for (size_t i = m_Mounts.size() ; i-- > 0 ; ) {
+            const std::string& root = m_Mounts[i].Root;
+            if (normalized.size() <= root.size() || normalized.compare(0, root.size(), root) != 0 || normalized[root.size()] != '/') {
+                continue;
+            }
+
+            const ArchiveEntry* entry = m_Mounts[i].Package->Find(normalized.substr(root.size() + 1));
+            if (entry) {
+                archive = m_Mounts[i].Package.get();
+                return entry;
+            }
+        }
+        return NULL;
+    }
+};
+
+
+/**
+ * @brief Virtual file system shared by all the loaders
+ *
+ */
+inline VirtualFileSystem& getVirtualFileSystem()
+{
+    static VirtualFileSystem fileSystem;
+    return fileSystem;
+}
+
+
+#endif